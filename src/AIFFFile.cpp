@@ -0,0 +1,325 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "AIFFFile.hpp"
+#include "Log.hpp"
+#include "SndFile.hpp"
+#include "SampleSink.hpp"
+#include "NullDecoder.hpp"
+#include "IMA4Decoder.hpp"
+#include "MACEDecoder.hpp"
+#include "XLawDecoder.hpp"
+
+#include <iomanip>
+#include <cstddef> // For std::size_t
+#include <algorithm> // For std::copy
+
+bool AIFFHeader::isAIFFC() const
+{
+    return formType[3] == 'C';
+}
+
+std::ostream& operator<<(std::ostream& lhs, const AIFFHeader& rhs)
+{
+    lhs << std::setfill('0'); // For hex values
+    lhs <<
+        "Generated AIFF file header:" << std::endl <<
+        " -- Form ID: " << std::string(reinterpret_cast<const char*>(rhs.formID), 4) <<
+            std::endl <<
+        " -- Form size: " << rhs.formSize << std::endl <<
+        " -- Form type: " << std::string(reinterpret_cast<const char*>(rhs.formType), 4) <<
+            std::endl <<
+
+        " -- Common chunk size: " << rhs.commonSize << std::endl <<
+        " -- Number of channels: " << rhs.numChannels << std::endl <<
+        " -- Number of sample frames: " << rhs.numSampleFrames << std::endl <<
+        " -- Sample size: " << rhs.sampleSize << std::endl <<
+        " -- Sample rate: " << "0x" << std::hex << std::setw(4) << rhs.sampleRate[0] <<
+            std::setw(8) << rhs.sampleRate[1] << std::setw(8) << rhs.sampleRate[2] <<
+            std::dec << std::endl;
+
+    if(rhs.isAIFFC())
+    {
+        lhs <<
+            " -- Compression type: " <<
+                std::string(reinterpret_cast<const char*>(rhs.compressionType), 4) <<
+                std::endl <<
+            " -- Compression name: " << rhs.compressionName << std::endl;
+    }
+
+    lhs <<
+        " -- Sound data chunk size: " << rhs.soundDataSize;
+
+    lhs << std::dec << std::setfill(' '); // Restore
+    return lhs;
+}
+
+AIFFFile::AIFFFile()
+{
+}
+
+const AIFFHeader& AIFFFile::getHeader() const
+{
+    return mHeader;
+}
+
+// Static
+void AIFFFile::writeID(std::ostream& stream, const std::uint8_t* ID)
+{
+    stream.write(reinterpret_cast<const char*>(ID), 4);
+}
+
+// Static
+// Converts a snd unsigned 16.16 fixed-point sample rate to an 80-bit extended
+// value, exactly.
+void AIFFFile::fixedToExtended(std::uint32_t fixed, std::uint32_t* extended)
+{
+    extended[0] = extended[1] = extended[2] = 0;
+    if(fixed == 0)
+        return;
+
+    int topBit = 31;
+    while(((fixed >> topBit) & 1) == 0)
+        --topBit;
+
+    // The mantissa has an explicit integer bit.
+    std::uint64_t mantissa = static_cast<std::uint64_t>(fixed) << (63 - topBit);
+    extended[0] = 16383 + topBit - 16; // Positive, so no sign bit.
+    extended[1] = static_cast<std::uint32_t>(mantissa >> 32);
+    extended[2] = static_cast<std::uint32_t>(mantissa);
+}
+
+// Picks the AIFF or AIFF-C format which stores the samples as they are in
+// the snd.
+// Returns true on success, false on failure.
+bool AIFFFile::populateCompression(const SndFile& sndFile)
+{
+    const Decoder& decoder = sndFile.getDecoder();
+    mHeader.sampleSize = decoder.getBitsPerSample();
+
+    const char* type = nullptr;
+    const char* name = nullptr;
+
+    if(!sndFile.canWriteEncoded())
+    {
+        Log::verb << "Sound is resampled, or the range does not start and end " <<
+            "on packets; writing decoded samples." << std::endl;
+        mDecodeSamples = true;
+
+        // Decoded 8-bit samples are unsigned, as in snds.
+        if(mHeader.sampleSize != 8)
+            return true;
+
+        type = "raw ";
+        name = "";
+    } else if(dynamic_cast<const NullDecoder*>(&decoder) != nullptr)
+    {
+        // Big-endian PCM is native to AIFF, except for 8-bit samples, which
+        // are unsigned in snds and signed in AIFF.
+        if(mHeader.sampleSize != 8)
+            return true;
+
+        type = "raw ";
+        name = "";
+    } else if(dynamic_cast<const IMA4Decoder*>(&decoder) != nullptr)
+    {
+        type = "ima4";
+        name = "IMA 4:1";
+    } else if(dynamic_cast<const MACE3Decoder*>(&decoder) != nullptr)
+    {
+        type = "MAC3";
+        name = "MACE 3-to-1";
+    } else if(dynamic_cast<const MACE6Decoder*>(&decoder) != nullptr)
+    {
+        type = "MAC6";
+        name = "MACE 6-to-1";
+    } else if(dynamic_cast<const ULawDecoder*>(&decoder) != nullptr)
+    {
+        type = "ulaw";
+        name = "uLaw 2:1";
+    } else if(dynamic_cast<const ALawDecoder*>(&decoder) != nullptr)
+    {
+        type = "alaw";
+        name = "aLaw 2:1";
+    } else
+    {
+        Log::err << "Error: no AIFF-C compression type matches the sound's " <<
+            "compression!" << std::endl;
+        return false;
+    }
+
+    mHeader.formType[3] = 'C';
+    std::copy(type, type + 4, mHeader.compressionType);
+    mHeader.compressionName = name;
+    return true;
+}
+
+// Returns true on success, false on failure.
+bool AIFFFile::populateHeader(const SndFile& sndFile)
+{
+    if(!sndFile.isValid())
+    {
+        Log::err << "Error: cannot convert invalid snd file!" << std::endl;
+        return false;
+    }
+
+    const SoundSampleHeader& sndHeader = sndFile.getSoundSampleHeader();
+    const Decoder& decoder = sndFile.getDecoder();
+    mHeader = AIFFHeader(); // In case it was populated for another sound.
+    mDecodeSamples = false;
+
+    if(!populateCompression(sndFile))
+        return false; // Error messages already dealt with.
+
+    // "COMM" //
+    std::size_t numChannels = sndFile.getDecodedNumChannels();
+    mHeader.numChannels = numChannels;
+
+    // Only standard headers lack the 80-bit sample rate.
+    const std::uint32_t* AIFFSampleRate = nullptr;
+    if(sndHeader.encode == SndFile::cExtendedSoundHeaderEncode)
+        AIFFSampleRate = static_cast<const ExtendedSoundSampleHeader&>(sndHeader).AIFFSampleRate;
+    else if(sndHeader.encode == SndFile::cCompressedSoundHeaderEncode)
+        AIFFSampleRate = static_cast<const CompressedSoundSampleHeader&>(sndHeader).AIFFSampleRate;
+
+    if(AIFFSampleRate != nullptr && AIFFSampleRate[0] != 0 &&
+        sndFile.getDecodedSampleRate() == sndHeader.sampleRate)
+        std::copy(AIFFSampleRate, AIFFSampleRate + 3, mHeader.sampleRate);
+    else
+        fixedToExtended(sndFile.getDecodedSampleRate(), mHeader.sampleRate);
+
+    std::size_t numDecodedFrames = sndFile.getDecodedSize() /
+        (numChannels * decoder.getBitsPerSample()/8);
+    std::size_t numPacketFrames = sndFile.getNumPackets() / numChannels;
+    std::size_t dataSize = sndFile.getDecodedSize();
+
+    if(mDecodeSamples)
+    {
+        mHeader.numSampleFrames = numDecodedFrames;
+    } else
+    {
+        // Packets are copied as-is: if they hold several sample frames, the
+        // whole sound is copied.
+        mHeader.numSampleFrames = sndFile.getNumFrames() == numPacketFrames ?
+            numDecodedFrames : numPacketFrames;
+        dataSize = mHeader.numSampleFrames * decoder.getEncodedSize(numChannels);
+    }
+
+    mHeader.commonSize = 18;
+    if(mHeader.isAIFFC())
+    {
+        // Pascal string, padded to an even size.
+        std::size_t nameSize = 1 + mHeader.compressionName.size();
+        mHeader.commonSize += 4 + nameSize + nameSize%2;
+    }
+
+    // "SSND" //
+    mHeader.soundDataSize = 8 + dataSize;
+
+    mHeader.formSize = 4 + (8 + mHeader.commonSize) + (8 + mHeader.soundDataSize) +
+        mHeader.soundDataSize%2;
+    if(mHeader.isAIFFC())
+        mHeader.formSize += 8 + mHeader.formatVersionSize;
+
+    // Debug info.
+    Log::verb << mHeader << std::endl;
+
+    return true;
+}
+
+void AIFFFile::writeHeader(std::ostream& outputStream)
+{
+    writeID(outputStream, mHeader.formID);
+    writeBigValue(outputStream, mHeader.formSize);
+    writeID(outputStream, mHeader.formType);
+
+    if(mHeader.isAIFFC())
+    {
+        writeID(outputStream, mHeader.formatVersionID);
+        writeBigValue(outputStream, mHeader.formatVersionSize);
+        writeBigValue(outputStream, mHeader.formatVersion);
+    }
+
+    writeID(outputStream, mHeader.commonID);
+    writeBigValue(outputStream, mHeader.commonSize);
+    writeBigValue(outputStream, mHeader.numChannels);
+    writeBigValue(outputStream, mHeader.numSampleFrames);
+    writeBigValue(outputStream, mHeader.sampleSize);
+    writeBigValue(outputStream, static_cast<std::uint16_t>(mHeader.sampleRate[0]));
+    writeBigValue(outputStream, mHeader.sampleRate[1]);
+    writeBigValue(outputStream, mHeader.sampleRate[2]);
+
+    if(mHeader.isAIFFC())
+    {
+        writeID(outputStream, mHeader.compressionType);
+
+        std::size_t nameSize = mHeader.compressionName.size();
+        outputStream.put(static_cast<char>(nameSize));
+        outputStream.write(mHeader.compressionName.data(), nameSize);
+        if((1 + nameSize)%2 != 0)
+            outputStream.put(0);
+    }
+
+    writeID(outputStream, mHeader.soundDataID);
+    writeBigValue(outputStream, mHeader.soundDataSize);
+    writeBigValue(outputStream, mHeader.offset);
+    writeBigValue(outputStream, mHeader.blockSize);
+}
+
+// Copies sample data as it is in the snd, or prepares to swap it as it is
+// decoded if the range splits packets.
+// Returns true on success, false on failure.
+bool AIFFFile::beginSampleData(std::ostream& outputStream, SndFile& sndFile)
+{
+    mOutputStream = &outputStream;
+    mBigSink.reset();
+    mStreamSink.reset(new StreamSampleSink(outputStream));
+
+    // Decoded samples are little-endian.
+    if(mDecodeSamples)
+    {
+        mBigSink.reset(new ByteSwapSampleSink(*mStreamSink, mHeader.sampleSize/8));
+        return true;
+    }
+
+    return sndFile.writeEncoded(*mStreamSink);
+}
+
+// Returns true on success, false on failure.
+bool AIFFFile::begin(SndFile& sndFile, std::ostream& outputStream)
+{
+    if(!populateHeader(sndFile))
+        return false; // Error messages already dealt with.
+
+    writeHeader(outputStream);
+    return beginSampleData(outputStream, sndFile) && !outputStream.fail();
+}
+
+SampleSink* AIFFFile::getSampleSink()
+{
+    return mBigSink.get();
+}
+
+// Returns true on success, false on failure.
+bool AIFFFile::finish()
+{
+    // Chunks have an even size.
+    if(mHeader.soundDataSize%2 != 0)
+        mOutputStream->put(0);
+
+    return !mOutputStream->fail();
+}
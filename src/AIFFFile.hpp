@@ -0,0 +1,100 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef AIFF_FILE_HPP
+#define AIFF_FILE_HPP
+
+#include "Endian.hpp"
+#include "SoundWriter.hpp"
+
+#include <ostream>
+#include <string>
+#include <cstdint> // Fixed-width types
+#include <memory>
+
+class AIFFHeader
+{
+public:
+    // http://www-mmsp.ece.mcgill.ca/Documents/AudioFormats/AIFF/AIFF.html
+    std::uint8_t formID[4] = {'F','O','R','M'};
+    std::uint32_t formSize = 0;
+    std::uint8_t formType[4] = {'A','I','F','F'}; // Or 'AIFC'.
+
+    // "FVER", AIFF-C only.
+    std::uint8_t formatVersionID[4] = {'F','V','E','R'};
+    std::uint32_t formatVersionSize = 4;
+    std::uint32_t formatVersion = 0xA2805140; // AIFF-C version 1.
+
+    std::uint8_t commonID[4] = {'C','O','M','M'};
+    std::uint32_t commonSize = 0;
+    std::uint16_t numChannels = 0;
+    std::uint32_t numSampleFrames = 0; // Packet frames, for compressed sounds.
+    std::uint16_t sampleSize = 0;
+    // 80-bit extended value, like SoundSampleHeader::AIFFSampleRate.
+    std::uint32_t sampleRate[3] = {0};
+    std::uint8_t compressionType[4] = {'N','O','N','E'}; // AIFF-C only.
+    std::string compressionName; // Pascal string, AIFF-C only.
+
+    std::uint8_t soundDataID[4] = {'S','S','N','D'};
+    std::uint32_t soundDataSize = 0;
+    std::uint32_t offset = 0;
+    std::uint32_t blockSize = 0;
+
+    bool isAIFFC() const;
+};
+
+std::ostream& operator<<(std::ostream& lhs, const AIFFHeader& rhs);
+
+class SndFile;
+class AIFFFile : public SoundWriter
+{
+private:
+    AIFFHeader mHeader;
+    bool mDecodeSamples = false; // Only when packets cannot be copied.
+
+    std::ostream* mOutputStream = nullptr;
+    std::unique_ptr<StreamSampleSink> mStreamSink;
+    std::unique_ptr<ByteSwapSampleSink> mBigSink; // Only if decoding samples.
+
+    // Safe endian.
+    // bigStream is a big-endian output stream.
+    template<class T>
+    static void writeBigValue(std::ostream& bigStream, T value)
+    {
+        T big = Endian::toBig(value);
+        bigStream.write(reinterpret_cast<const char*>(&big), sizeof(T));
+    }
+
+    static void writeID(std::ostream& stream, const std::uint8_t* ID);
+    static void fixedToExtended(std::uint32_t fixed, std::uint32_t* extended);
+
+    bool populateCompression(const SndFile& sndFile);
+    void writeHeader(std::ostream& outputStream);
+    bool beginSampleData(std::ostream& outputStream, SndFile& sndFile);
+
+public:
+    AIFFFile();
+
+    bool populateHeader(const SndFile& sndFile);
+    const AIFFHeader& getHeader() const;
+
+    bool begin(SndFile& sndFile, std::ostream& outputStream) override;
+    SampleSink* getSampleSink() override;
+    bool finish() override;
+};
+
+#endif // AIFF_FILE_HPP
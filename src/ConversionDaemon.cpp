@@ -0,0 +1,467 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "ConversionDaemon.hpp"
+#include "Log.hpp"
+#include "SndFile.hpp"
+#include "WAVFile.hpp"
+
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <cstring> // For std::strerror
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <csignal>
+#endif
+
+namespace
+{
+    const std::size_t FORK_CACHE_CAPACITY = 16; // In resource forks.
+    const std::size_t MAX_REQUEST_LENGTH = 64 * 1024;
+    const std::size_t MAX_CONNECTIONS = 64; // Each one has a thread.
+
+    std::vector<std::string> splitFields(const std::string& line)
+    {
+        std::vector<std::string> fields;
+        std::stringstream stream(line);
+        std::string field;
+        while(std::getline(stream, field, '\t'))
+            fields.push_back(field);
+
+        return fields;
+    }
+
+    double hitRate(std::uint64_t hits, std::uint64_t misses)
+    {
+        return (hits + misses) == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+    }
+}
+
+bool ConversionDaemon::FileStamp::operator==(const FileStamp& other) const
+{
+    return modificationTime == other.modificationTime && size == other.size;
+}
+
+// soundCacheSize is in bytes.
+ConversionDaemon::ConversionDaemon(std::size_t resourceFileBlockSize,
+    std::size_t soundCacheSize)
+    : mResourceFileBlockSize(resourceFileBlockSize)
+    , mForkCache(FORK_CACHE_CAPACITY)
+    , mSoundCache(soundCacheSize, [](const std::shared_ptr<const CachedSound>& sound)
+        {
+            return sound->wav.size();
+        })
+{
+
+}
+
+#ifndef _WIN32
+
+// Static
+bool ConversionDaemon::getFileStamp(const std::string& filePath, FileStamp& stamp)
+{
+    struct stat fileStatus;
+    if(stat(filePath.c_str(), &fileStatus) != 0)
+        return false;
+
+    stamp.modificationTime = static_cast<std::int64_t>(fileStatus.st_mtime);
+    stamp.size = static_cast<std::int64_t>(fileStatus.st_size);
+    return true;
+}
+
+// Static
+bool ConversionDaemon::sendAll(int socket, const char* data, std::size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t sent = send(socket, data, size, 0);
+        if(sent < 0 && errno == EINTR)
+            continue;
+        if(sent <= 0)
+            return false;
+
+        data += sent;
+        size -= sent;
+    }
+
+    return true;
+}
+
+// Static
+bool ConversionDaemon::sendError(int socket, const std::string& message)
+{
+    std::string response = "ERROR " + message + "\n";
+    return sendAll(socket, response.data(), response.size());
+}
+
+// Static
+bool ConversionDaemon::sendData(int socket, const char* data, std::size_t size)
+{
+    std::string response = "OK " + std::to_string(size) + "\n";
+    return sendAll(socket, response.data(), response.size()) &&
+        sendAll(socket, data, size);
+}
+
+bool ConversionDaemon::run(const std::string& socketPath)
+{
+    // Clients hanging up must not kill the daemon.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if(socketPath.size() >= sizeof(address.sun_path))
+    {
+        Log::err << "Error: socket path '" << socketPath << "' is too long!" << std::endl;
+        return false;
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    int listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listenSocket < 0)
+    {
+        Log::err << "Error: could not create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Remove a stale socket from a previous run, but never another kind of file.
+    struct stat fileStatus;
+    if(lstat(socketPath.c_str(), &fileStatus) == 0)
+    {
+        if(!S_ISSOCK(fileStatus.st_mode))
+        {
+            Log::err << "Error: '" << socketPath << "' already exists and is not a " <<
+                "socket!" << std::endl;
+            close(listenSocket);
+            return false;
+        }
+
+        unlink(socketPath.c_str());
+    }
+
+    if(bind(listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listenSocket, SOMAXCONN) != 0)
+    {
+        Log::err << "Error: could not listen on '" << socketPath << "': " <<
+            std::strerror(errno) << std::endl;
+        close(listenSocket);
+        return false;
+    }
+
+    Log::info << "Listening on '" << socketPath << "'." << std::endl;
+
+    while(true)
+    {
+        // Clients wait in the listen backlog while all connections are in use.
+        {
+            std::unique_lock<std::mutex> lock(mConnectionMutex);
+            mConnectionClosed.wait(lock, [this] { return mNumConnections < MAX_CONNECTIONS; });
+        }
+
+        int clientSocket = accept(listenSocket, nullptr, nullptr);
+        if(clientSocket < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            Log::err << "Error: could not accept connection: " << std::strerror(errno) <<
+                std::endl;
+            close(listenSocket);
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mConnectionMutex);
+            ++mNumConnections;
+        }
+
+        std::thread(&ConversionDaemon::serveConnection, this, clientSocket).detach();
+    }
+}
+
+// Serves requests until the client disconnects.
+void ConversionDaemon::serveConnection(int socket)
+{
+    std::string buffer;
+    char received[4096];
+
+    while(true)
+    {
+        std::size_t lineEnd = buffer.find('\n');
+        if(lineEnd != std::string::npos)
+        {
+            std::string request = buffer.substr(0, lineEnd);
+            buffer.erase(0, lineEnd + 1);
+
+            if(!handleRequest(socket, request))
+                break;
+
+            continue;
+        }
+
+        if(buffer.size() > MAX_REQUEST_LENGTH)
+        {
+            sendError(socket, "request too long");
+            break;
+        }
+
+        ssize_t receivedSize = recv(socket, received, sizeof(received), 0);
+        if(receivedSize < 0 && errno == EINTR)
+            continue;
+        if(receivedSize <= 0)
+            break;
+
+        buffer.append(received, receivedSize);
+    }
+
+    close(socket);
+
+    std::lock_guard<std::mutex> lock(mConnectionMutex);
+    --mNumConnections;
+    mConnectionClosed.notify_one();
+}
+
+// Returns false if the connection should be closed.
+bool ConversionDaemon::handleRequest(int socket, const std::string& request)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<std::string> fields = splitFields(request);
+    bool connectionOK = false;
+
+    if(fields.size() == 5 && fields[0] == "CONVERT")
+    {
+        connectionOK = handleConvert(socket, fields[1], fields[2], fields[3], fields[4]);
+    } else if(fields.size() == 1 && fields[0] == "METRICS")
+    {
+        connectionOK = handleMetrics(socket);
+    } else
+    {
+        {
+            std::lock_guard<std::mutex> lock(mCacheMutex);
+            ++mMetrics.failedRequests;
+        }
+
+        connectionOK = sendError(socket, "malformed request");
+    }
+
+    recordLatency(std::chrono::steady_clock::now() - startTime);
+    return connectionOK;
+}
+
+bool ConversionDaemon::handleConvert(int socket, const std::string& format,
+    const std::string& selector, const std::string& resource, const std::string& forkPath)
+{
+    {
+        std::lock_guard<std::mutex> lock(mCacheMutex);
+        ++mMetrics.convertRequests;
+    }
+
+    std::string error;
+    FileStamp stamp;
+    std::shared_ptr<const CachedSound> sound;
+
+    if(format != "wav" && format != "pcm")
+        error = "unsupported format '" + format + "'";
+    else if(selector != "ID" && selector != "NAME")
+        error = "resource must be selected by ID or NAME";
+    else if(!getFileStamp(forkPath, stamp))
+        error = "cannot read '" + forkPath + "'";
+    else if((sound = convertSound(forkPath, stamp, selector, resource)) == nullptr)
+        error = "cannot convert sound " + resource + " from '" + forkPath + "'";
+
+    if(!error.empty())
+    {
+        std::lock_guard<std::mutex> lock(mCacheMutex);
+        ++mMetrics.failedRequests;
+        return sendError(socket, error);
+    }
+
+    if(format == "pcm")
+    {
+        return sendData(socket, sound->wav.data() + sound->headerSize,
+            sound->wav.size() - sound->headerSize);
+    }
+
+    return sendData(socket, sound->wav.data(), sound->wav.size());
+}
+
+bool ConversionDaemon::handleMetrics(int socket)
+{
+    std::ostringstream json;
+
+    {
+        std::lock_guard<std::mutex> lock(mCacheMutex);
+        ++mMetrics.metricsRequests;
+
+        json <<
+            "{\"requests\":{" <<
+                "\"convert\":" << mMetrics.convertRequests << "," <<
+                "\"metrics\":" << mMetrics.metricsRequests << "," <<
+                "\"failed\":" << mMetrics.failedRequests << "}," <<
+            "\"forkCache\":{" <<
+                "\"entries\":" << mForkCache.size() << "," <<
+                "\"hits\":" << mMetrics.forkCacheHits << "," <<
+                "\"misses\":" << mMetrics.forkCacheMisses << "," <<
+                "\"hitRate\":" << hitRate(mMetrics.forkCacheHits, mMetrics.forkCacheMisses) << "}," <<
+            "\"soundCache\":{" <<
+                "\"entries\":" << mSoundCache.size() << "," <<
+                "\"bytes\":" << mSoundCache.getTotalCost() << "," <<
+                "\"hits\":" << mMetrics.soundCacheHits << "," <<
+                "\"misses\":" << mMetrics.soundCacheMisses << "," <<
+                "\"hitRate\":" << hitRate(mMetrics.soundCacheHits, mMetrics.soundCacheMisses) << "}," <<
+            "\"latencyMicroseconds\":[";
+
+        for(std::size_t i = 0; i < Metrics::cNumLatencyBuckets; ++i)
+        {
+            json << (i == 0 ? "" : ",") << "{\"lessThan\":";
+            if(i + 1 < Metrics::cNumLatencyBuckets)
+                json << (std::uint64_t(1) << i);
+            else
+                json << "null";
+
+            json << ",\"count\":" << mMetrics.latencyBuckets[i] << "}";
+        }
+
+        json << "]}\n";
+    }
+
+    std::string response = json.str();
+    return sendData(socket, response.data(), response.size());
+}
+
+#else // _WIN32
+
+// Static
+bool ConversionDaemon::getFileStamp(const std::string&, FileStamp&)
+{
+    return false;
+}
+
+bool ConversionDaemon::run(const std::string&)
+{
+    Log::err << "Error: daemon mode is not supported on this platform." << std::endl;
+    return false;
+}
+
+#endif // _WIN32
+
+// Returns the converted sound, from the cache if its fork did not change.
+// Returns nullptr on failure.
+std::shared_ptr<const ConversionDaemon::CachedSound> ConversionDaemon::convertSound(
+    const std::string& forkPath, const FileStamp& stamp,
+    const std::string& selector, const std::string& resource)
+{
+    std::string key = forkPath + '\t' + selector + '\t' + resource;
+
+    {
+        std::lock_guard<std::mutex> lock(mCacheMutex);
+        std::shared_ptr<const CachedSound>* cachedSound = mSoundCache.find(key);
+        if(cachedSound != nullptr && (*cachedSound)->stamp == stamp)
+        {
+            ++mMetrics.soundCacheHits;
+            return *cachedSound;
+        }
+
+        ++mMetrics.soundCacheMisses;
+    }
+
+    std::lock_guard<std::mutex> conversionLock(mConversionMutex);
+
+    try
+    {
+        RESX::ResourceFork* fork = loadFork(forkPath, stamp);
+        std::size_t resourceSize = 0;
+        std::unique_ptr<char, RESX::freeDelete> resourceData;
+
+        if(selector == "ID")
+            resourceData = fork->getResourceData("snd ", std::stoul(resource), &resourceSize);
+        else
+            resourceData = fork->getResourceData("snd ", resource, &resourceSize);
+
+        if(resourceData == nullptr)
+            return nullptr;
+
+        std::istringstream sndStream(std::string(resourceData.get(), resourceSize));
+        SndFile sndFile(sndStream, resource);
+        WAVFile wavFile;
+        std::ostringstream wavStream;
+        if(!wavFile.convertSnd(sndFile, wavStream))
+            return nullptr;
+
+        std::shared_ptr<CachedSound> sound(new CachedSound());
+        sound->stamp = stamp;
+        sound->wav = wavStream.str();
+        sound->headerSize = sound->wav.size() - wavFile.getHeader().subchunk2Size;
+
+        std::lock_guard<std::mutex> lock(mCacheMutex);
+        mSoundCache.insert(key, sound);
+        return sound;
+    } catch(const std::exception& e)
+    {
+        Log::err << "Error: could not convert '" << resource << "' from '" << forkPath <<
+            "': " << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+// Call with mConversionMutex locked.
+RESX::ResourceFork* ConversionDaemon::loadFork(const std::string& forkPath,
+    const FileStamp& stamp)
+{
+    {
+        std::lock_guard<std::mutex> lock(mCacheMutex);
+        CachedFork* cachedFork = mForkCache.find(forkPath);
+        if(cachedFork != nullptr && cachedFork->stamp == stamp)
+        {
+            ++mMetrics.forkCacheHits;
+            return cachedFork->fork.get();
+        }
+
+        ++mMetrics.forkCacheMisses;
+    }
+
+    CachedFork cachedFork;
+    cachedFork.stamp = stamp;
+    cachedFork.file = std::unique_ptr<RESX::File>(
+        new RESX::File(forkPath, mResourceFileBlockSize));
+    cachedFork.fork = std::unique_ptr<RESX::ResourceFork>(
+        new RESX::ResourceFork(cachedFork.file->loadResourceFork(0)));
+
+    RESX::ResourceFork* fork = cachedFork.fork.get();
+
+    std::lock_guard<std::mutex> lock(mCacheMutex);
+    mForkCache.insert(forkPath, std::move(cachedFork));
+    return fork;
+}
+
+void ConversionDaemon::recordLatency(std::chrono::steady_clock::duration latency)
+{
+    auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+
+    std::size_t bucket = 0;
+    while(bucket + 1 < Metrics::cNumLatencyBuckets &&
+        microseconds >= (static_cast<long long>(1) << bucket))
+        ++bucket;
+
+    std::lock_guard<std::mutex> lock(mCacheMutex);
+    ++mMetrics.latencyBuckets[bucket];
+}
@@ -0,0 +1,123 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CONVERSION_DAEMON_HPP
+#define CONVERSION_DAEMON_HPP
+
+#include "ResExtractor.hpp"
+#include "LRUCache.hpp"
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <cstddef> // For std::size_t
+
+// Long-running conversion server, listening on a Unix domain socket.
+//
+// Requests are single lines, with tab-separated fields:
+//     CONVERT \t wav|pcm \t ID|NAME \t resource ID or name \t resource fork path \n
+//     METRICS \n
+// Responses are either:
+//     OK <size in bytes> \n <data>
+//     ERROR <message> \n
+// A connection may send any number of requests. Each connection is served by
+// its own thread, up to a fixed number of connections; further clients wait to
+// be accepted.
+//
+// Recently used resource forks and converted sounds are kept in LRU caches,
+// so repeated requests skip fork loading and decoding.
+class ConversionDaemon
+{
+private:
+    // Identifies a version of a resource fork on disk.
+    struct FileStamp
+    {
+        std::int64_t modificationTime = 0;
+        std::int64_t size = 0;
+
+        bool operator==(const FileStamp& other) const;
+    };
+
+    struct CachedFork
+    {
+        FileStamp stamp;
+        std::unique_ptr<RESX::File> file;
+        std::unique_ptr<RESX::ResourceFork> fork; // Must not outlive file.
+    };
+
+    struct CachedSound
+    {
+        FileStamp stamp;
+        std::string wav;
+        std::size_t headerSize = 0; // Sample data follows the header.
+    };
+
+    struct Metrics
+    {
+        static const std::size_t cNumLatencyBuckets = 24;
+
+        std::uint64_t convertRequests = 0;
+        std::uint64_t metricsRequests = 0;
+        std::uint64_t failedRequests = 0;
+        std::uint64_t forkCacheHits = 0;
+        std::uint64_t forkCacheMisses = 0;
+        std::uint64_t soundCacheHits = 0;
+        std::uint64_t soundCacheMisses = 0;
+
+        // Bucket i counts requests that took less than 2^i microseconds,
+        // the last bucket counts all slower requests.
+        std::uint64_t latencyBuckets[cNumLatencyBuckets] = {0};
+    };
+
+    static bool getFileStamp(const std::string& filePath, FileStamp& stamp);
+    static bool sendAll(int socket, const char* data, std::size_t size);
+    static bool sendError(int socket, const std::string& message);
+    static bool sendData(int socket, const char* data, std::size_t size);
+
+    void serveConnection(int socket);
+    bool handleRequest(int socket, const std::string& request);
+    bool handleConvert(int socket, const std::string& format, const std::string& selector,
+        const std::string& resource, const std::string& forkPath);
+    bool handleMetrics(int socket);
+
+    std::shared_ptr<const CachedSound> convertSound(const std::string& forkPath,
+        const FileStamp& stamp, const std::string& selector, const std::string& resource);
+    RESX::ResourceFork* loadFork(const std::string& forkPath, const FileStamp& stamp);
+    void recordLatency(std::chrono::steady_clock::duration latency);
+
+    std::size_t mResourceFileBlockSize;
+
+    std::mutex mCacheMutex; // Protects caches and metrics.
+    std::mutex mConversionMutex; // Conversions are not run concurrently.
+    std::mutex mConnectionMutex; // Protects mNumConnections.
+    std::condition_variable mConnectionClosed;
+    std::size_t mNumConnections = 0;
+    LRUCache<std::string, CachedFork> mForkCache;
+    LRUCache<std::string, std::shared_ptr<const CachedSound>> mSoundCache;
+    Metrics mMetrics;
+
+public:
+    ConversionDaemon(std::size_t resourceFileBlockSize, std::size_t soundCacheSize);
+
+    // Serves requests forever; only returns on failure.
+    bool run(const std::string& socketPath);
+};
+
+#endif // CONVERSION_DAEMON_HPP
@@ -0,0 +1,218 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "CpuFeatures.hpp"
+#include "Log.hpp"
+
+#if defined(SNDTOWAV_X86) && defined(_MSC_VER)
+#include <intrin.h> // For __cpuid and _xgetbv
+#endif
+
+CpuFeatures::KernelSet CpuFeatures::mKernelSet = CpuFeatures::KernelSet::Scalar;
+bool CpuFeatures::mKernelSetForced = false;
+
+// Static
+// Detected once, the first time it is needed.
+const CpuFeatures::Features& CpuFeatures::getFeatures()
+{
+    static const Features features = []
+    {
+        Features detected;
+
+#if defined(SNDTOWAV_X86) && defined(_MSC_VER)
+        int info[4] = {0};
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+
+        __cpuid(info, 1);
+        detected.ssse3 = (info[2] & (1 << 9)) != 0;
+        detected.sse41 = (info[2] & (1 << 19)) != 0;
+        bool hasXGETBV = (info[2] & (1 << 27)) != 0;
+        unsigned long long savedStates = hasXGETBV ? _xgetbv(0) : 0;
+        bool osSavesYMM = (savedStates & 0x6) == 0x6;
+        bool osSavesZMM = (savedStates & 0xE6) == 0xE6;
+
+        if(maxLeaf >= 7 && osSavesYMM)
+        {
+            __cpuidex(info, 7, 0);
+            detected.avx2 = (info[1] & (1 << 5)) != 0;
+            detected.avx512 = osSavesZMM && (info[1] & (1 << 16)) != 0 && // AVX512F
+                (info[1] & (1 << 30)) != 0; // AVX512BW
+        }
+#elif defined(SNDTOWAV_X86)
+        __builtin_cpu_init();
+        detected.ssse3 = __builtin_cpu_supports("ssse3") != 0;
+        detected.sse41 = __builtin_cpu_supports("sse4.1") != 0;
+        detected.avx2 = __builtin_cpu_supports("avx2") != 0;
+        detected.avx512 = __builtin_cpu_supports("avx512f") != 0 &&
+            __builtin_cpu_supports("avx512bw") != 0;
+#endif
+
+        return detected;
+    }();
+
+    return features;
+}
+
+// Static
+bool CpuFeatures::hasSSSE3()
+{
+    return getFeatures().ssse3;
+}
+
+// Static
+bool CpuFeatures::hasSSE41()
+{
+    return getFeatures().sse41;
+}
+
+// Static
+bool CpuFeatures::hasAVX2()
+{
+    return getFeatures().avx2;
+}
+
+// Static
+bool CpuFeatures::hasAVX512()
+{
+    return getFeatures().avx512;
+}
+
+// Static
+bool CpuFeatures::hasNEON()
+{
+#ifdef SNDTOWAV_NEON
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Static
+bool CpuFeatures::isSupported(KernelSet kernelSet)
+{
+    switch(kernelSet)
+    {
+    case KernelSet::Scalar:
+        return true;
+    case KernelSet::SSE:
+        return hasSSSE3() && hasSSE41();
+    case KernelSet::AVX2:
+        return isSupported(KernelSet::SSE) && hasAVX2();
+    case KernelSet::AVX512:
+        return isSupported(KernelSet::AVX2) && hasAVX512();
+    case KernelSet::NEON:
+        return hasNEON();
+    }
+
+    return false;
+}
+
+// Static
+CpuFeatures::KernelSet CpuFeatures::getBestKernelSet()
+{
+    for(KernelSet kernelSet : {KernelSet::AVX512, KernelSet::AVX2, KernelSet::SSE,
+        KernelSet::NEON})
+    {
+        if(isSupported(kernelSet))
+            return kernelSet;
+    }
+
+    return KernelSet::Scalar;
+}
+
+// Static
+// Returns true on success, false on failure.
+bool CpuFeatures::parseKernelSet(const std::string& name, KernelSet& kernelSet)
+{
+    for(KernelSet candidate : {KernelSet::Scalar, KernelSet::SSE, KernelSet::AVX2,
+        KernelSet::AVX512, KernelSet::NEON})
+    {
+        if(name == getKernelSetName(candidate))
+        {
+            kernelSet = candidate;
+            return true;
+        }
+    }
+
+    Log::err << "Error: unknown kernel set '" << name << "'! Expected scalar, sse, " <<
+        "avx2, avx512 or neon." << std::endl;
+    return false;
+}
+
+// Static
+std::string CpuFeatures::getKernelSetName(KernelSet kernelSet)
+{
+    switch(kernelSet)
+    {
+    case KernelSet::Scalar:
+        return "scalar";
+    case KernelSet::SSE:
+        return "sse";
+    case KernelSet::AVX2:
+        return "avx2";
+    case KernelSet::AVX512:
+        return "avx512";
+    case KernelSet::NEON:
+        return "neon";
+    }
+
+    return "unknown";
+}
+
+// Static
+// Returns true on success, false if the CPU doesn't support the set.
+bool CpuFeatures::setKernelSet(KernelSet kernelSet)
+{
+    if(!isSupported(kernelSet))
+    {
+        Log::err << "Error: this CPU does not support " <<
+            getKernelSetName(kernelSet) << " kernels!" << std::endl;
+        return false;
+    }
+
+    mKernelSet = kernelSet;
+    mKernelSetForced = true;
+    return true;
+}
+
+// Static
+CpuFeatures::KernelSet CpuFeatures::getKernelSet()
+{
+    return mKernelSetForced ? mKernelSet : getBestKernelSet();
+}
+
+// Static
+bool CpuFeatures::useSSE()
+{
+    KernelSet kernelSet = getKernelSet();
+    return kernelSet == KernelSet::SSE || kernelSet == KernelSet::AVX2 ||
+        kernelSet == KernelSet::AVX512;
+}
+
+// Static
+bool CpuFeatures::useAVX2()
+{
+    KernelSet kernelSet = getKernelSet();
+    return kernelSet == KernelSet::AVX2 || kernelSet == KernelSet::AVX512;
+}
+
+// Static
+bool CpuFeatures::useNEON()
+{
+    return getKernelSet() == KernelSet::NEON;
+}
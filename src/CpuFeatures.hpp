@@ -0,0 +1,95 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CPU_FEATURES_HPP
+#define CPU_FEATURES_HPP
+
+// Instruction set architecture of the build.
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SNDTOWAV_X86
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && !defined(__ARM_BIG_ENDIAN)
+#define SNDTOWAV_NEON // Always available on these targets.
+#endif
+
+// Lets a function use instructions which the rest of the build cannot assume.
+// Such functions must only be called once the feature was detected.
+// MSVC allows intrinsics anywhere, so it needs nothing.
+#if defined(SNDTOWAV_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SNDTOWAV_TARGET(features) __attribute__((target(features)))
+#else
+#define SNDTOWAV_TARGET(features)
+#endif
+
+#include <string>
+
+// Instruction set extensions available on the running CPU, and the kernel set
+// codecs dispatch to. Kernels are bound when decoding starts, so the kernel
+// set should be chosen before decoding anything.
+class CpuFeatures
+{
+public:
+    // Families of kernels, from the most portable. Each x86 set implies the
+    // previous ones. AVX-512 CPUs use the AVX2 kernels.
+    enum class KernelSet
+    {
+        Scalar,
+        SSE, // SSSE3 and SSE4.1
+        AVX2,
+        AVX512,
+        NEON
+    };
+
+private:
+    struct Features
+    {
+        bool ssse3 = false;
+        bool sse41 = false;
+        bool avx2 = false;
+        bool avx512 = false; // Foundation and byte/word instructions.
+    };
+
+    static const Features& getFeatures();
+
+    static KernelSet mKernelSet;
+    static bool mKernelSetForced;
+
+public:
+    static bool hasSSSE3();
+    static bool hasSSE41();
+    static bool hasAVX2();
+    static bool hasAVX512();
+    static bool hasNEON();
+
+    static bool isSupported(KernelSet kernelSet);
+    static KernelSet getBestKernelSet();
+
+    // Returns true on success, false on failure.
+    static bool parseKernelSet(const std::string& name, KernelSet& kernelSet);
+    static std::string getKernelSetName(KernelSet kernelSet);
+
+    // Forces kernels of a set, for testing them against each other.
+    // Returns true on success, false if the CPU doesn't support the set.
+    static bool setKernelSet(KernelSet kernelSet);
+    static KernelSet getKernelSet();
+
+    // Whether kernels should use these instructions.
+    static bool useSSE();
+    static bool useAVX2();
+    static bool useNEON();
+};
+
+#endif // CPU_FEATURES_HPP
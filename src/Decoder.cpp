@@ -16,50 +16,80 @@
 // along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
 
 #include "Decoder.hpp"
+#include "Endian.hpp"
 
-// Static
-// Convert std::vector<std::int16_t> native-endian values to
-// std::vector<std::uint8_t> in little-endian.
-std::vector<uint8_t> Decoder::serializeToLittleEndian(const std::vector<std::int16_t>& data)
+#include <algorithm> // For std::min
+#include <limits>
+
+const std::size_t Decoder::cChunkSamples = 16384;
+
+Decoder::Decoder()
+    : mRemainingBytes(std::numeric_limits<std::size_t>::max())
 {
-    std::vector<std::uint8_t> convertedData(data.size() * 16/8);
-
-    for(std::size_t i = 0; i < data.size(); ++i)
-    {
-        // Signed to unsigned:
-        std::uint16_t unsignedValue =
-            *reinterpret_cast<const std::uint16_t*>( &(data[i]) );
-
-        // LSB goes to smallest adress.
-        // '&' makes this platform-independant.
-        convertedData[i*2] = static_cast<std::uint8_t>(unsignedValue & 0x00FF);
-        
-        // MSB goes to largest adress.
-        // '>>' makes this platform-independant.
-        convertedData[i*2 + 1] = static_cast<std::uint8_t>(unsignedValue >> 8);
-    }
-
-    return convertedData;
+
 }
 
-void Decoder::setLittleEndianData(const std::vector<std::int16_t>& samples)
+bool Decoder::outputSamples(const std::int16_t* samples, std::size_t numSamples)
 {
-    mLittleEndianData = serializeToLittleEndian(samples);
+    mSerializedChunk.resize(numSamples * 16/8);
+    Endian::storeLittle(samples, numSamples, mSerializedChunk.data());
+
+    return outputSamples(mSerializedChunk.data(), mSerializedChunk.size());
 }
 
-void Decoder::setLittleEndianData(const std::vector<std::int8_t>& samples)
+// For raw data.
+bool Decoder::outputSamples(const std::uint8_t* data, std::size_t size)
 {
-    // Conversion exists between int8_t and uint8_t.
-    mLittleEndianData = std::vector<std::uint8_t>(samples.begin(), samples.end());
+    std::size_t skipped = std::min(mSkipBytes, size);
+    data += skipped;
+    size = std::min(size - skipped, mRemainingBytes);
+    mSkipBytes -= skipped;
+    mRemainingBytes -= size;
+
+    if(size == 0)
+        return true;
+
+    if(mSink != nullptr)
+        return mSink->write(data, size);
+
+    mLittleEndianData.insert(mLittleEndianData.end(), data, data + size);
+    return true;
 }
 
-// For raw data.
-void Decoder::setLittleEndianData(const std::vector<std::uint8_t>& data)
+// Most decoders don't depend on the channel count.
+void Decoder::specialize(std::size_t /* numChannels */)
 {
-    mLittleEndianData = data;
+
+}
+
+void Decoder::setSink(SampleSink* sink)
+{
+    mSink = sink;
+    mLittleEndianData.clear();
+}
+
+void Decoder::setOutputWindow(std::size_t skipBytes, std::size_t maxBytes)
+{
+    mSkipBytes = skipBytes;
+    mRemainingBytes = maxBytes;
+}
+
+void Decoder::resetOutputWindow()
+{
+    setOutputWindow(0, std::numeric_limits<std::size_t>::max());
+}
+
+bool Decoder::decodeFrames(const std::vector<std::uint8_t>& data,
+    std::size_t numChannels, std::size_t firstFrame, std::size_t endFrame)
+{
+    std::size_t end = std::min(getEncodedSize(endFrame * numChannels), data.size());
+    std::size_t begin = std::min(getEncodedSize(firstFrame * numChannels), end);
+
+    std::vector<std::uint8_t> packets(data.begin() + begin, data.begin() + end);
+    return decode(packets, numChannels);
 }
 
-const std::vector<std::uint8_t> Decoder::getLittleEndianData() const
+const std::vector<std::uint8_t>& Decoder::getLittleEndianData() const
 {
     return mLittleEndianData;
 }
@@ -18,6 +18,8 @@
 #ifndef DECODER_HPP
 #define DECODER_HPP
 
+#include "SampleSink.hpp"
+
 #include <cstdint>
 #include <cstddef>
 #include <vector>
@@ -25,18 +27,36 @@
 class Decoder
 {
 private:
-    std::vector<std::uint8_t> mLittleEndianData;
-
-    static std::vector<uint8_t> serializeToLittleEndian(const std::vector<std::int16_t>& data);
+    std::vector<std::uint8_t> mLittleEndianData; // Only used without a sink.
+    std::vector<std::uint8_t> mSerializedChunk;
+    SampleSink* mSink = nullptr;
+    std::size_t mSkipBytes = 0;
+    std::size_t mRemainingBytes;
 
 protected:
-    void setLittleEndianData(const std::vector<std::int16_t>& samples);
-    void setLittleEndianData(const std::vector<std::int8_t>& samples);
-    void setLittleEndianData(const std::vector<std::uint8_t>& data);
+    // Decoders should output at most this many samples at a time, so that
+    // large sounds are streamed to the sink as they are decoded.
+    static const std::size_t cChunkSamples;
+
+    // Hands decoded data to the sink, or keeps it if there is no sink.
+    // Returns true on success, false on failure.
+    bool outputSamples(const std::int16_t* samples, std::size_t numSamples);
+    bool outputSamples(const std::uint8_t* data, std::size_t size);
 
 public:
+    Decoder();
     virtual ~Decoder() = default;
 
+    // Decoded data will be written to sink, instead of being kept by the
+    // decoder. Set to nullptr to keep decoded data.
+    void setSink(SampleSink* sink);
+
+    // Drops the first skipBytes decoded bytes, and everything after the
+    // following maxBytes. Lets callers decode whole packets, but only
+    // output part of them.
+    void setOutputWindow(std::size_t skipBytes, std::size_t maxBytes);
+    void resetOutputWindow();
+
     // Returns size of compressed samples, in bytes.
     virtual std::size_t getEncodedSize(std::size_t numPackets) const = 0;
 
@@ -46,14 +66,28 @@ public:
     // Bits per uncompressed sample.
     virtual unsigned getBitsPerSample() const = 0;
 
+    // Binds kernels specialized for numChannels, so decoding loops don't
+    // branch on it. Called once the sound header is known; decoding another
+    // channel count binds kernels again.
+    virtual void specialize(std::size_t numChannels);
+
     // data is the raw data as found in the sound file.
     // decode() must take into account the endianness of the inputted data, which in
     // our case is always Big-endian.
+    // Decoded data is output with outputSamples(), in order.
     // Returns true on success, false on failure.
     virtual bool decode(const std::vector<std::uint8_t>& data,
         std::size_t numChannels) = 0;
 
-    const std::vector<std::uint8_t> getLittleEndianData() const;
+    // Decodes packet frames [firstFrame, endFrame) only; a packet frame holds
+    // one packet per channel. By default, only the bytes of these packets are
+    // decoded, which suits codecs whose packets are independent.
+    // Returns true on success, false on failure.
+    virtual bool decodeFrames(const std::vector<std::uint8_t>& data,
+        std::size_t numChannels, std::size_t firstFrame, std::size_t endFrame);
+
+    // Decoded data, if decoded without a sink.
+    const std::vector<std::uint8_t>& getLittleEndianData() const;
 };
 
 #endif // DECODER_HPP
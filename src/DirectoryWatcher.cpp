@@ -0,0 +1,272 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "DirectoryWatcher.hpp"
+#include "SndToWAV.hpp"
+#include "Log.hpp"
+
+#include <vector>
+#include <exception>
+#include <cstring> // For std::strerror
+#include <climits> // For NAME_MAX
+#include <cerrno>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const std::string cResourceForkExtension = ".rsrc";
+}
+
+DirectoryWatcher::DirectoryWatcher(std::size_t resourceFileBlockSize,
+    std::shared_ptr<Journal> journal, std::size_t numThreads,
+    std::chrono::milliseconds debounceDelay)
+    : mResourceFileBlockSize(resourceFileBlockSize),
+    mJournal(journal),
+    mDebounceDelay(debounceDelay),
+    mWorkers(numThreads)
+{
+
+}
+
+// Static
+bool DirectoryWatcher::isResourceFork(const std::string& fileName)
+{
+    // Skip hidden files, such as temporary files of rsync.
+    return fileName.size() > cResourceForkExtension.size() && fileName[0] != '.' &&
+        fileName.compare(fileName.size() - cResourceForkExtension.size(),
+            cResourceForkExtension.size(), cResourceForkExtension) == 0;
+}
+
+// Queues a conversion, unless the fork is already busy, in which case it is
+// converted again once done.
+void DirectoryWatcher::schedule(const std::string& fileName)
+{
+    std::lock_guard<std::mutex> lock(mScheduleMutex);
+    if(!mBusyForks.insert(fileName).second)
+    {
+        mStaleForks.insert(fileName);
+        return;
+    }
+
+    mWorkers.submit([this, fileName] { convert(fileName); });
+}
+
+#ifdef __linux__
+
+// Marks all forks in the directory as pending.
+// Returns true on success, false on failure.
+bool DirectoryWatcher::scanDirectory(Clock::time_point readyTime)
+{
+    DIR* directory = opendir(mDirectoryPath.c_str());
+    if(directory == nullptr)
+    {
+        Log::err << "Error: could not read directory '" << mDirectoryPath << "': " <<
+            std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    while(dirent* entry = readdir(directory))
+    {
+        if(isResourceFork(entry->d_name))
+            mPendingForks[entry->d_name] = readyTime;
+    }
+
+    closedir(directory);
+    return true;
+}
+
+// Runs on a worker thread.
+void DirectoryWatcher::convert(const std::string& fileName)
+{
+    // Next to the fork, so that forks of other watched directories never collide.
+    std::string outputDirectory = mDirectoryPath + '/' + fileName.substr(0,
+        fileName.size() - cResourceForkExtension.size());
+
+    if(mkdir(outputDirectory.c_str(), 0777) != 0 && errno != EEXIST)
+    {
+        Log::err << "Error: could not create directory '" << outputDirectory << "': " <<
+            std::strerror(errno) << std::endl;
+    } else
+    {
+        SndToWAV sndToWAV(mResourceFileBlockSize);
+        sndToWAV.useJournal(mJournal);
+        sndToWAV.setOutputDirectory(outputDirectory);
+
+        try
+        {
+            if(sndToWAV.extract(mDirectoryPath + '/' + fileName))
+                Log::info << "Converted '" << fileName << "'." << std::endl;
+            else
+                Log::err << "Error: could not fully convert '" << fileName << "'!" << std::endl;
+        } catch(const std::exception& e)
+        {
+            Log::err << "Error: could not convert '" << fileName << "': " << e.what() <<
+                std::endl;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mScheduleMutex);
+    if(mStaleForks.erase(fileName) > 0)
+        mWorkers.submit([this, fileName] { convert(fileName); });
+    else
+        mBusyForks.erase(fileName);
+}
+
+bool DirectoryWatcher::run(const std::string& directoryPath)
+{
+    mDirectoryPath = directoryPath;
+
+    int inotifyHandle = inotify_init1(IN_CLOEXEC);
+    if(inotifyHandle < 0)
+    {
+        Log::err << "Error: could not initialize inotify: " << std::strerror(errno) <<
+            std::endl;
+        return false;
+    }
+
+    // Watch before scanning, so no fork is missed in between.
+    if(inotify_add_watch(inotifyHandle, mDirectoryPath.c_str(),
+        IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        Log::err << "Error: could not watch '" << mDirectoryPath << "': " <<
+            std::strerror(errno) << std::endl;
+        close(inotifyHandle);
+        return false;
+    }
+
+    // Forks added while we were not watching are converted right away.
+    if(!scanDirectory(Clock::now()))
+    {
+        close(inotifyHandle);
+        return false;
+    }
+
+    Log::info << "Watching '" << mDirectoryPath << "' with " << mWorkers.getNumThreads() <<
+        " worker thread(s)." << std::endl;
+
+    std::vector<char> eventBuffer(64 * (sizeof(inotify_event) + NAME_MAX + 1));
+
+    while(true)
+    {
+        // Sleep until the next pending fork is ready, or forever.
+        int timeout = -1;
+        Clock::time_point now = Clock::now();
+        for(const auto& pendingFork : mPendingForks)
+        {
+            int untilReady = pendingFork.second <= now ? 0 : static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    pendingFork.second - now).count()) + 1;
+
+            if(timeout < 0 || untilReady < timeout)
+                timeout = untilReady;
+        }
+
+        pollfd pollHandle = {inotifyHandle, POLLIN, 0};
+        int numReady = poll(&pollHandle, 1, timeout);
+        if(numReady < 0 && errno != EINTR)
+        {
+            Log::err << "Error: could not wait for changes: " << std::strerror(errno) <<
+                std::endl;
+            close(inotifyHandle);
+            return false;
+        }
+
+        if(numReady > 0)
+        {
+            ssize_t size = read(inotifyHandle, eventBuffer.data(), eventBuffer.size());
+            if(size < 0 && errno != EINTR)
+            {
+                Log::err << "Error: could not read changes: " << std::strerror(errno) <<
+                    std::endl;
+                close(inotifyHandle);
+                return false;
+            }
+
+            // Every touch postpones conversion, so a fork is only read once
+            // writers have been quiet for the whole debounce delay.
+            Clock::time_point readyTime = Clock::now() + mDebounceDelay;
+
+            for(ssize_t offset = 0; offset < size; )
+            {
+                inotify_event event;
+                std::memcpy(&event, eventBuffer.data() + offset, sizeof(event));
+                const char* name = eventBuffer.data() + offset + sizeof(event);
+                offset += sizeof(event) + event.len;
+
+                if(event.mask & IN_IGNORED)
+                {
+                    Log::err << "Error: '" << mDirectoryPath << "' is no longer watchable!" <<
+                        std::endl;
+                    close(inotifyHandle);
+                    return false;
+                }
+
+                if(event.mask & IN_Q_OVERFLOW)
+                {
+                    // Changes were lost; the journal makes rescanning cheap.
+                    Log::warn << "Warning: too many changes at once, rescanning '" <<
+                        mDirectoryPath << "'." << std::endl;
+                    scanDirectory(readyTime);
+                } else if(event.len > 0 && isResourceFork(name))
+                {
+                    Log::verb << "Change detected in '" << name << "'." << std::endl;
+                    mPendingForks[name] = readyTime;
+                }
+            }
+        }
+
+        now = Clock::now();
+        for(auto pendingIt = mPendingForks.begin(); pendingIt != mPendingForks.end(); )
+        {
+            if(pendingIt->second <= now)
+            {
+                schedule(pendingIt->first);
+                pendingIt = mPendingForks.erase(pendingIt);
+            } else
+            {
+                ++pendingIt;
+            }
+        }
+    }
+}
+
+#else // __linux__
+
+bool DirectoryWatcher::scanDirectory(Clock::time_point)
+{
+    return false;
+}
+
+void DirectoryWatcher::convert(const std::string&)
+{
+
+}
+
+bool DirectoryWatcher::run(const std::string&)
+{
+    Log::err << "Error: watch mode is not supported on this platform." << std::endl;
+    return false;
+}
+
+#endif // __linux__
@@ -0,0 +1,71 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DIRECTORY_WATCHER_HPP
+#define DIRECTORY_WATCHER_HPP
+
+#include "Journal.hpp"
+#include "WorkerPool.hpp"
+
+#include <string>
+#include <memory>
+#include <map>
+#include <set>
+#include <mutex>
+#include <chrono>
+#include <cstddef> // For std::size_t
+
+// Watches a directory for new or modified resource forks (.rsrc files), and
+// converts their sounds on a worker pool.
+//
+// A fork is converted once it has not been touched for the debounce delay, so
+// files still being copied are not read half-written. Sounds of each fork are
+// written to a directory named after the fork, next to it, and a shared journal
+// ensures only sounds which actually changed are converted again.
+class DirectoryWatcher
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static bool isResourceFork(const std::string& fileName);
+
+    bool scanDirectory(Clock::time_point readyTime);
+    void schedule(const std::string& fileName);
+    void convert(const std::string& fileName);
+
+    std::size_t mResourceFileBlockSize;
+    std::shared_ptr<Journal> mJournal;
+    std::chrono::milliseconds mDebounceDelay;
+    std::string mDirectoryPath;
+
+    std::map<std::string, Clock::time_point> mPendingForks; // Fork -> ready time.
+
+    std::mutex mScheduleMutex; // Protects the two sets below.
+    std::set<std::string> mBusyForks; // Queued or being converted.
+    std::set<std::string> mStaleForks; // Modified while busy; convert again.
+
+    WorkerPool mWorkers; // Last, so jobs finish before members are destroyed.
+
+public:
+    DirectoryWatcher(std::size_t resourceFileBlockSize, std::shared_ptr<Journal> journal,
+        std::size_t numThreads, std::chrono::milliseconds debounceDelay);
+
+    // Converts existing forks, then watches forever; only returns on failure.
+    bool run(const std::string& directoryPath);
+};
+
+#endif // DIRECTORY_WATCHER_HPP
@@ -0,0 +1,145 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "DuplicateReport.hpp"
+#include "FingerprintFile.hpp"
+#include "FingerprintMatcher.hpp"
+#include "TarArchive.hpp"
+#include "Log.hpp"
+
+#include <fstream>
+#include <iomanip> // For std::setprecision
+#include <algorithm> // For std::sort
+#include <cstring> // For std::strerror and std::strcmp
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
+
+const std::string DuplicateReport::cFingerprintExtension = ".fingerprint";
+
+DuplicateReport::DuplicateReport(double maxBitErrorRate)
+    : mMaxBitErrorRate(maxBitErrorRate)
+{
+
+}
+
+// Static
+bool DuplicateReport::isFingerprintFile(const std::string& fileName)
+{
+    return fileName.size() > cFingerprintExtension.size() &&
+        fileName.compare(fileName.size() - cFingerprintExtension.size(),
+            cFingerprintExtension.size(), cFingerprintExtension) == 0;
+}
+
+#ifndef _WIN32
+
+// Adds fingerprint files of the directory and of its subdirectories.
+// Returns true on success, false on failure.
+bool DuplicateReport::findFingerprintFiles(const std::string& directoryPath)
+{
+    DIR* directory = opendir(directoryPath.c_str());
+    if(directory == nullptr)
+    {
+        Log::err << "Error: could not read directory '" << directoryPath << "': " <<
+            std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    bool success = true;
+    while(dirent* entry = readdir(directory))
+    {
+        if(std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        std::string path = directoryPath + '/' + entry->d_name;
+        struct stat fileStatus;
+        if(stat(path.c_str(), &fileStatus) != 0)
+            continue; // Removed since, or a broken link.
+
+        if(S_ISDIR(fileStatus.st_mode))
+            success = findFingerprintFiles(path) && success;
+        else if(S_ISREG(fileStatus.st_mode) && isFingerprintFile(entry->d_name))
+            mFilePaths.push_back(path);
+    }
+
+    closedir(directory);
+    return success;
+}
+
+#else // _WIN32
+
+bool DuplicateReport::findFingerprintFiles(const std::string&)
+{
+    Log::err << "Error: duplicate reports are not supported on this platform." << std::endl;
+    return false;
+}
+
+#endif // _WIN32
+
+// Returns true on success, false on failure.
+bool DuplicateReport::run(const std::string& directoryPath, std::ostream& outputStream)
+{
+    mFilePaths.clear();
+    if(!findFingerprintFiles(directoryPath))
+        return false;
+
+    std::sort(mFilePaths.begin(), mFilePaths.end());
+
+    FingerprintMatcher matcher;
+    std::vector<std::string> names; // Of the fingerprints added.
+    for(const std::string& filePath : mFilePaths)
+    {
+        std::ifstream file(filePath, std::ios::binary);
+        std::vector<std::uint32_t> subFingerprints;
+        std::vector<std::uint32_t> masks;
+        if(!FingerprintFile::read(file, subFingerprints, masks))
+        {
+            Log::warn << "Warning: skipped '" << filePath << "'; it is not a fingerprint " <<
+                "file of this version." << std::endl;
+            continue;
+        }
+
+        matcher.add(std::move(subFingerprints), std::move(masks));
+        names.push_back(filePath);
+    }
+
+    std::vector<FingerprintMatcher::Cluster> clusters = matcher.findClusters(mMaxBitErrorRate);
+
+    outputStream << std::fixed << std::setprecision(3) << "{\"clusters\":[";
+    for(std::size_t i = 0; i < clusters.size(); ++i)
+    {
+        outputStream << (i > 0 ? ",\n" : "\n") << "{\"bitErrorRate\":" <<
+            clusters[i].bitErrorRate << ",\"sounds\":[";
+
+        for(std::size_t j = 0; j < clusters[i].fingerprints.size(); ++j)
+        {
+            outputStream << (j > 0 ? "," : "") << '"' <<
+                TarArchive::escapeJSON(names[clusters[i].fingerprints[j]]) << '"';
+        }
+
+        outputStream << "]}";
+    }
+
+    outputStream << "]}" << std::endl;
+
+    Log::info << "Found " << clusters.size() << " clusters of duplicates among " <<
+        names.size() << " fingerprints." << std::endl;
+    return !outputStream.fail();
+}
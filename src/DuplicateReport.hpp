@@ -0,0 +1,51 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DUPLICATE_REPORT_HPP
+#define DUPLICATE_REPORT_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+// Finds near-duplicate sounds across a batch, from the fingerprint files
+// written with '-format fingerprint' anywhere in a directory tree, and writes
+// them as JSON clusters:
+//     {"clusters":[
+//     {"bitErrorRate":0.083,"sounds":["a/128.fingerprint","b/12.fingerprint"]},
+//     ...]}
+// Sounds of a cluster match each other directly or through other sounds; the
+// bit error rate is that of its worst match.
+class DuplicateReport
+{
+private:
+    static const std::string cFingerprintExtension;
+
+    static bool isFingerprintFile(const std::string& fileName);
+
+    bool findFingerprintFiles(const std::string& directoryPath);
+
+    double mMaxBitErrorRate;
+    std::vector<std::string> mFilePaths;
+
+public:
+    DuplicateReport(double maxBitErrorRate);
+
+    bool run(const std::string& directoryPath, std::ostream& outputStream);
+};
+
+#endif // DUPLICATE_REPORT_HPP
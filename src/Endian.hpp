@@ -0,0 +1,158 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ENDIAN_HPP
+#define ENDIAN_HPP
+
+#include <cstdint>
+#include <cstddef> // For size_t
+#include <cstring> // For std::memmove and std::memcpy
+#include <climits> // For CHAR_BIT
+#include <type_traits>
+
+static_assert(CHAR_BIT == 8, "CHAR_BIT != 8");
+
+// Byte order conversions. Scalar conversions are constexpr, and bulk ones
+// convert whole arrays in one pass, which compilers turn into bswap, movbe or
+// vector shuffles.
+namespace Endian
+{
+    // Byte order of the target, detected at compile time.
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && \
+    __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    constexpr bool cNativeIsLittle = false;
+#elif (defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_WIN32)
+    constexpr bool cNativeIsLittle = true;
+#else
+#error "Cannot detect the byte order of the target."
+#endif
+
+    namespace Detail
+    {
+        template<std::size_t size>
+        struct UnsignedOfSize;
+
+        template<> struct UnsignedOfSize<1> { using Type = std::uint8_t; };
+        template<> struct UnsignedOfSize<2> { using Type = std::uint16_t; };
+        template<> struct UnsignedOfSize<4> { using Type = std::uint32_t; };
+        template<> struct UnsignedOfSize<8> { using Type = std::uint64_t; };
+
+        constexpr std::uint8_t swapUnsigned(std::uint8_t value)
+        {
+            return value;
+        }
+
+        constexpr std::uint16_t swapUnsigned(std::uint16_t value)
+        {
+            return static_cast<std::uint16_t>((value >> 8) | (value << 8));
+        }
+
+        constexpr std::uint32_t swapUnsigned(std::uint32_t value)
+        {
+            return (value >> 24) | ((value >> 8) & 0x0000FF00U) |
+                ((value << 8) & 0x00FF0000U) | (value << 24);
+        }
+
+        constexpr std::uint64_t swapUnsigned(std::uint64_t value)
+        {
+            return (static_cast<std::uint64_t>(swapUnsigned(static_cast<std::uint32_t>(value))) << 32) |
+                swapUnsigned(static_cast<std::uint32_t>(value >> 32));
+        }
+    }
+
+    // Reverses the bytes of an integer.
+    template<class T>
+    constexpr T swap(T value)
+    {
+        static_assert(std::is_integral<T>::value, "Only integers can be swapped");
+        return static_cast<T>(Detail::swapUnsigned(
+            static_cast<typename Detail::UnsignedOfSize<sizeof(T)>::Type>(value)));
+    }
+
+    // Converts Big-endian to native-endian.
+    template<class T>
+    constexpr T fromBig(T big)
+    {
+        return cNativeIsLittle ? swap(big) : big;
+    }
+
+    // Converts little-endian to native-endian.
+    template<class T>
+    constexpr T fromLittle(T little)
+    {
+        return cNativeIsLittle ? little : swap(little);
+    }
+
+    // Converts native-endian to Big-endian.
+    template<class T>
+    constexpr T toBig(T nativeEndian)
+    {
+        return fromBig(nativeEndian);
+    }
+
+    // Converts native-endian to little-endian.
+    template<class T>
+    constexpr T toLittle(T nativeEndian)
+    {
+        return fromLittle(nativeEndian);
+    }
+
+    // Loads count Big-endian values from bytes, which may be values itself.
+    template<class T>
+    inline void loadBig(const void* bytes, T* values, std::size_t count)
+    {
+        std::memmove(values, bytes, count * sizeof(T));
+        if(cNativeIsLittle && sizeof(T) > 1)
+        {
+            for(std::size_t i = 0; i < count; ++i)
+                values[i] = swap(values[i]);
+        }
+    }
+
+    // Loads count little-endian values from bytes, which may be values itself.
+    template<class T>
+    inline void loadLittle(const void* bytes, T* values, std::size_t count)
+    {
+        std::memmove(values, bytes, count * sizeof(T));
+        if(!cNativeIsLittle && sizeof(T) > 1)
+        {
+            for(std::size_t i = 0; i < count; ++i)
+                values[i] = swap(values[i]);
+        }
+    }
+
+    // Stores count native-endian values to bytes, as little-endian.
+    template<class T>
+    inline void storeLittle(const T* values, std::size_t count, void* bytes)
+    {
+        if(cNativeIsLittle || sizeof(T) == 1)
+        {
+            std::memmove(bytes, values, count * sizeof(T));
+            return;
+        }
+
+        std::uint8_t* out = static_cast<std::uint8_t*>(bytes);
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            T little = swap(values[i]);
+            std::memcpy(out + i*sizeof(T), &little, sizeof(T));
+        }
+    }
+}
+
+#endif // ENDIAN_HPP
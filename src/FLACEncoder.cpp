@@ -0,0 +1,838 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "FLACEncoder.hpp"
+#include "WorkerPool.hpp"
+
+#include <algorithm> // For std::min and std::max
+#include <cmath>
+#include <cstdlib> // For std::abs
+#include <limits>
+#include <utility> // For std::swap
+
+// https://xiph.org/flac/format.html
+const std::size_t FLACEncoder::cBlockSize = 4096;
+
+namespace
+{
+    const unsigned cMaxFixedOrder = 4;
+    const unsigned cMaxLPCOrder = 8;
+    const unsigned cMaxPartitionOrder = 8;
+    const unsigned cMaxRiceParameter = 30; // 14 without the 5-bit parameters.
+
+    // Subframe header types.
+    const unsigned cConstantSubframe = 0x00;
+    const unsigned cVerbatimSubframe = 0x01;
+    const unsigned cFixedSubframe = 0x08; // | order
+    const unsigned cLPCSubframe = 0x20; // | (order - 1)
+
+    // Channel assignments of stereo frames.
+    const unsigned cLeftSideChannels = 8;
+    const unsigned cRightSideChannels = 9;
+    const unsigned cMidSideChannels = 10;
+
+    // Writes big-endian bit fields.
+    class BitWriter
+    {
+    private:
+        std::vector<std::uint8_t>& mBytes;
+        std::uint64_t mBits = 0;
+        unsigned mNumBits = 0; // Not yet in mBytes; always under 32.
+
+    public:
+        BitWriter(std::vector<std::uint8_t>& bytes)
+            : mBytes(bytes)
+        {
+
+        }
+
+        // Writes the numBits LSBs of value; numBits is at most 32.
+        void write(std::uint32_t value, unsigned numBits)
+        {
+            if(numBits == 0)
+                return;
+
+            std::uint64_t mask = (std::uint64_t(1) << numBits) - 1;
+            mBits = (mBits << numBits) | (value & mask);
+            mNumBits += numBits;
+
+            if(mNumBits >= 32)
+            {
+                mNumBits -= 32;
+                std::uint32_t word = static_cast<std::uint32_t>(mBits >> mNumBits);
+                std::uint8_t bytes[4] = {static_cast<std::uint8_t>(word >> 24),
+                    static_cast<std::uint8_t>(word >> 16), static_cast<std::uint8_t>(word >> 8),
+                    static_cast<std::uint8_t>(word)};
+                mBytes.insert(mBytes.end(), bytes, bytes + 4);
+            }
+        }
+
+        void writeSigned(std::int64_t value, unsigned numBits)
+        {
+            write(static_cast<std::uint32_t>(value), numBits);
+        }
+
+        // Zigzag-folded value, as quotient in unary then remainder.
+        void writeRice(std::uint32_t folded, unsigned parameter)
+        {
+            std::uint32_t quotient = folded >> parameter;
+            std::uint32_t remainder = folded &
+                ((std::uint32_t(1) << parameter) - 1);
+
+            // Usually, the stop bit and remainder fit in a single write.
+            if(std::uint64_t(quotient) + 1 + parameter <= 32)
+            {
+                write((std::uint32_t(1) << parameter) | remainder,
+                    static_cast<unsigned>(quotient) + 1 + parameter);
+                return;
+            }
+
+            for(; quotient >= 32; quotient -= 32)
+                write(0, 32);
+
+            write(1, static_cast<unsigned>(quotient) + 1);
+            write(remainder, parameter);
+        }
+
+        // FLAC's UTF-8-like coding of frame numbers.
+        void writeUTF8(std::uint64_t value)
+        {
+            if(value < 0x80)
+            {
+                write(static_cast<std::uint32_t>(value), 8);
+                return;
+            }
+
+            unsigned numBytes = 2;
+            while(numBytes < 7 && value >= (std::uint64_t(1) << (5*numBytes + 1)))
+                ++numBytes;
+
+            unsigned firstBits = 7 - numBytes;
+            std::uint32_t first = (0xFF00u >> numBytes) & 0xFF;
+            write(first | (static_cast<std::uint32_t>(value >> (6*(numBytes - 1))) &
+                ((1u << firstBits) - 1)), 8);
+
+            for(unsigned i = numBytes - 1; i > 0; --i)
+                write(0x80 | static_cast<std::uint32_t>((value >> (6*(i - 1))) & 0x3F), 8);
+        }
+
+        // Pads with 0s, and makes all bits available in the bytes.
+        void alignToByte()
+        {
+            if(mNumBits % 8 != 0)
+                write(0, 8 - mNumBits % 8);
+
+            for(; mNumBits > 0; mNumBits -= 8)
+                mBytes.push_back(static_cast<std::uint8_t>(mBits >> (mNumBits - 8)));
+        }
+    };
+
+    std::uint8_t crc8(const std::uint8_t* data, std::size_t size)
+    {
+        std::uint8_t crc = 0;
+        for(std::size_t i = 0; i < size; ++i)
+        {
+            crc ^= data[i];
+            for(int bit = 0; bit < 8; ++bit)
+                crc = static_cast<std::uint8_t>((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+
+        return crc;
+    }
+
+    std::uint16_t crc16(const std::uint8_t* data, std::size_t size)
+    {
+        static const std::vector<std::uint16_t> table = []
+        {
+            std::vector<std::uint16_t> entries(256);
+            for(unsigned i = 0; i < 256; ++i)
+            {
+                std::uint16_t crc = static_cast<std::uint16_t>(i << 8);
+                for(int bit = 0; bit < 8; ++bit)
+                    crc = static_cast<std::uint16_t>((crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1);
+                entries[i] = crc;
+            }
+
+            return entries;
+        }();
+
+        std::uint16_t crc = 0;
+        for(std::size_t i = 0; i < size; ++i)
+            crc = static_cast<std::uint16_t>((crc << 8) ^ table[(crc >> 8) ^ data[i]]);
+
+        return crc;
+    }
+
+    std::uint32_t fold(std::int32_t residual)
+    {
+        // Branchless, since signs are unpredictable.
+        return (static_cast<std::uint32_t>(residual) << 1) ^
+            static_cast<std::uint32_t>(residual >> 31);
+    }
+
+    // How a subframe is coded, and its size in bits.
+    struct Subframe
+    {
+        unsigned type = cVerbatimSubframe;
+        unsigned order = 0;
+        std::vector<std::int32_t> coefficients; // LPC only.
+        unsigned precision = 0;
+        int shift = 0;
+        std::vector<std::int32_t> residual; // From sample 'order'.
+        unsigned partitionOrder = 0;
+        std::vector<unsigned> parameters;
+        std::uint64_t numBits = std::numeric_limits<std::uint64_t>::max();
+    };
+
+    // Picks Rice partitions and parameters for the residual of a subframe,
+    // and returns the size of the coded residual, in bits.
+    std::uint64_t partitionResidual(const std::vector<std::int32_t>& residual,
+        std::size_t blockSize, unsigned order, unsigned& partitionOrder,
+        std::vector<unsigned>& parameters)
+    {
+        unsigned maxPartitionOrder = 0;
+        while(maxPartitionOrder < cMaxPartitionOrder &&
+            blockSize % (std::size_t(1) << (maxPartitionOrder + 1)) == 0 &&
+            (blockSize >> (maxPartitionOrder + 1)) > order)
+            ++maxPartitionOrder;
+
+        // Sums of folded residuals per partition, at the finest order first.
+        std::vector<std::uint64_t> sums(std::size_t(1) << maxPartitionOrder, 0);
+        std::size_t partitionSize = blockSize >> maxPartitionOrder;
+        std::size_t i = 0;
+        for(std::size_t partition = 0; partition < sums.size(); ++partition)
+        {
+            std::size_t end = (partition + 1)*partitionSize - order;
+            for(; i < end; ++i)
+                sums[partition] += fold(residual[i]);
+        }
+
+        std::uint64_t bestNumBits = std::numeric_limits<std::uint64_t>::max();
+        for(int p = maxPartitionOrder; p >= 0; --p)
+        {
+            std::size_t numPartitions = std::size_t(1) << p;
+            std::vector<unsigned> candidates(numPartitions);
+            std::uint64_t numBits = 0;
+            bool needsWideParameters = false;
+
+            for(std::size_t partition = 0; partition < numPartitions; ++partition)
+            {
+                std::uint64_t count = (blockSize >> p) - (partition == 0 ? order : 0);
+                std::uint64_t best = std::numeric_limits<std::uint64_t>::max();
+
+                // Each sample costs its quotient, the stop bit and k bits; the
+                // best k is near log2 of the mean.
+                unsigned estimate = 0;
+                while(estimate < cMaxRiceParameter && (count << (estimate + 1)) <= sums[partition])
+                    ++estimate;
+
+                for(unsigned k = estimate > 0 ? estimate - 1 : 0;
+                    k <= std::min(estimate + 1, cMaxRiceParameter); ++k)
+                {
+                    std::uint64_t cost = count*(k + 1) + (sums[partition] >> k);
+                    if(cost < best)
+                    {
+                        best = cost;
+                        candidates[partition] = k;
+                    }
+                }
+
+                numBits += best;
+                needsWideParameters |= candidates[partition] > 14;
+            }
+
+            numBits += 2 + 4 + numPartitions*(needsWideParameters ? 5 : 4);
+            if(numBits < bestNumBits)
+            {
+                bestNumBits = numBits;
+                partitionOrder = p;
+                parameters = candidates;
+            }
+
+            // Merge pairs of partitions for the next, coarser order.
+            for(std::size_t partition = 0; partition < numPartitions/2; ++partition)
+                sums[partition] = sums[2*partition] + sums[2*partition + 1];
+        }
+
+        return bestNumBits;
+    }
+
+    std::int64_t predictFixed(const std::int32_t* x, unsigned order)
+    {
+        switch(order)
+        {
+        case 1: return x[-1];
+        case 2: return 2*std::int64_t(x[-1]) - x[-2];
+        case 3: return 3*(std::int64_t(x[-1]) - x[-2]) + x[-3];
+        case 4: return 4*(std::int64_t(x[-1]) + x[-3]) - 6*std::int64_t(x[-2]) - x[-4];
+        default: return 0;
+        }
+    }
+
+    // Predicts with the fixed polynomial whose residual is the smallest.
+    void tryFixed(const std::int32_t* samples, std::size_t blockSize, unsigned bitsPerSample,
+        Subframe& best, Subframe& candidate)
+    {
+        unsigned maxOrder = static_cast<unsigned>(std::min<std::size_t>(cMaxFixedOrder, blockSize - 1));
+
+        // The residual of order k is the k-th difference of the samples;
+        // differences before sample k are wrong, but not summed.
+        std::uint64_t sums[cMaxFixedOrder + 1] = {0};
+        std::int32_t last0 = 0, last1 = 0, last2 = 0, last3 = 0;
+        for(std::size_t i = 0; i < blockSize; ++i)
+        {
+            std::int32_t error0 = samples[i];
+            std::int32_t error1 = error0 - last0;
+            std::int32_t error2 = error1 - last1;
+            std::int32_t error3 = error2 - last2;
+            std::int32_t error4 = error3 - last3;
+            last0 = error0;
+            last1 = error1;
+            last2 = error2;
+            last3 = error3;
+
+            if(i >= maxOrder)
+            {
+                sums[0] += std::abs(error0);
+                sums[1] += std::abs(error1);
+                sums[2] += std::abs(error2);
+                sums[3] += std::abs(error3);
+                sums[4] += std::abs(error4);
+            }
+        }
+
+        unsigned order = static_cast<unsigned>(
+            std::min_element(sums, sums + maxOrder + 1) - sums);
+
+        candidate.residual.resize(blockSize - order);
+        for(std::size_t i = order; i < blockSize; ++i)
+            candidate.residual[i - order] =
+                static_cast<std::int32_t>(samples[i] - predictFixed(samples + i, order));
+
+        std::uint64_t numBits = 8 + order*bitsPerSample +
+            partitionResidual(candidate.residual, blockSize, order,
+                candidate.partitionOrder, candidate.parameters);
+
+        if(numBits < best.numBits)
+        {
+            candidate.type = cFixedSubframe | order;
+            candidate.order = order;
+            candidate.numBits = numBits;
+            std::swap(best, candidate);
+        }
+    }
+
+    // Residual of an LPC predictor of fixed order, with sums of type T.
+    // Returns false if the residual does not fit in 32 bits.
+    template<unsigned order, class T>
+    bool lpc_residual(const std::int32_t* samples, std::size_t blockSize,
+        const std::int32_t* coefficients, int shift, std::int32_t* residual)
+    {
+        T quantized[order];
+        for(unsigned j = 0; j < order; ++j)
+            quantized[j] = coefficients[j];
+
+        bool fits = true;
+        for(std::size_t i = order; i < blockSize; ++i)
+        {
+            T prediction = 0;
+            for(unsigned j = 0; j < order; ++j)
+                prediction += quantized[j] * samples[i - 1 - j];
+
+            std::int64_t error = samples[i] - static_cast<std::int64_t>(prediction >> shift);
+            fits &= error >= std::numeric_limits<std::int32_t>::min() &&
+                error <= std::numeric_limits<std::int32_t>::max();
+            residual[i - order] = static_cast<std::int32_t>(error);
+        }
+
+        return fits;
+    }
+
+    template<class T>
+    bool lpc_residual(const std::int32_t* samples, std::size_t blockSize,
+        const std::vector<std::int32_t>& coefficients, int shift, std::int32_t* residual)
+    {
+        const std::int32_t* c = coefficients.data();
+        switch(coefficients.size())
+        {
+        case 1: return lpc_residual<1, T>(samples, blockSize, c, shift, residual);
+        case 2: return lpc_residual<2, T>(samples, blockSize, c, shift, residual);
+        case 3: return lpc_residual<3, T>(samples, blockSize, c, shift, residual);
+        case 4: return lpc_residual<4, T>(samples, blockSize, c, shift, residual);
+        case 5: return lpc_residual<5, T>(samples, blockSize, c, shift, residual);
+        case 6: return lpc_residual<6, T>(samples, blockSize, c, shift, residual);
+        case 7: return lpc_residual<7, T>(samples, blockSize, c, shift, residual);
+        default: return lpc_residual<8, T>(samples, blockSize, c, shift, residual);
+        }
+    }
+
+    // Predictions of small samples can be summed in 32 bits, which is faster.
+    bool computeLPCResidual(const std::int32_t* samples, std::size_t blockSize,
+        unsigned bitsPerSample, const std::vector<std::int32_t>& coefficients,
+        unsigned precision, int shift, std::int32_t* residual)
+    {
+        unsigned orderBits = 0;
+        while((1u << orderBits) < coefficients.size())
+            ++orderBits;
+
+        if(bitsPerSample + precision + orderBits <= 32)
+            return lpc_residual<std::int32_t>(samples, blockSize, coefficients, shift, residual);
+
+        return lpc_residual<std::int64_t>(samples, blockSize, coefficients, shift, residual);
+    }
+
+    // Tukey(0.5) window, tapering the ends of blocks.
+    std::vector<double> createWindow(std::size_t blockSize)
+    {
+        std::vector<double> window(blockSize, 1.0);
+        double taper = blockSize / 4.0;
+        const double pi = 3.14159265358979323846;
+
+        for(std::size_t i = 0; i < blockSize; ++i)
+        {
+            if(i < taper)
+                window[i] = 0.5 - 0.5*std::cos(pi * i / taper);
+            else if(i >= blockSize - taper)
+                window[i] = 0.5 - 0.5*std::cos(pi * (blockSize - 1 - i) / taper);
+        }
+
+        return window;
+    }
+
+    // Predicts with linear prediction coefficients, from the autocorrelation
+    // of the windowed block. The order is the one whose prediction error
+    // promises the smallest subframe.
+    void tryLPC(const std::int32_t* samples, std::size_t blockSize, unsigned bitsPerSample,
+        Subframe& best, Subframe& candidate)
+    {
+        unsigned maxOrder = static_cast<unsigned>(std::min<std::size_t>(cMaxLPCOrder, blockSize - 1));
+        if(maxOrder == 0)
+            return;
+
+        // Full blocks share their window.
+        static const std::vector<double> blockWindow = createWindow(FLACEncoder::cBlockSize);
+        std::vector<double> otherWindow;
+        const double* window = blockWindow.data();
+        if(blockSize != FLACEncoder::cBlockSize)
+        {
+            otherWindow = createWindow(blockSize);
+            window = otherWindow.data();
+        }
+
+        // Starts with zeros, so every lag can be summed over the whole block.
+        std::vector<double> windowed(cMaxLPCOrder + blockSize, 0.0);
+        for(std::size_t i = 0; i < blockSize; ++i)
+            windowed[cMaxLPCOrder + i] = samples[i] * window[i];
+
+        // Lags in the inner loop, so sums do not wait on each other.
+        double autocorrelation[cMaxLPCOrder + 1] = {0.0};
+        for(std::size_t i = cMaxLPCOrder; i < windowed.size(); ++i)
+        {
+            for(unsigned lag = 0; lag <= cMaxLPCOrder; ++lag)
+                autocorrelation[lag] += windowed[i] * windowed[i - lag];
+        }
+
+        if(autocorrelation[0] == 0.0)
+            return; // Silence; fixed prediction is as good.
+
+        // Levinson-Durbin recursion, keeping the coefficients of every order.
+        // Predicts x[i] as the sum of lpc[order - 1][j] * x[i - 1 - j].
+        double lpc[cMaxLPCOrder][cMaxLPCOrder] = {{0.0}};
+        double error = autocorrelation[0];
+        unsigned precision = bitsPerSample <= 16 ? 12 : 15;
+        unsigned bestOrder = 0;
+        double bestEstimate = 0.0;
+
+        for(unsigned order = 1; order <= maxOrder; ++order)
+        {
+            const double* previous = order > 1 ? lpc[order - 2] : lpc[0];
+            double reflection = autocorrelation[order];
+            for(unsigned j = 0; j < order - 1; ++j)
+                reflection -= previous[j] * autocorrelation[order - 1 - j];
+            reflection /= error;
+
+            for(unsigned j = 0; j < order - 1; ++j)
+                lpc[order - 1][j] = previous[j] - reflection * previous[order - 2 - j];
+            lpc[order - 1][order - 1] = reflection;
+            error *= 1.0 - reflection*reflection;
+
+            // Laplacian residuals of that variance need about this many bits.
+            double bitsPerResidual = error > 0.0 ?
+                std::max(0.0, 0.5*std::log2(0.5*error / blockSize)) : 0.0;
+            double estimate = order*(bitsPerSample + precision) +
+                bitsPerResidual*(blockSize - order);
+            if(bestOrder == 0 || estimate < bestEstimate)
+            {
+                bestOrder = order;
+                bestEstimate = estimate;
+            }
+
+            if(error <= 0.0)
+                break;
+        }
+
+        // Quantize, carrying rounding errors over.
+        unsigned order = bestOrder;
+        const double* coefficients = lpc[order - 1];
+        double maxCoefficient = 0.0;
+        for(unsigned j = 0; j < order; ++j)
+            maxCoefficient = std::max(maxCoefficient, std::fabs(coefficients[j]));
+        if(maxCoefficient == 0.0)
+            return;
+
+        int exponent = 0;
+        std::frexp(maxCoefficient, &exponent);
+        int shift = std::min(15, static_cast<int>(precision) - 1 - exponent);
+        if(shift < 0)
+            return;
+
+        std::int32_t maxQuantized = (1 << (precision - 1)) - 1;
+        candidate.coefficients.resize(order);
+        double carry = 0.0;
+        for(unsigned j = 0; j < order; ++j)
+        {
+            double scaled = coefficients[j] * (1 << shift) + carry;
+            std::int32_t quantized = static_cast<std::int32_t>(std::lround(scaled));
+            quantized = std::max(-maxQuantized - 1, std::min(maxQuantized, quantized));
+            carry = scaled - quantized;
+            candidate.coefficients[j] = quantized;
+        }
+
+        candidate.residual.resize(blockSize - order);
+        if(!computeLPCResidual(samples, blockSize, bitsPerSample, candidate.coefficients,
+            precision, shift, candidate.residual.data()))
+            return;
+
+        std::uint64_t numBits = 8 + order*bitsPerSample + 4 + 5 + order*precision +
+            partitionResidual(candidate.residual, blockSize, order,
+                candidate.partitionOrder, candidate.parameters);
+
+        if(numBits < best.numBits)
+        {
+            candidate.type = cLPCSubframe | (order - 1);
+            candidate.order = order;
+            candidate.precision = precision;
+            candidate.shift = shift;
+            candidate.numBits = numBits;
+            std::swap(best, candidate);
+        }
+    }
+
+    Subframe chooseSubframe(const std::int32_t* samples, std::size_t blockSize,
+        unsigned bitsPerSample)
+    {
+        Subframe best;
+
+        if(std::all_of(samples, samples + blockSize,
+            [samples](std::int32_t sample) { return sample == samples[0]; }))
+        {
+            best.type = cConstantSubframe;
+            best.numBits = 8 + bitsPerSample;
+            return best;
+        }
+
+        best.type = cVerbatimSubframe;
+        best.numBits = 8 + blockSize*bitsPerSample;
+
+        Subframe candidate;
+        tryFixed(samples, blockSize, bitsPerSample, best, candidate);
+        tryLPC(samples, blockSize, bitsPerSample, best, candidate);
+        return best;
+    }
+
+    void writeSubframe(BitWriter& writer, const Subframe& subframe,
+        const std::int32_t* samples, std::size_t blockSize, unsigned bitsPerSample)
+    {
+        writer.write(subframe.type << 1, 8); // No wasted bits.
+
+        if(subframe.type == cConstantSubframe)
+        {
+            writer.writeSigned(samples[0], bitsPerSample);
+            return;
+        } else if(subframe.type == cVerbatimSubframe)
+        {
+            for(std::size_t i = 0; i < blockSize; ++i)
+                writer.writeSigned(samples[i], bitsPerSample);
+            return;
+        }
+
+        // Warm-up samples.
+        for(unsigned i = 0; i < subframe.order; ++i)
+            writer.writeSigned(samples[i], bitsPerSample);
+
+        if(subframe.type >= cLPCSubframe)
+        {
+            writer.write(subframe.precision - 1, 4);
+            writer.writeSigned(subframe.shift, 5);
+            for(std::int32_t coefficient : subframe.coefficients)
+                writer.writeSigned(coefficient, subframe.precision);
+        }
+
+        bool wideParameters = std::any_of(subframe.parameters.begin(),
+            subframe.parameters.end(), [](unsigned parameter) { return parameter > 14; });
+        writer.write(wideParameters ? 1 : 0, 2);
+        writer.write(subframe.partitionOrder, 4);
+
+        std::size_t partitionSize = blockSize >> subframe.partitionOrder;
+        std::size_t i = 0;
+        for(std::size_t partition = 0; partition < subframe.parameters.size(); ++partition)
+        {
+            unsigned parameter = subframe.parameters[partition];
+            writer.write(parameter, wideParameters ? 5 : 4);
+
+            std::size_t end = (partition + 1)*partitionSize - subframe.order;
+            for(; i < end; ++i)
+                writer.writeRice(fold(subframe.residual[i]), parameter);
+        }
+    }
+}
+
+FLACEncoder::FLACEncoder(SampleSink& output, std::size_t numChannels,
+    unsigned bitsPerSample, WorkerPool* pool)
+    : mOutput(output),
+      mNumChannels(numChannels),
+      mBitsPerSample(bitsPerSample),
+      mPool(pool)
+{
+    // A few blocks per thread, so threads finishing early have more to do.
+    mBatchSize = mPool != nullptr ? 4*mPool->getNumThreads() : 1;
+    mSamples.resize(mBatchSize * cBlockSize * mNumChannels);
+    mFrames.resize(mBatchSize);
+}
+
+// Static
+bool FLACEncoder::isSupported(std::size_t numChannels, unsigned bitsPerSample)
+{
+    return numChannels >= 1 && numChannels <= 8 &&
+        (bitsPerSample == 8 || bitsPerSample == 16 || bitsPerSample == 24);
+}
+
+// Encodes one frame, with its header and footer.
+void FLACEncoder::encodeFrame(const std::int32_t* samples, std::size_t blockSize,
+    std::uint64_t frameNumber, std::vector<std::uint8_t>& frame) const
+{
+    // Deinterleave.
+    std::vector<std::vector<std::int32_t>> channels(mNumChannels,
+        std::vector<std::int32_t>(blockSize));
+    for(std::size_t i = 0; i < blockSize; ++i)
+    {
+        for(std::size_t channel = 0; channel < mNumChannels; ++channel)
+            channels[channel][i] = samples[i*mNumChannels + channel];
+    }
+
+    std::vector<Subframe> subframes;
+    std::vector<unsigned> subframeBits(mNumChannels, mBitsPerSample);
+    unsigned channelAssignment = static_cast<unsigned>(mNumChannels - 1); // Independent.
+
+    for(std::size_t channel = 0; channel < mNumChannels; ++channel)
+        subframes.push_back(chooseSubframe(channels[channel].data(), blockSize, mBitsPerSample));
+
+    if(mNumChannels == 2)
+    {
+        // Side needs one more bit.
+        std::vector<std::int32_t> mid(blockSize);
+        std::vector<std::int32_t> side(blockSize);
+        for(std::size_t i = 0; i < blockSize; ++i)
+        {
+            mid[i] = (channels[0][i] + channels[1][i]) >> 1;
+            side[i] = channels[0][i] - channels[1][i];
+        }
+
+        Subframe midSubframe = chooseSubframe(mid.data(), blockSize, mBitsPerSample);
+        Subframe sideSubframe = chooseSubframe(side.data(), blockSize, mBitsPerSample + 1);
+
+        std::uint64_t independentBits = subframes[0].numBits + subframes[1].numBits;
+        std::uint64_t leftSideBits = subframes[0].numBits + sideSubframe.numBits;
+        std::uint64_t rightSideBits = sideSubframe.numBits + subframes[1].numBits;
+        std::uint64_t midSideBits = midSubframe.numBits + sideSubframe.numBits;
+        std::uint64_t bestBits = std::min(std::min(independentBits, leftSideBits),
+            std::min(rightSideBits, midSideBits));
+
+        if(bestBits == midSideBits)
+        {
+            channelAssignment = cMidSideChannels;
+            channels[0] = mid;
+            channels[1] = side;
+            subframes[0] = midSubframe;
+            subframes[1] = sideSubframe;
+            subframeBits[1] += 1;
+        } else if(bestBits == leftSideBits)
+        {
+            channelAssignment = cLeftSideChannels;
+            channels[1] = side;
+            subframes[1] = sideSubframe;
+            subframeBits[1] += 1;
+        } else if(bestBits == rightSideBits)
+        {
+            channelAssignment = cRightSideChannels;
+            channels[0] = side;
+            subframes[0] = sideSubframe;
+            subframeBits[0] += 1;
+        }
+    }
+
+    frame.clear();
+    frame.reserve(blockSize*mNumChannels*(mBitsPerSample + 1)/8 + 32); // Verbatim size.
+    BitWriter writer(frame);
+
+    // Header.
+    unsigned blockSizeCode = blockSize == cBlockSize ? 12 : (blockSize <= 256 ? 6 : 7);
+    unsigned sampleSizeCode = mBitsPerSample == 8 ? 1 : (mBitsPerSample == 16 ? 4 : 6);
+
+    writer.write(0x3FFE, 14); // Sync code.
+    writer.write(0, 1);
+    writer.write(0, 1); // Fixed block size.
+    writer.write(blockSizeCode, 4);
+    writer.write(0, 4); // Sample rate from STREAMINFO.
+    writer.write(channelAssignment, 4);
+    writer.write(sampleSizeCode, 3);
+    writer.write(0, 1);
+    writer.writeUTF8(frameNumber);
+    if(blockSizeCode == 6)
+        writer.write(static_cast<std::uint32_t>(blockSize - 1), 8);
+    else if(blockSizeCode == 7)
+        writer.write(static_cast<std::uint32_t>(blockSize - 1), 16);
+
+    writer.alignToByte();
+    writer.write(crc8(frame.data(), frame.size()), 8);
+
+    for(std::size_t channel = 0; channel < mNumChannels; ++channel)
+    {
+        writeSubframe(writer, subframes[channel], channels[channel].data(), blockSize,
+            subframeBits[channel]);
+    }
+
+    writer.alignToByte();
+    std::uint16_t crc = crc16(frame.data(), frame.size());
+    writer.write(crc, 16);
+    writer.alignToByte();
+}
+
+// Returns true on success, false on failure.
+bool FLACEncoder::encodeBatch()
+{
+    std::size_t frameSize = cBlockSize * mNumChannels;
+    std::size_t numBlocks = (mNumSamples + frameSize - 1) / frameSize;
+
+    for(std::size_t block = 0; block < numBlocks; ++block)
+    {
+        const std::int32_t* samples = mSamples.data() + block*frameSize;
+        std::size_t blockSize = std::min(frameSize, mNumSamples - block*frameSize) /
+            mNumChannels;
+        std::uint64_t frameNumber = mNumFrames + block;
+        std::vector<std::uint8_t>& frame = mFrames[block];
+
+        if(mPool != nullptr && numBlocks > 1)
+        {
+            mPool->submit([this, samples, blockSize, frameNumber, &frame]
+            {
+                encodeFrame(samples, blockSize, frameNumber, frame);
+            });
+        } else
+        {
+            encodeFrame(samples, blockSize, frameNumber, frame);
+        }
+    }
+
+    if(mPool != nullptr && numBlocks > 1)
+        mPool->wait();
+
+    mNumSamples = 0;
+    mNumFrames += numBlocks;
+
+    for(std::size_t block = 0; block < numBlocks; ++block)
+    {
+        std::size_t size = mFrames[block].size();
+        mMinFrameSize = mMinFrameSize == 0 ? size : std::min(mMinFrameSize, size);
+        mMaxFrameSize = std::max(mMaxFrameSize, size);
+
+        if(!mOutput.write(mFrames[block].data(), size))
+            return false;
+    }
+
+    return true;
+}
+
+// Little-endian; 8-bit samples are unsigned.
+std::int32_t FLACEncoder::readSample(const std::uint8_t* bytes) const
+{
+    if(mBitsPerSample == 8)
+        return static_cast<std::int32_t>(bytes[0]) - 128;
+
+    std::uint32_t bits = 0;
+    for(unsigned byte = 0; byte < mBitsPerSample/8; ++byte)
+        bits |= static_cast<std::uint32_t>(bytes[byte]) << (8*byte);
+
+    // Sign-extend.
+    unsigned unusedBits = 32 - mBitsPerSample;
+    return static_cast<std::int32_t>(bits << unusedBits) >> unusedBits;
+}
+
+// Returns true on success, false on failure.
+bool FLACEncoder::addSample(std::int32_t sample)
+{
+    mSamples[mNumSamples++] = sample;
+    return mNumSamples < mSamples.size() || encodeBatch();
+}
+
+// Returns true on success, false on failure.
+bool FLACEncoder::write(const std::uint8_t* data, std::size_t size)
+{
+    std::size_t bytesPerSample = mBitsPerSample/8;
+    const std::uint8_t* end = data + size;
+
+    // Complete a sample split across writes.
+    while(!mPendingBytes.empty() && data < end)
+    {
+        mPendingBytes.push_back(*data++);
+        if(mPendingBytes.size() == bytesPerSample)
+        {
+            std::int32_t sample = readSample(mPendingBytes.data());
+            mPendingBytes.clear();
+            if(!addSample(sample))
+                return false;
+        }
+    }
+
+    for(; end - data >= static_cast<std::ptrdiff_t>(bytesPerSample); data += bytesPerSample)
+    {
+        if(!addSample(readSample(data)))
+            return false;
+    }
+
+    mPendingBytes.insert(mPendingBytes.end(), data, end);
+    return true;
+}
+
+// Returns true on success, false on failure.
+bool FLACEncoder::finish()
+{
+    if(mNumSamples == 0)
+        return true;
+
+    return encodeBatch();
+}
+
+std::size_t FLACEncoder::getMinFrameSize() const
+{
+    return mMinFrameSize;
+}
+
+std::size_t FLACEncoder::getMaxFrameSize() const
+{
+    return mMaxFrameSize;
+}
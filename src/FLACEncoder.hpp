@@ -0,0 +1,79 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef FLAC_ENCODER_HPP
+#define FLAC_ENCODER_HPP
+
+#include "SampleSink.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class WorkerPool;
+
+// Encodes little-endian interleaved PCM into FLAC frames, written to another
+// sink. Each block is predicted with the best fixed or LPC predictor, and
+// its residual is Rice-coded; stereo blocks may also use mid/side coding.
+// Given a worker pool, batches of blocks are encoded in parallel, and written
+// in order.
+class FLACEncoder : public SampleSink
+{
+private:
+    std::int32_t readSample(const std::uint8_t* bytes) const;
+    bool addSample(std::int32_t sample);
+    bool encodeBatch();
+    void encodeFrame(const std::int32_t* samples, std::size_t blockSize,
+        std::uint64_t frameNumber, std::vector<std::uint8_t>& frame) const;
+
+    SampleSink& mOutput;
+    std::size_t mNumChannels;
+    unsigned mBitsPerSample;
+    WorkerPool* mPool;
+
+    std::size_t mBatchSize; // In blocks.
+    std::vector<std::int32_t> mSamples; // Interleaved, for a whole batch.
+    std::size_t mNumSamples = 0;
+    std::vector<std::vector<std::uint8_t>> mFrames; // Encoded batch.
+    std::uint64_t mNumFrames = 0; // Written so far.
+
+    std::vector<std::uint8_t> mPendingBytes; // Sample split across writes.
+
+    std::size_t mMinFrameSize = 0;
+    std::size_t mMaxFrameSize = 0;
+
+public:
+    static const std::size_t cBlockSize;
+
+    // pool may be nullptr, to encode on the calling thread.
+    FLACEncoder(SampleSink& output, std::size_t numChannels, unsigned bitsPerSample,
+        WorkerPool* pool);
+
+    static bool isSupported(std::size_t numChannels, unsigned bitsPerSample);
+
+    bool write(const std::uint8_t* data, std::size_t size) override;
+
+    // Encodes and writes the last, possibly shorter, block.
+    // Returns true on success, false on failure.
+    bool finish();
+
+    // In bytes, of the frames written so far.
+    std::size_t getMinFrameSize() const;
+    std::size_t getMaxFrameSize() const;
+};
+
+#endif // FLAC_ENCODER_HPP
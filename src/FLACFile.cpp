@@ -0,0 +1,177 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "FLACFile.hpp"
+#include "FLACEncoder.hpp"
+#include "Log.hpp"
+#include "SndFile.hpp"
+#include "SampleSink.hpp"
+
+#include <cstddef> // For std::size_t
+
+std::ostream& operator<<(std::ostream& lhs, const FLACStreamInfo& rhs)
+{
+    lhs <<
+        "Generated FLAC stream info:" << std::endl <<
+        " -- Block size: " << rhs.minBlockSize << " to " << rhs.maxBlockSize << std::endl <<
+        " -- Frame size: " << rhs.minFrameSize << " to " << rhs.maxFrameSize << std::endl <<
+        " -- Sample rate: " << rhs.sampleRate << std::endl <<
+        " -- Number of channels: " << static_cast<unsigned>(rhs.numChannels) << std::endl <<
+        " -- Bits per sample: " << static_cast<unsigned>(rhs.bitsPerSample) << std::endl <<
+        " -- Number of samples: " << rhs.numSamples;
+
+    return lhs;
+}
+
+FLACFile::FLACFile()
+{
+}
+
+FLACFile::~FLACFile()
+{
+}
+
+void FLACFile::setWorkerPool(WorkerPool* pool)
+{
+    mPool = pool;
+}
+
+const FLACStreamInfo& FLACFile::getStreamInfo() const
+{
+    return mStreamInfo;
+}
+
+// Returns true on success, false on failure.
+bool FLACFile::populateHeader(const SndFile& sndFile)
+{
+    if(!sndFile.isValid())
+    {
+        Log::err << "Error: cannot convert invalid snd file!" << std::endl;
+        return false;
+    }
+
+    std::size_t numChannels = sndFile.getDecodedNumChannels();
+    unsigned bitsPerSample = sndFile.getDecoder().getBitsPerSample();
+
+    if(!FLACEncoder::isSupported(numChannels, bitsPerSample))
+    {
+        Log::err << "Error: cannot encode " << numChannels << "-channel, " <<
+            bitsPerSample << "-bit sound to FLAC; only 1 to 8 channels of 8, 16 " <<
+            "or 24-bit samples are supported." << std::endl;
+        return false;
+    }
+
+    mStreamInfo = FLACStreamInfo();
+    mStreamInfo.minBlockSize = FLACEncoder::cBlockSize;
+    mStreamInfo.maxBlockSize = FLACEncoder::cBlockSize;
+
+    // Snd sample rate is an unsigned 32-bit fixed-point.
+    // We only keep the integer part!
+    mStreamInfo.sampleRate = sndFile.getDecodedSampleRate() >> 16;
+    mStreamInfo.numChannels = numChannels;
+    mStreamInfo.bitsPerSample = bitsPerSample;
+    mStreamInfo.numSamples = sndFile.getDecodedSize() / (numChannels * bitsPerSample/8);
+
+    if(mStreamInfo.sampleRate == 0)
+    {
+        Log::err << "Error: cannot encode sound with a sample rate under 1 Hz to FLAC." <<
+            std::endl;
+        return false;
+    }
+
+    // Debug info.
+    Log::verb << mStreamInfo << std::endl;
+
+    return true;
+}
+
+void FLACFile::writeHeader(std::ostream& outputStream)
+{
+    std::uint8_t header[42] = {'f', 'L', 'a', 'C',
+        0x80, 0, 0, 34}; // Last metadata block, STREAMINFO, of 34 bytes.
+    std::uint8_t* streamInfo = header + 8;
+
+    streamInfo[0] = static_cast<std::uint8_t>(mStreamInfo.minBlockSize >> 8);
+    streamInfo[1] = static_cast<std::uint8_t>(mStreamInfo.minBlockSize);
+    streamInfo[2] = static_cast<std::uint8_t>(mStreamInfo.maxBlockSize >> 8);
+    streamInfo[3] = static_cast<std::uint8_t>(mStreamInfo.maxBlockSize);
+    for(int i = 0; i < 3; ++i)
+    {
+        streamInfo[4 + i] = static_cast<std::uint8_t>(mStreamInfo.minFrameSize >> (16 - 8*i));
+        streamInfo[7 + i] = static_cast<std::uint8_t>(mStreamInfo.maxFrameSize >> (16 - 8*i));
+    }
+
+    // 20 bits of sample rate, 3 of channels - 1, 5 of bits per sample - 1 and
+    // 36 of number of samples.
+    std::uint64_t fields =
+        (static_cast<std::uint64_t>(mStreamInfo.sampleRate) << 44) |
+        (static_cast<std::uint64_t>(mStreamInfo.numChannels - 1) << 41) |
+        (static_cast<std::uint64_t>(mStreamInfo.bitsPerSample - 1) << 36) |
+        (mStreamInfo.numSamples & 0xFFFFFFFFFULL);
+    for(int i = 0; i < 8; ++i)
+        streamInfo[10 + i] = static_cast<std::uint8_t>(fields >> (56 - 8*i));
+
+    for(int i = 0; i < 16; ++i)
+        streamInfo[18 + i] = mStreamInfo.MD5[i];
+
+    outputStream.write(reinterpret_cast<const char*>(header), sizeof(header));
+}
+
+// Returns true on success, false on failure.
+bool FLACFile::begin(SndFile& sndFile, std::ostream& outputStream)
+{
+    if(!populateHeader(sndFile))
+        return false; // Error messages already dealt with.
+
+    mOutputStream = &outputStream;
+    mHeaderPosition = outputStream.tellp();
+    writeHeader(outputStream);
+
+    // Sample data is encoded as it is decoded.
+    mEncoder.reset();
+    mStreamSink.reset(new StreamSampleSink(outputStream));
+    mEncoder.reset(new FLACEncoder(*mStreamSink, mStreamInfo.numChannels,
+        mStreamInfo.bitsPerSample, mPool));
+
+    return !outputStream.fail();
+}
+
+SampleSink* FLACFile::getSampleSink()
+{
+    return mEncoder.get();
+}
+
+// Returns true on success, false on failure.
+bool FLACFile::finish()
+{
+    if(!mEncoder->finish() || mOutputStream->fail())
+        return false;
+
+    mStreamInfo.minFrameSize = mEncoder->getMinFrameSize();
+    mStreamInfo.maxFrameSize = mEncoder->getMaxFrameSize();
+
+    // Frame sizes are only known now; fill them in if the stream can seek.
+    if(mHeaderPosition != std::ostream::pos_type(-1))
+    {
+        std::ostream::pos_type endPosition = mOutputStream->tellp();
+        mOutputStream->seekp(mHeaderPosition);
+        writeHeader(*mOutputStream);
+        mOutputStream->seekp(endPosition);
+    }
+
+    return !mOutputStream->fail();
+}
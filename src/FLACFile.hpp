@@ -0,0 +1,77 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef FLAC_FILE_HPP
+#define FLAC_FILE_HPP
+
+#include "SoundWriter.hpp"
+
+#include <ostream>
+#include <string>
+#include <cstdint> // Fixed-width types
+#include <memory>
+
+class FLACStreamInfo
+{
+public:
+    // https://xiph.org/flac/format.html#metadata_block_streaminfo
+    std::uint16_t minBlockSize = 0;
+    std::uint16_t maxBlockSize = 0;
+    std::uint32_t minFrameSize = 0; // 0 if unknown.
+    std::uint32_t maxFrameSize = 0; // 0 if unknown.
+    std::uint32_t sampleRate = 0;
+    std::uint8_t numChannels = 0;
+    std::uint8_t bitsPerSample = 0;
+    std::uint64_t numSamples = 0; // Per channel.
+    std::uint8_t MD5[16] = {0}; // All 0s means unknown.
+};
+
+std::ostream& operator<<(std::ostream& lhs, const FLACStreamInfo& rhs);
+
+class SndFile;
+class WorkerPool;
+class FLACEncoder;
+class FLACFile : public SoundWriter
+{
+private:
+    FLACStreamInfo mStreamInfo;
+    WorkerPool* mPool = nullptr;
+
+    std::ostream* mOutputStream = nullptr;
+    std::ostream::pos_type mHeaderPosition;
+    std::unique_ptr<StreamSampleSink> mStreamSink;
+    std::unique_ptr<FLACEncoder> mEncoder;
+
+    void writeHeader(std::ostream& outputStream);
+
+public:
+    FLACFile();
+    ~FLACFile();
+
+    // Encodes blocks in parallel on pool, which must not run other jobs
+    // meanwhile. By default, encodes on the calling thread.
+    void setWorkerPool(WorkerPool* pool);
+
+    bool populateHeader(const SndFile& sndFile);
+    const FLACStreamInfo& getStreamInfo() const;
+
+    bool begin(SndFile& sndFile, std::ostream& outputStream) override;
+    SampleSink* getSampleSink() override;
+    bool finish() override;
+};
+
+#endif // FLAC_FILE_HPP
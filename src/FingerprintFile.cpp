@@ -0,0 +1,131 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "FingerprintFile.hpp"
+#include "Endian.hpp"
+#include "Log.hpp"
+#include "SndFile.hpp"
+
+#include <algorithm> // For std::copy and std::equal
+
+const std::uint16_t FingerprintFile::cVersion = 2;
+
+// Returns true on success, false on failure.
+bool FingerprintFile::begin(SndFile& sndFile, std::ostream& outputStream)
+{
+    if(!sndFile.isValid())
+    {
+        Log::err << "Error: cannot convert invalid snd file!" << std::endl;
+        return false;
+    }
+
+    unsigned bitsPerSample = sndFile.getDecoder().getBitsPerSample();
+    std::uint32_t sampleRate = sndFile.getDecodedSampleRate();
+    if(!Fingerprinter::isSupported(bitsPerSample) || sampleRate == 0)
+    {
+        Log::err << "Error: cannot fingerprint " << bitsPerSample << "-bit samples " <<
+            "without a sample rate; only sounds with a sample rate, and 8, 16, 24 or " <<
+            "32-bit samples, can be fingerprinted." << std::endl;
+        return false;
+    }
+
+    std::size_t numChannels = sndFile.getDecodedNumChannels();
+    mOutputStream = &outputStream;
+    mFingerprinter.reset(new Fingerprinter(numChannels, bitsPerSample));
+
+    if(sampleRate != Fingerprinter::cSampleRate << 16)
+    {
+        mResampler.reset(new Resampler(*mFingerprinter, numChannels, bitsPerSample,
+            sampleRate, Fingerprinter::cSampleRate << 16));
+    }
+
+    return true;
+}
+
+SampleSink* FingerprintFile::getSampleSink()
+{
+    if(mResampler != nullptr)
+        return mResampler.get();
+
+    return mFingerprinter.get();
+}
+
+// Returns true on success, false on failure.
+bool FingerprintFile::finish()
+{
+    if(mResampler != nullptr && !mResampler->finish())
+        return false;
+
+    mFingerprinter->finish();
+    const std::vector<std::uint32_t>& subFingerprints = mFingerprinter->getSubFingerprints();
+    const std::vector<std::uint32_t>& masks = mFingerprinter->getMasks();
+
+    std::uint8_t header[16];
+    std::uint16_t hopSize = static_cast<std::uint16_t>(Fingerprinter::cHopSize);
+    std::uint32_t sizes[2] = {Fingerprinter::cSampleRate,
+        static_cast<std::uint32_t>(subFingerprints.size())};
+
+    const std::uint8_t ID[4] = {'F', 'P', 'R', 'T'};
+    std::copy(ID, ID + 4, header);
+    Endian::storeLittle(&cVersion, 1, header + 4);
+    Endian::storeLittle(&hopSize, 1, header + 6);
+    Endian::storeLittle(sizes, 2, header + 8);
+    mOutputStream->write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    std::vector<std::uint8_t> bytes(2 * subFingerprints.size() * sizeof(std::uint32_t));
+    Endian::storeLittle(subFingerprints.data(), subFingerprints.size(), bytes.data());
+    Endian::storeLittle(masks.data(), masks.size(),
+        bytes.data() + subFingerprints.size() * sizeof(std::uint32_t));
+    mOutputStream->write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+
+    return !mOutputStream->fail();
+}
+
+// Static
+// Only reads fingerprints of this version, at the rate of the fingerprinter,
+// which are the only ones comparable with each other.
+// Returns true on success, false on failure.
+bool FingerprintFile::read(std::istream& inputStream, std::vector<std::uint32_t>& subFingerprints,
+    std::vector<std::uint32_t>& masks)
+{
+    std::uint8_t header[16];
+    if(!inputStream.read(reinterpret_cast<char*>(header), sizeof(header)))
+        return false;
+
+    const std::uint8_t ID[4] = {'F', 'P', 'R', 'T'};
+    std::uint16_t fields[2];
+    std::uint32_t sizes[2];
+    Endian::loadLittle(header + 4, fields, 2);
+    Endian::loadLittle(header + 8, sizes, 2);
+
+    // Days of audio at most, so corrupt sizes cannot exhaust memory.
+    if(!std::equal(ID, ID + 4, header) || fields[0] != cVersion ||
+        fields[1] != Fingerprinter::cHopSize || sizes[0] != Fingerprinter::cSampleRate ||
+        sizes[1] > (1U << 26))
+        return false;
+
+    const std::size_t size = static_cast<std::size_t>(sizes[1]) * sizeof(std::uint32_t);
+    std::vector<std::uint8_t> bytes(2 * size);
+    if(!inputStream.read(reinterpret_cast<char*>(bytes.data()), bytes.size()))
+        return false;
+
+    subFingerprints.resize(sizes[1]);
+    masks.resize(sizes[1]);
+    Endian::loadLittle(bytes.data(), subFingerprints.data(), subFingerprints.size());
+    Endian::loadLittle(bytes.data() + size, masks.data(), masks.size());
+    return true;
+}
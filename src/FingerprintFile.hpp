@@ -0,0 +1,57 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef FINGERPRINT_FILE_HPP
+#define FINGERPRINT_FILE_HPP
+
+#include "SoundWriter.hpp"
+#include "Fingerprinter.hpp"
+#include "Resampler.hpp"
+
+#include <istream>
+#include <ostream>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+// Writes the fingerprint of a sound's decoded samples, which are first
+// resampled to the rate of the fingerprinter. Sounds with nearly the same
+// audio have nearly the same fingerprint, whatever their compression, rate
+// or number of channels. All values are little-endian:
+//     'FPRT', uint16 version (2), uint16 hopSize (samples),
+//     uint32 sampleRate (Hz), uint32 numSubFingerprints,
+// followed by the sub-fingerprints, then their masks, as uint32.
+class FingerprintFile : public SoundWriter
+{
+private:
+    static const std::uint16_t cVersion;
+
+    std::ostream* mOutputStream = nullptr;
+    std::unique_ptr<Fingerprinter> mFingerprinter;
+    std::unique_ptr<Resampler> mResampler; // Unless sounds are at the right rate.
+
+public:
+    bool begin(SndFile& sndFile, std::ostream& outputStream) override;
+    SampleSink* getSampleSink() override;
+    bool finish() override;
+
+    // Returns true on success, false on failure.
+    static bool read(std::istream& inputStream, std::vector<std::uint32_t>& subFingerprints,
+        std::vector<std::uint32_t>& masks);
+};
+
+#endif // FINGERPRINT_FILE_HPP
@@ -0,0 +1,350 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "FingerprintMatcher.hpp"
+#include "CpuFeatures.hpp"
+
+#include <algorithm> // For std::min, std::max and std::sort
+#include <cmath> // For std::ceil
+#include <map>
+#include <utility> // For std::move and std::swap
+
+#if defined(SNDTOWAV_X86)
+#include <immintrin.h>
+#elif defined(SNDTOWAV_NEON)
+#include <arm_neon.h>
+#endif
+
+const std::size_t FingerprintMatcher::cMinSize = 8; // About 46 ms, and 256 bits.
+const double FingerprintMatcher::cMinOverlap = 0.8;
+const std::size_t FingerprintMatcher::cMaxShift = 16; // About 93 ms.
+
+static inline unsigned count_bits(std::uint32_t bits)
+{
+    bits -= (bits >> 1) & 0x55555555U;
+    bits = (bits & 0x33333333U) + ((bits >> 2) & 0x33333333U);
+    return (((bits + (bits >> 4)) & 0x0F0F0F0FU) * 0x01010101U) >> 24;
+}
+
+// A bit valid in both fingerprints is 2 half bits, and an error if it differs;
+// a bit valid in only one is 2 half bits, of which one is an error.
+static FingerprintMatcher::BitCounts count_bit_errors_scalar(const std::uint32_t* first,
+    const std::uint32_t* firstMasks, const std::uint32_t* second,
+    const std::uint32_t* secondMasks, std::size_t count)
+{
+    FingerprintMatcher::BitCounts counts;
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        std::uint32_t bothValid = firstMasks[i] & secondMasks[i];
+        counts.errors += 2*count_bits((first[i] ^ second[i]) & bothValid) +
+            count_bits(firstMasks[i] ^ secondMasks[i]);
+        counts.valid += 2*count_bits(firstMasks[i] | secondMasks[i]);
+    }
+
+    return counts;
+}
+
+#if defined(SNDTOWAV_X86)
+
+// Bits of each byte, with a table lookup a nibble at a time.
+SNDTOWAV_TARGET("sse4.1")
+static inline __m128i count_bits_sse(__m128i bits)
+{
+    const __m128i lookup = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m128i lowNibbles = _mm_set1_epi8(0x0F);
+
+    return _mm_add_epi8(_mm_shuffle_epi8(lookup, _mm_and_si128(bits, lowNibbles)),
+        _mm_shuffle_epi8(lookup, _mm_and_si128(_mm_srli_epi16(bits, 4), lowNibbles)));
+}
+
+SNDTOWAV_TARGET("sse4.1")
+static FingerprintMatcher::BitCounts count_bit_errors_sse(const std::uint32_t* first,
+    const std::uint32_t* firstMasks, const std::uint32_t* second,
+    const std::uint32_t* secondMasks, std::size_t count)
+{
+    __m128i errorSums = _mm_setzero_si128();
+    __m128i validSums = _mm_setzero_si128();
+
+    std::size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i firstMask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(firstMasks + i));
+        __m128i secondMask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(secondMasks + i));
+        __m128i differing = _mm_and_si128(_mm_and_si128(firstMask, secondMask), _mm_xor_si128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + i))));
+
+        // At most 24 per byte.
+        __m128i differingCounts = count_bits_sse(differing);
+        __m128i errors = _mm_add_epi8(_mm_add_epi8(differingCounts, differingCounts),
+            count_bits_sse(_mm_xor_si128(firstMask, secondMask)));
+        __m128i valid = count_bits_sse(_mm_or_si128(firstMask, secondMask));
+
+        errorSums = _mm_add_epi64(errorSums, _mm_sad_epu8(errors, _mm_setzero_si128()));
+        validSums = _mm_add_epi64(validSums, _mm_sad_epu8(valid, _mm_setzero_si128()));
+    }
+
+    alignas(16) std::uint64_t errorLanes[2];
+    alignas(16) std::uint64_t validLanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(errorLanes), errorSums);
+    _mm_store_si128(reinterpret_cast<__m128i*>(validLanes), validSums);
+
+    FingerprintMatcher::BitCounts counts = count_bit_errors_scalar(first + i,
+        firstMasks + i, second + i, secondMasks + i, count - i);
+    counts.errors += static_cast<std::size_t>(errorLanes[0] + errorLanes[1]);
+    counts.valid += 2*static_cast<std::size_t>(validLanes[0] + validLanes[1]);
+    return counts;
+}
+
+SNDTOWAV_TARGET("avx2")
+static inline __m256i count_bits_avx2(__m256i bits)
+{
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowNibbles = _mm256_set1_epi8(0x0F);
+
+    return _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(bits, lowNibbles)),
+        _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(bits, 4), lowNibbles)));
+}
+
+SNDTOWAV_TARGET("avx2")
+static FingerprintMatcher::BitCounts count_bit_errors_avx2(const std::uint32_t* first,
+    const std::uint32_t* firstMasks, const std::uint32_t* second,
+    const std::uint32_t* secondMasks, std::size_t count)
+{
+    __m256i errorSums = _mm256_setzero_si256();
+    __m256i validSums = _mm256_setzero_si256();
+
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i firstMask = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(firstMasks + i));
+        __m256i secondMask = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secondMasks + i));
+        __m256i differing = _mm256_and_si256(_mm256_and_si256(firstMask, secondMask),
+            _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + i)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + i))));
+
+        // At most 24 per byte.
+        __m256i differingCounts = count_bits_avx2(differing);
+        __m256i errors = _mm256_add_epi8(_mm256_add_epi8(differingCounts, differingCounts),
+            count_bits_avx2(_mm256_xor_si256(firstMask, secondMask)));
+        __m256i valid = count_bits_avx2(_mm256_or_si256(firstMask, secondMask));
+
+        errorSums = _mm256_add_epi64(errorSums, _mm256_sad_epu8(errors, _mm256_setzero_si256()));
+        validSums = _mm256_add_epi64(validSums, _mm256_sad_epu8(valid, _mm256_setzero_si256()));
+    }
+
+    alignas(32) std::uint64_t errorLanes[4];
+    alignas(32) std::uint64_t validLanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(errorLanes), errorSums);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(validLanes), validSums);
+
+    FingerprintMatcher::BitCounts counts = count_bit_errors_scalar(first + i,
+        firstMasks + i, second + i, secondMasks + i, count - i);
+    counts.errors += static_cast<std::size_t>(errorLanes[0] + errorLanes[1] +
+        errorLanes[2] + errorLanes[3]);
+    counts.valid += 2*static_cast<std::size_t>(validLanes[0] + validLanes[1] +
+        validLanes[2] + validLanes[3]);
+    return counts;
+}
+
+#elif defined(SNDTOWAV_NEON)
+
+static FingerprintMatcher::BitCounts count_bit_errors_neon(const std::uint32_t* first,
+    const std::uint32_t* firstMasks, const std::uint32_t* second,
+    const std::uint32_t* secondMasks, std::size_t count)
+{
+    uint32x4_t errorSums = vdupq_n_u32(0);
+    uint32x4_t validSums = vdupq_n_u32(0);
+
+    std::size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        uint32x4_t firstMask = vld1q_u32(firstMasks + i);
+        uint32x4_t secondMask = vld1q_u32(secondMasks + i);
+        uint32x4_t differing = vandq_u32(vandq_u32(firstMask, secondMask),
+            veorq_u32(vld1q_u32(first + i), vld1q_u32(second + i)));
+
+        // At most 24 per byte.
+        uint8x16_t errors = vaddq_u8(vshlq_n_u8(vcntq_u8(vreinterpretq_u8_u32(differing)), 1),
+            vcntq_u8(vreinterpretq_u8_u32(veorq_u32(firstMask, secondMask))));
+        uint8x16_t valid = vcntq_u8(vreinterpretq_u8_u32(vorrq_u32(firstMask, secondMask)));
+
+        errorSums = vpadalq_u16(errorSums, vpaddlq_u8(errors));
+        validSums = vpadalq_u16(validSums, vpaddlq_u8(valid));
+    }
+
+    FingerprintMatcher::BitCounts counts = count_bit_errors_scalar(first + i,
+        firstMasks + i, second + i, secondMasks + i, count - i);
+    counts.errors += vaddvq_u32(errorSums);
+    counts.valid += 2*vaddvq_u32(validSums);
+    return counts;
+}
+
+#endif
+
+// Picks the kernel of the current kernel set.
+static FingerprintMatcher::CountFunction select_count_function()
+{
+#if defined(SNDTOWAV_X86)
+    if(CpuFeatures::useAVX2())
+        return count_bit_errors_avx2;
+    if(CpuFeatures::useSSE())
+        return count_bit_errors_sse;
+#elif defined(SNDTOWAV_NEON)
+    if(CpuFeatures::useNEON())
+        return count_bit_errors_neon;
+#endif
+
+    return count_bit_errors_scalar;
+}
+
+// Root of a set of clusters, halving paths on the way.
+static std::size_t find_root(std::vector<std::size_t>& parents, std::size_t index)
+{
+    while(parents[index] != index)
+    {
+        parents[index] = parents[parents[index]];
+        index = parents[index];
+    }
+
+    return index;
+}
+
+FingerprintMatcher::FingerprintMatcher()
+    : mCountBitErrors(select_count_function())
+{
+
+}
+
+void FingerprintMatcher::add(std::vector<std::uint32_t> subFingerprints,
+    std::vector<std::uint32_t> masks)
+{
+    mFingerprints.push_back(Fingerprint());
+    mFingerprints.back().subFingerprints = std::move(subFingerprints);
+    mFingerprints.back().masks = std::move(masks);
+}
+
+std::size_t FingerprintMatcher::getNumFingerprints() const
+{
+    return mFingerprints.size();
+}
+
+// The shorter fingerprint slides along the longer one, as long as they
+// overlap enough, and up to cMaxShift sub-fingerprints past either end.
+double FingerprintMatcher::compare(std::size_t first, std::size_t second) const
+{
+    const Fingerprint* shorter = &mFingerprints[first];
+    const Fingerprint* longer = &mFingerprints[second];
+    if(shorter->subFingerprints.size() > longer->subFingerprints.size())
+        std::swap(shorter, longer);
+
+    const std::size_t shortSize = shorter->subFingerprints.size();
+    const std::size_t longSize = longer->subFingerprints.size();
+    const std::size_t minOverlap = std::max(cMinSize,
+        static_cast<std::size_t>(std::ceil(cMinOverlap * longSize)));
+    if(shortSize < minOverlap)
+        return 1;
+
+    double bitErrorRate = 1;
+    const std::ptrdiff_t maxShift = static_cast<std::ptrdiff_t>(cMaxShift);
+    const std::ptrdiff_t maxOffset = static_cast<std::ptrdiff_t>(longSize - shortSize) + maxShift;
+
+    // Sub-fingerprint i of the shorter fingerprint faces i + offset of the
+    // longer one.
+    for(std::ptrdiff_t offset = -maxShift; offset <= maxOffset; ++offset)
+    {
+        // Offsets past the end of a fingerprint shorter than cMaxShift give a
+        // negative end, so the overlap is checked before going unsigned.
+        const std::ptrdiff_t begin = std::max<std::ptrdiff_t>(0, -offset);
+        const std::ptrdiff_t end = std::min<std::ptrdiff_t>(
+            static_cast<std::ptrdiff_t>(shortSize), static_cast<std::ptrdiff_t>(longSize) - offset);
+        if(end - begin < static_cast<std::ptrdiff_t>(minOverlap))
+            continue;
+
+        BitCounts counts = mCountBitErrors(shorter->subFingerprints.data() + begin,
+            shorter->masks.data() + begin, longer->subFingerprints.data() + begin + offset,
+            longer->masks.data() + begin + offset, static_cast<std::size_t>(end - begin));
+        if(counts.valid > 0)
+        {
+            bitErrorRate = std::min(bitErrorRate,
+                static_cast<double>(counts.errors) / counts.valid);
+        }
+    }
+
+    return bitErrorRate;
+}
+
+// Only fingerprints of similar sizes can match, so they are compared in order
+// of size, each with the next few.
+std::vector<FingerprintMatcher::Cluster> FingerprintMatcher::findClusters(
+    double maxBitErrorRate) const
+{
+    std::vector<std::size_t> order(mFingerprints.size());
+    std::vector<std::size_t> parents(mFingerprints.size()); // Each its own cluster.
+    for(std::size_t i = 0; i < order.size(); ++i)
+        order[i] = parents[i] = i;
+
+    std::sort(order.begin(), order.end(), [this](std::size_t first, std::size_t second)
+        {
+            return mFingerprints[first].subFingerprints.size() <
+                mFingerprints[second].subFingerprints.size();
+        });
+
+    std::vector<double> bitErrorRates(mFingerprints.size(), 0); // Of roots.
+
+    for(std::size_t i = 0; i < order.size(); ++i)
+    {
+        std::size_t shortSize = mFingerprints[order[i]].subFingerprints.size();
+        if(shortSize < cMinSize)
+            continue;
+
+        for(std::size_t j = i + 1; j < order.size() &&
+            shortSize >= cMinOverlap * mFingerprints[order[j]].subFingerprints.size(); ++j)
+        {
+            double bitErrorRate = compare(order[i], order[j]);
+            if(bitErrorRate > maxBitErrorRate)
+                continue;
+
+            std::size_t first = find_root(parents, order[i]);
+            std::size_t second = find_root(parents, order[j]);
+            double worst = std::max({bitErrorRate, bitErrorRates[first], bitErrorRates[second]});
+            if(first != second)
+                parents[std::max(first, second)] = std::min(first, second);
+
+            bitErrorRates[std::min(first, second)] = worst;
+        }
+    }
+
+    // Roots are the first fingerprint of their cluster.
+    std::map<std::size_t, Cluster> clusters;
+    for(std::size_t i = 0; i < mFingerprints.size(); ++i)
+    {
+        std::size_t root = find_root(parents, i);
+        clusters[root].fingerprints.push_back(i);
+        clusters[root].bitErrorRate = bitErrorRates[root];
+    }
+
+    std::vector<Cluster> duplicates;
+    for(std::pair<const std::size_t, Cluster>& cluster : clusters)
+    {
+        if(cluster.second.fingerprints.size() > 1)
+            duplicates.push_back(std::move(cluster.second));
+    }
+
+    return duplicates;
+}
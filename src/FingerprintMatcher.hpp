@@ -0,0 +1,83 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef FINGERPRINT_MATCHER_HPP
+#define FINGERPRINT_MATCHER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Finds near-duplicate sounds from their fingerprints (see Fingerprinter).
+// Two fingerprints match if, at some alignment, few of the bits they overlap
+// on differ: unrelated sounds differ on about half of them. Only valid bits
+// count; a bit valid in one fingerprint but not the other counts as half an
+// error, so that sounds with energy in different bands do not match.
+class FingerprintMatcher
+{
+public:
+    // Of the bits valid in either fingerprint, in half bits, so that
+    // errors / valid is the bit error rate.
+    struct BitCounts
+    {
+        std::size_t errors = 0;
+        std::size_t valid = 0;
+    };
+
+    // Bit errors of count sub-fingerprints and their masks.
+    using CountFunction = BitCounts (*)(const std::uint32_t* first,
+        const std::uint32_t* firstMasks, const std::uint32_t* second,
+        const std::uint32_t* secondMasks, std::size_t count);
+
+    // Fingerprints which match, directly or through each other.
+    struct Cluster
+    {
+        std::vector<std::size_t> fingerprints; // In the order they were added.
+        double bitErrorRate = 0; // Worst of the matches joining them.
+    };
+
+    static const std::size_t cMinSize; // In sub-fingerprints.
+    static const double cMinOverlap; // Of the longest fingerprint.
+    static const std::size_t cMaxShift; // Beyond the difference in size.
+
+private:
+    struct Fingerprint
+    {
+        std::vector<std::uint32_t> subFingerprints;
+        std::vector<std::uint32_t> masks; // One per sub-fingerprint.
+    };
+
+    std::vector<Fingerprint> mFingerprints;
+    CountFunction mCountBitErrors; // Bound for the current kernel set.
+
+public:
+    FingerprintMatcher();
+
+    // Masks are those of the sub-fingerprints; see Fingerprinter::getMasks().
+    void add(std::vector<std::uint32_t> subFingerprints, std::vector<std::uint32_t> masks);
+    std::size_t getNumFingerprints() const;
+
+    // Lowest bit error rate over the alignments of two fingerprints; 1 if they
+    // are too short, or too different in size, to match.
+    double compare(std::size_t first, std::size_t second) const;
+
+    // Clusters of at least two fingerprints, which match at up to
+    // maxBitErrorRate, in the order of their first fingerprint.
+    std::vector<Cluster> findClusters(double maxBitErrorRate) const;
+};
+
+#endif // FINGERPRINT_MATCHER_HPP
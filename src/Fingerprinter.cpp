@@ -0,0 +1,295 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Fingerprinter.hpp"
+
+#include <algorithm> // For std::min, std::max and std::max_element
+#include <cmath> // For std::cos, std::sin, std::pow and std::lround
+
+const std::uint32_t Fingerprinter::cSampleRate = 5512;
+const std::size_t Fingerprinter::cFrameSize = 512; // About 93 ms.
+const std::size_t Fingerprinter::cHopSize = 32; // About 5.8 ms.
+const std::size_t Fingerprinter::cNumBands = 33; // For 32 bits.
+const double Fingerprinter::cMinFrequency = 300.0;
+const double Fingerprinter::cMaxFrequency = 2000.0;
+const float Fingerprinter::cSilenceThreshold = 1e-5f;
+const float Fingerprinter::cBandFloor = 1e-3f;
+
+// Mixes channels to full-scale mono floats.
+template<unsigned bytesPerSample>
+static void mix_frames(const std::uint8_t* data, std::size_t numFrames,
+    std::size_t numChannels, float* output)
+{
+    const float scale = 1.0f / (static_cast<float>(1U << (8*bytesPerSample - 1)) *
+        static_cast<float>(numChannels));
+
+    for(std::size_t frame = 0; frame < numFrames; ++frame)
+    {
+        float sum = 0;
+        for(std::size_t channel = 0; channel < numChannels; ++channel)
+        {
+            const std::uint8_t* bytes = data + (frame*numChannels + channel)*bytesPerSample;
+            std::int32_t sample = 0;
+
+            if(bytesPerSample == 1)
+            {
+                sample = static_cast<std::int32_t>(bytes[0]) - 128; // Unsigned.
+            } else
+            {
+                std::uint32_t bits = 0;
+                for(unsigned byte = 0; byte < bytesPerSample; ++byte)
+                    bits |= static_cast<std::uint32_t>(bytes[byte]) << (8*byte);
+
+                // Sign-extend.
+                const unsigned unusedBits = 32 - 8*bytesPerSample;
+                sample = static_cast<std::int32_t>(bits << unusedBits) >> unusedBits;
+            }
+
+            sum += static_cast<float>(sample);
+        }
+
+        output[frame] = sum * scale;
+    }
+}
+
+Fingerprinter::Fingerprinter(std::size_t numChannels, unsigned bitsPerSample)
+    : mNumChannels(numChannels),
+      mBitsPerSample(bitsPerSample),
+      mWindow(cFrameSize),
+      mBitReversed(cFrameSize),
+      mTwiddles(cFrameSize/2),
+      mBandEdges(cNumBands + 1),
+      mSpectrum(cFrameSize),
+      mFrameEnergies(cNumBands),
+      mBandEnergies(cNumBands)
+{
+    const double pi = 3.14159265358979323846;
+
+    std::size_t numBits = 0;
+    while((std::size_t(1) << numBits) < cFrameSize)
+        ++numBits;
+
+    for(std::size_t i = 0; i < cFrameSize; ++i)
+    {
+        mWindow[i] = static_cast<float>(0.5 - 0.5*std::cos(2*pi*i / cFrameSize)); // Hann.
+
+        std::size_t reversed = 0;
+        for(std::size_t bit = 0; bit < numBits; ++bit)
+            reversed |= ((i >> bit) & 1) << (numBits - 1 - bit);
+        mBitReversed[i] = reversed;
+    }
+
+    for(std::size_t i = 0; i < cFrameSize/2; ++i)
+    {
+        double angle = -2*pi*i / cFrameSize;
+        mTwiddles[i] = std::complex<float>(static_cast<float>(std::cos(angle)),
+            static_cast<float>(std::sin(angle)));
+    }
+
+    // Logarithmically spaced, and at least a bin wide.
+    const double binWidth = static_cast<double>(cSampleRate) / cFrameSize;
+    for(std::size_t band = 0; band <= cNumBands; ++band)
+    {
+        double frequency = cMinFrequency *
+            std::pow(cMaxFrequency / cMinFrequency, static_cast<double>(band) / cNumBands);
+        mBandEdges[band] = static_cast<std::size_t>(std::lround(frequency / binWidth));
+        if(band > 0)
+            mBandEdges[band] = std::max(mBandEdges[band], mBandEdges[band - 1] + 1);
+    }
+}
+
+// Static
+bool Fingerprinter::isSupported(unsigned bitsPerSample)
+{
+    return bitsPerSample == 8 || bitsPerSample == 16 || bitsPerSample == 24 ||
+        bitsPerSample == 32;
+}
+
+void Fingerprinter::mixFrames(const std::uint8_t* data, std::size_t numFrames)
+{
+    std::size_t numBuffered = mSamples.size();
+    mSamples.resize(numBuffered + numFrames);
+
+    switch(mBitsPerSample)
+    {
+    case 8:
+        mix_frames<1>(data, numFrames, mNumChannels, mSamples.data() + numBuffered);
+        break;
+    case 16:
+        mix_frames<2>(data, numFrames, mNumChannels, mSamples.data() + numBuffered);
+        break;
+    case 24:
+        mix_frames<3>(data, numFrames, mNumChannels, mSamples.data() + numBuffered);
+        break;
+    default:
+        mix_frames<4>(data, numFrames, mNumChannels, mSamples.data() + numBuffered);
+        break;
+    }
+}
+
+// Iterative radix-2 FFT of mSpectrum, whose values are in bit-reversed order.
+void Fingerprinter::transform()
+{
+    for(std::size_t size = 2; size <= cFrameSize; size *= 2)
+    {
+        std::size_t half = size/2;
+        std::size_t twiddleStep = cFrameSize / size;
+
+        for(std::size_t start = 0; start < cFrameSize; start += size)
+        {
+            for(std::size_t i = 0; i < half; ++i)
+            {
+                std::complex<float> odd = mSpectrum[start + half + i] * mTwiddles[i*twiddleStep];
+                std::complex<float> even = mSpectrum[start + i];
+                mSpectrum[start + i] = even + odd;
+                mSpectrum[start + half + i] = even - odd;
+            }
+        }
+    }
+}
+
+void Fingerprinter::analyzeFrame(const float* samples)
+{
+    float meanSquare = 0;
+    for(std::size_t i = 0; i < cFrameSize; ++i)
+    {
+        meanSquare += samples[i] * samples[i];
+        mSpectrum[mBitReversed[i]] = std::complex<float>(samples[i] * mWindow[i], 0.0f);
+    }
+
+    meanSquare /= cFrameSize;
+    bool isSilent = meanSquare < cSilenceThreshold;
+
+    transform();
+
+    std::vector<float>& energies = mFrameEnergies;
+    for(std::size_t band = 0; band < cNumBands; ++band)
+    {
+        energies[band] = 0;
+        for(std::size_t bin = mBandEdges[band]; bin < mBandEdges[band + 1]; ++bin)
+            energies[band] += std::norm(mSpectrum[bin]);
+    }
+
+    // Bands far below the loudest one only hold codec noise.
+    float floor = *std::max_element(energies.begin(), energies.end()) * cBandFloor;
+    std::uint64_t validBands = 0;
+    if(!isSilent)
+    {
+        for(std::size_t band = 0; band < cNumBands; ++band)
+        {
+            if(energies[band] >= floor)
+                validBands |= std::uint64_t(1) << band;
+        }
+    }
+
+    if(mHasPreviousFrame)
+    {
+        // Bit i compares bands i and i + 1.
+        std::uint64_t bothValid = validBands & mValidBands;
+        std::uint32_t mask = static_cast<std::uint32_t>(bothValid & (bothValid >> 1));
+
+        std::uint32_t subFingerprint = 0;
+        for(std::size_t band = 0; band + 1 < cNumBands; ++band)
+        {
+            float difference = (energies[band] - energies[band + 1]) -
+                (mBandEnergies[band] - mBandEnergies[band + 1]);
+            if(difference > 0)
+                subFingerprint |= std::uint32_t(1) << band;
+        }
+
+        mSubFingerprints.push_back(subFingerprint & mask);
+        mMasks.push_back(mask);
+    }
+
+    mBandEnergies.swap(mFrameEnergies);
+    mValidBands = validBands;
+    mHasPreviousFrame = true;
+}
+
+// Samples of a frame may be split across writes.
+bool Fingerprinter::write(const std::uint8_t* data, std::size_t size)
+{
+    std::size_t frameSize = mNumChannels * mBitsPerSample/8;
+
+    // Complete a frame split across writes.
+    if(!mPendingBytes.empty())
+    {
+        std::size_t count = std::min(frameSize - mPendingBytes.size(), size);
+        mPendingBytes.insert(mPendingBytes.end(), data, data + count);
+        data += count;
+        size -= count;
+
+        if(mPendingBytes.size() < frameSize)
+            return true;
+
+        mixFrames(mPendingBytes.data(), 1);
+        mPendingBytes.clear();
+    }
+
+    std::size_t numFrames = size / frameSize;
+    mixFrames(data, numFrames);
+    mPendingBytes.assign(data + numFrames*frameSize, data + size);
+
+    // Only whole frames are analyzed; the rest waits for more samples.
+    std::size_t start = 0;
+    for(; start + cFrameSize <= mSamples.size(); start += cHopSize)
+        analyzeFrame(mSamples.data() + start);
+
+    mSamples.erase(mSamples.begin(), mSamples.begin() + start);
+    return true;
+}
+
+void Fingerprinter::finish()
+{
+    if(mFinished)
+        return;
+    mFinished = true;
+
+    // Silence after the last samples lets whole frames cover them.
+    if(!mSamples.empty())
+    {
+        mSamples.resize(mSamples.size() + cFrameSize);
+        for(std::size_t start = 0; start + cFrameSize <= mSamples.size(); start += cHopSize)
+            analyzeFrame(mSamples.data() + start);
+    }
+
+    mSamples.clear();
+
+    // Drop leading and trailing silence, so trimmed copies still match.
+    std::size_t begin = 0;
+    while(begin < mMasks.size() && mMasks[begin] == 0)
+        ++begin;
+
+    std::size_t end = mMasks.size();
+    while(end > begin && mMasks[end - 1] == 0)
+        --end;
+
+    mSubFingerprints.erase(mSubFingerprints.begin() + end, mSubFingerprints.end());
+    mSubFingerprints.erase(mSubFingerprints.begin(), mSubFingerprints.begin() + begin);
+    mMasks.erase(mMasks.begin() + end, mMasks.end());
+    mMasks.erase(mMasks.begin(), mMasks.begin() + begin);
+}
+
+const std::vector<std::uint32_t>& Fingerprinter::getSubFingerprints() const
+{
+    return mSubFingerprints;
+}
+
+const std::vector<std::uint32_t>& Fingerprinter::getMasks() const
+{
+    return mMasks;
+}
@@ -0,0 +1,94 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef FINGERPRINTER_HPP
+#define FINGERPRINTER_HPP
+
+#include "SampleSink.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <complex>
+
+// Computes a spectral fingerprint of decoded little-endian PCM, which must
+// already be at cSampleRate, as it is decoded. The same audio gives nearly the
+// same fingerprint whatever its compression, level, or number of channels.
+//
+// Channels are mixed to mono, and cut into overlapping frames. Each frame
+// gives a 32-bit sub-fingerprint: each bit is the sign of the change, from the
+// previous frame, of the energy difference between two neighbouring bands
+// (Haitsma and Kalker, 2002). Bands far below the loudest one hold codec noise
+// rather than the sound, so each sub-fingerprint has a mask of the bits whose
+// bands are all above that floor, in both frames; the other bits are 0. Silent
+// frames give no valid bits, and leading and trailing silence is dropped.
+class Fingerprinter : public SampleSink
+{
+public:
+    static const std::uint32_t cSampleRate; // In Hz.
+    static const std::size_t cFrameSize; // In samples; a power of two.
+    static const std::size_t cHopSize; // Between frames, in samples.
+
+private:
+    static const std::size_t cNumBands;
+    static const double cMinFrequency; // Of the bands, in Hz.
+    static const double cMaxFrequency;
+    static const float cSilenceThreshold; // Mean square; -50 dBFS.
+    static const float cBandFloor; // Relative to the loudest band; -30 dB.
+
+    void mixFrames(const std::uint8_t* data, std::size_t numFrames);
+    void analyzeFrame(const float* samples);
+    void transform();
+
+    std::size_t mNumChannels;
+    unsigned mBitsPerSample;
+
+    std::vector<std::uint8_t> mPendingBytes; // Frame split across writes.
+    std::vector<float> mSamples; // Mono; the first one starts the next frame.
+    bool mFinished = false;
+
+    std::vector<float> mWindow;
+    std::vector<std::size_t> mBitReversed;
+    std::vector<std::complex<float>> mTwiddles;
+    std::vector<std::size_t> mBandEdges; // In bins.
+    std::vector<std::complex<float>> mSpectrum;
+
+    std::vector<float> mFrameEnergies; // Of each band.
+    std::vector<float> mBandEnergies; // Of the previous frame.
+    std::uint64_t mValidBands = 0; // Of the previous frame; one bit per band.
+    bool mHasPreviousFrame = false;
+    std::vector<std::uint32_t> mSubFingerprints;
+    std::vector<std::uint32_t> mMasks;
+
+public:
+    Fingerprinter(std::size_t numChannels, unsigned bitsPerSample);
+
+    static bool isSupported(unsigned bitsPerSample);
+
+    bool write(const std::uint8_t* data, std::size_t size) override;
+
+    // Analyzes the last samples; call once all samples are written.
+    void finish();
+
+    // One per cHopSize samples.
+    const std::vector<std::uint32_t>& getSubFingerprints() const;
+
+    // One per sub-fingerprint; set bits are valid.
+    const std::vector<std::uint32_t>& getMasks() const;
+};
+
+#endif // FINGERPRINTER_HPP
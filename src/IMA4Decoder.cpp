@@ -16,89 +16,88 @@
 // along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
 
 #include "IMA4Decoder.hpp"
+#include "CpuFeatures.hpp"
 #include "Log.hpp"
-#include "Utils.hpp"
 
 #include <cstddef> // For std::size_t
-#include <cmath> // For floor()
+#include <cstring> // For std::memcpy
+#include <algorithm> // For std::min and std::max
 #include <limits> // For numeric limits
 
+#if defined(SNDTOWAV_X86)
+#include <immintrin.h>
+#endif
+
 // For IMA4 only:
 // numFrames = num. of pairs of packets.
 // Each packet is 34 bytes.
 // Each uncompressed frame is 16-bit.
 // Each packet decompresses to 128 bytes of sound samples.
 
-namespace
-{
-    // From https://web.archive.org/web/20111117212301/http://wiki.multimedia.cx/index.php?title=IMA_ADPCM
-    int gIndexTable[16] = {
-        -1, -1, -1, -1, 2, 4, 6, 8,
-        -1, -1, -1, -1, 2, 4, 6, 8
-    };
-
-    int gStepTable[89] = { 
-        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 
-        19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 
-        50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 
-        130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
-        337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
-        876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 
-         2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
-        5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 
-        15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767 
-    };
-}
-
-IMA4Decoder::IMA4Decoder()
-{
-    // Do nothing
-}
-
-// Returns the native-endian uncompressed sample for this nibble.
-// Nibble only uses the lower 4-bits.
+// From https://web.archive.org/web/20111117212301/http://wiki.multimedia.cx/index.php?title=IMA_ADPCM
+const int gIMAIndexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+const int gIMAStepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 
+     2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767 
+};
+
+// Returns the native-endian uncompressed sample for this nibble, updating the
+// packet's state.
 // From https://web.archive.org/web/20111026200128/http://www.wooji-juice.com/blog/iphone-openal-ima4-adpcm.html
-std::int16_t IMA4Decoder::processNibble(std::uint8_t nibble)
+static inline std::int16_t ima4_process_nibble(unsigned nibble, int& predictor,
+    int& stepIndex)
 {
-    // Select lower 4-bits only, for safety.
-    nibble = nibble & 0x0f;
-
     // Nibbles have a sign-magnitude representation!
     // See p.6: http://www.cs.columbia.edu/~hgs/audio/dvi/IMA_ADPCM.pdf
-    std::uint8_t nibbleMagnitude = nibble & 0x07;
+    unsigned nibbleMagnitude = nibble & 0x07;
     bool isNegative = (nibble & 0x08) == 0x08;
 
-    // Get step.
-    int step = gStepTable[mStepIndex];
-
     // In the specs, the formula mentionned is:
     //     ((signed)nibble + 0.5) * step / 4
     // which yields erroneous results. Instead, we use this:
     //     ((signed)((unsigned)nibble + 0.5)) * step / 4
-    int diff = static_cast<int>(
-        (nibbleMagnitude + 0.5f) * step/4.0f
-    );
+    // computed as (2 * nibble + 1) * step / 8, truncated. Both are exact.
+    int step = gIMAStepTable[stepIndex];
+    int diff = (static_cast<int>(2*nibbleMagnitude + 1) * step) >> 3;
     if(isNegative)
         diff = -diff;
 
-    // Calculate new predictor (sample).
-    mPredictor += diff;
-    // Clamp predictor.
-    mPredictor = clamp(
-        std::numeric_limits<std::int16_t>::min(),
-        mPredictor,
-        std::numeric_limits<std::int16_t>::max()
-    );
-
-    // Get next step index.
-    mStepIndex += gIndexTable[nibble];
-    // Clamp step index according to step table size:
-    mStepIndex = clamp(0, mStepIndex, 88);
-
-    return static_cast<std::int16_t>(mPredictor);
+    // Calculate and clamp new predictor (sample).
+    predictor = std::min(std::max(predictor + diff,
+        static_cast<int>(std::numeric_limits<std::int16_t>::min())),
+        static_cast<int>(std::numeric_limits<std::int16_t>::max()));
+
+    // Get next step index, clamped according to step table size.
+    stepIndex = std::min(std::max(stepIndex + gIMAIndexTable[nibble], 0), 88);
+
+    return static_cast<std::int16_t>(predictor);
+}
+
+// Header is the first 2 bytes, in Big-endian.
+static inline void ima4_read_header(const std::uint8_t* packet, int& predictor,
+    int& stepIndex)
+{
+    unsigned header = (static_cast<unsigned>(packet[0]) << 8) | packet[1];
+
+    // Lower 7 bits. Clamp for good measure (7 bits is 0..127, we want 0..88).
+    stepIndex = std::min(static_cast<int>(header & 0x007f), 88);
+
+    // Upper 9 bits. Represents the top 9 bits of the 16-bit value, so sign is important!
+    predictor = static_cast<int>(header & 0x7f80) - static_cast<int>(header & 0x8000);
 }
 
-// Returns native-endian signed values.
+// Outputs 64 native-endian signed values, stride samples apart.
 // Based on:
 // https://web.archive.org/web/20111026200128/http://www.wooji-juice.com/blog/iphone-openal-ima4-adpcm.html
 // https://web.archive.org/web/20111117212301/http://wiki.multimedia.cx/index.php?title=IMA_ADPCM
@@ -106,60 +105,234 @@ std::int16_t IMA4Decoder::processNibble(std::uint8_t nibble)
 // https://wiki.multimedia.cx/index.php/Apple_QuickTime_IMA_ADPCM
 // Answers by Laurent Etiemble and Arthur Shipkowski from:
 // --- https://stackoverflow.com/questions/2130831/decoding-ima4-audio-format
-std::vector<std::int16_t> IMA4Decoder::decodeFrame(const std::uint8_t frame[IMA4_PACKET_LENGTH])
+static void ima4_decode_packet(const std::uint8_t* packet, std::int16_t* samples,
+    std::size_t stride)
 {
-    // Header is the first 2 bytes, in Big-endian.
-    std::uint16_t header = Utils::makeBigEndianNative(
-        *reinterpret_cast<const std::uint16_t*>(frame)
-    );
+    int predictor;
+    int stepIndex;
+    ima4_read_header(packet, predictor, stepIndex);
 
-    std::vector<std::int16_t> decodedSamples;
+    // Iterate through all bytes of packet, starting after the header.
+    for(std::size_t i = 2; i < IMA4_PACKET_LENGTH; ++i)
+    {
+        // We must process low nibble first, then high nibble!
+        // These are little-endian values.
+        samples[0] = ima4_process_nibble(packet[i] & 0x0f, predictor, stepIndex);
+        samples[stride] = ima4_process_nibble(packet[i] >> 4, predictor, stepIndex);
+        samples += stride*2;
+    }
+}
 
-    mStepIndex = header & 0x007f; // Lower 7 bits.
-    mStepIndex = clamp(0, mStepIndex, 88); // Clamp for good measure (7 bits is 0..127, we want 0..88).
+// Kernels decode numPackets consecutive packets, whose channels are
+// interleaved packet by packet, interleaving channels sample by sample.
+// They are specialized per channel count, so positions are computed without
+// divisions.
+template<std::size_t numChannels>
+static void ima4_decode_packets_scalar(const std::uint8_t* packets,
+    std::size_t numPackets, std::int16_t* samples)
+{
+    for(std::size_t packet = 0; packet < numPackets; ++packet)
+    {
+        std::size_t frame = packet / numChannels;
+        std::size_t channel = packet % numChannels;
+        ima4_decode_packet(&packets[packet * IMA4_PACKET_LENGTH],
+            &samples[frame*IMA4_SAMPLES_PER_PACKET*numChannels + channel], numChannels);
+    }
+}
 
-    // Upper 9 bits. Represents the top 9 bits of the 16-bit value, so sign is important!
-    mPredictor = castSigned16Bit<int>(header & 0xff80);
+// Each packet starts from its own header, so the vector kernels decode one
+// packet per 32-bit lane, in lockstep. Nibble bytes are transposed to one
+// vector per byte position beforehand, and samples back afterwards.
+template<std::size_t numLanes>
+struct IMA4LaneBlock
+{
+    std::uint8_t bytes[IMA4_PACKET_LENGTH - 2][numLanes];
+    std::int32_t samples[IMA4_SAMPLES_PER_PACKET][numLanes];
+    std::int32_t predictors[numLanes];
+    std::int32_t stepIndices[numLanes];
 
-    // Iterate through all bytes of frame, starting after the header.
-    for(std::size_t i = 2; i < IMA4_PACKET_LENGTH; ++i)
+    void load(const std::uint8_t* packets)
     {
-        // Make sure frame[i] is unsigned to avoid sign-extension problems.
-        std::uint8_t lowNibble = frame[i] & 0x0f; // Lower 4 bits.
-        std::uint8_t highNibble = frame[i] >> 4; // Top 4 bits.
+        for(std::size_t lane = 0; lane < numLanes; ++lane)
+        {
+            const std::uint8_t* packet = &packets[lane * IMA4_PACKET_LENGTH];
+            int predictor;
+            int stepIndex;
+            ima4_read_header(packet, predictor, stepIndex);
+            predictors[lane] = predictor;
+            stepIndices[lane] = stepIndex;
+
+            for(std::size_t i = 2; i < IMA4_PACKET_LENGTH; ++i)
+                bytes[i - 2][lane] = packet[i];
+        }
+    }
 
-        // We must process low nibble first, then high nibble!
-        // These are little-endian values.
-        std::int16_t sample1 = processNibble(lowNibble);
-        std::int16_t sample2 = processNibble(highNibble);
+    // Packet firstPacket is the packet in lane 0.
+    template<std::size_t numChannels>
+    void store(std::size_t firstPacket, std::int16_t* samplesOut) const
+    {
+        for(std::size_t lane = 0; lane < numLanes; ++lane)
+        {
+            std::size_t packet = firstPacket + lane;
+            std::int16_t* out = &samplesOut[(packet / numChannels)*IMA4_SAMPLES_PER_PACKET*numChannels +
+                packet % numChannels];
 
-        decodedSamples.push_back(sample1);
-        decodedSamples.push_back(sample2);
+            for(std::size_t i = 0; i < IMA4_SAMPLES_PER_PACKET; ++i)
+                out[i*numChannels] = static_cast<std::int16_t>(samples[i][lane]);
+        }
     }
+};
+
+#if defined(SNDTOWAV_X86)
 
-    return decodedSamples;
+// Per lane, the same as ima4_process_nibble().
+SNDTOWAV_TARGET("sse4.1")
+static inline __m128i ima4_process_nibbles_sse(__m128i nibbles, __m128i& predictors,
+    __m128i& stepIndices)
+{
+    __m128i steps = _mm_setr_epi32(gIMAStepTable[_mm_cvtsi128_si32(stepIndices)],
+        gIMAStepTable[_mm_extract_epi32(stepIndices, 1)],
+        gIMAStepTable[_mm_extract_epi32(stepIndices, 2)],
+        gIMAStepTable[_mm_extract_epi32(stepIndices, 3)]);
+    __m128i magnitudes = _mm_and_si128(nibbles, _mm_set1_epi32(0x07));
+    __m128i negative = _mm_cmpgt_epi32(nibbles, magnitudes);
+
+    __m128i diffs = _mm_srai_epi32(_mm_mullo_epi32(_mm_add_epi32(
+        _mm_add_epi32(magnitudes, magnitudes), _mm_set1_epi32(1)), steps), 3);
+    diffs = _mm_sub_epi32(_mm_xor_si128(diffs, negative), negative);
+    predictors = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(predictors, diffs),
+        _mm_set1_epi32(-32768)), _mm_set1_epi32(32767));
+
+    // gIMAIndexTable: -1 for magnitudes up to 3, 2 * magnitude - 6 above.
+    __m128i adjustments = _mm_blendv_epi8(_mm_set1_epi32(-1),
+        _mm_sub_epi32(_mm_add_epi32(magnitudes, magnitudes), _mm_set1_epi32(6)),
+        _mm_cmpgt_epi32(magnitudes, _mm_set1_epi32(3)));
+    stepIndices = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(stepIndices, adjustments),
+        _mm_setzero_si128()), _mm_set1_epi32(88));
+
+    return predictors;
+}
+
+template<std::size_t numChannels>
+SNDTOWAV_TARGET("sse4.1")
+static void ima4_decode_packets_sse(const std::uint8_t* packets,
+    std::size_t numPackets, std::int16_t* samples)
+{
+    IMA4LaneBlock<4> block;
+
+    std::size_t packet = 0;
+    for(; packet + 4 <= numPackets; packet += 4)
+    {
+        block.load(&packets[packet * IMA4_PACKET_LENGTH]);
+        __m128i predictors = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block.predictors));
+        __m128i stepIndices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block.stepIndices));
+
+        for(std::size_t i = 0; i < IMA4_PACKET_LENGTH - 2; ++i)
+        {
+            std::int32_t fourBytes;
+            std::memcpy(&fourBytes, block.bytes[i], sizeof(fourBytes));
+            __m128i bytes = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(fourBytes));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(block.samples[i*2]), ima4_process_nibbles_sse(
+                _mm_and_si128(bytes, _mm_set1_epi32(0x0f)), predictors, stepIndices));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(block.samples[i*2 + 1]), ima4_process_nibbles_sse(
+                _mm_srli_epi32(bytes, 4), predictors, stepIndices));
+        }
+
+        block.store<numChannels>(packet, samples);
+    }
+
+    // Fewer than 4 packets remain. packet is a multiple of numChannels, so
+    // the remaining packets start on a new frame.
+    ima4_decode_packets_scalar<numChannels>(&packets[packet * IMA4_PACKET_LENGTH],
+        numPackets - packet, &samples[(packet / numChannels)*IMA4_SAMPLES_PER_PACKET*numChannels]);
 }
 
-// Returns interweaved native-endian signed samples.
-std::vector<std::int16_t> IMA4Decoder::decodeStereoFrame(const std::uint8_t leftFrame[IMA4_PACKET_LENGTH],
-        const std::uint8_t rightFrame[IMA4_PACKET_LENGTH])
+// Per lane, the same as ima4_process_nibble().
+SNDTOWAV_TARGET("avx2")
+static inline __m256i ima4_process_nibbles_avx2(__m256i nibbles, __m256i& predictors,
+    __m256i& stepIndices)
 {
-    std::vector<std::int16_t> leftSamples = decodeFrame(leftFrame);
-    std::vector<std::int16_t> rightSamples = decodeFrame(rightFrame);
+    __m256i steps = _mm256_i32gather_epi32(gIMAStepTable, stepIndices, 4);
+    __m256i magnitudes = _mm256_and_si256(nibbles, _mm256_set1_epi32(0x07));
+    __m256i negative = _mm256_cmpgt_epi32(nibbles, magnitudes);
+
+    __m256i diffs = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_add_epi32(
+        _mm256_add_epi32(magnitudes, magnitudes), _mm256_set1_epi32(1)), steps), 3);
+    diffs = _mm256_sub_epi32(_mm256_xor_si256(diffs, negative), negative);
+    predictors = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(predictors, diffs),
+        _mm256_set1_epi32(-32768)), _mm256_set1_epi32(32767));
+
+    // gIMAIndexTable: -1 for magnitudes up to 3, 2 * magnitude - 6 above.
+    __m256i adjustments = _mm256_blendv_epi8(_mm256_set1_epi32(-1),
+        _mm256_sub_epi32(_mm256_add_epi32(magnitudes, magnitudes), _mm256_set1_epi32(6)),
+        _mm256_cmpgt_epi32(magnitudes, _mm256_set1_epi32(3)));
+    stepIndices = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(stepIndices, adjustments),
+        _mm256_setzero_si256()), _mm256_set1_epi32(88));
+
+    return predictors;
+}
 
-    // Make enough space for both channels.
-    // Both left and right samples should be the same length (32*2 bytes).
-    std::vector<std::int16_t> stereoSamples(leftSamples.size() + rightSamples.size(), 0);
+template<std::size_t numChannels>
+SNDTOWAV_TARGET("avx2")
+static void ima4_decode_packets_avx2(const std::uint8_t* packets,
+    std::size_t numPackets, std::int16_t* samples)
+{
+    IMA4LaneBlock<8> block;
 
-    // Interweave.
-    for(std::size_t i = 0; i < leftSamples.size(); ++i)
+    std::size_t packet = 0;
+    for(; packet + 8 <= numPackets; packet += 8)
     {
-        // Left channel is first!
-        stereoSamples[i*2] = leftSamples[i];
-        stereoSamples[i*2 + 1] = rightSamples[i];
+        block.load(&packets[packet * IMA4_PACKET_LENGTH]);
+        __m256i predictors = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block.predictors));
+        __m256i stepIndices = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block.stepIndices));
+
+        for(std::size_t i = 0; i < IMA4_PACKET_LENGTH - 2; ++i)
+        {
+            __m256i bytes = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(block.bytes[i])));
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(block.samples[i*2]), ima4_process_nibbles_avx2(
+                _mm256_and_si256(bytes, _mm256_set1_epi32(0x0f)), predictors, stepIndices));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(block.samples[i*2 + 1]), ima4_process_nibbles_avx2(
+                _mm256_srli_epi32(bytes, 4), predictors, stepIndices));
+        }
+
+        block.store<numChannels>(packet, samples);
     }
 
-    return stereoSamples;
+    // Fewer than 8 packets remain, starting on a new frame.
+    ima4_decode_packets_sse<numChannels>(&packets[packet * IMA4_PACKET_LENGTH],
+        numPackets - packet, &samples[(packet / numChannels)*IMA4_SAMPLES_PER_PACKET*numChannels]);
+}
+
+#endif
+
+// Picks the kernel of the current kernel set.
+template<std::size_t numChannels>
+static IMA4Decoder::DecodePacketsFunction select_decode_function()
+{
+#if defined(SNDTOWAV_X86)
+    if(CpuFeatures::useAVX2())
+        return ima4_decode_packets_avx2<numChannels>;
+    if(CpuFeatures::useSSE())
+        return ima4_decode_packets_sse<numChannels>;
+#endif
+
+    return ima4_decode_packets_scalar<numChannels>;
+}
+
+IMA4Decoder::IMA4Decoder()
+{
+    // Do nothing
+}
+
+// Only mono and stereo are supported.
+void IMA4Decoder::specialize(std::size_t numChannels)
+{
+    mDecodePackets = numChannels == 2 ? select_decode_function<2>() :
+        select_decode_function<1>();
+    mKernelChannels = numChannels;
 }
 
 std::size_t IMA4Decoder::getEncodedSize(std::size_t numPackets) const
@@ -181,8 +354,6 @@ unsigned IMA4Decoder::getBitsPerSample() const
 bool IMA4Decoder::decode(const std::vector<std::uint8_t>& data,
     std::size_t numChannels)
 {
-    std::vector<std::int16_t> decodedSamples;
-
     if(data.size() % 34 != 0)
     {
         Log::warn << "Warning: data given to IMA4 decoder is not a multiple of 34 bytes! " <<
@@ -200,34 +371,27 @@ bool IMA4Decoder::decode(const std::vector<std::uint8_t>& data,
         return false;
     }
 
-    if(numChannels == 1)
-    {
-        // Iterate through every 34-byte packet.
-        for(long long int i = 0;
-            i < static_cast<long long int>(data.size()) - IMA4_PACKET_LENGTH;
-            i += IMA4_PACKET_LENGTH)
-        {
-            std::vector<std::int16_t> samples = decodeFrame(&data[i]);
+    // Channels are interleaved packet by packet; left channel is first.
+    if(mDecodePackets == nullptr || mKernelChannels != numChannels)
+        specialize(numChannels);
 
-            // From https://stackoverflow.com/questions/2551775/appending-a-vector-to-a-vector
-            decodedSamples.insert(decodedSamples.end(), samples.begin(), samples.end());
-        }
-    } else if(numChannels == 2)
-    {
-        // Iterate through every pair of 34-byte packets.
-        for(long long int i = 0;
-            i < static_cast<long long int>(data.size()) - IMA4_PACKET_LENGTH*2;
-            i += IMA4_PACKET_LENGTH*2)
-        {
-            std::vector<std::int16_t> stereoSamples = decodeStereoFrame(&data[i],
-                &data[i + IMA4_PACKET_LENGTH]);
+    std::size_t packetsPerChunk = cChunkSamples / IMA4_SAMPLES_PER_PACKET;
+    std::size_t framesPerChunk = packetsPerChunk / numChannels;
+    std::size_t numFrames = data.size() / (IMA4_PACKET_LENGTH * numChannels);
+    std::vector<std::int16_t> decodedSamples(packetsPerChunk * IMA4_SAMPLES_PER_PACKET);
 
-            // From https://stackoverflow.com/questions/2551775/appending-a-vector-to-a-vector
-            decodedSamples.insert(decodedSamples.end(), stereoSamples.begin(), stereoSamples.end());
-        }
+    for(std::size_t frame = 0; frame < numFrames; frame += framesPerChunk)
+    {
+        // Decode one chunk, interleaving channels sample by sample.
+        std::size_t numChunkFrames = std::min(framesPerChunk, numFrames - frame);
+        mDecodePackets(&data[frame*numChannels*IMA4_PACKET_LENGTH], numChunkFrames*numChannels,
+            decodedSamples.data());
+
+        if(!outputSamples(decodedSamples.data(),
+            numChunkFrames*numChannels*IMA4_SAMPLES_PER_PACKET))
+            return false;
     }
 
-    setLittleEndianData(decodedSamples);
     return true;
 }
 
@@ -25,48 +25,28 @@
 #include <vector>
 
 const unsigned IMA4_PACKET_LENGTH = 34;
+const unsigned IMA4_SAMPLES_PER_PACKET = 64;
+
+// IMA ADPCM tables, also used by the encoder.
+extern const int gIMAIndexTable[16];
+extern const int gIMAStepTable[89];
 
 class IMA4Decoder : public Decoder
 {
-private:
-    template<class T>
-    static T clamp(long long int min, T value, long long int max)
-    {
-        if(value < min) return min;
-        if(value > max) return max;
-        return value;
-    }
-
-    // Will cast 16-bit value as a signed value, assuming two's compliment.
-    // Why write this? For platform-independance.
-    template<class TDest>
-    static TDest castSigned16Bit(std::uint16_t value)
-    {
-        // Two's complement:
-        std::int16_t positivePart = value & 0x7fff; // 15 LSbits
-
-        // If MSb is 1, we are dealing with a negative value:
-        bool isNegative = (value & 0x8000) == 0x8000;
-       
-        if(isNegative)
-            return static_cast<TDest>(positivePart) - 0x8000; // Subtract sign-bit value
-        else
-            return static_cast<TDest>(positivePart);
-    }
-
-    std::int16_t processNibble(std::uint8_t nibble);
-    std::vector<std::int16_t> decodeFrame(const std::uint8_t frame[IMA4_PACKET_LENGTH]);
-    std::vector<std::int16_t> decodeStereoFrame(const std::uint8_t leftFrame[IMA4_PACKET_LENGTH],
-        const std::uint8_t rightFrame[IMA4_PACKET_LENGTH]);
+public:
+    // Decodes consecutive packets into interleaved samples.
+    using DecodePacketsFunction = void (*)(const std::uint8_t* packets,
+        std::size_t numPackets, std::int16_t* samples);
 
-    // Step index must be a signed value, even if it is clamped!
-    // Failing to do so will result in problematic sound due to overflow.
-    int mStepIndex = 0;
-    int mPredictor = 0;
+private:
+    DecodePacketsFunction mDecodePackets = nullptr;
+    std::size_t mKernelChannels = 0;
 
 public:
     IMA4Decoder();
 
+    void specialize(std::size_t numChannels) override;
+
     std::size_t getEncodedSize(std::size_t numPackets) const override;
     std::size_t getDecodedSize(std::size_t numPackets) const override;
 
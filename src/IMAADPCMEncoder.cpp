@@ -0,0 +1,167 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "IMAADPCMEncoder.hpp"
+#include "IMA4Decoder.hpp" // For the IMA ADPCM tables
+
+#include <algorithm> // For std::min and std::max
+
+// samplesPerBlock must be 1 more than a multiple of 8.
+IMAADPCMEncoder::IMAADPCMEncoder(SampleSink& output, std::size_t numChannels,
+    std::size_t samplesPerBlock)
+    : mOutput(output),
+      mNumChannels(numChannels),
+      mSamplesPerBlock(samplesPerBlock),
+      mStates(numChannels),
+      mBlockSamples(numChannels * samplesPerBlock),
+      mBlock(getBlockAlign(numChannels, samplesPerBlock))
+{
+
+}
+
+// Static
+std::size_t IMAADPCMEncoder::getBlockAlign(std::size_t numChannels,
+    std::size_t samplesPerBlock)
+{
+    // 4-byte header, then 4 bits per remaining sample, per channel.
+    return numChannels * (4 + (samplesPerBlock - 1)/2);
+}
+
+// Static
+// Size of numFrames sample frames once encoded, in whole blocks.
+std::size_t IMAADPCMEncoder::getEncodedSize(std::size_t numChannels,
+    std::size_t samplesPerBlock, std::size_t numFrames)
+{
+    std::size_t numBlocks = (numFrames + samplesPerBlock - 1) / samplesPerBlock;
+    return numBlocks * getBlockAlign(numChannels, samplesPerBlock);
+}
+
+// Picks the nibble whose decoded value is closest to sample, and decodes it
+// like WAV decoders do, by adding shifted steps.
+std::uint8_t IMAADPCMEncoder::encodeSample(int sample, ChannelState& state) const
+{
+    int step = gIMAStepTable[state.stepIndex];
+    int diff = sample - state.predictor;
+    std::uint8_t nibble = 0;
+
+    if(diff < 0)
+    {
+        nibble = 8;
+        diff = -diff;
+    }
+
+    int delta = step >> 3;
+    if(diff >= step)
+    {
+        nibble |= 4;
+        diff -= step;
+        delta += step;
+    }
+
+    if(diff >= step >> 1)
+    {
+        nibble |= 2;
+        diff -= step >> 1;
+        delta += step >> 1;
+    }
+
+    if(diff >= step >> 2)
+    {
+        nibble |= 1;
+        delta += step >> 2;
+    }
+
+    state.predictor += (nibble & 8) ? -delta : delta;
+    state.predictor = std::min(std::max(state.predictor, -32768), 32767);
+    state.stepIndex = std::min(std::max(state.stepIndex + gIMAIndexTable[nibble], 0), 88);
+
+    return nibble;
+}
+
+// Returns true on success, false on failure.
+bool IMAADPCMEncoder::encodeBlock()
+{
+    std::uint8_t* header = mBlock.data();
+    std::uint8_t* nibbles = header + 4*mNumChannels;
+
+    for(std::size_t channel = 0; channel < mNumChannels; ++channel)
+    {
+        // The header sample is exact; the step index carries over from the
+        // previous block.
+        ChannelState& state = mStates[channel];
+        state.predictor = mBlockSamples[channel];
+
+        std::uint16_t first = static_cast<std::uint16_t>(mBlockSamples[channel]);
+        header[channel*4] = static_cast<std::uint8_t>(first & 0xFF);
+        header[channel*4 + 1] = static_cast<std::uint8_t>(first >> 8);
+        header[channel*4 + 2] = static_cast<std::uint8_t>(state.stepIndex);
+        header[channel*4 + 3] = 0;
+
+        // Groups of 8 samples, 4 bytes per channel, low nibble first.
+        for(std::size_t i = 1; i < mSamplesPerBlock; i += 2)
+        {
+            std::size_t group = (i - 1) / 8;
+            std::size_t byte = ((i - 1) % 8) / 2;
+
+            std::uint8_t low = encodeSample(mBlockSamples[i*mNumChannels + channel], state);
+            std::uint8_t high = encodeSample(mBlockSamples[(i + 1)*mNumChannels + channel], state);
+            nibbles[(group*mNumChannels + channel)*4 + byte] =
+                static_cast<std::uint8_t>(low | (high << 4));
+        }
+    }
+
+    mNumBlockSamples = 0;
+    return mOutput.write(mBlock.data(), mBlock.size());
+}
+
+// Returns true on success, false on failure.
+bool IMAADPCMEncoder::write(const std::uint8_t* data, std::size_t size)
+{
+    for(std::size_t i = 0; i < size; ++i)
+    {
+        if(!mHasPendingByte)
+        {
+            mPendingByte = data[i];
+            mHasPendingByte = true;
+            continue;
+        }
+
+        // Little-endian.
+        std::uint16_t unsignedSample = static_cast<std::uint16_t>(mPendingByte | (data[i] << 8));
+        mBlockSamples[mNumBlockSamples++] = static_cast<std::int16_t>(unsignedSample);
+        mHasPendingByte = false;
+
+        if(mNumBlockSamples == mBlockSamples.size() && !encodeBlock())
+            return false;
+    }
+
+    return true;
+}
+
+// Returns true on success, false on failure.
+bool IMAADPCMEncoder::finish()
+{
+    if(mNumBlockSamples == 0)
+        return true;
+
+    // Repeat the last frame, so padding is silent.
+    std::size_t numFrames = mNumBlockSamples / mNumChannels;
+    for(std::size_t i = mNumBlockSamples; i < mBlockSamples.size(); ++i)
+        mBlockSamples[i] = mBlockSamples[(numFrames - 1)*mNumChannels + i % mNumChannels];
+
+    return encodeBlock();
+}
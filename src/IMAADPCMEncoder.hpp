@@ -0,0 +1,69 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef IMA_ADPCM_ENCODER_HPP
+#define IMA_ADPCM_ENCODER_HPP
+
+#include "SampleSink.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Encodes 16-bit little-endian interleaved samples into the IMA ADPCM blocks
+// of WAV files (format 0x11), written to another sink.
+// Each block starts with one header per channel: the first sample, as-is, and
+// the step index. The other samples follow as nibbles, 8 per channel at a
+// time.
+class IMAADPCMEncoder : public SampleSink
+{
+private:
+    struct ChannelState
+    {
+        int predictor = 0;
+        int stepIndex = 0;
+    };
+
+    std::uint8_t encodeSample(int sample, ChannelState& state) const;
+    bool encodeBlock();
+
+    SampleSink& mOutput;
+    std::size_t mNumChannels;
+    std::size_t mSamplesPerBlock;
+    std::vector<ChannelState> mStates;
+    std::vector<std::int16_t> mBlockSamples; // Interleaved.
+    std::size_t mNumBlockSamples = 0;
+    std::vector<std::uint8_t> mBlock;
+    std::uint8_t mPendingByte = 0; // Half of a sample split across writes.
+    bool mHasPendingByte = false;
+
+public:
+    IMAADPCMEncoder(SampleSink& output, std::size_t numChannels,
+        std::size_t samplesPerBlock);
+
+    static std::size_t getBlockAlign(std::size_t numChannels, std::size_t samplesPerBlock);
+    static std::size_t getEncodedSize(std::size_t numChannels, std::size_t samplesPerBlock,
+        std::size_t numFrames);
+
+    bool write(const std::uint8_t* data, std::size_t size) override;
+
+    // Pads and writes the last block, if incomplete.
+    // Returns true on success, false on failure.
+    bool finish();
+};
+
+#endif // IMA_ADPCM_ENCODER_HPP
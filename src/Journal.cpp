@@ -0,0 +1,252 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Journal.hpp"
+#include "Log.hpp"
+
+#include <sstream>
+#include <vector>
+#include <iomanip>
+
+namespace
+{
+    const std::uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+    const std::uint64_t FNV_PRIME = 0x100000001b3ULL;
+    const std::size_t NUM_FIELDS = 6;
+
+    // 64-bit FNV-1a, continuing from a previous hash value.
+    std::uint64_t fnv1a(const char* data, std::size_t size, std::uint64_t hash)
+    {
+        for(std::size_t i = 0; i < size; ++i)
+        {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= FNV_PRIME;
+        }
+
+        return hash;
+    }
+
+}
+
+const std::uint64_t Journal::cInitialHash = FNV_OFFSET_BASIS;
+
+Journal::Journal(const std::string& journalPath)
+    : mJournalPath(journalPath)
+{
+    bool endsWithNewline = load();
+
+    mJournalFile.open(mJournalPath, std::ofstream::out |
+        std::ofstream::binary | std::ofstream::app);
+
+    if(mJournalFile.fail())
+    {
+        Log::err << "Error: could not open journal '" << mJournalPath <<
+            "' for writing!" << std::endl;
+        return;
+    }
+
+    // Terminate a partial entry left by a crash, so that the next
+    // committed entry starts on its own line.
+    if(!endsWithNewline)
+        mJournalFile << '\n' << std::flush;
+}
+
+// Static
+std::string Journal::makeKey(const std::string& inputPath, const std::string& resourceKey)
+{
+    return escape(inputPath) + '\t' + escape(resourceKey);
+}
+
+// Static
+// Tabs and newlines delimit entries, so they must not appear in fields.
+std::string Journal::escape(const std::string& field)
+{
+    std::string escaped;
+
+    for(char c : field)
+    {
+        if(c == '\\')
+            escaped += "\\\\";
+        else if(c == '\t')
+            escaped += "\\t";
+        else if(c == '\n')
+            escaped += "\\n";
+        else
+            escaped += c;
+    }
+
+    return escaped;
+}
+
+// Static
+std::string Journal::unescape(const std::string& field)
+{
+    std::string unescaped;
+
+    for(std::size_t i = 0; i < field.size(); ++i)
+    {
+        if(field[i] == '\\' && i + 1 < field.size())
+        {
+            ++i;
+            if(field[i] == 't')
+                unescaped += '\t';
+            else if(field[i] == 'n')
+                unescaped += '\n';
+            else
+                unescaped += field[i];
+        } else
+        {
+            unescaped += field[i];
+        }
+    }
+
+    return unescaped;
+}
+
+// Loads all committed entries; later entries replace earlier ones.
+// Returns false if the journal ends with a partial (uncommitted) entry.
+bool Journal::load()
+{
+    std::ifstream journalFile(mJournalPath, std::ifstream::in | std::ifstream::binary);
+    if(journalFile.fail())
+        return true; // New journal.
+
+    std::stringstream contents;
+    contents << journalFile.rdbuf();
+    const std::string text = contents.str();
+
+    std::size_t lineStart = 0;
+    std::size_t lineEnd = 0;
+    while((lineEnd = text.find('\n', lineStart)) != std::string::npos)
+    {
+        std::vector<std::string> fields;
+        std::stringstream line(text.substr(lineStart, lineEnd - lineStart));
+        std::string field;
+        while(std::getline(line, field, '\t'))
+            fields.push_back(field);
+
+        lineStart = lineEnd + 1;
+
+        if(fields.size() != NUM_FIELDS)
+            continue; // Empty or damaged line, or written by an older version.
+
+        Entry entry = {fields[2], unescape(fields[3]), unescape(fields[4]), fields[5]};
+        mEntries[fields[0] + '\t' + fields[1]] = entry;
+    }
+
+    Log::verb << "Loaded " << mEntries.size() << " journal entries from '" <<
+        mJournalPath << "'." << std::endl;
+
+    return lineStart == text.size();
+}
+
+bool Journal::isOpen() const
+{
+    return mJournalFile.is_open() && !mJournalFile.fail();
+}
+
+// A resource is up to date if its input is unchanged since the last committed
+// conversion, which had the same options and output path, and its output still
+// exists unmodified.
+bool Journal::isUpToDate(const std::string& inputPath, const std::string& resourceKey,
+    const std::string& inputHash, const std::string& options,
+    const std::string& outputPath) const
+{
+    Entry entry;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto entryIt = mEntries.find(makeKey(inputPath, resourceKey));
+        if(entryIt == mEntries.end())
+            return false;
+
+        entry = entryIt->second;
+    }
+
+    if(entry.inputHash != inputHash || entry.options != options ||
+        entry.outputPath != outputPath)
+        return false;
+
+    // Hashed unlocked, so that workers sharing the journal do not wait on
+    // each other's outputs being read.
+    std::string outputHash;
+    return hashFile(entry.outputPath, outputHash) && outputHash == entry.outputHash;
+}
+
+// Call once the output file is completely written and closed.
+// Returns true on success, false on failure.
+bool Journal::commit(const std::string& inputPath, const std::string& resourceKey,
+    const std::string& inputHash, const std::string& options,
+    const std::string& outputPath)
+{
+    std::string outputHash;
+    bool hashed = hashFile(outputPath, outputHash);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(!isOpen() || !hashed)
+    {
+        Log::err << "Error: could not record '" << resourceKey << "' in journal '" <<
+            mJournalPath << "'!" << std::endl;
+        return false;
+    }
+
+    std::string key = makeKey(inputPath, resourceKey);
+    mJournalFile << key << '\t' << inputHash << '\t' << escape(options) << '\t' <<
+        escape(outputPath) << '\t' << outputHash << '\n' << std::flush;
+
+    Entry entry = {inputHash, options, outputPath, outputHash};
+    mEntries[key] = entry;
+
+    return !mJournalFile.fail();
+}
+
+// Static
+std::string Journal::hash(const char* data, std::size_t size)
+{
+    return hashToString(fnv1a(data, size, FNV_OFFSET_BASIS));
+}
+
+// Static
+std::uint64_t Journal::hash(const char* data, std::size_t size, std::uint64_t previousHash)
+{
+    return fnv1a(data, size, previousHash);
+}
+
+// Static
+std::string Journal::hashToString(std::uint64_t hash)
+{
+    std::ostringstream stream;
+    stream << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return stream.str();
+}
+
+// Static
+// Returns true on success, false if the file cannot be read.
+bool Journal::hashFile(const std::string& filePath, std::string& fileHash)
+{
+    std::ifstream file(filePath, std::ifstream::in | std::ifstream::binary);
+    if(file.fail())
+        return false;
+
+    std::uint64_t hash = FNV_OFFSET_BASIS;
+    char buffer[65536];
+
+    while(file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+        hash = fnv1a(buffer, static_cast<std::size_t>(file.gcount()), hash);
+
+    fileHash = hashToString(hash);
+    return true;
+}
@@ -0,0 +1,79 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <string>
+#include <map>
+#include <fstream>
+#include <mutex>
+#include <cstdint>
+#include <cstddef> // For std::size_t
+
+// Append-only record of converted resources, used for incremental extraction.
+// Each line is one committed entry:
+//     inputPath \t resourceKey \t inputHash \t options \t outputPath \t outputHash \n
+// where options describes the conversion options, so that converting with
+// other options, or to another output, is never skipped.
+// A line is only considered committed once its trailing newline is written,
+// so a crash mid-write leaves at worst a partial last line, which is ignored.
+// Safe to share between threads.
+class Journal
+{
+private:
+    struct Entry
+    {
+        std::string inputHash;
+        std::string options;
+        std::string outputPath;
+        std::string outputHash;
+    };
+
+    static std::string makeKey(const std::string& inputPath, const std::string& resourceKey);
+    static std::string escape(const std::string& field);
+    static std::string unescape(const std::string& field);
+
+    bool load();
+
+    std::string mJournalPath;
+    std::ofstream mJournalFile;
+    std::map<std::string, Entry> mEntries; // Last committed entry per resource.
+    mutable std::mutex mMutex; // Guards the file and entries.
+
+public:
+    Journal(const std::string& journalPath);
+
+    bool isOpen() const;
+
+    bool isUpToDate(const std::string& inputPath, const std::string& resourceKey,
+        const std::string& inputHash, const std::string& options,
+        const std::string& outputPath) const;
+    bool commit(const std::string& inputPath, const std::string& resourceKey,
+        const std::string& inputHash, const std::string& options,
+        const std::string& outputPath);
+
+    // 64-bit FNV-1a, as hex strings. Hashes can also be computed chunk by
+    // chunk, starting from cInitialHash.
+    static const std::uint64_t cInitialHash;
+    static std::string hash(const char* data, std::size_t size);
+    static std::uint64_t hash(const char* data, std::size_t size, std::uint64_t previousHash);
+    static std::string hashToString(std::uint64_t hash);
+    static bool hashFile(const std::string& filePath, std::string& fileHash);
+};
+
+#endif // JOURNAL_HPP
@@ -0,0 +1,114 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef LRU_CACHE_HPP
+#define LRU_CACHE_HPP
+
+#include <list>
+#include <unordered_map>
+#include <utility> // For std::move, std::pair
+#include <cstddef> // For std::size_t
+
+// Least-recently-used cache.
+// Each value has a cost (1 by default, or e.g. its size in bytes); least
+// recently used values are evicted once the total cost exceeds the capacity.
+// Not thread-safe.
+template<class Key, class Value>
+class LRUCache
+{
+private:
+    using Item = std::pair<Key, Value>;
+    using ItemList = std::list<Item>;
+    using CostFunction = std::size_t (*)(const Value&);
+
+    static std::size_t unitCost(const Value&)
+    {
+        return 1;
+    }
+
+    ItemList mItems; // Most recently used first.
+    std::unordered_map<Key, typename ItemList::iterator> mIndex;
+    CostFunction mCostFunction;
+    std::size_t mCapacity;
+    std::size_t mTotalCost = 0;
+
+    void evict()
+    {
+        // Always keep the most recently used value, even if it is too big.
+        while(mTotalCost > mCapacity && mItems.size() > 1)
+        {
+            mTotalCost -= mCostFunction(mItems.back().second);
+            mIndex.erase(mItems.back().first);
+            mItems.pop_back();
+        }
+    }
+
+public:
+    LRUCache(std::size_t capacity, CostFunction costFunction = unitCost)
+        : mCostFunction(costFunction)
+        , mCapacity(capacity)
+    {
+
+    }
+
+    // Returns nullptr if not found.
+    // The returned pointer is valid until the next insert() or erase().
+    Value* find(const Key& key)
+    {
+        auto indexIt = mIndex.find(key);
+        if(indexIt == mIndex.end())
+            return nullptr;
+
+        // Mark as most recently used.
+        mItems.splice(mItems.begin(), mItems, indexIt->second);
+        return &indexIt->second->second;
+    }
+
+    void insert(const Key& key, Value value)
+    {
+        erase(key);
+
+        mTotalCost += mCostFunction(value);
+        mItems.emplace_front(key, std::move(value));
+        mIndex[key] = mItems.begin();
+
+        evict();
+    }
+
+    void erase(const Key& key)
+    {
+        auto indexIt = mIndex.find(key);
+        if(indexIt == mIndex.end())
+            return;
+
+        mTotalCost -= mCostFunction(indexIt->second->second);
+        mItems.erase(indexIt->second);
+        mIndex.erase(indexIt);
+    }
+
+    std::size_t size() const
+    {
+        return mItems.size();
+    }
+
+    std::size_t getTotalCost() const
+    {
+        return mTotalCost;
+    }
+};
+
+#endif // LRU_CACHE_HPP
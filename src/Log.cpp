@@ -19,23 +19,41 @@
 #include <iostream>
 
 std::stringstream Log::mDeadStream;
+bool Log::mVerbose = false;
+bool Log::mUseStandardError = false;
 
-std::ostream Log::info(std::cout.rdbuf());
-std::ostream Log::warn(std::cout.rdbuf());
-std::ostream Log::err(std::cerr.rdbuf());
+thread_local std::ostream Log::info(Log::getInfoBuffer());
+thread_local std::ostream Log::warn(Log::getInfoBuffer());
+thread_local std::ostream Log::err(std::cerr.rdbuf());
 
 // Initilally, verbose is disabled; it will not print anything.
-std::ostream Log::verb(Log::mDeadStream.rdbuf());
+thread_local std::ostream Log::verb(Log::getVerboseBuffer());
+
+// Static
+std::streambuf* Log::getInfoBuffer()
+{
+    return mUseStandardError ? std::cerr.rdbuf() : std::cout.rdbuf();
+}
+
+// Static
+std::streambuf* Log::getVerboseBuffer()
+{
+    return mVerbose ? getInfoBuffer() : mDeadStream.rdbuf();
+}
 
 // Static
 void Log::setVerbose(bool verboseOn)
 {
-    if(verboseOn)
-    {
-        verb.rdbuf(std::cout.rdbuf());
-    } else
-    {
-        verb.rdbuf(mDeadStream.rdbuf());
-    }
+    mVerbose = verboseOn;
+    verb.rdbuf(getVerboseBuffer());
 }
 
+// Static
+void Log::useStandardError()
+{
+    mUseStandardError = true;
+
+    info.rdbuf(getInfoBuffer());
+    warn.rdbuf(getInfoBuffer());
+    verb.rdbuf(getVerboseBuffer());
+}
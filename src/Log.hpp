@@ -24,15 +24,26 @@
 class Log
 {
 private:
+    static std::streambuf* getInfoBuffer();
+    static std::streambuf* getVerboseBuffer();
+
     static std::stringstream mDeadStream; // Will not print anything.
+    static bool mVerbose;
+    static bool mUseStandardError;
 
 public:
-    static std::ostream info; // Normal logging
-    static std::ostream warn; // Warning
-    static std::ostream err;  // Error
-    static std::ostream verb; // Verbose
+    // Each thread gets its own streams, all writing to the same
+    // (thread-safe) standard buffers. Settings must be changed before
+    // starting other threads.
+    static thread_local std::ostream info; // Normal logging
+    static thread_local std::ostream warn; // Warning
+    static thread_local std::ostream err;  // Error
+    static thread_local std::ostream verb; // Verbose
 
     static void setVerbose(bool verboseOn);
+
+    // Sends all logging to stderr, leaving stdout free for output data.
+    static void useStandardError();
 };
 
 #endif // LOG_HPP
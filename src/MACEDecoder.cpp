@@ -30,15 +30,17 @@
  * - Modified methods' interfaces and changed some types.
  */
 
-// This class decodes MACE 3:1 sounds.
+// These classes decode MACE 3:1 and MACE 6:1 sounds.
 // Important note:
 //   - MACE would normally decode into 8-bit sound samples. However,
 //     this implementation of the algorithm decodes into 16-bit samples.
 
 #include "MACEDecoder.hpp"
 #include "Log.hpp"
+#include "Endian.hpp"
 
-#include <cassert>
+#include <vector>
+#include <algorithm> // For std::min and std::max
 
 static const std::int16_t MACEtab1[] = {-13, 8, 76, 222, 222, 76, 8, -13};
 
@@ -146,67 +148,356 @@ static const std::int16_t MACEtab4[][2] = {
     { 14576,  32767}, { 15226,  32767}, { 15906,  32767}, { 16615,  32767}
 };
 
-static const struct
+#define QT_8S_2_16S(x) (((x) & 0xFF00) | (((x) >> 8) & 0xFF))
+
+// MACEtab2 and MACEtab4 re-laid out so that all steps of a step index sit
+// together, with the mirrored (negative) half precomputed: entry 'val' of a
+// row is the step ffmpeg's read_table() returns for 'val'.
+struct MACEStepTable
 {
-    const std::int16_t *tab1;
-    const std::int16_t *tab2;
-    int stride;
-} tabs[] = {
-    {MACEtab1, &MACEtab2[0][0], 4},
-    {MACEtab3, &MACEtab4[0][0], 2},
-    {MACEtab1, &MACEtab2[0][0], 4}
+    struct Row
+    {
+        std::int16_t wide[8];   // 3-bit fields, from MACEtab2.
+        std::int16_t narrow[4]; // 2-bit fields, from MACEtab4.
+    };
+
+    Row rows[128];
+
+    MACEStepTable()
+    {
+        for(int i = 0; i < 128; ++i)
+        {
+            for(int val = 0; val < 4; ++val)
+            {
+                rows[i].wide[val] = MACEtab2[i][val];
+                rows[i].wide[7 - val] = static_cast<std::int16_t>(-1 - MACEtab2[i][val]);
+            }
+
+            for(int val = 0; val < 2; ++val)
+            {
+                rows[i].narrow[val] = MACEtab4[i][val];
+                rows[i].narrow[3 - val] = static_cast<std::int16_t>(-1 - MACEtab4[i][val]);
+            }
+        }
+    }
 };
 
-#define QT_8S_2_16S(x) (((x) & 0xFF00) | (((x) >> 8) & 0xFF))
+static const MACEStepTable cStepTable;
 
-struct ChannelData
+static inline const MACEStepTable::Row& step_row(int index)
 {
-    std::int16_t index, factor, prev2, previous, level;
-};
+    return cStepTable.rows[(index & 0x7f0) >> 4];
+}
 
-struct MACEContext
+// Moves the step index; negative indices are clamped to 0 without branching.
+static inline int advance_index(int index, int indexStep)
 {
-    ChannelData chd[2];
-};
+    index += indexStep - (index >> 5);
+    return index & ~(index >> 31);
+}
 
-static inline std::int16_t mace_broken_clip_int16(int n)
+// Same as ffmpeg's, including the off-by-one on the negative side.
+// Written with selects, which compile to conditional moves.
+static inline int mace_broken_clip_int16(int n)
 {
-    if(n > 32767)
-        return 32767;
-    else if(n < -32768)
-        return -32767;
-    else
-        return n;
+    n = n > 32767 ? 32767 : n;
+    return n < -32768 ? -32767 : n;
 }
 
-static std::int16_t read_table(ChannelData* chd, uint8_t val, int tab_idx)
+static inline std::int16_t mace3_sample(int step, int& level)
 {
-    std::int16_t current;
+    int current = mace_broken_clip_int16(step + level);
+    level = current - (current >> 3);
+    return static_cast<std::int16_t>(QT_8S_2_16S(current));
+}
+
+// Decodes the 3 samples of one MACE 3:1 byte, in straight-line code.
+// Samples are written 'stride' apart, so channels can be interleaved.
+static inline void mace3_decode_byte(MACEDecoder::ChannelData& chd, std::uint8_t pkt, std::int16_t* out,
+    std::size_t stride)
+{
+    int index = chd.index;
+    int level = chd.level;
+
+    int val = pkt & 7;
+    int step = step_row(index).wide[val];
+    index = advance_index(index, MACEtab1[val]);
+    out[0] = mace3_sample(step, level);
+
+    val = (pkt >> 3) & 3;
+    step = step_row(index).narrow[val];
+    index = advance_index(index, MACEtab3[val]);
+    out[stride] = mace3_sample(step, level);
+
+    val = pkt >> 5;
+    step = step_row(index).wide[val];
+    index = advance_index(index, MACEtab1[val]);
+    out[2 * stride] = mace3_sample(step, level);
 
-    if(val < tabs[tab_idx].stride)
-        current = tabs[tab_idx].tab2[((chd->index & 0x7f0) >> 4) * tabs[tab_idx].stride + val];
+    chd.index = static_cast<std::int16_t>(index);
+    chd.level = static_cast<std::int16_t>(level);
+}
+
+// Decodes one MACE 6:1 field into 2 samples, written 'stride' apart.
+static inline void mace6_decode_field(MACEDecoder::ChannelData& chd, int step, std::int16_t* out,
+    std::size_t stride)
+{
+    int current = step;
+    int factor = chd.factor;
+
+    if((chd.previous ^ current) >= 0)
+        factor = factor + 506 > 32767 ? 32767 : factor + 506;
     else
-        current = - 1 - tabs[tab_idx].tab2[((chd->index & 0x7f0) >> 4)*tabs[tab_idx].stride + 2*tabs[tab_idx].stride-val-1];
+        factor = factor - 314 < -32768 ? -32767 : factor - 314;
+
+    current = mace_broken_clip_int16(current + chd.level);
+
+    chd.factor = static_cast<std::int16_t>(factor);
+    chd.level = static_cast<std::int16_t>((current * factor) >> 15);
+    current >>= 1;
+
+    int previous = chd.previous;
+    int prev2 = chd.prev2;
+    out[0] = static_cast<std::int16_t>(QT_8S_2_16S(previous + prev2 - ((prev2 - current) >> 2)));
+    out[stride] = static_cast<std::int16_t>(QT_8S_2_16S(previous + current + ((prev2 - current) >> 2)));
+
+    chd.prev2 = chd.previous;
+    chd.previous = static_cast<std::int16_t>(current);
+}
+
+// Decodes the 6 samples of one MACE 6:1 byte. Unlike MACE 3:1, fields are
+// read from the most significant bits.
+static inline void mace6_decode_byte(MACEDecoder::ChannelData& chd, std::uint8_t pkt, std::int16_t* out,
+    std::size_t stride)
+{
+    int val = pkt >> 5;
+    int step = step_row(chd.index).wide[val];
+    chd.index = static_cast<std::int16_t>(advance_index(chd.index, MACEtab1[val]));
+    mace6_decode_field(chd, step, out, stride);
 
-    if(( chd->index += tabs[tab_idx].tab1[val]-(chd->index >> 5) ) < 0)
-        chd->index = 0;
+    val = (pkt >> 3) & 3;
+    step = step_row(chd.index).narrow[val];
+    chd.index = static_cast<std::int16_t>(advance_index(chd.index, MACEtab3[val]));
+    mace6_decode_field(chd, step, out + 2 * stride, stride);
 
-    return current;
+    val = pkt & 7;
+    step = step_row(chd.index).wide[val];
+    chd.index = static_cast<std::int16_t>(advance_index(chd.index, MACEtab1[val]));
+    mace6_decode_field(chd, step, out + 4 * stride, stride);
 }
 
-MACEDecoder::MACEDecoder()
+// Packet decoders, for packet frames laid out one channel after the other.
+static inline void mace3_decode_packet(MACEDecoder::ChannelData& chd,
+    const std::uint8_t* packet, std::int16_t* out, std::size_t stride)
 {
-    // Do nothing
+    mace3_decode_byte(chd, packet[0], out, stride);
+    mace3_decode_byte(chd, packet[1], out + 3 * stride, stride);
+}
+
+static inline void mace6_decode_packet(MACEDecoder::ChannelData& chd,
+    const std::uint8_t* packet, std::int16_t* out, std::size_t stride)
+{
+    mace6_decode_byte(chd, packet[0], out, stride);
+}
+
+// Channels are decoded in lockstep, in a single pass over the packets,
+// so frames come out interleaved. fixedChannels is the channel count when
+// known at compile time, letting the channel loop unroll, or 0.
+template<std::size_t bytesPerPacket, void (*decodePacket)(MACEDecoder::ChannelData&,
+    const std::uint8_t*, std::int16_t*, std::size_t), std::size_t fixedChannels>
+static void mace_decode_frames(const std::uint8_t* data, std::size_t numChannels,
+    std::size_t numFrames, MACEDecoder::ChannelData* channels, std::int16_t* out)
+{
+    if(fixedChannels != 0)
+        numChannels = fixedChannels;
+
+    const std::uint8_t* dataEnd = data + numFrames * numChannels * bytesPerPacket;
+
+    for(const std::uint8_t* packet = data; packet < dataEnd; out += numChannels * 6)
+    {
+        for(std::size_t chan = 0; chan < numChannels; chan++)
+        {
+            decodePacket(channels[chan], packet, out + chan, numChannels);
+            packet += bytesPerPacket;
+        }
+    }
+}
+
+template<std::size_t bytesPerPacket, void (*decodePacket)(MACEDecoder::ChannelData&,
+    const std::uint8_t*, std::int16_t*, std::size_t)>
+static MACEDecoder::KernelFunction select_kernel(std::size_t numChannels)
+{
+    switch(numChannels)
+    {
+    case 1:
+        return mace_decode_frames<bytesPerPacket, decodePacket, 1>;
+    case 2:
+        return mace_decode_frames<bytesPerPacket, decodePacket, 2>;
+    default:
+        return mace_decode_frames<bytesPerPacket, decodePacket, 0>;
+    }
+}
+
+static MACEDecoder::KernelFunction select_kernel(std::size_t bytesPerPacket,
+    std::size_t numChannels)
+{
+    if(bytesPerPacket == 2)
+        return select_kernel<2, mace3_decode_packet>(numChannels);
+
+    return select_kernel<1, mace6_decode_packet>(numChannels);
+}
+
+static void write_big_value(std::ostream& out, std::uint32_t value, std::size_t size)
+{
+    for(std::size_t i = size; i-- > 0; )
+        out.put(static_cast<char>((value >> (i * 8)) & 0xFF));
+}
+
+static std::uint32_t read_big_value(std::istream& in, std::size_t size)
+{
+    std::uint32_t value = 0;
+    for(std::size_t i = 0; i < size; ++i)
+        value = (value << 8) | static_cast<std::uint8_t>(in.get());
+
+    return value;
+}
+
+// Hashes 8 bytes at a time, FNV-1a style, so that checking that a seek index
+// matches a sound costs far less than decoding it.
+static std::uint64_t hash_data(const std::vector<std::uint8_t>& data)
+{
+    const std::uint64_t prime = 0x100000001b3ULL;
+    std::uint64_t hash = 0xcbf29ce484222325ULL ^ data.size();
+
+    std::size_t i = 0;
+    for(; i + 8 <= data.size(); i += 8)
+    {
+        std::uint64_t word = 0;
+        Endian::loadLittle(data.data() + i, &word, 1);
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 32; // Carries high bytes down.
+    }
+
+    for(; i < data.size(); ++i)
+        hash = (hash ^ data[i]) * prime;
+
+    return hash;
+}
+
+static const char cSeekIndexMagic[4] = {'M', 'S', 'I', 'X'};
+static const std::size_t cSeekIndexHeaderSize = 22;
+static const std::size_t cSeekIndexStateSize = 10;
+
+// Layout, big-endian: magic, interval (32 bits), number of channels (16 bits),
+// hash of the encoded data (64 bits), number of states (32 bits), then index,
+// factor, prev2, previous and level of each state (16 bits each).
+bool MACEDecoder::SeekIndex::save(std::ostream& out) const
+{
+    out.write(cSeekIndexMagic, sizeof(cSeekIndexMagic));
+    write_big_value(out, static_cast<std::uint32_t>(interval), 4);
+    write_big_value(out, static_cast<std::uint32_t>(numChannels), 2);
+    write_big_value(out, static_cast<std::uint32_t>(dataHash >> 32), 4);
+    write_big_value(out, static_cast<std::uint32_t>(dataHash), 4);
+    write_big_value(out, static_cast<std::uint32_t>(states.size()), 4);
+
+    for(const ChannelData& state : states)
+    {
+        write_big_value(out, static_cast<std::uint16_t>(state.index), 2);
+        write_big_value(out, static_cast<std::uint16_t>(state.factor), 2);
+        write_big_value(out, static_cast<std::uint16_t>(state.prev2), 2);
+        write_big_value(out, static_cast<std::uint16_t>(state.previous), 2);
+        write_big_value(out, static_cast<std::uint16_t>(state.level), 2);
+    }
+
+    return !out.fail();
+}
+
+bool MACEDecoder::SeekIndex::load(std::istream& in)
+{
+    char magic[sizeof(cSeekIndexMagic)] = {0};
+    in.read(magic, sizeof(magic));
+    if(in.fail() || !std::equal(magic, magic + sizeof(magic), cSeekIndexMagic))
+    {
+        Log::err << "Error: not a MACE seek index!" << std::endl;
+        return false;
+    }
+
+    interval = read_big_value(in, 4);
+    numChannels = read_big_value(in, 2);
+    dataHash = static_cast<std::uint64_t>(read_big_value(in, 4)) << 32;
+    dataHash |= read_big_value(in, 4);
+    std::size_t numStates = read_big_value(in, 4);
+
+    if(in.fail() || interval == 0 || numChannels == 0 || numStates % numChannels != 0)
+    {
+        Log::err << "Error: MACE seek index is corrupted!" << std::endl;
+        return false;
+    }
+
+    states.clear();
+    for(std::size_t i = 0; i < numStates && !in.fail(); ++i)
+    {
+        ChannelData state;
+        state.index = static_cast<std::int16_t>(read_big_value(in, 2));
+        state.factor = static_cast<std::int16_t>(read_big_value(in, 2));
+        state.prev2 = static_cast<std::int16_t>(read_big_value(in, 2));
+        state.previous = static_cast<std::int16_t>(read_big_value(in, 2));
+        state.level = static_cast<std::int16_t>(read_big_value(in, 2));
+        states.push_back(state);
+    }
+
+    if(in.fail())
+    {
+        Log::err << "Error: MACE seek index is truncated!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+const std::size_t MACEDecoder::cSeekIndexInterval = 1024; // 6144 samples per channel.
+
+MACEDecoder::MACEDecoder(std::size_t bytesPerPacket)
+    : mBytesPerPacket(bytesPerPacket)
+{
+
+}
+
+// Decodes numFrames packet frames into out, advancing channel states.
+void MACEDecoder::runKernel(const std::uint8_t* data, std::size_t numChannels,
+    std::size_t numFrames, std::vector<ChannelData>& channels, std::int16_t* out) const
+{
+    KernelFunction kernel = numChannels == mKernelChannels ? mKernel :
+        select_kernel(mBytesPerPacket, numChannels);
+    kernel(data, numChannels, numFrames, channels.data(), out);
+}
+
+void MACEDecoder::specialize(std::size_t numChannels)
+{
+    mKernel = select_kernel(mBytesPerPacket, numChannels);
+    mKernelChannels = numChannels;
+}
+
+bool MACEDecoder::checkSize(const std::vector<std::uint8_t>& data,
+    std::size_t numChannels) const
+{
+    if(numChannels == 0 || data.size() % (numChannels * mBytesPerPacket) != 0)
+    {
+        Log::err << "Error: cannot decode MACE; input buffer has an odd length!" << std::endl;
+        return false;
+    }
+
+    return true;
 }
 
 std::size_t MACEDecoder::getEncodedSize(std::size_t numPackets) const
 {
-    return numPackets * 2; // 2 bytes per packet
+    return numPackets * mBytesPerPacket;
 }
 
 std::size_t MACEDecoder::getDecodedSize(std::size_t numPackets) const
 {
-    // 6x 16-bit samples per packet.
+    // 6x 16-bit samples per packet, for both 3:1 and 6:1.
     // Normally, MACE would output 6x 8-bit samples, but this algorithm
     // outputs 6x 16-bit samples instead.
     return numPackets * 6 * 2;
@@ -218,46 +509,148 @@ unsigned MACEDecoder::getBitsPerSample() const
     return 16;
 }
 
-// Decodes MACE 3:1 compressed sound only.
 // Decodes into 16-bit samples!
 bool MACEDecoder::decode(const std::vector<std::uint8_t>& data,
     std::size_t numChannels)
 {
-    std::size_t nSamples = 3 * static_cast<int>(data.size());
-    std::vector<std::int16_t> decodedData(nSamples);
+    return decodeFrames(data, numChannels, 0, data.size());
+}
 
-    if(data.size() % (numChannels * 2) != 0)
-    {
-        Log::err << "Error: cannot decode MACE; input buffer has an odd length!" << std::endl;
+bool MACEDecoder::decodeFrames(const std::vector<std::uint8_t>& data,
+    std::size_t numChannels, std::size_t firstFrame, std::size_t endFrame)
+{
+    if(!checkSize(data, numChannels))
         return false;
+
+    std::size_t frameSize = numChannels * mBytesPerPacket;
+    std::size_t frameSamples = numChannels * 6;
+    endFrame = std::min(endFrame, data.size() / frameSize);
+
+    std::vector<ChannelData> channels(numChannels);
+    std::size_t frame = 0;
+
+    if(mSeekIndex != nullptr && mSeekIndex->numChannels == numChannels &&
+        !mSeekIndex->states.empty())
+    {
+        std::size_t checkpoint = std::min(firstFrame / mSeekIndex->interval,
+            mSeekIndex->states.size() / numChannels - 1);
+
+        std::copy(mSeekIndex->states.begin() + checkpoint * numChannels,
+            mSeekIndex->states.begin() + (checkpoint + 1) * numChannels, channels.begin());
+        frame = checkpoint * mSeekIndex->interval;
     }
 
-    std::int16_t* out = decodedData.data();
+    std::vector<std::int16_t> decodedData(std::max(cChunkSamples, frameSamples));
+    std::size_t chunkFrames = decodedData.size() / frameSamples;
 
-    MACEContext ctx = {};
+    // Frames before firstFrame are only decoded for their state.
+    while(frame < firstFrame && frame < endFrame)
+    {
+        std::size_t numFrames = std::min(chunkFrames, firstFrame - frame);
+        runKernel(data.data() + frame * frameSize, numChannels, numFrames, channels,
+            decodedData.data());
+        frame += numFrames;
+    }
 
-    for(std::size_t chan = 0; chan < numChannels; chan++)
-    for(std::size_t j = 0; j < data.size() / (numChannels * 2); j++)
-    for(std::size_t k = 0; k < 2; k++)
+    while(frame < endFrame)
     {
-        std::uint8_t pkt = static_cast<std::uint8_t>(data[(chan * 2) + (j * numChannels * 2) + k]);
+        std::size_t numFrames = std::min(chunkFrames, endFrame - frame);
+        runKernel(data.data() + frame * frameSize, numChannels, numFrames, channels,
+            decodedData.data());
 
-        int val2[3] = { pkt & 7, (pkt >> 3) & 3, pkt >> 5 };
+        // 16-bit samples.
+        if(!outputSamples(decodedData.data(), numFrames * frameSamples))
+            return false;
 
-        for(int l = 0; l < 3; l++)
-        {
-            std::int16_t current = read_table(&ctx.chd[chan], static_cast<std::uint8_t>(val2[l]), l);
-            current = mace_broken_clip_int16(current + ctx.chd[chan].level);
-            ctx.chd[chan].level = current - (current >> 3);
-            current = QT_8S_2_16S(current);
-            *out = current;
-            out++;
-        }
+        frame += numFrames;
     }
 
-    assert(out == decodedData.data() + decodedData.size());
+    return true;
+}
+
+bool MACEDecoder::buildSeekIndex(const std::vector<std::uint8_t>& data,
+    std::size_t numChannels, std::size_t interval, SeekIndex& seekIndex) const
+{
+    if(interval == 0)
+    {
+        Log::err << "Error: MACE seek index interval must not be 0!" << std::endl;
+        return false;
+    }
+
+    if(!checkSize(data, numChannels))
+        return false;
+
+    std::size_t frameSize = numChannels * mBytesPerPacket;
+    std::size_t frameSamples = numChannels * 6;
+    std::size_t totalFrames = data.size() / frameSize;
+
+    std::vector<ChannelData> channels(numChannels);
+    std::vector<std::int16_t> decodedData(std::max(cChunkSamples, frameSamples));
+    std::size_t chunkFrames = decodedData.size() / frameSamples;
+
+    seekIndex.interval = interval;
+    seekIndex.numChannels = numChannels;
+    seekIndex.dataHash = hash_data(data);
+    seekIndex.states.clear();
+
+    for(std::size_t frame = 0; frame < totalFrames || frame == 0; )
+    {
+        if(frame % interval == 0)
+            seekIndex.states.insert(seekIndex.states.end(), channels.begin(), channels.end());
+
+        std::size_t numFrames = std::min(std::min(chunkFrames, interval - frame % interval),
+            totalFrames - frame);
+        if(numFrames == 0)
+            break; // Empty sound.
+
+        runKernel(data.data() + frame * frameSize, numChannels, numFrames, channels,
+            decodedData.data());
+        frame += numFrames;
+    }
 
-    // 16-bit samples.
-    setLittleEndianData(decodedData);
     return true;
 }
+
+// One checkpoint per interval, and one for empty sounds.
+std::size_t MACEDecoder::getNumCheckpoints(const std::vector<std::uint8_t>& data,
+    std::size_t numChannels, std::size_t interval) const
+{
+    std::size_t numFrames = data.size() / (numChannels * mBytesPerPacket);
+    return std::max<std::size_t>((numFrames + interval - 1) / interval, 1);
+}
+
+bool MACEDecoder::matchesSeekIndex(const std::vector<std::uint8_t>& data,
+    std::size_t numChannels, const SeekIndex& seekIndex) const
+{
+    return numChannels != 0 && seekIndex.numChannels == numChannels &&
+        seekIndex.interval != 0 && seekIndex.states.size() ==
+            getNumCheckpoints(data, numChannels, seekIndex.interval) * numChannels &&
+        seekIndex.dataHash == hash_data(data);
+}
+
+std::size_t MACEDecoder::getSeekIndexSize(const std::vector<std::uint8_t>& data,
+    std::size_t numChannels, std::size_t interval) const
+{
+    if(numChannels == 0 || interval == 0)
+        return 0;
+
+    return cSeekIndexHeaderSize +
+        getNumCheckpoints(data, numChannels, interval) * numChannels * cSeekIndexStateSize;
+}
+
+void MACEDecoder::setSeekIndex(const SeekIndex* seekIndex)
+{
+    mSeekIndex = seekIndex;
+}
+
+MACE3Decoder::MACE3Decoder()
+    : MACEDecoder(2) // 2 bytes per packet
+{
+
+}
+
+MACE6Decoder::MACE6Decoder()
+    : MACEDecoder(1) // 1 byte per packet
+{
+
+}
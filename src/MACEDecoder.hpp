@@ -21,21 +21,111 @@
 #include "Decoder.hpp"
 
 #include <vector>
+#include <istream>
+#include <ostream>
 #include <cstddef>
 #include <cstdint>
 
+// Base of the MACE 3:1 and 6:1 decoders.
 class MACEDecoder : public Decoder
 {
 public:
-    MACEDecoder();
+    // Decoding state of one channel, carried across the whole stream.
+    struct ChannelData
+    {
+        std::int16_t index = 0;
+        std::int16_t factor = 0;
+        std::int16_t prev2 = 0;
+        std::int16_t previous = 0;
+        std::int16_t level = 0;
+    };
+
+    // Channel states snapshotted every 'interval' packet frames, so that
+    // decoding can start from the nearest checkpoint instead of the beginning.
+    // Checkpoint i is at packet frame i * interval, and its states start at
+    // states[i * numChannels].
+    struct SeekIndex
+    {
+        std::size_t interval = 0;
+        std::size_t numChannels = 0;
+        std::uint64_t dataHash = 0; // Of the encoded data it was built from.
+        std::vector<ChannelData> states;
+
+        // Compact binary form, to store with the resource metadata.
+        // Returns true on success, false on failure.
+        bool save(std::ostream& out) const;
+        bool load(std::istream& in);
+    };
+
+    // Decodes packet frames into interleaved samples, advancing channel states.
+    using KernelFunction = void (*)(const std::uint8_t* data, std::size_t numChannels,
+        std::size_t numFrames, ChannelData* channels, std::int16_t* out);
+
+private:
+    void runKernel(const std::uint8_t* data, std::size_t numChannels,
+        std::size_t numFrames, std::vector<ChannelData>& channels,
+        std::int16_t* out) const;
+    bool checkSize(const std::vector<std::uint8_t>& data, std::size_t numChannels) const;
+    std::size_t getNumCheckpoints(const std::vector<std::uint8_t>& data,
+        std::size_t numChannels, std::size_t interval) const;
+
+    std::size_t mBytesPerPacket;
+    const SeekIndex* mSeekIndex = nullptr;
+    KernelFunction mKernel = nullptr;
+    std::size_t mKernelChannels = 0;
+
+protected:
+    MACEDecoder(std::size_t bytesPerPacket);
+
+public:
+    static const std::size_t cSeekIndexInterval; // Default, in packet frames.
 
     std::size_t getEncodedSize(std::size_t numPackets) const override;
     std::size_t getDecodedSize(std::size_t numPackets) const override;
 
     unsigned getBitsPerSample() const override;
 
+    void specialize(std::size_t numChannels) override;
+
     bool decode(const std::vector<std::uint8_t>& data,
         std::size_t numChannels) override;
+
+    // Decodes packet frames [firstFrame, endFrame) only, starting from the
+    // closest checkpoint of the seek index if one is set.
+    // Returns true on success, false on failure.
+    bool decodeFrames(const std::vector<std::uint8_t>& data, std::size_t numChannels,
+        std::size_t firstFrame, std::size_t endFrame) override;
+
+    // Decodes the state of the whole stream, without outputting anything.
+    // Returns true on success, false on failure.
+    bool buildSeekIndex(const std::vector<std::uint8_t>& data, std::size_t numChannels,
+        std::size_t interval, SeekIndex& seekIndex) const;
+
+    // Returns true if seekIndex was built from data, with numChannels.
+    bool matchesSeekIndex(const std::vector<std::uint8_t>& data, std::size_t numChannels,
+        const SeekIndex& seekIndex) const;
+
+    // Size of the saved seek index of data, in bytes.
+    std::size_t getSeekIndexSize(const std::vector<std::uint8_t>& data,
+        std::size_t numChannels, std::size_t interval) const;
+
+    // Index used by decodeFrames(), owned by the caller. Set to nullptr to
+    // always decode from the beginning.
+    void setSeekIndex(const SeekIndex* seekIndex);
+};
+
+// MACE 3:1 ('MAC3').
+class MACE3Decoder : public MACEDecoder
+{
+public:
+    MACE3Decoder();
+};
+
+// MACE 6:1 ('MAC6').
+class MACE6Decoder : public MACEDecoder
+{
+public:
+    MACE6Decoder();
 };
 
 #endif // MACE_DECODER_HPP
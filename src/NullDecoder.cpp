@@ -18,38 +18,168 @@
 // Use this pass-through class for uncompressed sound.
 
 #include "NullDecoder.hpp"
+#include "CpuFeatures.hpp"
 #include "Log.hpp"
 
-NullDecoder::NullDecoder(unsigned bitsPerSample)
-    : mBitsPerSample(bitsPerSample)
+#include <algorithm> // For std::min
+
+#if defined(SNDTOWAV_X86)
+#include <immintrin.h>
+#elif defined(SNDTOWAV_NEON)
+#include <arm_neon.h>
+#endif
+
+// Reverses the bytes of each big-endian sample, giving little-endian samples.
+using SwapFunction = void (*)(const std::uint8_t* data, std::size_t numSamples,
+    std::uint8_t* samples);
+
+template<std::size_t bytesPerSample>
+static inline void swap_bytes_scalar(const std::uint8_t* data, std::size_t numSamples,
+    std::uint8_t* samples)
+{
+    for(std::size_t i = 0; i < numSamples; ++i)
+    {
+        for(std::size_t byte = 0; byte < bytesPerSample; ++byte)
+            samples[i*bytesPerSample + byte] = data[i*bytesPerSample + bytesPerSample - 1 - byte];
+    }
+}
+
+// The vector kernels shuffle whole vectors of samples. 24-bit samples don't
+// divide vectors evenly, so the last bytes of each vector are rewritten by the
+// next iteration. The scalar kernel handles the tail.
+
+#if defined(SNDTOWAV_X86)
+
+template<std::size_t bytesPerSample>
+SNDTOWAV_TARGET("ssse3")
+static void swap_bytes_ssse3(const std::uint8_t* data, std::size_t numSamples,
+    std::uint8_t* samples)
 {
+    const __m128i order = bytesPerSample == 2 ?
+        _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14) :
+        bytesPerSample == 3 ?
+        _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15) :
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const std::size_t samplesPerVector = 16/bytesPerSample;
+    const std::size_t size = numSamples * bytesPerSample;
 
+    std::size_t i = 0;
+    for(; i*bytesPerSample + 16 <= size; i += samplesPerVector)
+    {
+        __m128i vector = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i*bytesPerSample));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(samples + i*bytesPerSample),
+            _mm_shuffle_epi8(vector, order));
+    }
+
+    swap_bytes_scalar<bytesPerSample>(data + i*bytesPerSample, numSamples - i,
+        samples + i*bytesPerSample);
 }
 
-// Big-endian std::vector<std::uint8_t> to native-endian
-// std::vector<std::int16_t>.
-std::vector<std::int16_t> NullDecoder::bigDataTo16BitSamples(
-    const std::vector<std::uint8_t>& data)
+template<std::size_t bytesPerSample>
+SNDTOWAV_TARGET("avx2")
+static void swap_bytes_avx2(const std::uint8_t* data, std::size_t numSamples,
+    std::uint8_t* samples)
 {
-    std::vector<std::int16_t> samples(data.size()/2);
+    const __m256i order = bytesPerSample == 2 ?
+        _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14) :
+        bytesPerSample == 3 ?
+        _mm256_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15,
+            2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15) :
+        _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
 
-    if(data.size()%2 != 0)
+    // Shuffles stay within 128-bit lanes, which 24-bit samples straddle.
+    // So, these are spread to 12 bytes per lane first, and packed back after.
+    const __m256i spread = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    const __m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    const std::size_t samplesPerVector = bytesPerSample == 3 ? 8 : 32/bytesPerSample;
+    const std::size_t size = numSamples * bytesPerSample;
+
+    std::size_t i = 0;
+    for(; i*bytesPerSample + 32 <= size; i += samplesPerVector)
     {
-        Log::err << "Error: 16-bit samples do not contain an even number " <<
-            "of bytes!" << std::endl;
-        return samples;
+        __m256i vector = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i*bytesPerSample));
+        if(bytesPerSample == 3)
+            vector = _mm256_permutevar8x32_epi32(vector, spread);
+
+        vector = _mm256_shuffle_epi8(vector, order);
+        if(bytesPerSample == 3)
+            vector = _mm256_permutevar8x32_epi32(vector, pack);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(samples + i*bytesPerSample), vector);
     }
 
-    for(std::size_t i = 0; i < data.size()/2; ++i)
+    swap_bytes_scalar<bytesPerSample>(data + i*bytesPerSample, numSamples - i,
+        samples + i*bytesPerSample);
+}
+
+#elif defined(SNDTOWAV_NEON)
+
+template<std::size_t bytesPerSample>
+static void swap_bytes_neon(const std::uint8_t* data, std::size_t numSamples,
+    std::uint8_t* samples)
+{
+    static const std::uint8_t orders[3][16] = {
+        {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+        {2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15},
+        {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12}
+    };
+    const uint8x16_t order = vld1q_u8(orders[bytesPerSample - 2]);
+    const std::size_t samplesPerVector = 16/bytesPerSample;
+    const std::size_t size = numSamples * bytesPerSample;
+
+    std::size_t i = 0;
+    for(; i*bytesPerSample + 16 <= size; i += samplesPerVector)
     {
-        // Because of << and &, this is platform-independant.
-        std::uint16_t unsignedValue =
-            (static_cast<std::uint16_t>(data[i*2]) << 8) | data[i*2+1];
+        vst1q_u8(samples + i*bytesPerSample,
+            vqtbl1q_u8(vld1q_u8(data + i*bytesPerSample), order));
+    }
+
+    swap_bytes_scalar<bytesPerSample>(data + i*bytesPerSample, numSamples - i,
+        samples + i*bytesPerSample);
+}
+
+#endif
+
+// Picks the kernel of the current kernel set.
+template<std::size_t bytesPerSample>
+static SwapFunction select_swap_function()
+{
+#if defined(SNDTOWAV_X86)
+    if(CpuFeatures::useAVX2())
+        return swap_bytes_avx2<bytesPerSample>;
+    if(CpuFeatures::useSSE())
+        return swap_bytes_ssse3<bytesPerSample>;
+#elif defined(SNDTOWAV_NEON)
+    if(CpuFeatures::useNEON())
+        return swap_bytes_neon<bytesPerSample>;
+#endif
 
-        samples[i] = *reinterpret_cast<std::int16_t*>(&unsignedValue);
+    return swap_bytes_scalar<bytesPerSample>;
+}
+
+static SwapFunction select_swap_function(unsigned bitsPerSample)
+{
+    switch(bitsPerSample)
+    {
+    case 16:
+        return select_swap_function<2>();
+    case 24:
+        return select_swap_function<3>();
+    case 32:
+        return select_swap_function<4>();
+    default:
+        return nullptr;
     }
+}
+
+// The kernel only depends on the sample size, so it is bound right away.
+NullDecoder::NullDecoder(unsigned bitsPerSample)
+    : mBitsPerSample(bitsPerSample),
+      mSwapBytes(select_swap_function(bitsPerSample))
+{
 
-    return samples;
 }
 
 // For uncompressed sound, numPackets = number of samples.
@@ -76,20 +206,33 @@ bool NullDecoder::decode(const std::vector<std::uint8_t>& data,
     std::size_t /* numChannels */)
 {
     if(mBitsPerSample == 8)
+        return outputSamples(data.data(), data.size());
+
+    if(mSwapBytes == nullptr)
     {
-        setLittleEndianData(data);
-        return true;
-    } else if(mBitsPerSample == 16)
+        Log::err << "Error: " << mBitsPerSample << "-bit samples not supported " <<
+            "for uncompressed sound!" << std::endl;
+        return false;
+    }
+
+    std::size_t bytesPerSample = mBitsPerSample/8;
+    if(data.size()%bytesPerSample != 0)
     {
-        // Convert the Big-endian sample data to little-endian samples.
-        setLittleEndianData(
-            bigDataTo16BitSamples(data)
-        );
-        return true;
+        Log::err << "Error: " << mBitsPerSample << "-bit samples do not " <<
+            "contain a whole number of samples!" << std::endl;
+        return false;
     }
 
-    Log::err << "Error: " << mBitsPerSample << "-bit samples not supported " <<
-        "for uncompressed sound!" << std::endl;
-    return false;
-}
+    // Convert the Big-endian sample data to little-endian samples.
+    std::vector<std::uint8_t> samples(cChunkSamples * bytesPerSample);
+    for(std::size_t i = 0; i < data.size()/bytesPerSample; i += cChunkSamples)
+    {
+        std::size_t numSamples = std::min(cChunkSamples, data.size()/bytesPerSample - i);
+        mSwapBytes(&data[i*bytesPerSample], numSamples, samples.data());
 
+        if(!outputSamples(samples.data(), numSamples * bytesPerSample))
+            return false;
+    }
+
+    return true;
+}
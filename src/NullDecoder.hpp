@@ -27,10 +27,12 @@
 class NullDecoder : public Decoder
 {
 private:
-    static std::vector<std::int16_t> bigDataTo16BitSamples(
-        const std::vector<std::uint8_t>& data);
+    // Reverses the bytes of each big-endian sample.
+    using SwapFunction = void (*)(const std::uint8_t* data, std::size_t numSamples,
+        std::uint8_t* samples);
 
     unsigned mBitsPerSample;
+    SwapFunction mSwapBytes; // nullptr for 8-bit and unsupported samples.
 
 public:
     NullDecoder(unsigned bitsPerSample);
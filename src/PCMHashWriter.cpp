@@ -0,0 +1,53 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "PCMHashWriter.hpp"
+#include "Journal.hpp"
+#include "Log.hpp"
+#include "SndFile.hpp"
+
+// Returns true on success, false on failure.
+bool PCMHashWriter::begin(SndFile& sndFile, std::ostream& outputStream)
+{
+    if(!sndFile.isValid())
+    {
+        Log::err << "Error: cannot convert invalid snd file!" << std::endl;
+        return false;
+    }
+
+    mOutputStream = &outputStream;
+    mHash = Journal::cInitialHash;
+    return true;
+}
+
+SampleSink* PCMHashWriter::getSampleSink()
+{
+    return this;
+}
+
+bool PCMHashWriter::write(const std::uint8_t* data, std::size_t size)
+{
+    mHash = Journal::hash(reinterpret_cast<const char*>(data), size, mHash);
+    return true;
+}
+
+// Returns true on success, false on failure.
+bool PCMHashWriter::finish()
+{
+    *mOutputStream << Journal::hashToString(mHash) << '\n';
+    return !mOutputStream->fail();
+}
@@ -0,0 +1,45 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PCM_HASH_WRITER_HPP
+#define PCM_HASH_WRITER_HPP
+
+#include "SoundWriter.hpp"
+#include "SampleSink.hpp"
+
+#include <ostream>
+#include <cstdint>
+#include <cstddef> // For std::size_t
+
+// Writes the hash of a sound's decoded samples, as a line of hex, in the
+// same format as journal hashes. Sounds with the same samples have the same
+// hash, whatever their compression.
+class PCMHashWriter : public SoundWriter, private SampleSink
+{
+private:
+    std::ostream* mOutputStream = nullptr;
+    std::uint64_t mHash = 0;
+
+    bool write(const std::uint8_t* data, std::size_t size) override;
+
+public:
+    bool begin(SndFile& sndFile, std::ostream& outputStream) override;
+    SampleSink* getSampleSink() override;
+    bool finish() override;
+};
+
+#endif // PCM_HASH_WRITER_HPP
@@ -0,0 +1,111 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "PeakFile.hpp"
+#include "Endian.hpp"
+#include "Log.hpp"
+#include "SndFile.hpp"
+
+#include <vector>
+#include <algorithm> // For std::copy
+#include <cmath> // For std::lround
+
+const std::uint16_t PeakFile::cVersion = 1;
+
+// Static
+std::int16_t PeakFile::toInt16(float sample)
+{
+    long value = std::lround(sample * 32767.0f);
+    return static_cast<std::int16_t>(value < -32768 ? -32768 : value > 32767 ? 32767 : value);
+}
+
+// Returns true on success, false on failure.
+bool PeakFile::begin(SndFile& sndFile, std::ostream& outputStream)
+{
+    if(!sndFile.isValid())
+    {
+        Log::err << "Error: cannot convert invalid snd file!" << std::endl;
+        return false;
+    }
+
+    unsigned bitsPerSample = sndFile.getDecoder().getBitsPerSample();
+    if(!SampleAnalyzer::isSupported(bitsPerSample))
+    {
+        Log::err << "Error: cannot analyze " << bitsPerSample << "-bit samples." <<
+            std::endl;
+        return false;
+    }
+
+    mOutputStream = &outputStream;
+    mAnalyzer.reset(new SampleAnalyzer(sndFile.getDecodedNumChannels(), bitsPerSample,
+        sndFile.getDecodedSampleRate() / 65536.0, false));
+    return true;
+}
+
+SampleSink* PeakFile::getSampleSink()
+{
+    return mAnalyzer.get();
+}
+
+// Returns true on success, false on failure.
+bool PeakFile::finish()
+{
+    mAnalyzer->finish();
+    const std::vector<SampleAnalyzer::PeakLevel>& levels = mAnalyzer->getPeakLevels();
+
+    std::vector<std::uint8_t> header(4 + 2 + 2 + 4 + 8 + 2 + 8*levels.size());
+    std::uint8_t* field = header.data();
+    std::uint16_t numChannels = static_cast<std::uint16_t>(mAnalyzer->getNumChannels());
+    std::uint32_t sampleRate = static_cast<std::uint32_t>(std::lround(mAnalyzer->getSampleRate()));
+    std::uint64_t numFrames = mAnalyzer->getNumFrames();
+    std::uint16_t numLevels = static_cast<std::uint16_t>(levels.size());
+
+    const std::uint8_t ID[4] = {'P', 'E', 'A', 'K'};
+    std::copy(ID, ID + 4, field);
+    Endian::storeLittle(&cVersion, 1, field + 4);
+    Endian::storeLittle(&numChannels, 1, field + 6);
+    Endian::storeLittle(&sampleRate, 1, field + 8);
+    Endian::storeLittle(&numFrames, 1, field + 12);
+    Endian::storeLittle(&numLevels, 1, field + 20);
+    field += 22;
+
+    for(const SampleAnalyzer::PeakLevel& level : levels)
+    {
+        std::uint32_t sizes[2] = {static_cast<std::uint32_t>(level.framesPerPeak),
+            static_cast<std::uint32_t>(level.minimums.size() / numChannels)};
+        Endian::storeLittle(sizes, 2, field);
+        field += 8;
+    }
+
+    mOutputStream->write(reinterpret_cast<const char*>(header.data()), header.size());
+
+    for(const SampleAnalyzer::PeakLevel& level : levels)
+    {
+        std::vector<std::int16_t> peaks(2*level.minimums.size());
+        for(std::size_t i = 0; i < level.minimums.size(); ++i)
+        {
+            peaks[2*i] = toInt16(level.minimums[i]);
+            peaks[2*i + 1] = toInt16(level.maximums[i]);
+        }
+
+        std::vector<std::uint8_t> bytes(peaks.size() * sizeof(std::int16_t));
+        Endian::storeLittle(peaks.data(), peaks.size(), bytes.data());
+        mOutputStream->write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+
+    return !mOutputStream->fail();
+}
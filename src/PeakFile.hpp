@@ -0,0 +1,51 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PEAK_FILE_HPP
+#define PEAK_FILE_HPP
+
+#include "SoundWriter.hpp"
+#include "SampleAnalyzer.hpp"
+
+#include <ostream>
+#include <memory>
+#include <cstdint>
+
+// Writes min/max peak envelopes of a sound at several zoom levels, for
+// drawing waveforms. All values are little-endian:
+//     'PEAK', uint16 version (1), uint16 numChannels, uint32 sampleRate (Hz),
+//     uint64 numFrames, uint16 numLevels,
+//     for each level, from the finest: uint32 framesPerPeak, uint32 numPeaks,
+// followed by the peaks of each level: for each peak and channel, the minimum
+// then the maximum, as int16 (32767 is full scale).
+class PeakFile : public SoundWriter
+{
+private:
+    static const std::uint16_t cVersion;
+
+    static std::int16_t toInt16(float sample);
+
+    std::ostream* mOutputStream = nullptr;
+    std::unique_ptr<SampleAnalyzer> mAnalyzer;
+
+public:
+    bool begin(SndFile& sndFile, std::ostream& outputStream) override;
+    SampleSink* getSampleSink() override;
+    bool finish() override;
+};
+
+#endif // PEAK_FILE_HPP
@@ -0,0 +1,765 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "PostProcessor.hpp"
+#include "CpuFeatures.hpp"
+#include "Log.hpp"
+
+#include <algorithm> // For std::min and std::max
+#include <cmath> // For std::pow, std::ceil, std::log10 and std::nearbyint
+#include <cstring> // For std::memmove
+
+#if defined(SNDTOWAV_X86)
+#include <immintrin.h>
+#elif defined(SNDTOWAV_NEON)
+#include <arm_neon.h>
+#endif
+
+template<unsigned bytesPerSample>
+static inline std::int32_t load_sample(const std::uint8_t* bytes)
+{
+    if(bytesPerSample == 1)
+        return static_cast<std::int32_t>(bytes[0]) - 128; // Unsigned.
+
+    return static_cast<std::int16_t>(bytes[0] | (bytes[1] << 8));
+}
+
+template<unsigned bytesPerSample>
+static inline void store_sample(std::int32_t sample, std::uint8_t* bytes)
+{
+    if(bytesPerSample == 1)
+    {
+        bytes[0] = static_cast<std::uint8_t>(sample + 128);
+        return;
+    }
+
+    bytes[0] = static_cast<std::uint8_t>(sample);
+    bytes[1] = static_cast<std::uint8_t>(sample >> 8);
+}
+
+static inline unsigned get_magnitude(std::int32_t sample)
+{
+    return static_cast<unsigned>(sample < 0 ? -sample : sample);
+}
+
+template<unsigned bytesPerSample>
+static unsigned peak_scalar(const std::uint8_t* samples, std::size_t numSamples)
+{
+    unsigned peak = 0;
+    for(std::size_t i = 0; i < numSamples; ++i)
+    {
+        peak = std::max(peak,
+            get_magnitude(load_sample<bytesPerSample>(samples + i*bytesPerSample)));
+    }
+
+    return peak;
+}
+
+// Rounds means to nearest, and halves up, like the vector kernels.
+template<unsigned bytesPerSample>
+static unsigned downmix_scalar(const std::uint8_t* samples, std::size_t numFrames,
+    std::size_t numChannels, std::uint8_t* output)
+{
+    const std::int32_t divisor = static_cast<std::int32_t>(numChannels);
+    unsigned peak = 0;
+
+    for(std::size_t frame = 0; frame < numFrames; ++frame)
+    {
+        const std::uint8_t* frameSamples = samples + frame*numChannels*bytesPerSample;
+
+        std::int32_t sum = divisor/2;
+        for(std::size_t channel = 0; channel < numChannels; ++channel)
+            sum += load_sample<bytesPerSample>(frameSamples + channel*bytesPerSample);
+
+        // Floor division.
+        std::int32_t mean = sum / divisor;
+        if(sum % divisor != 0 && sum < 0)
+            --mean;
+
+        store_sample<bytesPerSample>(mean, output + frame*bytesPerSample);
+        peak = std::max(peak, get_magnitude(mean));
+    }
+
+    return peak;
+}
+
+// Rounds halves to even, like the conversions of the vector kernels.
+template<unsigned bytesPerSample>
+static void gain_scalar(const std::uint8_t* samples, std::size_t numSamples, float gain,
+    std::uint8_t* output)
+{
+    const float minimum = bytesPerSample == 1 ? -128.0f : -32768.0f;
+    const float maximum = bytesPerSample == 1 ? 127.0f : 32767.0f;
+
+    for(std::size_t i = 0; i < numSamples; ++i)
+    {
+        float value = std::nearbyint(
+            static_cast<float>(load_sample<bytesPerSample>(samples + i*bytesPerSample)) * gain);
+        value = std::min(std::max(value, minimum), maximum);
+        store_sample<bytesPerSample>(static_cast<std::int32_t>(value), output + i*bytesPerSample);
+    }
+}
+
+#if defined(SNDTOWAV_X86)
+
+SNDTOWAV_TARGET("sse4.1")
+static unsigned peak_u8_sse(const std::uint8_t* samples, std::size_t numSamples)
+{
+    __m128i maximum = _mm_set1_epi8(static_cast<char>(0x80));
+    __m128i minimum = maximum;
+
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+        maximum = _mm_max_epu8(maximum, bytes);
+        minimum = _mm_min_epu8(minimum, bytes);
+    }
+
+    alignas(16) std::uint8_t maximums[16];
+    alignas(16) std::uint8_t minimums[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(maximums), maximum);
+    _mm_store_si128(reinterpret_cast<__m128i*>(minimums), minimum);
+
+    unsigned peak = peak_scalar<1>(samples + i, numSamples - i);
+    for(int lane = 0; lane < 16; ++lane)
+        peak = std::max({peak, maximums[lane] - 128U, 128U - minimums[lane]});
+
+    return peak;
+}
+
+SNDTOWAV_TARGET("sse4.1")
+static unsigned peak_s16_sse(const std::uint8_t* samples, std::size_t numSamples)
+{
+    __m128i peaks = _mm_setzero_si128();
+
+    std::size_t i = 0;
+    for(; i + 8 <= numSamples; i += 8)
+    {
+        // -32768 stays 0x8000, which is 32768 unsigned.
+        __m128i shorts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + 2*i));
+        peaks = _mm_max_epu16(peaks, _mm_abs_epi16(shorts));
+    }
+
+    alignas(16) std::uint16_t lanes[8];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), peaks);
+
+    unsigned peak = peak_scalar<2>(samples + 2*i, numSamples - i);
+    for(std::uint16_t lane : lanes)
+        peak = std::max<unsigned>(peak, lane);
+
+    return peak;
+}
+
+// Vectorized for stereo, which has a rounding average instruction.
+SNDTOWAV_TARGET("sse4.1")
+static unsigned downmix_u8_sse(const std::uint8_t* samples, std::size_t numFrames,
+    std::size_t numChannels, std::uint8_t* output)
+{
+    if(numChannels != 2)
+        return downmix_scalar<1>(samples, numFrames, numChannels, output);
+
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    __m128i maximum = _mm_set1_epi8(static_cast<char>(0x80));
+    __m128i minimum = maximum;
+
+    std::size_t frame = 0;
+    for(; frame + 16 <= numFrames; frame += 16)
+    {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + 2*frame));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + 2*frame + 16));
+
+        // Unsigned samples average like signed ones.
+        __m128i firstMeans = _mm_avg_epu16(_mm_and_si128(first, lowBytes),
+            _mm_srli_epi16(first, 8));
+        __m128i secondMeans = _mm_avg_epu16(_mm_and_si128(second, lowBytes),
+            _mm_srli_epi16(second, 8));
+        __m128i means = _mm_packus_epi16(firstMeans, secondMeans);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + frame), means);
+        maximum = _mm_max_epu8(maximum, means);
+        minimum = _mm_min_epu8(minimum, means);
+    }
+
+    alignas(16) std::uint8_t maximums[16];
+    alignas(16) std::uint8_t minimums[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(maximums), maximum);
+    _mm_store_si128(reinterpret_cast<__m128i*>(minimums), minimum);
+
+    unsigned peak = downmix_scalar<1>(samples + 2*frame, numFrames - frame, 2, output + frame);
+    for(int lane = 0; lane < 16; ++lane)
+        peak = std::max({peak, maximums[lane] - 128U, 128U - minimums[lane]});
+
+    return peak;
+}
+
+SNDTOWAV_TARGET("sse4.1")
+static unsigned downmix_s16_sse(const std::uint8_t* samples, std::size_t numFrames,
+    std::size_t numChannels, std::uint8_t* output)
+{
+    if(numChannels != 2)
+        return downmix_scalar<2>(samples, numFrames, numChannels, output);
+
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i roundingOne = _mm_set1_epi32(1);
+    __m128i peaks = _mm_setzero_si128();
+
+    std::size_t frame = 0;
+    for(; frame + 8 <= numFrames; frame += 8)
+    {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + 4*frame));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + 4*frame + 16));
+
+        // Sums of left and right samples, as 32-bit integers.
+        __m128i firstMeans = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(first, ones),
+            roundingOne), 1);
+        __m128i secondMeans = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(second, ones),
+            roundingOne), 1);
+        __m128i means = _mm_packs_epi32(firstMeans, secondMeans);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 2*frame), means);
+        peaks = _mm_max_epu16(peaks, _mm_abs_epi16(means));
+    }
+
+    alignas(16) std::uint16_t lanes[8];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), peaks);
+
+    unsigned peak = downmix_scalar<2>(samples + 4*frame, numFrames - frame, 2, output + 2*frame);
+    for(std::uint16_t lane : lanes)
+        peak = std::max<unsigned>(peak, lane);
+
+    return peak;
+}
+
+SNDTOWAV_TARGET("sse4.1")
+static void gain_u8_sse(const std::uint8_t* samples, std::size_t numSamples, float gain,
+    std::uint8_t* output)
+{
+    const __m128i centre = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m128 gains = _mm_set1_ps(gain);
+
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        // Flipping the top bit centres unsigned samples.
+        __m128i bytes = _mm_xor_si128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i)), centre);
+
+        __m128i quarters[4];
+        for(int quarter = 0; quarter < 4; ++quarter)
+        {
+            quarters[quarter] = _mm_cvtps_epi32(_mm_mul_ps(
+                _mm_cvtepi32_ps(_mm_cvtepi8_epi32(bytes)), gains));
+            bytes = _mm_srli_si128(bytes, 4);
+        }
+
+        __m128i result = _mm_packs_epi16(_mm_packs_epi32(quarters[0], quarters[1]),
+            _mm_packs_epi32(quarters[2], quarters[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_xor_si128(result, centre));
+    }
+
+    gain_scalar<1>(samples + i, numSamples - i, gain, output + i);
+}
+
+SNDTOWAV_TARGET("sse4.1")
+static void gain_s16_sse(const std::uint8_t* samples, std::size_t numSamples, float gain,
+    std::uint8_t* output)
+{
+    const __m128 gains = _mm_set1_ps(gain);
+
+    std::size_t i = 0;
+    for(; i + 8 <= numSamples; i += 8)
+    {
+        __m128i shorts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + 2*i));
+        __m128i low = _mm_cvtps_epi32(_mm_mul_ps(
+            _mm_cvtepi32_ps(_mm_cvtepi16_epi32(shorts)), gains));
+        __m128i high = _mm_cvtps_epi32(_mm_mul_ps(
+            _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(shorts, 8))), gains));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 2*i), _mm_packs_epi32(low, high));
+    }
+
+    gain_scalar<2>(samples + 2*i, numSamples - i, gain, output + 2*i);
+}
+
+SNDTOWAV_TARGET("avx2")
+static unsigned peak_u8_avx2(const std::uint8_t* samples, std::size_t numSamples)
+{
+    __m256i maximum = _mm256_set1_epi8(static_cast<char>(0x80));
+    __m256i minimum = maximum;
+
+    std::size_t i = 0;
+    for(; i + 32 <= numSamples; i += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+        maximum = _mm256_max_epu8(maximum, bytes);
+        minimum = _mm256_min_epu8(minimum, bytes);
+    }
+
+    alignas(32) std::uint8_t maximums[32];
+    alignas(32) std::uint8_t minimums[32];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(maximums), maximum);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(minimums), minimum);
+
+    unsigned peak = peak_scalar<1>(samples + i, numSamples - i);
+    for(int lane = 0; lane < 32; ++lane)
+        peak = std::max({peak, maximums[lane] - 128U, 128U - minimums[lane]});
+
+    return peak;
+}
+
+SNDTOWAV_TARGET("avx2")
+static unsigned peak_s16_avx2(const std::uint8_t* samples, std::size_t numSamples)
+{
+    __m256i peaks = _mm256_setzero_si256();
+
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        // -32768 stays 0x8000, which is 32768 unsigned.
+        __m256i shorts = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + 2*i));
+        peaks = _mm256_max_epu16(peaks, _mm256_abs_epi16(shorts));
+    }
+
+    alignas(32) std::uint16_t lanes[16];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), peaks);
+
+    unsigned peak = peak_scalar<2>(samples + 2*i, numSamples - i);
+    for(std::uint16_t lane : lanes)
+        peak = std::max<unsigned>(peak, lane);
+
+    return peak;
+}
+
+SNDTOWAV_TARGET("avx2")
+static unsigned downmix_u8_avx2(const std::uint8_t* samples, std::size_t numFrames,
+    std::size_t numChannels, std::uint8_t* output)
+{
+    if(numChannels != 2)
+        return downmix_scalar<1>(samples, numFrames, numChannels, output);
+
+    const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+    __m256i maximum = _mm256_set1_epi8(static_cast<char>(0x80));
+    __m256i minimum = maximum;
+
+    std::size_t frame = 0;
+    for(; frame + 32 <= numFrames; frame += 32)
+    {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + 2*frame));
+        __m256i second = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(samples + 2*frame + 32));
+
+        // Unsigned samples average like signed ones. Packing works within
+        // 128-bit lanes, so the quarters need reordering.
+        __m256i firstMeans = _mm256_avg_epu16(_mm256_and_si256(first, lowBytes),
+            _mm256_srli_epi16(first, 8));
+        __m256i secondMeans = _mm256_avg_epu16(_mm256_and_si256(second, lowBytes),
+            _mm256_srli_epi16(second, 8));
+        __m256i means = _mm256_permute4x64_epi64(_mm256_packus_epi16(firstMeans, secondMeans),
+            0xD8);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + frame), means);
+        maximum = _mm256_max_epu8(maximum, means);
+        minimum = _mm256_min_epu8(minimum, means);
+    }
+
+    alignas(32) std::uint8_t maximums[32];
+    alignas(32) std::uint8_t minimums[32];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(maximums), maximum);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(minimums), minimum);
+
+    unsigned peak = downmix_scalar<1>(samples + 2*frame, numFrames - frame, 2, output + frame);
+    for(int lane = 0; lane < 32; ++lane)
+        peak = std::max({peak, maximums[lane] - 128U, 128U - minimums[lane]});
+
+    return peak;
+}
+
+SNDTOWAV_TARGET("avx2")
+static unsigned downmix_s16_avx2(const std::uint8_t* samples, std::size_t numFrames,
+    std::size_t numChannels, std::uint8_t* output)
+{
+    if(numChannels != 2)
+        return downmix_scalar<2>(samples, numFrames, numChannels, output);
+
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i roundingOne = _mm256_set1_epi32(1);
+    __m256i peaks = _mm256_setzero_si256();
+
+    std::size_t frame = 0;
+    for(; frame + 16 <= numFrames; frame += 16)
+    {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + 4*frame));
+        __m256i second = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(samples + 4*frame + 32));
+
+        // Sums of left and right samples, as 32-bit integers. Packing works
+        // within 128-bit lanes, so the quarters need reordering.
+        __m256i firstMeans = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(first, ones),
+            roundingOne), 1);
+        __m256i secondMeans = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(second, ones),
+            roundingOne), 1);
+        __m256i means = _mm256_permute4x64_epi64(_mm256_packs_epi32(firstMeans, secondMeans),
+            0xD8);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + 2*frame), means);
+        peaks = _mm256_max_epu16(peaks, _mm256_abs_epi16(means));
+    }
+
+    alignas(32) std::uint16_t lanes[16];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), peaks);
+
+    unsigned peak = downmix_scalar<2>(samples + 4*frame, numFrames - frame, 2, output + 2*frame);
+    for(std::uint16_t lane : lanes)
+        peak = std::max<unsigned>(peak, lane);
+
+    return peak;
+}
+
+SNDTOWAV_TARGET("avx2")
+static void gain_u8_avx2(const std::uint8_t* samples, std::size_t numSamples, float gain,
+    std::uint8_t* output)
+{
+    const __m128i centre = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m256 gains = _mm256_set1_ps(gain);
+
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        // Flipping the top bit centres unsigned samples.
+        __m128i bytes = _mm_xor_si128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i)), centre);
+        __m256i low = _mm256_cvtps_epi32(_mm256_mul_ps(
+            _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(bytes)), gains));
+        __m256i high = _mm256_cvtps_epi32(_mm256_mul_ps(
+            _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(bytes, 8))), gains));
+
+        // Packing works within 128-bit lanes, so the quarters need reordering.
+        __m256i shorts = _mm256_permute4x64_epi64(_mm256_packs_epi32(low, high), 0xD8);
+        __m128i result = _mm_packs_epi16(_mm256_castsi256_si128(shorts),
+            _mm256_extracti128_si256(shorts, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_xor_si128(result, centre));
+    }
+
+    gain_scalar<1>(samples + i, numSamples - i, gain, output + i);
+}
+
+SNDTOWAV_TARGET("avx2")
+static void gain_s16_avx2(const std::uint8_t* samples, std::size_t numSamples, float gain,
+    std::uint8_t* output)
+{
+    const __m256 gains = _mm256_set1_ps(gain);
+
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        __m128i lowShorts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + 2*i));
+        __m128i highShorts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + 2*i + 16));
+        __m256i low = _mm256_cvtps_epi32(_mm256_mul_ps(
+            _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(lowShorts)), gains));
+        __m256i high = _mm256_cvtps_epi32(_mm256_mul_ps(
+            _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(highShorts)), gains));
+
+        // Packing works within 128-bit lanes, so the quarters need reordering.
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + 2*i),
+            _mm256_permute4x64_epi64(_mm256_packs_epi32(low, high), 0xD8));
+    }
+
+    gain_scalar<2>(samples + 2*i, numSamples - i, gain, output + 2*i);
+}
+
+#elif defined(SNDTOWAV_NEON)
+
+static unsigned peak_u8_neon(const std::uint8_t* samples, std::size_t numSamples)
+{
+    uint8x16_t maximum = vdupq_n_u8(0x80);
+    uint8x16_t minimum = maximum;
+
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        uint8x16_t bytes = vld1q_u8(samples + i);
+        maximum = vmaxq_u8(maximum, bytes);
+        minimum = vminq_u8(minimum, bytes);
+    }
+
+    return std::max({peak_scalar<1>(samples + i, numSamples - i),
+        vmaxvq_u8(maximum) - 128U, 128U - vminvq_u8(minimum)});
+}
+
+static unsigned peak_s16_neon(const std::uint8_t* samples, std::size_t numSamples)
+{
+    uint16x8_t peaks = vdupq_n_u16(0);
+
+    std::size_t i = 0;
+    for(; i + 8 <= numSamples; i += 8)
+    {
+        // -32768 stays 0x8000, which is 32768 unsigned.
+        int16x8_t shorts = vreinterpretq_s16_u8(vld1q_u8(samples + 2*i));
+        peaks = vmaxq_u16(peaks, vreinterpretq_u16_s16(vabsq_s16(shorts)));
+    }
+
+    return std::max<unsigned>(peak_scalar<2>(samples + 2*i, numSamples - i),
+        vmaxvq_u16(peaks));
+}
+
+// Vectorized for stereo, which deinterleaving loads and rounding averages
+// handle directly.
+static unsigned downmix_u8_neon(const std::uint8_t* samples, std::size_t numFrames,
+    std::size_t numChannels, std::uint8_t* output)
+{
+    if(numChannels != 2)
+        return downmix_scalar<1>(samples, numFrames, numChannels, output);
+
+    uint8x16_t maximum = vdupq_n_u8(0x80);
+    uint8x16_t minimum = maximum;
+
+    std::size_t frame = 0;
+    for(; frame + 16 <= numFrames; frame += 16)
+    {
+        // Unsigned samples average like signed ones.
+        uint8x16x2_t channels = vld2q_u8(samples + 2*frame);
+        uint8x16_t means = vrhaddq_u8(channels.val[0], channels.val[1]);
+
+        vst1q_u8(output + frame, means);
+        maximum = vmaxq_u8(maximum, means);
+        minimum = vminq_u8(minimum, means);
+    }
+
+    return std::max({downmix_scalar<1>(samples + 2*frame, numFrames - frame, 2, output + frame),
+        vmaxvq_u8(maximum) - 128U, 128U - vminvq_u8(minimum)});
+}
+
+static unsigned downmix_s16_neon(const std::uint8_t* samples, std::size_t numFrames,
+    std::size_t numChannels, std::uint8_t* output)
+{
+    if(numChannels != 2)
+        return downmix_scalar<2>(samples, numFrames, numChannels, output);
+
+    uint16x8_t peaks = vdupq_n_u16(0);
+
+    std::size_t frame = 0;
+    for(; frame + 8 <= numFrames; frame += 8)
+    {
+        int16x8x2_t channels = vld2q_s16(reinterpret_cast<const std::int16_t*>(samples + 4*frame));
+        int16x8_t means = vrhaddq_s16(channels.val[0], channels.val[1]);
+
+        vst1q_s16(reinterpret_cast<std::int16_t*>(output + 2*frame), means);
+        peaks = vmaxq_u16(peaks, vreinterpretq_u16_s16(vabsq_s16(means)));
+    }
+
+    return std::max<unsigned>(
+        downmix_scalar<2>(samples + 4*frame, numFrames - frame, 2, output + 2*frame),
+        vmaxvq_u16(peaks));
+}
+
+static void gain_u8_neon(const std::uint8_t* samples, std::size_t numSamples, float gain,
+    std::uint8_t* output)
+{
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        // Flipping the top bit centres unsigned samples.
+        int8x16_t bytes = vreinterpretq_s8_u8(veorq_u8(vld1q_u8(samples + i), vdupq_n_u8(0x80)));
+        int16x8_t shorts[2] = {vmovl_s8(vget_low_s8(bytes)), vmovl_s8(vget_high_s8(bytes))};
+
+        int8x8_t results[2];
+        for(int half = 0; half < 2; ++half)
+        {
+            int32x4_t low = vcvtnq_s32_f32(vmulq_n_f32(
+                vcvtq_f32_s32(vmovl_s16(vget_low_s16(shorts[half]))), gain));
+            int32x4_t high = vcvtnq_s32_f32(vmulq_n_f32(
+                vcvtq_f32_s32(vmovl_s16(vget_high_s16(shorts[half]))), gain));
+            results[half] = vqmovn_s16(vcombine_s16(vqmovn_s32(low), vqmovn_s32(high)));
+        }
+
+        vst1q_u8(output + i, veorq_u8(vreinterpretq_u8_s8(vcombine_s8(results[0], results[1])),
+            vdupq_n_u8(0x80)));
+    }
+
+    gain_scalar<1>(samples + i, numSamples - i, gain, output + i);
+}
+
+static void gain_s16_neon(const std::uint8_t* samples, std::size_t numSamples, float gain,
+    std::uint8_t* output)
+{
+    std::size_t i = 0;
+    for(; i + 8 <= numSamples; i += 8)
+    {
+        int16x8_t shorts = vreinterpretq_s16_u8(vld1q_u8(samples + 2*i));
+        int32x4_t low = vcvtnq_s32_f32(vmulq_n_f32(
+            vcvtq_f32_s32(vmovl_s16(vget_low_s16(shorts))), gain));
+        int32x4_t high = vcvtnq_s32_f32(vmulq_n_f32(
+            vcvtq_f32_s32(vmovl_s16(vget_high_s16(shorts))), gain));
+        vst1q_u8(output + 2*i,
+            vreinterpretq_u8_s16(vcombine_s16(vqmovn_s32(low), vqmovn_s32(high))));
+    }
+
+    gain_scalar<2>(samples + 2*i, numSamples - i, gain, output + 2*i);
+}
+
+#endif
+
+// Pick the kernels of the current kernel set.
+static PostProcessor::PeakFunction select_peak_function(unsigned bytesPerSample)
+{
+#if defined(SNDTOWAV_X86)
+    if(CpuFeatures::useAVX2())
+        return bytesPerSample == 1 ? peak_u8_avx2 : peak_s16_avx2;
+    if(CpuFeatures::useSSE())
+        return bytesPerSample == 1 ? peak_u8_sse : peak_s16_sse;
+#elif defined(SNDTOWAV_NEON)
+    if(CpuFeatures::useNEON())
+        return bytesPerSample == 1 ? peak_u8_neon : peak_s16_neon;
+#endif
+
+    return bytesPerSample == 1 ? peak_scalar<1> : peak_scalar<2>;
+}
+
+static PostProcessor::DownmixFunction select_downmix_function(unsigned bytesPerSample)
+{
+#if defined(SNDTOWAV_X86)
+    if(CpuFeatures::useAVX2())
+        return bytesPerSample == 1 ? downmix_u8_avx2 : downmix_s16_avx2;
+    if(CpuFeatures::useSSE())
+        return bytesPerSample == 1 ? downmix_u8_sse : downmix_s16_sse;
+#elif defined(SNDTOWAV_NEON)
+    if(CpuFeatures::useNEON())
+        return bytesPerSample == 1 ? downmix_u8_neon : downmix_s16_neon;
+#endif
+
+    return bytesPerSample == 1 ? downmix_scalar<1> : downmix_scalar<2>;
+}
+
+static PostProcessor::GainFunction select_gain_function(unsigned bytesPerSample)
+{
+#if defined(SNDTOWAV_X86)
+    if(CpuFeatures::useAVX2())
+        return bytesPerSample == 1 ? gain_u8_avx2 : gain_s16_avx2;
+    if(CpuFeatures::useSSE())
+        return bytesPerSample == 1 ? gain_u8_sse : gain_s16_sse;
+#elif defined(SNDTOWAV_NEON)
+    if(CpuFeatures::useNEON())
+        return bytesPerSample == 1 ? gain_u8_neon : gain_s16_neon;
+#endif
+
+    return bytesPerSample == 1 ? gain_scalar<1> : gain_scalar<2>;
+}
+
+bool PostProcessor::Options::isEnabled() const
+{
+    return trimSilence || downmix || normalize;
+}
+
+PostProcessor::PostProcessor(const Options& options, unsigned bitsPerSample)
+    : mOptions(options),
+      mBytesPerSample(bitsPerSample/8),
+      mPeak(select_peak_function(bitsPerSample/8)),
+      mDownmix(select_downmix_function(bitsPerSample/8)),
+      mGain(select_gain_function(bitsPerSample/8))
+{
+
+}
+
+// Static
+bool PostProcessor::isSupported(unsigned bitsPerSample)
+{
+    return bitsPerSample == 8 || bitsPerSample == 16;
+}
+
+// Returns the first frame with a sample at or above the threshold, or the
+// end of the last one if fromEnd is true; numFrames if there are none.
+// Only silence is scanned, so this needs no kernel.
+std::size_t PostProcessor::findSoundFrame(const std::uint8_t* samples, std::size_t numFrames,
+    std::size_t numChannels, unsigned threshold, bool fromEnd) const
+{
+    const std::size_t frameSize = numChannels * mBytesPerSample;
+
+    for(std::size_t i = 0; i < numFrames; ++i)
+    {
+        std::size_t frame = fromEnd ? numFrames - 1 - i : i;
+        const std::uint8_t* frameSamples = samples + frame*frameSize;
+
+        unsigned peak = mBytesPerSample == 1 ? peak_scalar<1>(frameSamples, numChannels) :
+            peak_scalar<2>(frameSamples, numChannels);
+        if(peak >= threshold)
+            return fromEnd ? frame + 1 : frame;
+    }
+
+    return numFrames;
+}
+
+void PostProcessor::process(std::vector<std::uint8_t>& samples, std::size_t& numChannels) const
+{
+    const double fullScale = mBytesPerSample == 1 ? 128.0 : 32768.0;
+
+    // First pass: the peak, which downmixing measures as it goes.
+    unsigned peak;
+    if(mOptions.downmix && numChannels > 1)
+    {
+        std::size_t numFrames = samples.size() / (numChannels * mBytesPerSample);
+        peak = mDownmix(samples.data(), numFrames, numChannels, samples.data());
+        samples.resize(numFrames * mBytesPerSample);
+        numChannels = 1;
+    } else
+    {
+        peak = mPeak(samples.data(), samples.size() / mBytesPerSample);
+    }
+
+    const std::size_t frameSize = numChannels * mBytesPerSample;
+    std::size_t numFrames = samples.size() / frameSize;
+    std::size_t firstFrame = 0;
+    std::size_t endFrame = numFrames;
+
+    if(mOptions.trimSilence)
+    {
+        unsigned threshold = static_cast<unsigned>(std::max(1.0,
+            std::ceil(std::pow(10.0, mOptions.silenceThreshold / 20) * fullScale)));
+
+        if(peak < threshold)
+        {
+            endFrame = 0; // All silence.
+        } else
+        {
+            firstFrame = findSoundFrame(samples.data(), numFrames, numChannels, threshold,
+                false);
+            endFrame = firstFrame + findSoundFrame(samples.data() + firstFrame*frameSize,
+                numFrames - firstFrame, numChannels, threshold, true);
+        }
+
+        Log::verb << "Trimmed " << firstFrame << " leading and " << numFrames - endFrame <<
+            " trailing silent frames." << std::endl;
+    }
+
+    // Second pass: the gain, which also moves trimmed samples to the front.
+    const std::uint8_t* soundSamples = samples.data() + firstFrame*frameSize;
+    std::size_t numSoundSamples = (endFrame - firstFrame) * numChannels;
+
+    if(mOptions.normalize && peak > 0 && numSoundSamples > 0)
+    {
+        // Relative to the largest positive sample, so that 0 dBFS never clips.
+        float gain = static_cast<float>(std::pow(10.0, mOptions.peakLevel / 20) *
+            (fullScale - 1) / peak);
+
+        mGain(soundSamples, numSoundSamples, gain, samples.data());
+        Log::verb << "Normalized with a gain of " << 20*std::log10(gain) << " dB." << std::endl;
+    } else if(firstFrame > 0)
+    {
+        std::memmove(samples.data(), soundSamples, numSoundSamples * mBytesPerSample);
+    }
+
+    samples.resize(numSoundSamples * mBytesPerSample);
+}
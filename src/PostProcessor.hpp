@@ -0,0 +1,78 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef POST_PROCESSOR_HPP
+#define POST_PROCESSOR_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Prepares decoded sounds for shipping: trims leading and trailing silence,
+// downmixes them to mono, and normalizes their peak level. All of it takes
+// at most two passes over the decoded samples, which must be 8-bit unsigned
+// or 16-bit signed little-endian PCM.
+class PostProcessor
+{
+public:
+    struct Options
+    {
+        bool trimSilence = false;
+        double silenceThreshold = -60.0; // dBFS; quieter samples are silent.
+        bool downmix = false; // To mono.
+        bool normalize = false;
+        double peakLevel = 0.0; // dBFS, once normalized.
+
+        bool isEnabled() const;
+    };
+
+    // Peak of numSamples samples, from their centre (128 for 8-bit samples).
+    using PeakFunction = unsigned (*)(const std::uint8_t* samples, std::size_t numSamples);
+
+    // Averages the channels of numFrames frames and returns the peak of the
+    // result. output may overlap samples if it does not come after them.
+    using DownmixFunction = unsigned (*)(const std::uint8_t* samples, std::size_t numFrames,
+        std::size_t numChannels, std::uint8_t* output);
+
+    // Scales numSamples samples from their centre, rounding and clipping
+    // them. output may overlap samples if it does not come after them.
+    using GainFunction = void (*)(const std::uint8_t* samples, std::size_t numSamples,
+        float gain, std::uint8_t* output);
+
+private:
+    Options mOptions;
+    unsigned mBytesPerSample;
+
+    // Bound for the current kernel set.
+    PeakFunction mPeak;
+    DownmixFunction mDownmix;
+    GainFunction mGain;
+
+    std::size_t findSoundFrame(const std::uint8_t* samples, std::size_t numFrames,
+        std::size_t numChannels, unsigned threshold, bool fromEnd) const;
+
+public:
+    PostProcessor(const Options& options, unsigned bitsPerSample);
+
+    static bool isSupported(unsigned bitsPerSample);
+
+    // Processes interleaved samples in place; numChannels is 1 once
+    // downmixed, and samples shrinks once trimmed.
+    void process(std::vector<std::uint8_t>& samples, std::size_t& numChannels) const;
+};
+
+#endif // POST_PROCESSOR_HPP
@@ -0,0 +1,474 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Resampler.hpp"
+#include "CpuFeatures.hpp"
+
+#include <algorithm> // For std::min and std::max
+#include <cmath>
+
+#if defined(SNDTOWAV_X86)
+#include <immintrin.h>
+#elif defined(SNDTOWAV_NEON)
+#include <arm_neon.h>
+#endif
+
+// Phases of the filter table when the rates do not have a small ratio.
+const std::size_t Resampler::cMaxNumPhases = 256;
+
+namespace
+{
+    const double cPi = 3.14159265358979323846;
+
+    // Zero crossings of the filter on each side, when upsampling. Downsampling
+    // widens the filter so that the transition band keeps the same width.
+    const std::size_t cNumZeroCrossings = 32;
+    const double cCutoff = 0.9; // Of the lowest Nyquist frequency.
+    const double cKaiserBeta = 8.0; // About 80 dB of stopband attenuation.
+
+    std::uint64_t gcd(std::uint64_t a, std::uint64_t b)
+    {
+        while(b != 0)
+        {
+            std::uint64_t remainder = a % b;
+            a = b;
+            b = remainder;
+        }
+
+        return a;
+    }
+
+    // Modified Bessel function of the first kind, of order 0.
+    double bessel_i0(double x)
+    {
+        double sum = 1.0;
+        double term = 1.0;
+        for(unsigned k = 1; k < 50 && term > sum * 1e-12; ++k)
+        {
+            double factor = x / (2.0 * k);
+            term *= factor * factor;
+            sum += term;
+        }
+
+        return sum;
+    }
+}
+
+static inline float filter_scalar(const float* coefficients, const float* deltas,
+    float fraction, const float* samples, std::size_t numTaps)
+{
+    float sum = 0;
+    for(std::size_t i = 0; i < numTaps; ++i)
+        sum += (coefficients[i] + fraction*deltas[i]) * samples[i];
+
+    return sum;
+}
+
+#if defined(SNDTOWAV_X86)
+
+SNDTOWAV_TARGET("sse4.1")
+static float filter_sse(const float* coefficients, const float* deltas,
+    float fraction, const float* samples, std::size_t numTaps)
+{
+    __m128 fractions = _mm_set1_ps(fraction);
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+
+    for(std::size_t i = 0; i < numTaps; i += 8)
+    {
+        __m128 taps0 = _mm_add_ps(_mm_loadu_ps(coefficients + i),
+            _mm_mul_ps(fractions, _mm_loadu_ps(deltas + i)));
+        __m128 taps1 = _mm_add_ps(_mm_loadu_ps(coefficients + i + 4),
+            _mm_mul_ps(fractions, _mm_loadu_ps(deltas + i + 4)));
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(taps0, _mm_loadu_ps(samples + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(taps1, _mm_loadu_ps(samples + i + 4)));
+    }
+
+    __m128 sum = _mm_add_ps(sum0, sum1);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+SNDTOWAV_TARGET("avx2")
+static float filter_avx2(const float* coefficients, const float* deltas,
+    float fraction, const float* samples, std::size_t numTaps)
+{
+    __m256 fractions = _mm256_set1_ps(fraction);
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+
+    // Filters have a multiple of 8 taps, so the second sum may take the last
+    // 8 alone.
+    std::size_t i = 0;
+    for(; i + 16 <= numTaps; i += 16)
+    {
+        __m256 taps0 = _mm256_add_ps(_mm256_loadu_ps(coefficients + i),
+            _mm256_mul_ps(fractions, _mm256_loadu_ps(deltas + i)));
+        __m256 taps1 = _mm256_add_ps(_mm256_loadu_ps(coefficients + i + 8),
+            _mm256_mul_ps(fractions, _mm256_loadu_ps(deltas + i + 8)));
+        sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(taps0, _mm256_loadu_ps(samples + i)));
+        sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(taps1, _mm256_loadu_ps(samples + i + 8)));
+    }
+
+    if(i < numTaps)
+    {
+        __m256 taps = _mm256_add_ps(_mm256_loadu_ps(coefficients + i),
+            _mm256_mul_ps(fractions, _mm256_loadu_ps(deltas + i)));
+        sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(taps, _mm256_loadu_ps(samples + i)));
+    }
+
+    __m256 sum = _mm256_add_ps(sum0, sum1);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half);
+}
+
+#elif defined(SNDTOWAV_NEON)
+
+static float filter_neon(const float* coefficients, const float* deltas,
+    float fraction, const float* samples, std::size_t numTaps)
+{
+    float32x4_t sum0 = vdupq_n_f32(0);
+    float32x4_t sum1 = vdupq_n_f32(0);
+
+    for(std::size_t i = 0; i < numTaps; i += 8)
+    {
+        float32x4_t taps0 = vmlaq_n_f32(vld1q_f32(coefficients + i),
+            vld1q_f32(deltas + i), fraction);
+        float32x4_t taps1 = vmlaq_n_f32(vld1q_f32(coefficients + i + 4),
+            vld1q_f32(deltas + i + 4), fraction);
+        sum0 = vmlaq_f32(sum0, taps0, vld1q_f32(samples + i));
+        sum1 = vmlaq_f32(sum1, taps1, vld1q_f32(samples + i + 4));
+    }
+
+    float sums[4];
+    vst1q_f32(sums, vaddq_f32(sum0, sum1));
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+#endif
+
+// Picks the kernel of the current kernel set.
+static Resampler::FilterFunction select_filter_function()
+{
+#if defined(SNDTOWAV_X86)
+    if(CpuFeatures::useAVX2())
+        return filter_avx2;
+    if(CpuFeatures::useSSE())
+        return filter_sse;
+#elif defined(SNDTOWAV_NEON)
+    if(CpuFeatures::useNEON())
+        return filter_neon;
+#endif
+
+    return filter_scalar;
+}
+
+// Deinterleaves samples to full-scale floats, appending them to channels.
+template<unsigned bytesPerSample>
+static void convert_frames(const std::uint8_t* data, std::size_t numFrames,
+    std::vector<std::vector<float>>& channels)
+{
+    const float scale = 1.0f / static_cast<float>(1U << (8*bytesPerSample - 1));
+    const std::size_t numChannels = channels.size();
+
+    for(std::size_t channel = 0; channel < numChannels; ++channel)
+    {
+        std::vector<float>& samples = channels[channel];
+        std::size_t offset = samples.size();
+        samples.resize(offset + numFrames);
+
+        for(std::size_t frame = 0; frame < numFrames; ++frame)
+        {
+            const std::uint8_t* bytes = data + (frame*numChannels + channel)*bytesPerSample;
+            std::int32_t sample = 0;
+
+            if(bytesPerSample == 1)
+            {
+                sample = static_cast<std::int32_t>(bytes[0]) - 128; // Unsigned.
+            } else
+            {
+                std::uint32_t bits = 0;
+                for(unsigned byte = 0; byte < bytesPerSample; ++byte)
+                    bits |= static_cast<std::uint32_t>(bytes[byte]) << (8*byte);
+
+                // Sign-extend.
+                const unsigned unusedBits = 32 - 8*bytesPerSample;
+                sample = static_cast<std::int32_t>(bits << unusedBits) >> unusedBits;
+            }
+
+            samples[offset + frame] = static_cast<float>(sample) * scale;
+        }
+    }
+}
+
+// Rounds full-scale floats to little-endian samples, clipping them.
+template<unsigned bytesPerSample>
+static void store_samples(const float* samples, std::size_t numSamples, std::uint8_t* data)
+{
+    // Doubles hold every 32-bit sample.
+    const double scale = static_cast<double>(1U << (8*bytesPerSample - 1));
+
+    for(std::size_t i = 0; i < numSamples; ++i)
+    {
+        double value = samples[i] * scale;
+        value = std::min(std::max(value, -scale), scale - 1.0);
+        value += value < 0 ? -0.5 : 0.5; // Rounds away from zero once truncated.
+
+        std::int32_t sample = static_cast<std::int32_t>(value);
+        if(bytesPerSample == 1)
+            sample += 128; // Unsigned.
+
+        std::uint32_t bits = static_cast<std::uint32_t>(sample);
+        for(unsigned byte = 0; byte < bytesPerSample; ++byte)
+            data[i*bytesPerSample + byte] = static_cast<std::uint8_t>(bits >> (8*byte));
+    }
+}
+
+Resampler::Resampler(SampleSink& output, std::size_t numChannels, unsigned bitsPerSample,
+    std::uint32_t inputSampleRate, std::uint32_t outputSampleRate)
+    : mOutput(output),
+      mNumChannels(numChannels),
+      mBitsPerSample(bitsPerSample),
+      mFilter(select_filter_function()),
+      mChannels(numChannels)
+{
+    std::uint64_t divisor = gcd(inputSampleRate, outputSampleRate);
+    mStepNumerator = inputSampleRate / divisor;
+    mStepDenominator = outputSampleRate / divisor;
+
+    // Output frames fall on mStepDenominator phases of input frames.
+    mNumPhases = static_cast<std::size_t>(std::min<std::uint64_t>(mStepDenominator,
+        cMaxNumPhases));
+
+    // Downsampling lowers the cutoff, and stretches the filter to match.
+    double scale = std::min(1.0, static_cast<double>(outputSampleRate) / inputSampleRate);
+    double cutoff = cCutoff * scale;
+    std::size_t halfTaps = static_cast<std::size_t>(std::ceil(cNumZeroCrossings / scale));
+    halfTaps = (halfTaps + 3) / 4 * 4;
+    mNumTaps = 2*halfTaps;
+
+    // The first input frame of a filter is halfTaps - 1 frames before the
+    // output frame, which falls between taps halfTaps - 1 and halfTaps.
+    mCoefficients.resize((mNumPhases + 1) * mNumTaps);
+    double windowScale = 1.0 / bessel_i0(cKaiserBeta);
+    for(std::size_t phase = 0; phase <= mNumPhases; ++phase)
+    {
+        double fraction = static_cast<double>(phase) / mNumPhases;
+        float* taps = &mCoefficients[phase * mNumTaps];
+        double sum = 0;
+
+        for(std::size_t tap = 0; tap < mNumTaps; ++tap)
+        {
+            double distance = static_cast<double>(tap) - (halfTaps - 1) - fraction;
+            double x = distance / halfTaps;
+            double window = std::abs(x) < 1.0 ?
+                bessel_i0(cKaiserBeta * std::sqrt(1.0 - x*x)) * windowScale : 0.0;
+            double sinc = distance == 0.0 ? 1.0 :
+                std::sin(cPi * cutoff * distance) / (cPi * cutoff * distance);
+
+            taps[tap] = static_cast<float>(cutoff * sinc * window);
+            sum += taps[tap];
+        }
+
+        // Unity gain at DC, for every phase.
+        for(std::size_t tap = 0; tap < mNumTaps; ++tap)
+            taps[tap] = static_cast<float>(taps[tap] / sum);
+    }
+
+    mDeltas.resize(mNumPhases * mNumTaps);
+    for(std::size_t i = 0; i < mDeltas.size(); ++i)
+        mDeltas[i] = mCoefficients[i + mNumTaps] - mCoefficients[i];
+
+    // Silence before the first input frame.
+    for(std::vector<float>& samples : mChannels)
+        samples.assign(halfTaps - 1, 0.0f);
+}
+
+// Static
+bool Resampler::isSupported(unsigned bitsPerSample)
+{
+    return bitsPerSample == 8 || bitsPerSample == 16 || bitsPerSample == 24 ||
+        bitsPerSample == 32;
+}
+
+// Static
+std::uint64_t Resampler::getNumOutputFrames(std::uint64_t numInputFrames,
+    std::uint32_t inputSampleRate, std::uint32_t outputSampleRate)
+{
+    if(inputSampleRate == 0)
+        return 0;
+
+    // ceil(numInputFrames * outputSampleRate / inputSampleRate), without
+    // overflowing.
+    std::uint64_t wholeSteps = numInputFrames / inputSampleRate;
+    std::uint64_t remainder = numInputFrames % inputSampleRate;
+    return wholeSteps * outputSampleRate +
+        (remainder * outputSampleRate + inputSampleRate - 1) / inputSampleRate;
+}
+
+void Resampler::convertFrames(const std::uint8_t* data, std::size_t numFrames)
+{
+    switch(mBitsPerSample)
+    {
+    case 8:
+        convert_frames<1>(data, numFrames, mChannels);
+        break;
+    case 16:
+        convert_frames<2>(data, numFrames, mChannels);
+        break;
+    case 24:
+        convert_frames<3>(data, numFrames, mChannels);
+        break;
+    default:
+        convert_frames<4>(data, numFrames, mChannels);
+        break;
+    }
+}
+
+void Resampler::storeSamples(std::size_t numSamples)
+{
+    mOutputBuffer.resize(numSamples * mBitsPerSample/8);
+
+    switch(mBitsPerSample)
+    {
+    case 8:
+        store_samples<1>(mOutputSamples.data(), numSamples, mOutputBuffer.data());
+        break;
+    case 16:
+        store_samples<2>(mOutputSamples.data(), numSamples, mOutputBuffer.data());
+        break;
+    case 24:
+        store_samples<3>(mOutputSamples.data(), numSamples, mOutputBuffer.data());
+        break;
+    default:
+        store_samples<4>(mOutputSamples.data(), numSamples, mOutputBuffer.data());
+        break;
+    }
+}
+
+// Resamples frames while their filters are covered by the input, up to
+// maxNumFrames of them, to mOutputBuffer.
+void Resampler::resampleFrames(std::uint64_t maxNumFrames)
+{
+    const std::size_t numInputFrames = mChannels.empty() ? 0 : mChannels[0].size();
+    if(mPosition + mNumTaps > numInputFrames)
+    {
+        mOutputBuffer.clear();
+        return;
+    }
+
+    const std::uint64_t wholeStep = mStepNumerator / mStepDenominator;
+    const std::uint64_t fractionStep = mStepNumerator % mStepDenominator;
+    const double phaseScale = static_cast<double>(mNumPhases) / mStepDenominator;
+
+    // At most one frame per step over the covered input, and one more.
+    std::uint64_t numCovered = numInputFrames - mNumTaps + 1 - mPosition;
+    maxNumFrames = std::min(maxNumFrames, numCovered * mStepDenominator / mStepNumerator + 2);
+    mOutputSamples.resize(static_cast<std::size_t>(maxNumFrames) * mNumChannels);
+
+    std::size_t numFrames = 0;
+    while(numFrames < maxNumFrames && mPosition + mNumTaps <= numInputFrames)
+    {
+        // Phase of the output frame in the table; exact if there is a phase
+        // for each fraction.
+        double phase = static_cast<double>(mFraction) * phaseScale;
+        std::size_t index = static_cast<std::size_t>(phase);
+        float fraction = static_cast<float>(phase - index);
+        const float* coefficients = &mCoefficients[index * mNumTaps];
+        const float* deltas = &mDeltas[index * mNumTaps];
+
+        float* frame = &mOutputSamples[numFrames * mNumChannels];
+        for(std::size_t channel = 0; channel < mNumChannels; ++channel)
+        {
+            frame[channel] = mFilter(coefficients, deltas, fraction,
+                mChannels[channel].data() + mPosition, mNumTaps);
+        }
+
+        mPosition += static_cast<std::size_t>(wholeStep);
+        mFraction += fractionStep;
+        if(mFraction >= mStepDenominator)
+        {
+            mFraction -= mStepDenominator;
+            ++mPosition;
+        }
+
+        ++numFrames;
+    }
+
+    mNumOutputFrames += numFrames;
+    storeSamples(numFrames * mNumChannels);
+
+    // Only keep the input which later filters need.
+    std::size_t numConsumed = std::min(mPosition, numInputFrames);
+    for(std::vector<float>& samples : mChannels)
+        samples.erase(samples.begin(), samples.begin() + numConsumed);
+
+    mPosition -= numConsumed;
+}
+
+bool Resampler::write(const std::uint8_t* data, std::size_t size)
+{
+    const std::size_t frameSize = mNumChannels * mBitsPerSample/8;
+    if(mFinished || frameSize == 0)
+        return false;
+
+    // Complete a frame split across writes first.
+    if(!mPendingBytes.empty())
+    {
+        std::size_t missing = std::min(frameSize - mPendingBytes.size(), size);
+        mPendingBytes.insert(mPendingBytes.end(), data, data + missing);
+        data += missing;
+        size -= missing;
+
+        if(mPendingBytes.size() < frameSize)
+            return true;
+
+        convertFrames(mPendingBytes.data(), 1);
+        mNumInputFrames += 1;
+        mPendingBytes.clear();
+    }
+
+    std::size_t numFrames = size / frameSize;
+    convertFrames(data, numFrames);
+    mNumInputFrames += numFrames;
+    mPendingBytes.assign(data + numFrames*frameSize, data + size);
+
+    resampleFrames(UINT64_MAX);
+    return mOutputBuffer.empty() || mOutput.write(mOutputBuffer.data(), mOutputBuffer.size());
+}
+
+// Returns true on success, false on failure.
+bool Resampler::finish()
+{
+    if(mFinished)
+        return true;
+
+    mFinished = true;
+
+    // Silence after the last input frame, for the filters of the last output
+    // frames.
+    for(std::vector<float>& samples : mChannels)
+        samples.resize(samples.size() + mNumTaps/2, 0.0f);
+
+    std::uint64_t numOutputFrames = getNumOutputFrames(mNumInputFrames,
+        static_cast<std::uint32_t>(mStepNumerator), static_cast<std::uint32_t>(mStepDenominator));
+    resampleFrames(numOutputFrames - std::min(mNumOutputFrames, numOutputFrames));
+    return mOutputBuffer.empty() || mOutput.write(mOutputBuffer.data(), mOutputBuffer.size());
+}
@@ -0,0 +1,95 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef RESAMPLER_HPP
+#define RESAMPLER_HPP
+
+#include "SampleSink.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Converts decoded little-endian PCM to another sample rate as it is decoded,
+// then writes it to another sink. Rates are unsigned 16.16 fixed-point, like
+// snd sample rates, so fractional rates such as 22254.5454 Hz are honoured.
+//
+// Filters are Kaiser-windowed sincs, in a table of phases: the exact phases
+// if the rates have a small enough ratio, or phases which are interpolated
+// between otherwise.
+class Resampler : public SampleSink
+{
+public:
+    // Sum of (coefficients[i] + fraction*deltas[i]) * samples[i], for
+    // numTaps taps (a multiple of 8).
+    using FilterFunction = float (*)(const float* coefficients, const float* deltas,
+        float fraction, const float* samples, std::size_t numTaps);
+
+    static const std::size_t cMaxNumPhases;
+
+private:
+    void convertFrames(const std::uint8_t* data, std::size_t numFrames);
+    void storeSamples(std::size_t numSamples);
+    void resampleFrames(std::uint64_t maxNumFrames);
+
+    SampleSink& mOutput;
+    std::size_t mNumChannels;
+    unsigned mBitsPerSample;
+    FilterFunction mFilter; // Bound for the current kernel set.
+
+    // Input frames per output frame, as an irreducible fraction.
+    std::uint64_t mStepNumerator;
+    std::uint64_t mStepDenominator;
+
+    std::size_t mNumTaps;
+    std::size_t mNumPhases;
+    std::vector<float> mCoefficients; // numTaps per phase, and one more phase.
+    std::vector<float> mDeltas; // To the next phase.
+
+    std::vector<std::uint8_t> mPendingBytes; // Frame split across writes.
+    std::vector<std::vector<float>> mChannels; // Input not yet consumed.
+    std::vector<float> mOutputSamples; // Interleaved.
+    std::vector<std::uint8_t> mOutputBuffer;
+
+    // Position of the next output frame: the first input frame of its
+    // filter, and the fraction of an input frame past it (over
+    // mStepDenominator).
+    std::size_t mPosition = 0;
+    std::uint64_t mFraction = 0;
+
+    std::uint64_t mNumInputFrames = 0;
+    std::uint64_t mNumOutputFrames = 0;
+    bool mFinished = false;
+
+public:
+    Resampler(SampleSink& output, std::size_t numChannels, unsigned bitsPerSample,
+        std::uint32_t inputSampleRate, std::uint32_t outputSampleRate);
+
+    static bool isSupported(unsigned bitsPerSample);
+
+    // Number of output frames; the last one starts before the end of the input.
+    static std::uint64_t getNumOutputFrames(std::uint64_t numInputFrames,
+        std::uint32_t inputSampleRate, std::uint32_t outputSampleRate);
+
+    bool write(const std::uint8_t* data, std::size_t size) override;
+
+    // Writes the last frames; call once all samples are written.
+    // Returns true on success, false on failure.
+    bool finish();
+};
+
+#endif // RESAMPLER_HPP
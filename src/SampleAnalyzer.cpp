@@ -0,0 +1,576 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "SampleAnalyzer.hpp"
+#include "CpuFeatures.hpp"
+
+#include <algorithm> // For std::min and std::max
+#include <cmath>
+#include <limits>
+
+#if defined(SNDTOWAV_X86)
+#include <immintrin.h>
+#elif defined(SNDTOWAV_NEON)
+#include <arm_neon.h>
+#endif
+
+const std::size_t SampleAnalyzer::cFramesPerPeak = 256;
+const std::size_t SampleAnalyzer::cMaxNumPeakLevels = 8; // Up to 32768 frames per peak.
+
+namespace
+{
+    const double cPi = 3.14159265358979323846;
+
+    // ITU-R BS.1770-4.
+    const double cSubBlockDuration = 0.1; // Seconds; blocks are 4 sub-blocks.
+    const std::size_t cSubBlocksPerBlock = 4;
+    const double cAbsoluteGate = -70.0; // LUFS
+    const double cRelativeGate = -10.0; // LU
+
+    double to_loudness(double meanSquare)
+    {
+        return -0.691 + 10.0*std::log10(meanSquare);
+    }
+}
+
+static inline void reduce_scalar(const float* samples, std::size_t numSamples,
+    float* minimum, float* maximum, float* sumOfSquares)
+{
+    float low = samples[0];
+    float high = samples[0];
+    float sum = 0;
+
+    for(std::size_t i = 0; i < numSamples; ++i)
+    {
+        low = std::min(low, samples[i]);
+        high = std::max(high, samples[i]);
+        sum += samples[i]*samples[i];
+    }
+
+    *minimum = low;
+    *maximum = high;
+    *sumOfSquares = sum;
+}
+
+// Merges the lanes of the vector kernels, and samples they left over.
+static inline void reduce_lanes(const float* lows, const float* highs, const float* sums,
+    std::size_t numLanes, const float* tail, std::size_t tailSize,
+    float* minimum, float* maximum, float* sumOfSquares)
+{
+    float low = lows[0];
+    float high = highs[0];
+    float sum = 0;
+
+    for(std::size_t lane = 0; lane < numLanes; ++lane)
+    {
+        low = std::min(low, lows[lane]);
+        high = std::max(high, highs[lane]);
+        sum += sums[lane];
+    }
+
+    for(std::size_t i = 0; i < tailSize; ++i)
+    {
+        low = std::min(low, tail[i]);
+        high = std::max(high, tail[i]);
+        sum += tail[i]*tail[i];
+    }
+
+    *minimum = low;
+    *maximum = high;
+    *sumOfSquares = sum;
+}
+
+#if defined(SNDTOWAV_X86)
+
+SNDTOWAV_TARGET("sse4.1")
+static void reduce_sse(const float* samples, std::size_t numSamples,
+    float* minimum, float* maximum, float* sumOfSquares)
+{
+    if(numSamples < 4)
+        return reduce_scalar(samples, numSamples, minimum, maximum, sumOfSquares);
+
+    __m128 low = _mm_loadu_ps(samples);
+    __m128 high = low;
+    __m128 sum = _mm_setzero_ps();
+
+    std::size_t i = 0;
+    for(; i + 4 <= numSamples; i += 4)
+    {
+        __m128 vector = _mm_loadu_ps(samples + i);
+        low = _mm_min_ps(low, vector);
+        high = _mm_max_ps(high, vector);
+        sum = _mm_add_ps(sum, _mm_mul_ps(vector, vector));
+    }
+
+    float lows[4], highs[4], sums[4];
+    _mm_storeu_ps(lows, low);
+    _mm_storeu_ps(highs, high);
+    _mm_storeu_ps(sums, sum);
+    reduce_lanes(lows, highs, sums, 4, samples + i, numSamples - i,
+        minimum, maximum, sumOfSquares);
+}
+
+SNDTOWAV_TARGET("avx2")
+static void reduce_avx2(const float* samples, std::size_t numSamples,
+    float* minimum, float* maximum, float* sumOfSquares)
+{
+    if(numSamples < 8)
+        return reduce_scalar(samples, numSamples, minimum, maximum, sumOfSquares);
+
+    __m256 low = _mm256_loadu_ps(samples);
+    __m256 high = low;
+    __m256 sum = _mm256_setzero_ps();
+
+    std::size_t i = 0;
+    for(; i + 8 <= numSamples; i += 8)
+    {
+        __m256 vector = _mm256_loadu_ps(samples + i);
+        low = _mm256_min_ps(low, vector);
+        high = _mm256_max_ps(high, vector);
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(vector, vector));
+    }
+
+    float lows[8], highs[8], sums[8];
+    _mm256_storeu_ps(lows, low);
+    _mm256_storeu_ps(highs, high);
+    _mm256_storeu_ps(sums, sum);
+    reduce_lanes(lows, highs, sums, 8, samples + i, numSamples - i,
+        minimum, maximum, sumOfSquares);
+}
+
+#elif defined(SNDTOWAV_NEON)
+
+static void reduce_neon(const float* samples, std::size_t numSamples,
+    float* minimum, float* maximum, float* sumOfSquares)
+{
+    if(numSamples < 4)
+        return reduce_scalar(samples, numSamples, minimum, maximum, sumOfSquares);
+
+    float32x4_t low = vld1q_f32(samples);
+    float32x4_t high = low;
+    float32x4_t sum = vdupq_n_f32(0);
+
+    std::size_t i = 0;
+    for(; i + 4 <= numSamples; i += 4)
+    {
+        float32x4_t vector = vld1q_f32(samples + i);
+        low = vminq_f32(low, vector);
+        high = vmaxq_f32(high, vector);
+        sum = vmlaq_f32(sum, vector, vector);
+    }
+
+    float lows[4], highs[4], sums[4];
+    vst1q_f32(lows, low);
+    vst1q_f32(highs, high);
+    vst1q_f32(sums, sum);
+    reduce_lanes(lows, highs, sums, 4, samples + i, numSamples - i,
+        minimum, maximum, sumOfSquares);
+}
+
+#endif
+
+// Picks the kernel of the current kernel set.
+static SampleAnalyzer::ReduceFunction select_reduce_function()
+{
+#if defined(SNDTOWAV_X86)
+    if(CpuFeatures::useAVX2())
+        return reduce_avx2;
+    if(CpuFeatures::useSSE())
+        return reduce_sse;
+#elif defined(SNDTOWAV_NEON)
+    if(CpuFeatures::useNEON())
+        return reduce_neon;
+#endif
+
+    return reduce_scalar;
+}
+
+// Deinterleaves samples to full-scale floats.
+template<unsigned bytesPerSample>
+static void convert_frames(const std::uint8_t* data, std::size_t numFrames,
+    std::size_t numChannels, float** channels)
+{
+    const float scale = 1.0f / static_cast<float>(1U << (8*bytesPerSample - 1));
+
+    for(std::size_t frame = 0; frame < numFrames; ++frame)
+    {
+        for(std::size_t channel = 0; channel < numChannels; ++channel)
+        {
+            const std::uint8_t* bytes = data + (frame*numChannels + channel)*bytesPerSample;
+            std::int32_t sample = 0;
+
+            if(bytesPerSample == 1)
+            {
+                sample = static_cast<std::int32_t>(bytes[0]) - 128; // Unsigned.
+            } else
+            {
+                std::uint32_t bits = 0;
+                for(unsigned byte = 0; byte < bytesPerSample; ++byte)
+                    bits |= static_cast<std::uint32_t>(bytes[byte]) << (8*byte);
+
+                // Sign-extend.
+                const unsigned unusedBits = 32 - 8*bytesPerSample;
+                sample = static_cast<std::int32_t>(bits << unusedBits) >> unusedBits;
+            }
+
+            channels[channel][frame] = static_cast<float>(sample) * scale;
+        }
+    }
+}
+
+// Sums the squares of K-weighted samples of numChannels (1 or 2) channels.
+// Filters are latency-bound, so filtering two channels at once is almost free.
+template<std::size_t numChannels>
+static void k_weighted_energy(const float* const* channels, std::size_t numFrames,
+    SampleAnalyzer::Biquad* shelves, SampleAnalyzer::Biquad* highPasses, double* energy)
+{
+    SampleAnalyzer::Biquad shelf[numChannels], highPass[numChannels];
+    std::copy(shelves, shelves + numChannels, shelf);
+    std::copy(highPasses, highPasses + numChannels, highPass);
+    double sum[numChannels] = {0};
+
+    for(std::size_t i = 0; i < numFrames; ++i)
+    {
+        for(std::size_t channel = 0; channel < numChannels; ++channel)
+        {
+            SampleAnalyzer::Biquad& s = shelf[channel];
+            SampleAnalyzer::Biquad& h = highPass[channel];
+            double sample = channels[channel][i];
+
+            double shelved = s.b0*sample + s.z1;
+            s.z1 = s.b1*sample - s.a1*shelved + s.z2;
+            s.z2 = s.b2*sample - s.a2*shelved;
+
+            double weighted = h.b0*shelved + h.z1;
+            h.z1 = h.b1*shelved - h.a1*weighted + h.z2;
+            h.z2 = h.b2*shelved - h.a2*weighted;
+
+            sum[channel] += weighted*weighted;
+        }
+    }
+
+    std::copy(shelf, shelf + numChannels, shelves);
+    std::copy(highPass, highPass + numChannels, highPasses);
+    for(std::size_t channel = 0; channel < numChannels; ++channel)
+        *energy += sum[channel];
+}
+
+SampleAnalyzer::SampleAnalyzer(std::size_t numChannels, unsigned bitsPerSample,
+    double sampleRate, bool measureLoudness)
+    : mNumChannels(numChannels),
+      mBitsPerSample(bitsPerSample),
+      mSampleRate(sampleRate),
+      mReduce(select_reduce_function()),
+      mChannels(numChannels),
+      mPeakLevels(1),
+      mMinimums(numChannels, 0),
+      mMaximums(numChannels, 0),
+      mSumsOfSquares(numChannels, 0),
+      mShelfFilters(numChannels),
+      mHighPassFilters(numChannels)
+{
+    mPeakLevels[0].framesPerPeak = cFramesPerPeak;
+
+    // K-weighting: a high shelf, then a high-pass filter, with coefficients
+    // for any sample rate (BS.1770 only gives those at 48 kHz).
+    const double shelfFrequency = 1681.974450955533;
+    const double shelfGain = 3.999843853973347; // dB
+    const double shelfQ = 0.7071752369554196;
+    const double highPassFrequency = 38.13547087602444;
+    const double highPassQ = 0.5003270373238773;
+
+    if(!measureLoudness || mSampleRate <= 2*shelfFrequency)
+        return; // Too low for the filters; loudness is unknown.
+
+    mSubBlockSize = static_cast<std::size_t>(std::lround(mSampleRate * cSubBlockDuration));
+
+    Biquad shelf;
+    double K = std::tan(cPi * shelfFrequency / mSampleRate);
+    double Vh = std::pow(10.0, shelfGain / 20.0);
+    double Vb = std::pow(Vh, 0.4996667741545416);
+    double a0 = 1.0 + K/shelfQ + K*K;
+    shelf.b0 = (Vh + Vb*K/shelfQ + K*K) / a0;
+    shelf.b1 = 2.0*(K*K - Vh) / a0;
+    shelf.b2 = (Vh - Vb*K/shelfQ + K*K) / a0;
+    shelf.a1 = 2.0*(K*K - 1.0) / a0;
+    shelf.a2 = (1.0 - K/shelfQ + K*K) / a0;
+
+    Biquad highPass;
+    K = std::tan(cPi * highPassFrequency / mSampleRate);
+    a0 = 1.0 + K/highPassQ + K*K;
+    highPass.b0 = 1.0;
+    highPass.b1 = -2.0;
+    highPass.b2 = 1.0;
+    highPass.a1 = 2.0*(K*K - 1.0) / a0;
+    highPass.a2 = (1.0 - K/highPassQ + K*K) / a0;
+
+    mShelfFilters.assign(numChannels, shelf);
+    mHighPassFilters.assign(numChannels, highPass);
+}
+
+// Static
+bool SampleAnalyzer::isSupported(unsigned bitsPerSample)
+{
+    return bitsPerSample == 8 || bitsPerSample == 16 || bitsPerSample == 24 ||
+        bitsPerSample == 32;
+}
+
+void SampleAnalyzer::convertFrames(const std::uint8_t* data, std::size_t numFrames)
+{
+    std::size_t numBuffered = mChannels[0].size();
+    std::vector<float*> channels(mNumChannels);
+    for(std::size_t channel = 0; channel < mNumChannels; ++channel)
+    {
+        mChannels[channel].resize(numBuffered + numFrames);
+        channels[channel] = mChannels[channel].data() + numBuffered;
+    }
+
+    switch(mBitsPerSample)
+    {
+    case 8:
+        convert_frames<1>(data, numFrames, mNumChannels, channels.data());
+        break;
+    case 16:
+        convert_frames<2>(data, numFrames, mNumChannels, channels.data());
+        break;
+    case 24:
+        convert_frames<3>(data, numFrames, mNumChannels, channels.data());
+        break;
+    default:
+        convert_frames<4>(data, numFrames, mNumChannels, channels.data());
+        break;
+    }
+}
+
+// Measures the first numFrames buffered frames, a peak at a time.
+void SampleAnalyzer::analyzeFrames(std::size_t numFrames)
+{
+    PeakLevel& finestLevel = mPeakLevels[0];
+
+    for(std::size_t start = 0; start < numFrames; start += cFramesPerPeak)
+    {
+        std::size_t count = std::min(cFramesPerPeak, numFrames - start);
+
+        for(std::size_t channel = 0; channel < mNumChannels; ++channel)
+        {
+            float minimum, maximum, sumOfSquares;
+            mReduce(mChannels[channel].data() + start, count, &minimum, &maximum,
+                &sumOfSquares);
+
+            finestLevel.minimums.push_back(minimum);
+            finestLevel.maximums.push_back(maximum);
+            mMinimums[channel] = std::min(mMinimums[channel], minimum);
+            mMaximums[channel] = std::max(mMaximums[channel], maximum);
+            mSumsOfSquares[channel] += sumOfSquares;
+        }
+    }
+
+    if(mSubBlockSize > 0)
+        filterFrames(numFrames);
+
+    mNumFrames += numFrames;
+}
+
+// Sums the K-weighted energy of the first numFrames buffered frames into
+// sub-blocks.
+void SampleAnalyzer::filterFrames(std::size_t numFrames)
+{
+    for(std::size_t start = 0; start < numFrames;)
+    {
+        std::size_t count = std::min(numFrames - start, mSubBlockSize - mNumSubBlockFrames);
+
+        // Channels all have a weight of 1; surround channels are not
+        // distinguished.
+        for(std::size_t channel = 0; channel < mNumChannels; channel += 2)
+        {
+            const float* samples[2] = {mChannels[channel].data() + start,
+                channel + 1 < mNumChannels ? mChannels[channel + 1].data() + start : nullptr};
+
+            if(samples[1] != nullptr)
+            {
+                k_weighted_energy<2>(samples, count, &mShelfFilters[channel],
+                    &mHighPassFilters[channel], &mSubBlockEnergy);
+            } else
+            {
+                k_weighted_energy<1>(samples, count, &mShelfFilters[channel],
+                    &mHighPassFilters[channel], &mSubBlockEnergy);
+            }
+        }
+
+        start += count;
+        mNumSubBlockFrames += count;
+        if(mNumSubBlockFrames == mSubBlockSize)
+        {
+            mSubBlockEnergies.push_back(mSubBlockEnergy / mSubBlockSize);
+            mSubBlockEnergy = 0;
+            mNumSubBlockFrames = 0;
+        }
+    }
+}
+
+// Samples of a frame may be split across writes.
+bool SampleAnalyzer::write(const std::uint8_t* data, std::size_t size)
+{
+    std::size_t frameSize = mNumChannels * mBitsPerSample/8;
+
+    // Complete a frame split across writes.
+    if(!mPendingBytes.empty())
+    {
+        std::size_t count = std::min(frameSize - mPendingBytes.size(), size);
+        mPendingBytes.insert(mPendingBytes.end(), data, data + count);
+        data += count;
+        size -= count;
+
+        if(mPendingBytes.size() < frameSize)
+            return true;
+
+        convertFrames(mPendingBytes.data(), 1);
+        mPendingBytes.clear();
+    }
+
+    std::size_t numFrames = size / frameSize;
+    convertFrames(data, numFrames);
+    mPendingBytes.assign(data + numFrames*frameSize, data + size);
+
+    // Only whole peaks are analyzed; the rest waits for more frames.
+    std::size_t numBuffered = mChannels[0].size();
+    std::size_t numAnalyzed = numBuffered - numBuffered % cFramesPerPeak;
+    if(numAnalyzed > 0)
+    {
+        analyzeFrames(numAnalyzed);
+        for(std::vector<float>& channel : mChannels)
+            channel.erase(channel.begin(), channel.begin() + numAnalyzed);
+    }
+
+    return true;
+}
+
+void SampleAnalyzer::finish()
+{
+    if(mFinished)
+        return;
+    mFinished = true;
+
+    if(!mChannels[0].empty())
+    {
+        analyzeFrames(mChannels[0].size());
+        for(std::vector<float>& channel : mChannels)
+            channel.clear();
+    }
+
+    // Each coarser level merges pairs of peaks of the previous one.
+    while(mPeakLevels.size() < cMaxNumPeakLevels &&
+        mPeakLevels.back().minimums.size() > mNumChannels)
+    {
+        const PeakLevel& finer = mPeakLevels.back();
+        PeakLevel coarser;
+        coarser.framesPerPeak = 2*finer.framesPerPeak;
+
+        std::size_t numFinerPeaks = finer.minimums.size() / mNumChannels;
+        for(std::size_t peak = 0; peak < numFinerPeaks; peak += 2)
+        {
+            for(std::size_t channel = 0; channel < mNumChannels; ++channel)
+            {
+                std::size_t first = peak*mNumChannels + channel;
+                std::size_t second = std::min(peak + 1, numFinerPeaks - 1)*mNumChannels + channel;
+                coarser.minimums.push_back(std::min(finer.minimums[first],
+                    finer.minimums[second]));
+                coarser.maximums.push_back(std::max(finer.maximums[first],
+                    finer.maximums[second]));
+            }
+        }
+
+        mPeakLevels.push_back(coarser);
+    }
+}
+
+std::size_t SampleAnalyzer::getNumChannels() const
+{
+    return mNumChannels;
+}
+
+double SampleAnalyzer::getSampleRate() const
+{
+    return mSampleRate;
+}
+
+std::uint64_t SampleAnalyzer::getNumFrames() const
+{
+    return mNumFrames;
+}
+
+const std::vector<SampleAnalyzer::PeakLevel>& SampleAnalyzer::getPeakLevels() const
+{
+    return mPeakLevels;
+}
+
+float SampleAnalyzer::getPeak(std::size_t channel) const
+{
+    return std::max(-mMinimums[channel], mMaximums[channel]);
+}
+
+double SampleAnalyzer::getRMS(std::size_t channel) const
+{
+    return mNumFrames > 0 ? std::sqrt(mSumsOfSquares[channel] / mNumFrames) : 0.0;
+}
+
+double SampleAnalyzer::getRMS() const
+{
+    double sumOfSquares = 0;
+    for(double channelSumOfSquares : mSumsOfSquares)
+        sumOfSquares += channelSumOfSquares;
+
+    return mNumFrames > 0 ? std::sqrt(sumOfSquares / (mNumFrames*mNumChannels)) : 0.0;
+}
+
+// Gated mean loudness of 400 ms blocks: blocks under -70 LUFS are ignored,
+// then those 10 LU below the mean of the others.
+double SampleAnalyzer::getIntegratedLoudness() const
+{
+    std::vector<double> blockEnergies;
+    for(std::size_t i = cSubBlocksPerBlock; i <= mSubBlockEnergies.size(); ++i)
+    {
+        double energy = 0;
+        for(std::size_t j = i - cSubBlocksPerBlock; j < i; ++j)
+            energy += mSubBlockEnergies[j];
+        energy /= cSubBlocksPerBlock;
+
+        if(energy > 0 && to_loudness(energy) > cAbsoluteGate)
+            blockEnergies.push_back(energy);
+    }
+
+    if(blockEnergies.empty())
+        return std::numeric_limits<double>::quiet_NaN();
+
+    double meanEnergy = 0;
+    for(double energy : blockEnergies)
+        meanEnergy += energy;
+    double relativeGate = to_loudness(meanEnergy / blockEnergies.size()) + cRelativeGate;
+
+    double gatedEnergy = 0;
+    std::size_t numGatedBlocks = 0;
+    for(double energy : blockEnergies)
+    {
+        if(to_loudness(energy) > relativeGate)
+        {
+            gatedEnergy += energy;
+            ++numGatedBlocks;
+        }
+    }
+
+    return to_loudness(gatedEnergy / numGatedBlocks);
+}
@@ -0,0 +1,114 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SAMPLE_ANALYZER_HPP
+#define SAMPLE_ANALYZER_HPP
+
+#include "SampleSink.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Measures decoded little-endian PCM as it is decoded: min/max peak envelopes
+// at several zoom levels, peak and RMS levels, and integrated loudness as
+// defined by ITU-R BS.1770 and EBU R128. Samples are measured relative to
+// full scale, so 8-bit sounds (which are unsigned) are centred first.
+class SampleAnalyzer : public SampleSink
+{
+public:
+    // Minimum and maximum of each channel over framesPerPeak sample frames,
+    // interleaved by channel. The last peak may cover fewer frames.
+    struct PeakLevel
+    {
+        std::size_t framesPerPeak = 0;
+        std::vector<float> minimums;
+        std::vector<float> maximums;
+    };
+
+    // Minimum, maximum and sum of squares of numSamples samples (at least 1).
+    using ReduceFunction = void (*)(const float* samples, std::size_t numSamples,
+        float* minimum, float* maximum, float* sumOfSquares);
+
+    // Second-order IIR filter, in transposed direct form II.
+    struct Biquad
+    {
+        double b0 = 1, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+        double z1 = 0, z2 = 0;
+    };
+
+    static const std::size_t cFramesPerPeak; // Of the finest level.
+    static const std::size_t cMaxNumPeakLevels;
+
+private:
+    void convertFrames(const std::uint8_t* data, std::size_t numFrames);
+    void analyzeFrames(std::size_t numFrames);
+    void filterFrames(std::size_t numFrames);
+
+    std::size_t mNumChannels;
+    unsigned mBitsPerSample;
+    double mSampleRate;
+    ReduceFunction mReduce; // Bound for the current kernel set.
+
+    std::vector<std::uint8_t> mPendingBytes; // Frame split across writes.
+    std::vector<std::vector<float>> mChannels; // Frames not yet analyzed.
+    std::uint64_t mNumFrames = 0;
+    bool mFinished = false;
+
+    std::vector<PeakLevel> mPeakLevels;
+    std::vector<float> mMinimums;
+    std::vector<float> mMaximums;
+    std::vector<double> mSumsOfSquares;
+
+    // K-weighting filters of each channel, and 100 ms sub-blocks of the
+    // 400 ms loudness blocks, which overlap by 75%.
+    std::vector<Biquad> mShelfFilters;
+    std::vector<Biquad> mHighPassFilters;
+    std::size_t mSubBlockSize = 0; // In frames; 0 if the rate is unknown.
+    std::size_t mNumSubBlockFrames = 0;
+    double mSubBlockEnergy = 0;
+    std::vector<double> mSubBlockEnergies; // Mean square, summed over channels.
+
+public:
+    // Loudness filters most of the time; without it, loudness is unknown.
+    SampleAnalyzer(std::size_t numChannels, unsigned bitsPerSample, double sampleRate,
+        bool measureLoudness = true);
+
+    static bool isSupported(unsigned bitsPerSample);
+
+    bool write(const std::uint8_t* data, std::size_t size) override;
+
+    // Analyzes the last frames; call once all samples are written.
+    void finish();
+
+    std::size_t getNumChannels() const;
+    double getSampleRate() const;
+    std::uint64_t getNumFrames() const;
+
+    // From the finest level.
+    const std::vector<PeakLevel>& getPeakLevels() const;
+
+    // Full scale is 1.
+    float getPeak(std::size_t channel) const;
+    double getRMS(std::size_t channel) const;
+    double getRMS() const; // Of all channels.
+
+    // In LUFS; NaN if the sound is shorter than 400 ms, or silent.
+    double getIntegratedLoudness() const;
+};
+
+#endif // SAMPLE_ANALYZER_HPP
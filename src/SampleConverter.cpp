@@ -0,0 +1,321 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "SampleConverter.hpp"
+#include "CpuFeatures.hpp"
+#include "Endian.hpp"
+
+#include <algorithm> // For std::min and std::max
+#include <cstring> // For std::memcpy
+
+#if defined(SNDTOWAV_X86)
+#include <immintrin.h>
+#elif defined(SNDTOWAV_NEON)
+#include <arm_neon.h>
+#endif
+
+template<unsigned bytesPerSample>
+static inline std::int32_t load_sample(const std::uint8_t* bytes)
+{
+    if(bytesPerSample == 1)
+        return static_cast<std::int32_t>(bytes[0]) - 128; // Unsigned.
+
+    std::uint32_t bits = 0;
+    for(unsigned byte = 0; byte < bytesPerSample; ++byte)
+        bits |= static_cast<std::uint32_t>(bytes[byte]) << (8*byte);
+
+    // Sign-extend.
+    const unsigned unusedBits = 32 - 8*bytesPerSample;
+    return static_cast<std::int32_t>(bits << unusedBits) >> unusedBits;
+}
+
+template<unsigned bytesPerSample>
+static void to_float_scalar(const std::uint8_t* samples, std::size_t numSamples,
+    std::uint8_t* output)
+{
+    const float scale = 1.0f / static_cast<float>(1U << (8*bytesPerSample - 1));
+
+    for(std::size_t i = 0; i < numSamples; ++i)
+    {
+        float value = static_cast<float>(load_sample<bytesPerSample>(samples + i*bytesPerSample)) *
+            scale;
+
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        bits = Endian::toLittle(bits);
+        std::memcpy(output + i*sizeof(bits), &bits, sizeof(bits));
+    }
+}
+
+template<unsigned bytesPerSample>
+static void to_int24_scalar(const std::uint8_t* samples, std::size_t numSamples,
+    std::uint8_t* output)
+{
+    for(std::size_t i = 0; i < numSamples; ++i)
+    {
+        std::int32_t sample = load_sample<bytesPerSample>(samples + i*bytesPerSample);
+
+        if(bytesPerSample < 3)
+        {
+            sample *= 1 << (8*(3 - bytesPerSample));
+        } else if(bytesPerSample == 4)
+        {
+            // Rounds to nearest, without overflowing.
+            sample = std::min((sample >> 8) + ((sample >> 7) & 1), 0x7FFFFF);
+        }
+
+        std::uint32_t bits = static_cast<std::uint32_t>(sample);
+        output[i*3] = static_cast<std::uint8_t>(bits);
+        output[i*3 + 1] = static_cast<std::uint8_t>(bits >> 8);
+        output[i*3 + 2] = static_cast<std::uint8_t>(bits >> 16);
+    }
+}
+
+#if defined(SNDTOWAV_X86)
+
+SNDTOWAV_TARGET("sse4.1")
+static void u8_to_float_sse(const std::uint8_t* samples, std::size_t numSamples,
+    std::uint8_t* output)
+{
+    const __m128i centre = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m128 scale = _mm_set1_ps(1.0f / 128);
+
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        // Flipping the top bit centres unsigned samples.
+        __m128i bytes = _mm_xor_si128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i)), centre);
+
+        for(int quarter = 0; quarter < 4; ++quarter)
+        {
+            __m128 floats = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi8_epi32(bytes)), scale);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 4*(i + 4*quarter)),
+                _mm_castps_si128(floats));
+            bytes = _mm_srli_si128(bytes, 4);
+        }
+    }
+
+    to_float_scalar<1>(samples + i, numSamples - i, output + 4*i);
+}
+
+SNDTOWAV_TARGET("sse4.1")
+static void s16_to_float_sse(const std::uint8_t* samples, std::size_t numSamples,
+    std::uint8_t* output)
+{
+    const __m128 scale = _mm_set1_ps(1.0f / 32768);
+
+    std::size_t i = 0;
+    for(; i + 8 <= numSamples; i += 8)
+    {
+        __m128i shorts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + 2*i));
+        __m128 low = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi16_epi32(shorts)), scale);
+        __m128 high = _mm_mul_ps(_mm_cvtepi32_ps(
+            _mm_cvtepi16_epi32(_mm_srli_si128(shorts, 8))), scale);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 4*i), _mm_castps_si128(low));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 4*i + 16), _mm_castps_si128(high));
+    }
+
+    to_float_scalar<2>(samples + 2*i, numSamples - i, output + 4*i);
+}
+
+SNDTOWAV_TARGET("avx2")
+static void u8_to_float_avx2(const std::uint8_t* samples, std::size_t numSamples,
+    std::uint8_t* output)
+{
+    const __m128i centre = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m256 scale = _mm256_set1_ps(1.0f / 128);
+
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        // Flipping the top bit centres unsigned samples.
+        __m128i bytes = _mm_xor_si128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i)), centre);
+        __m256 low = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(bytes)), scale);
+        __m256 high = _mm256_mul_ps(_mm256_cvtepi32_ps(
+            _mm256_cvtepi8_epi32(_mm_srli_si128(bytes, 8))), scale);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + 4*i), _mm256_castps_si256(low));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + 4*i + 32),
+            _mm256_castps_si256(high));
+    }
+
+    to_float_scalar<1>(samples + i, numSamples - i, output + 4*i);
+}
+
+SNDTOWAV_TARGET("avx2")
+static void s16_to_float_avx2(const std::uint8_t* samples, std::size_t numSamples,
+    std::uint8_t* output)
+{
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768);
+
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + 2*i));
+        __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + 2*i + 16));
+        __m256 lowFloats = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(low)), scale);
+        __m256 highFloats = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(high)), scale);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + 4*i),
+            _mm256_castps_si256(lowFloats));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + 4*i + 32),
+            _mm256_castps_si256(highFloats));
+    }
+
+    to_float_scalar<2>(samples + 2*i, numSamples - i, output + 4*i);
+}
+
+#elif defined(SNDTOWAV_NEON)
+
+static void u8_to_float_neon(const std::uint8_t* samples, std::size_t numSamples,
+    std::uint8_t* output)
+{
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        // Flipping the top bit centres unsigned samples.
+        int8x16_t bytes = vreinterpretq_s8_u8(veorq_u8(vld1q_u8(samples + i), vdupq_n_u8(0x80)));
+        int16x8_t shorts[2] = {vmovl_s8(vget_low_s8(bytes)), vmovl_s8(vget_high_s8(bytes))};
+
+        for(int half = 0; half < 2; ++half)
+        {
+            float32x4_t low = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(shorts[half]))),
+                1.0f / 128);
+            float32x4_t high = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(shorts[half]))),
+                1.0f / 128);
+            vst1q_f32(reinterpret_cast<float*>(output + 4*(i + 8*half)), low);
+            vst1q_f32(reinterpret_cast<float*>(output + 4*(i + 8*half) + 16), high);
+        }
+    }
+
+    to_float_scalar<1>(samples + i, numSamples - i, output + 4*i);
+}
+
+static void s16_to_float_neon(const std::uint8_t* samples, std::size_t numSamples,
+    std::uint8_t* output)
+{
+    std::size_t i = 0;
+    for(; i + 8 <= numSamples; i += 8)
+    {
+        int16x8_t shorts = vreinterpretq_s16_u8(vld1q_u8(samples + 2*i));
+        float32x4_t low = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(shorts))),
+            1.0f / 32768);
+        float32x4_t high = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(shorts))),
+            1.0f / 32768);
+        vst1q_f32(reinterpret_cast<float*>(output + 4*i), low);
+        vst1q_f32(reinterpret_cast<float*>(output + 4*i + 16), high);
+    }
+
+    to_float_scalar<2>(samples + 2*i, numSamples - i, output + 4*i);
+}
+
+#endif
+
+// Picks the kernel of the current kernel set. Only conversions of 8 and
+// 16-bit samples to floats, the common ones, are vectorized.
+static SampleConverter::ConvertFunction select_convert_function(unsigned bytesPerSample,
+    SampleConverter::Format format)
+{
+    if(format == SampleConverter::Format::Int24)
+    {
+        switch(bytesPerSample)
+        {
+        case 1:
+            return to_int24_scalar<1>;
+        case 2:
+            return to_int24_scalar<2>;
+        case 3:
+            return to_int24_scalar<3>;
+        default:
+            return to_int24_scalar<4>;
+        }
+    }
+
+#if defined(SNDTOWAV_X86)
+    if(CpuFeatures::useAVX2() && bytesPerSample <= 2)
+        return bytesPerSample == 1 ? u8_to_float_avx2 : s16_to_float_avx2;
+    if(CpuFeatures::useSSE() && bytesPerSample <= 2)
+        return bytesPerSample == 1 ? u8_to_float_sse : s16_to_float_sse;
+#elif defined(SNDTOWAV_NEON)
+    if(CpuFeatures::useNEON() && bytesPerSample <= 2)
+        return bytesPerSample == 1 ? u8_to_float_neon : s16_to_float_neon;
+#endif
+
+    switch(bytesPerSample)
+    {
+    case 1:
+        return to_float_scalar<1>;
+    case 2:
+        return to_float_scalar<2>;
+    case 3:
+        return to_float_scalar<3>;
+    default:
+        return to_float_scalar<4>;
+    }
+}
+
+SampleConverter::SampleConverter(SampleSink& output, unsigned bitsPerSample, Format format)
+    : mOutput(output),
+      mBytesPerSample(bitsPerSample/8),
+      mOutputBytesPerSample(getBitsPerSample(format)/8),
+      mConvert(select_convert_function(bitsPerSample/8, format))
+{
+
+}
+
+// Static
+bool SampleConverter::isSupported(unsigned bitsPerSample)
+{
+    return bitsPerSample == 8 || bitsPerSample == 16 || bitsPerSample == 24 ||
+        bitsPerSample == 32;
+}
+
+// Static
+unsigned SampleConverter::getBitsPerSample(Format format)
+{
+    return format == Format::Int24 ? 24 : 32;
+}
+
+bool SampleConverter::write(const std::uint8_t* data, std::size_t size)
+{
+    // Complete a sample split across writes first.
+    if(!mPendingBytes.empty())
+    {
+        std::size_t missing = std::min<std::size_t>(mBytesPerSample - mPendingBytes.size(), size);
+        mPendingBytes.insert(mPendingBytes.end(), data, data + missing);
+        data += missing;
+        size -= missing;
+
+        if(mPendingBytes.size() < mBytesPerSample)
+            return true;
+
+        std::uint8_t sample[4];
+        mConvert(mPendingBytes.data(), 1, sample);
+        mPendingBytes.clear();
+        if(!mOutput.write(sample, mOutputBytesPerSample))
+            return false;
+    }
+
+    std::size_t numSamples = size / mBytesPerSample;
+    mPendingBytes.assign(data + numSamples*mBytesPerSample, data + size);
+    if(numSamples == 0)
+        return true;
+
+    mBuffer.resize(numSamples * mOutputBytesPerSample);
+    mConvert(data, numSamples, mBuffer.data());
+    return mOutput.write(mBuffer.data(), mBuffer.size());
+}
@@ -0,0 +1,61 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SAMPLE_CONVERTER_HPP
+#define SAMPLE_CONVERTER_HPP
+
+#include "SampleSink.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Converts decoded little-endian PCM to 24-bit PCM or 32-bit float samples
+// as it is decoded, then writes it to another sink. 8-bit samples are
+// unsigned, so they are centred first; floats have a full scale of 1.
+class SampleConverter : public SampleSink
+{
+public:
+    enum class Format
+    {
+        Int24,
+        Float32
+    };
+
+    // Converts numSamples samples to little-endian output samples.
+    using ConvertFunction = void (*)(const std::uint8_t* samples, std::size_t numSamples,
+        std::uint8_t* output);
+
+private:
+    SampleSink& mOutput;
+    unsigned mBytesPerSample;
+    unsigned mOutputBytesPerSample;
+    ConvertFunction mConvert; // Bound for the current kernel set.
+
+    std::vector<std::uint8_t> mPendingBytes; // Sample split across writes.
+    std::vector<std::uint8_t> mBuffer;
+
+public:
+    SampleConverter(SampleSink& output, unsigned bitsPerSample, Format format);
+
+    static bool isSupported(unsigned bitsPerSample);
+    static unsigned getBitsPerSample(Format format);
+
+    bool write(const std::uint8_t* data, std::size_t size) override;
+};
+
+#endif // SAMPLE_CONVERTER_HPP
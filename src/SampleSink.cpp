@@ -0,0 +1,97 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "SampleSink.hpp"
+
+#include <cstring> // For std::memcpy
+#include <algorithm> // For std::reverse
+
+StreamSampleSink::StreamSampleSink(std::ostream& stream)
+    : mStream(stream)
+{
+
+}
+
+bool StreamSampleSink::write(const std::uint8_t* data, std::size_t size)
+{
+    mStream.write(reinterpret_cast<const char*>(data), size);
+    return !mStream.fail();
+}
+
+MemorySampleSink::MemorySampleSink(void* buffer, std::size_t capacity)
+    : mBuffer(static_cast<std::uint8_t*>(buffer))
+    , mCapacity(capacity)
+{
+
+}
+
+// Fails without writing anything if data does not fit.
+bool MemorySampleSink::write(const std::uint8_t* data, std::size_t size)
+{
+    if(size > mCapacity - mSize)
+        return false;
+
+    std::memcpy(mBuffer + mSize, data, size);
+    mSize += size;
+    return true;
+}
+
+std::size_t MemorySampleSink::getSize() const
+{
+    return mSize;
+}
+
+ByteSwapSampleSink::ByteSwapSampleSink(SampleSink& output, std::size_t bytesPerSample)
+    : mOutput(output)
+    , mBytesPerSample(bytesPerSample)
+{
+
+}
+
+bool ByteSwapSampleSink::write(const std::uint8_t* data, std::size_t size)
+{
+    mBuffer.resize(mNumPendingBytes);
+    mBuffer.insert(mBuffer.end(), data, data + size);
+
+    std::size_t wholeSize = mBuffer.size() - mBuffer.size() % mBytesPerSample;
+    for(std::size_t i = 0; i < wholeSize; i += mBytesPerSample)
+        std::reverse(mBuffer.begin() + i, mBuffer.begin() + i + mBytesPerSample);
+
+    if(wholeSize > 0 && !mOutput.write(mBuffer.data(), wholeSize))
+        return false;
+
+    mBuffer.erase(mBuffer.begin(), mBuffer.begin() + wholeSize);
+    mNumPendingBytes = mBuffer.size();
+    return true;
+}
+
+void FanOutSampleSink::addSink(SampleSink& sink)
+{
+    mSinks.push_back(&sink);
+}
+
+// Stops at the first sink which fails.
+bool FanOutSampleSink::write(const std::uint8_t* data, std::size_t size)
+{
+    for(SampleSink* sink : mSinks)
+    {
+        if(!sink->write(data, size))
+            return false;
+    }
+
+    return true;
+}
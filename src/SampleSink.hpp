@@ -0,0 +1,93 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SAMPLE_SINK_HPP
+#define SAMPLE_SINK_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+// Receives decoded little-endian sample data, chunk by chunk, as the decoder
+// produces it.
+class SampleSink
+{
+public:
+    virtual ~SampleSink() = default;
+
+    // Returns true on success, false on failure.
+    virtual bool write(const std::uint8_t* data, std::size_t size) = 0;
+};
+
+// Writes sample data straight to an output stream.
+class StreamSampleSink : public SampleSink
+{
+private:
+    std::ostream& mStream;
+
+public:
+    StreamSampleSink(std::ostream& stream);
+
+    bool write(const std::uint8_t* data, std::size_t size) override;
+};
+
+// Writes sample data to a fixed-size, caller-owned buffer.
+class MemorySampleSink : public SampleSink
+{
+private:
+    std::uint8_t* mBuffer;
+    std::size_t mCapacity;
+    std::size_t mSize = 0;
+
+public:
+    MemorySampleSink(void* buffer, std::size_t capacity);
+
+    bool write(const std::uint8_t* data, std::size_t size) override;
+    std::size_t getSize() const;
+};
+
+// Reverses the byte order of each sample, then writes it to another sink.
+// Samples may be split across writes.
+class ByteSwapSampleSink : public SampleSink
+{
+private:
+    SampleSink& mOutput;
+    std::size_t mBytesPerSample;
+    std::vector<std::uint8_t> mBuffer;
+    std::size_t mNumPendingBytes = 0; // Start of an incomplete sample.
+
+public:
+    ByteSwapSampleSink(SampleSink& output, std::size_t bytesPerSample);
+
+    bool write(const std::uint8_t* data, std::size_t size) override;
+};
+
+// Writes sample data to several sinks, so that a single decoding pass can
+// feed them all.
+class FanOutSampleSink : public SampleSink
+{
+private:
+    std::vector<SampleSink*> mSinks;
+
+public:
+    void addSink(SampleSink& sink);
+
+    bool write(const std::uint8_t* data, std::size_t size) override;
+};
+
+#endif // SAMPLE_SINK_HPP
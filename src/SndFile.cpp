@@ -25,10 +25,13 @@
 #include "MACEDecoder.hpp"
 #include "IMA4Decoder.hpp"
 #include "XLawDecoder.hpp"
+#include "Resampler.hpp"
 
 #include <iomanip>
 #include <utility> // For std::move
 #include <stdexcept>
+#include <algorithm> // For std::min
+#include <limits>
 
 namespace
 {
@@ -42,9 +45,9 @@ const std::uint8_t SndFile::cCompressedSoundHeaderEncode = 0xFE;
 SndFile::SndFile(std::istream& file, const std::string& fileName)
     : mFileName(fileName)
     , mFile(file)
+    , mEndFrame(std::numeric_limits<std::size_t>::max())
 {
-    parse();
-    decode();
+    mValid = parse();
 }
 
 // Parse the current snd file.
@@ -102,8 +105,10 @@ bool SndFile::parse()
     return false;
 }
 
-// Call after parsing!
-bool SndFile::decode()
+// Decodes the sample data, streaming it to sink as it is decoded.
+// If sink is nullptr, decoded data is kept by the decoder instead.
+// Returns true on success, false on failure.
+bool SndFile::decode(SampleSink* sink)
 {
     if(mDecoder == nullptr)
     {
@@ -118,17 +123,86 @@ bool SndFile::decode()
         return false;
     }
 
+    if(mProcessed)
+        return sink == nullptr || sink->write(mProcessedSamples.data(), mProcessedSamples.size());
+
     // Decode!
-    if(mSoundSampleHeader->encode == cStandardSoundHeaderEncode)
+    // For basic sounds, we don't have a number of channels; it is always 1.
+    std::unique_ptr<Resampler> resampler;
+    if(mOutputSampleRate != 0 && sink != nullptr)
+    {
+        resampler.reset(new Resampler(*sink, getNumChannels(), mDecoder->getBitsPerSample(),
+            mSoundSampleHeader->sampleRate, mOutputSampleRate));
+        mDecoder->setSink(resampler.get());
+    } else
     {
-        // For basic sounds, we don't have a number of channels; it is always 1.
-        return mDecoder->decode(mSoundSampleHeader->sampleArea, 1);
+        mDecoder->setSink(sink);
     }
 
-    return mDecoder->decode(
-        mSoundSampleHeader->sampleArea,
-        mSoundSampleHeader->lengthOrChannels
-    );
+    bool success = false;
+
+    std::size_t numFrames = getNumFrames();
+    std::size_t endFrame = std::min(mEndFrame, numFrames);
+    if(mFirstFrame == 0 && endFrame == numFrames)
+    {
+        success = mDecoder->decode(mSoundSampleHeader->sampleArea, getNumChannels());
+    } else
+    {
+        // Decode the packets covering the range, and trim the samples
+        // outside of it.
+        std::size_t frameSize = getNumChannels() * mDecoder->getBitsPerSample()/8;
+        std::size_t samplesPerPacket = mDecoder->getDecodedSize(1) /
+            (mDecoder->getBitsPerSample()/8);
+        std::size_t firstPacketFrame = mFirstFrame / samplesPerPacket;
+        std::size_t endPacketFrame = (endFrame + samplesPerPacket - 1) / samplesPerPacket;
+
+        mDecoder->setOutputWindow((mFirstFrame - firstPacketFrame * samplesPerPacket) * frameSize,
+            getNumRangeFrames() * frameSize);
+        success = mDecoder->decodeFrames(mSoundSampleHeader->sampleArea, getNumChannels(),
+            firstPacketFrame, endPacketFrame);
+        mDecoder->resetOutputWindow();
+    }
+
+    if(sink != nullptr)
+        mDecoder->setSink(nullptr); // Do not keep a dangling sink.
+
+    if(resampler != nullptr && success)
+        success = resampler->finish();
+
+    return success;
+}
+
+// Returns true if writeEncoded() can write the range: either packets hold
+// one sample frame each, or the range is the whole sound. Resampled and
+// post-processed sounds are never written encoded.
+bool SndFile::canWriteEncoded() const
+{
+    if(mDecoder == nullptr || mSoundSampleHeader == nullptr || mOutputSampleRate != 0 ||
+        mProcessed)
+        return false;
+
+    return getNumFrames() == getNumPackets() / getNumChannels() ||
+        (mFirstFrame == 0 && mEndFrame >= getNumFrames());
+}
+
+// Writes the sample data of the range as-is, without decoding it.
+// Returns true on success, false on failure.
+bool SndFile::writeEncoded(SampleSink& sink) const
+{
+    if(!canWriteEncoded())
+    {
+        Log::err << "Error: cannot write encoded samples of '" << mFileName <<
+            "'; it is resampled or post-processed, or the range does not start and end on packets." <<
+            std::endl;
+        return false;
+    }
+
+    // One sample frame per packet frame, or the whole sound.
+    std::size_t frameSize = mDecoder->getEncodedSize(getNumChannels());
+    std::size_t firstFrame = mFirstFrame;
+    std::size_t endFrame = std::min(mEndFrame, getNumPackets() / getNumChannels());
+    return sink.write(mSoundSampleHeader->sampleArea.data() + firstFrame * frameSize,
+        (endFrame - firstFrame) * frameSize);
 }
 
 // Finds first instance of cmdName, and returns entire command.
@@ -170,8 +244,7 @@ bool SndFile::doBufferCommand(std::uint64_t command)
         return false;
     }
 
-    loadSoundSampleHeader(param2);
-    return true;
+    return loadSoundSampleHeader(param2);
 }
 
 // Offset from beginning of file, must be in native endianness.
@@ -197,7 +270,7 @@ bool SndFile::loadSoundSampleHeader(std::size_t offset)
     {
         Log::err << "Error: sound sample data pointer is not null! Cannot read data." <<
             std::endl;
-        return true;
+        return false;
     }
 
     if(standardHeader->encode == cStandardSoundHeaderEncode)
@@ -269,6 +342,8 @@ bool SndFile::loadSoundSampleHeader(std::size_t offset)
             std::string formatString =
                 std::string(reinterpret_cast<const char*>(compressedHeader->format), 4);
             createDecompressionDecoder(formatString, compressedHeader->compressionID);
+            if(mDecoder == nullptr)
+                return false; // Error messages already dealt with.
         }
 
         // numFrames is the number of packet frames, not sample frames.
@@ -286,6 +361,16 @@ bool SndFile::loadSoundSampleHeader(std::size_t offset)
         return false;
     }
 
+    // Frame sizes are computed from the number of channels.
+    if(getNumChannels() == 0)
+    {
+        Log::err << "Error: sound has no channels! Cannot convert." << std::endl;
+        return false;
+    }
+
+    // Pick kernels for this sound once, rather than in every decoding loop.
+    mDecoder->specialize(getNumChannels());
+
     // Load sample data.
     loadSampleData(mFile.tellg(), sampleDataSize);
 
@@ -317,7 +402,12 @@ void SndFile::createDecompressionDecoder(const std::string& formatString,
        formatString == "mac3" ||
        formatString == "MAC3")
     {
-        mDecoder = std::unique_ptr<Decoder>(new MACEDecoder());
+        mDecoder = std::unique_ptr<Decoder>(new MACE3Decoder());
+    } else if(compressionID == 4 ||
+              formatString == "mac6" ||
+              formatString == "MAC6")
+    {
+        mDecoder = std::unique_ptr<Decoder>(new MACE6Decoder());
     } else if(formatString == "ima4" || formatString == "IMA4")
     {
         mDecoder = std::unique_ptr<Decoder>(new IMA4Decoder());
@@ -335,8 +425,272 @@ void SndFile::createDecompressionDecoder(const std::string& formatString,
     }
 }
 
+// Returns true if the file was parsed successfully.
+bool SndFile::isValid() const
+{
+    return mValid;
+}
+
+std::size_t SndFile::getNumChannels() const
+{
+    // Basic sounds only support mono.
+    if(mSoundSampleHeader == nullptr ||
+        mSoundSampleHeader->encode == cStandardSoundHeaderEncode)
+        return 1;
+
+    return mSoundSampleHeader->lengthOrChannels;
+}
+
+// For compressed sounds, numFrames is the number of packet frames, so
+// numPackets = numFrames * numChannels in all cases.
+std::size_t SndFile::getNumPackets() const
+{
+    if(mSoundSampleHeader == nullptr)
+        return 0;
+
+    if(mSoundSampleHeader->encode == cExtendedSoundHeaderEncode)
+    {
+        return static_cast<const ExtendedSoundSampleHeader&>(*mSoundSampleHeader).numFrames *
+            mSoundSampleHeader->lengthOrChannels;
+    } else if(mSoundSampleHeader->encode == cCompressedSoundHeaderEncode)
+    {
+        return static_cast<const CompressedSoundSampleHeader&>(*mSoundSampleHeader).numFrames *
+            mSoundSampleHeader->lengthOrChannels;
+    }
+
+    return mSoundSampleHeader->lengthOrChannels;
+}
+
+// Number of sample frames in the whole sound.
+std::size_t SndFile::getNumFrames() const
+{
+    if(mDecoder == nullptr || mDecoder->getBitsPerSample() < 8)
+        return 0;
+
+    return mDecoder->getDecodedSize(getNumPackets()) /
+        (getNumChannels() * mDecoder->getBitsPerSample()/8);
+}
+
+// In Hz, including the fractional part.
+double SndFile::getSampleRate() const
+{
+    if(mSoundSampleHeader == nullptr)
+        return 0;
+
+    return mSoundSampleHeader->sampleRate / 65536.0;
+}
+
+// Returns true on success, false on failure.
+bool SndFile::setRange(std::size_t firstFrame, std::size_t endFrame)
+{
+    if(firstFrame > endFrame || firstFrame > getNumFrames())
+    {
+        Log::err << "Error: invalid range [" << firstFrame << ", " << endFrame <<
+            ") for '" << mFileName << "', which has " << getNumFrames() <<
+            " frames." << std::endl;
+        return false;
+    }
+
+    mFirstFrame = firstFrame;
+    mEndFrame = endFrame;
+    return true;
+}
+
+// Number of sample frames of the range, before resampling.
+std::size_t SndFile::getNumRangeFrames() const
+{
+    std::size_t endFrame = std::min(mEndFrame, getNumFrames());
+    return endFrame - mFirstFrame;
+}
+
+std::size_t SndFile::getDecodedSize() const
+{
+    if(mDecoder == nullptr)
+        return 0;
+
+    if(mProcessed)
+        return mProcessedSamples.size();
+
+    std::size_t numFrames = getNumRangeFrames();
+    if(mOutputSampleRate != 0)
+    {
+        numFrames = static_cast<std::size_t>(Resampler::getNumOutputFrames(numFrames,
+            mSoundSampleHeader->sampleRate, mOutputSampleRate));
+    }
+
+    return numFrames * getNumChannels() * mDecoder->getBitsPerSample()/8;
+}
+
+// Returns true on success, false on failure.
+bool SndFile::setOutputSampleRate(std::uint32_t sampleRate)
+{
+    if(mSoundSampleHeader == nullptr || mDecoder == nullptr)
+    {
+        Log::err << "Error: cannot resample '" << mFileName << "'; it was not loaded." <<
+            std::endl;
+        return false;
+    }
+
+    if(sampleRate > 0xFFFF)
+    {
+        Log::err << "Error: cannot resample to " << sampleRate << " Hz; rates are " <<
+            "at most 65535 Hz." << std::endl;
+        return false;
+    }
+
+    std::uint32_t fixedSampleRate = sampleRate << 16;
+    if(sampleRate == 0 || fixedSampleRate == mSoundSampleHeader->sampleRate)
+    {
+        mOutputSampleRate = 0; // Nothing to do.
+        return true;
+    }
+
+    if(mSoundSampleHeader->sampleRate == 0 ||
+        !Resampler::isSupported(mDecoder->getBitsPerSample()))
+    {
+        Log::err << "Error: cannot resample '" << mFileName << "'; only sounds with " <<
+            "a sample rate, and 8, 16, 24 or 32-bit samples, can be resampled." <<
+            std::endl;
+        return false;
+    }
+
+    mOutputSampleRate = fixedSampleRate;
+    return true;
+}
+
+std::uint32_t SndFile::getDecodedSampleRate() const
+{
+    if(mOutputSampleRate != 0)
+        return mOutputSampleRate;
+
+    return mSoundSampleHeader != nullptr ? mSoundSampleHeader->sampleRate : 0;
+}
+
+// Normalizing and trimming trailing silence need the whole range, so it is
+// decoded to memory once, and processed there.
+// Returns true on success, false on failure.
+bool SndFile::process(const PostProcessor::Options& options)
+{
+    if(mSoundSampleHeader == nullptr || mDecoder == nullptr)
+    {
+        Log::err << "Error: cannot post-process '" << mFileName << "'; it was not loaded." <<
+            std::endl;
+        return false;
+    }
+
+    if(!PostProcessor::isSupported(mDecoder->getBitsPerSample()))
+    {
+        Log::err << "Error: cannot post-process '" << mFileName << "'; only sounds with " <<
+            "8 or 16-bit samples can be post-processed." << std::endl;
+        return false;
+    }
+
+    std::vector<std::uint8_t> samples(getDecodedSize());
+    MemorySampleSink sink(samples.data(), samples.size());
+    if(!decode(&sink))
+        return false;
+
+    samples.resize(sink.getSize());
+
+    std::size_t numChannels = getDecodedNumChannels();
+    PostProcessor(options, mDecoder->getBitsPerSample()).process(samples, numChannels);
+
+    mProcessedSamples = std::move(samples);
+    mProcessedNumChannels = numChannels;
+    mProcessed = true;
+    return true;
+}
+
+std::size_t SndFile::getDecodedNumChannels() const
+{
+    return mProcessed ? mProcessedNumChannels : getNumChannels();
+}
+
+bool SndFile::canUseSeekIndex() const
+{
+    return mSoundSampleHeader != nullptr &&
+        dynamic_cast<const MACEDecoder*>(mDecoder.get()) != nullptr;
+}
+
+// Builds a seek index of the whole sound, then decodes ranges from it.
+// Returns true on success, false on failure.
+bool SndFile::buildSeekIndex()
+{
+    if(!canUseSeekIndex())
+    {
+        Log::err << "Error: '" << mFileName << "' is not a MACE sound; it needs no " <<
+            "seek index." << std::endl;
+        return false;
+    }
+
+    MACEDecoder& decoder = static_cast<MACEDecoder&>(*mDecoder);
+    std::unique_ptr<MACEDecoder::SeekIndex> seekIndex(new MACEDecoder::SeekIndex());
+    if(!decoder.buildSeekIndex(mSoundSampleHeader->sampleArea, getNumChannels(),
+        MACEDecoder::cSeekIndexInterval, *seekIndex))
+        return false;
+
+    mSeekIndex = std::move(seekIndex);
+    decoder.setSeekIndex(mSeekIndex.get());
+    return true;
+}
+
+// Loads a seek index saved by saveSeekIndex(), then decodes ranges from it.
+// Returns true on success, false on failure.
+bool SndFile::loadSeekIndex(std::istream& in)
+{
+    if(!canUseSeekIndex())
+    {
+        Log::err << "Error: '" << mFileName << "' is not a MACE sound; it needs no " <<
+            "seek index." << std::endl;
+        return false;
+    }
+
+    MACEDecoder& decoder = static_cast<MACEDecoder&>(*mDecoder);
+    std::unique_ptr<MACEDecoder::SeekIndex> seekIndex(new MACEDecoder::SeekIndex());
+    if(!seekIndex->load(in))
+        return false;
+
+    if(!decoder.matchesSeekIndex(mSoundSampleHeader->sampleArea, getNumChannels(), *seekIndex))
+    {
+        Log::warn << "Warning: seek index was built for another version of '" <<
+            mFileName << "'." << std::endl;
+        return false;
+    }
+
+    mSeekIndex = std::move(seekIndex);
+    decoder.setSeekIndex(mSeekIndex.get());
+    return true;
+}
+
+// Returns true on success, false on failure.
+bool SndFile::saveSeekIndex(std::ostream& out) const
+{
+    if(mSeekIndex == nullptr)
+    {
+        Log::err << "Error: '" << mFileName << "' has no seek index to save." << std::endl;
+        return false;
+    }
+
+    return mSeekIndex->save(out);
+}
+
+std::size_t SndFile::getSeekIndexSize() const
+{
+    if(!canUseSeekIndex())
+        return 0;
+
+    return static_cast<const MACEDecoder&>(*mDecoder).getSeekIndexSize(
+        mSoundSampleHeader->sampleArea, getNumChannels(), MACEDecoder::cSeekIndexInterval);
+}
+
 const SoundSampleHeader& SndFile::getSoundSampleHeader() const
 {
+    if(mSoundSampleHeader == nullptr)
+    {
+        Log::err << "Error: cannot get sound sample header! It was not loaded." << std::endl;
+        throw std::logic_error("Cannot get sound sample header; it was not loaded.");
+    }
+
     return *mSoundSampleHeader;
 }
 
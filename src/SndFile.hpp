@@ -18,9 +18,12 @@
 #ifndef SND_FILE_HPP
 #define SND_FILE_HPP
 
-#include "Utils.hpp"
+#include "Endian.hpp"
 #include "SoundSampleHeader.hpp"
 #include "Decoder.hpp"
+#include "MACEDecoder.hpp"
+#include "SampleSink.hpp"
+#include "PostProcessor.hpp"
 
 #include <string>
 #include <istream>
@@ -40,7 +43,7 @@ private:
     {
         T readBigValue;
         bigStream.read(reinterpret_cast<char*>(&readBigValue), sizeof(T));
-        return Utils::makeBigEndianNative(readBigValue);
+        return Endian::fromBig(readBigValue);
     }
 
     // Will return native-endian value.
@@ -52,7 +55,7 @@ private:
         T readBigValue = 0; // Will with 0s.
         // Fill data in the LSBs of readValue (as Big-endian).
         bigStream.read(reinterpret_cast<char*>(&readBigValue) + (sizeof(T)-length), length);
-        return Utils::makeBigEndianNative(readBigValue);
+        return Endian::fromBig(readBigValue);
     }
 
     // Will return native-endian values.
@@ -60,11 +63,8 @@ private:
     template<class T>
     static void readBigArray(std::istream& bigStream, T* buffer, std::size_t length)
     {
-        for(std::size_t i = 0; i < length; ++i)
-        {
-            bigStream.read(reinterpret_cast<char*>(&buffer[i]), sizeof(T));
-            buffer[i] = Utils::makeBigEndianNative(buffer[i]);
-        }
+        bigStream.read(reinterpret_cast<char*>(buffer), length * sizeof(T));
+        Endian::loadBig(buffer, buffer, length);
     }
 
     std::string mFileName;
@@ -79,11 +79,28 @@ private:
 
     std::unique_ptr<SoundSampleHeader> mSoundSampleHeader;
     std::unique_ptr<Decoder> mDecoder;
+    bool mValid = false;
+
+    // Sample frames to decode; by default, the whole sound.
+    std::size_t mFirstFrame = 0;
+    std::size_t mEndFrame;
+
+    // Rate decoded samples are resampled to, in unsigned 16.16 fixed-point;
+    // 0 keeps the rate of the sound.
+    std::uint32_t mOutputSampleRate = 0;
+
+    // Decoded samples, once post-processed; decode() then writes them.
+    bool mProcessed = false;
+    std::vector<std::uint8_t> mProcessedSamples;
+    std::size_t mProcessedNumChannels = 0;
+
+    // Checkpoints of MACE decoder state, used by ranges.
+    std::unique_ptr<MACEDecoder::SeekIndex> mSeekIndex;
 
     std::vector<std::uint64_t> mSoundData; // Filled when interpreting bufferCmd.
 
     bool parse();
-    bool decode();
+    std::size_t getNumRangeFrames() const;
     std::uint64_t findSoundCommand(std::uint16_t cmdName) const;
     bool doBufferCommand(std::uint64_t command);
 
@@ -99,6 +116,41 @@ public:
 
     SndFile(std::istream& file, const std::string& fileName);
 
+    bool isValid() const;
+    bool decode(SampleSink* sink = nullptr);
+    bool canWriteEncoded() const;
+    bool writeEncoded(SampleSink& sink) const;
+
+    std::size_t getNumChannels() const;
+    std::size_t getNumPackets() const;
+    std::size_t getNumFrames() const;
+    double getSampleRate() const;
+
+    // Restricts decoding to sample frames [firstFrame, endFrame); endFrame
+    // is clamped to the end of the sound.
+    bool setRange(std::size_t firstFrame, std::size_t endFrame);
+    std::size_t getDecodedSize() const; // Of the range, in bytes.
+
+    // Resamples decoded samples to sampleRate Hz (at most 65535, like snd
+    // sample rates); 0 keeps the rate of the sound. Resampled samples cannot
+    // be written encoded.
+    bool setOutputSampleRate(std::uint32_t sampleRate);
+    std::uint32_t getDecodedSampleRate() const; // Unsigned 16.16 fixed-point.
+
+    // Decodes the range, resampled if set, and post-processes it; set them
+    // first. Post-processed samples cannot be written encoded.
+    bool process(const PostProcessor::Options& options);
+    std::size_t getDecodedNumChannels() const; // 1 once downmixed.
+
+    // MACE sounds carry decoder state from their very beginning, so ranges of
+    // them are decoded from it, unless a seek index gives checkpoints of that
+    // state. Sounds of other codecs can start at any packet, and need none.
+    bool canUseSeekIndex() const;
+    bool buildSeekIndex(); // Decodes the whole sound once.
+    bool loadSeekIndex(std::istream& in); // Fails if built for another sound.
+    bool saveSeekIndex(std::ostream& out) const;
+    std::size_t getSeekIndexSize() const; // Saved, in bytes; 0 if none is needed.
+
     const SoundSampleHeader& getSoundSampleHeader() const;
     const Decoder& getDecoder() const;
 
@@ -19,8 +19,19 @@
 #include "Log.hpp"
 #include "SndFile.hpp"
 #include "WAVFile.hpp"
+#include "AIFFFile.hpp"
+#include "FLACFile.hpp"
+#include "PCMHashWriter.hpp"
+#include "PeakFile.hpp"
+#include "StatsFile.hpp"
+#include "FingerprintFile.hpp"
+#include "WorkerPool.hpp"
 
 #include <sstream>
+#include <iostream>
+#include <fstream>
+#include <cmath> // For std::llround
+#include <algorithm> // For std::find
 
 // Block size is often 4096 bytes.
 SndToWAV::SndToWAV(std::size_t resourceFileBlockSize)
@@ -31,33 +42,556 @@ SndToWAV::SndToWAV(std::size_t resourceFileBlockSize)
 
 // Static
 void SndToWAV::printResult(bool success, const std::string& name,
-    const std::string& wavFileName)
+    const std::string& outputFileName)
 {
     if(success)
     {
         Log::info << "Extracted '" + name + "' to '" +
-            wavFileName + "'!" << std::endl;
+            outputFileName + "'!" << std::endl;
     } else
     {
         Log::err <<  "Error: failed to convert '" + name + "' to '" +
-            wavFileName + "'!" << std::endl;
+            outputFileName + "'!" << std::endl;
     }
 }
 
-// Converts char* containing an 'snd ' resource to wav.
+// Enables incremental mode: resources already converted according to the
+// journal are skipped, and every new conversion is committed to it.
 // Returns true on success, false on failure
-bool SndToWAV::convertResourceData(char* resourceData, std::size_t resourceSize,
-    const std::string& name)
+bool SndToWAV::useJournal(const std::string& journalPath)
 {
+    mJournal = std::make_shared<Journal>(journalPath);
+    return mJournal->isOpen();
+}
+
+// Same as above, with a journal which may be shared with other converters.
+void SndToWAV::useJournal(std::shared_ptr<Journal> journal)
+{
+    mJournal = journal;
+}
+
+// Directory in which WAV files are written. Must already exist.
+void SndToWAV::setOutputDirectory(const std::string& outputDirectory)
+{
+    mOutputDirectory = outputDirectory;
+}
+
+// Streams converted sounds to stdout instead of writing files.
+// If rawPCM is true, only headerless sample data is written.
+void SndToWAV::useStandardOutput(bool rawPCM)
+{
+    mToStandardOutput = true;
+    mRawPCM = rawPCM;
+    Log::useStandardError();
+}
+
+// Writes converted sounds as entries of a single tar archive, followed by a
+// JSON manifest of their offsets, instead of as separate files. An
+// archivePath of '-' streams the archive to stdout.
+// Returns true on success, false on failure
+bool SndToWAV::useArchive(const std::string& archivePath)
+{
+    if(archivePath == "-")
+        Log::useStandardError();
+
+    mArchive.reset(new TarArchive(archivePath));
+    return mArchive->isOpen();
+}
+
+// Ends the archive, if any; no more sounds may be converted afterwards.
+// Returns true on success, false on failure
+bool SndToWAV::closeArchive()
+{
+    return mArchive == nullptr || mArchive->close();
+}
+
+// Formats of the written files, separated by commas: "wav", "aiff", "flac",
+// "hash", "peaks", "stats" or "fingerprint". Every output of a sound is written from a
+// single decoding pass.
+// Returns true on success, false on failure.
+bool SndToWAV::setOutputFormats(const std::string& formatNames)
+{
+    std::vector<OutputFormat> outputFormats;
+    std::stringstream stream(formatNames);
+    std::string formatName;
+
+    while(std::getline(stream, formatName, ','))
+    {
+        OutputFormat format = OutputFormat::WAV;
+        if(formatName == "wav")
+        {
+            format = OutputFormat::WAV;
+        } else if(formatName == "aiff")
+        {
+            format = OutputFormat::AIFF;
+        } else if(formatName == "flac")
+        {
+            format = OutputFormat::FLAC;
+        } else if(formatName == "hash")
+        {
+            format = OutputFormat::PCMHash;
+        } else if(formatName == "peaks")
+        {
+            format = OutputFormat::Peaks;
+        } else if(formatName == "stats")
+        {
+            format = OutputFormat::Stats;
+        } else if(formatName == "fingerprint")
+        {
+            format = OutputFormat::Fingerprint;
+        } else
+        {
+            Log::err << "Error: unknown output format '" << formatName <<
+                "'; expected wav, aiff, flac, hash, peaks, stats or fingerprint." << std::endl;
+            return false;
+        }
+
+        if(std::find(outputFormats.begin(), outputFormats.end(), format) !=
+            outputFormats.end())
+        {
+            Log::err << "Error: output format '" << formatName << "' is given twice." <<
+                std::endl;
+            return false;
+        }
+
+        outputFormats.push_back(format);
+    }
+
+    if(outputFormats.empty())
+    {
+        Log::err << "Error: no output format given." << std::endl;
+        return false;
+    }
+
+    mOutputFormats = outputFormats;
+    return true;
+}
+
+// Number of threads encoding FLAC blocks; 0 means one per hardware thread.
+void SndToWAV::setNumEncoderThreads(std::size_t numThreads)
+{
+    mNumEncoderThreads = numThreads;
+}
+
+// Writes A-law and mu-law sounds without expanding them, and IMA 4:1 sounds
+// as WAV IMA ADPCM. Other sounds are still written as PCM.
+void SndToWAV::setKeepCompressed(bool keepCompressed)
+{
+    mKeepCompressed = keepCompressed;
+}
+
+// Converts the PCM samples of WAV files: 'int24' or 'float32'.
+// Returns true on success, false on failure
+bool SndToWAV::setSampleFormat(const std::string& sampleFormatName)
+{
+    if(sampleFormatName == "int24")
+    {
+        mSampleFormat = WAVFile::SampleFormat::Int24;
+    } else if(sampleFormatName == "float32")
+    {
+        mSampleFormat = WAVFile::SampleFormat::Float32;
+    } else
+    {
+        Log::err << "Error: unknown sample format '" << sampleFormatName <<
+            "'; expected int24 or float32." << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Static
+// Bounds are a number of sample frames, or a number of seconds ending with 's'.
+// Returns true on success, false on failure
+bool SndToWAV::parseRangeBound(const std::string& text, RangeBound& bound)
+{
+    bound = RangeBound();
+    if(text.empty())
+        return true; // Start or end of the sound.
+
+    bound.isSet = true;
+    bound.inSeconds = text.back() == 's';
+
+    std::istringstream stream(bound.inSeconds ? text.substr(0, text.size() - 1) : text);
+    if(bound.inSeconds)
+    {
+        stream >> bound.value;
+    } else
+    {
+        unsigned long long frame = 0;
+        stream >> frame;
+        bound.value = static_cast<double>(frame);
+    }
+
+    // The whole bound must be a non-negative number.
+    return !stream.fail() && stream.peek() == std::char_traits<char>::eof() &&
+        text[0] != '-' && bound.value >= 0;
+}
+
+// Static
+std::size_t SndToWAV::getFrame(const RangeBound& bound, const SndFile& sndFile,
+    std::size_t defaultFrame)
+{
+    if(!bound.isSet)
+        return defaultFrame;
+
+    if(bound.inSeconds)
+        return static_cast<std::size_t>(std::llround(bound.value * sndFile.getSampleRate()));
+
+    return static_cast<std::size_t>(bound.value);
+}
+
+// Only extracts part of each sound. The range is 'START:END', where both
+// bounds are optional, and either a number of sample frames or a number
+// of seconds ending with 's'; for example '1000:', '1.5s:3s'.
+// Returns true on success, false on failure
+bool SndToWAV::setRange(const std::string& range)
+{
+    std::size_t separator = range.find(':');
+    if(separator == std::string::npos ||
+        !parseRangeBound(range.substr(0, separator), mRangeStart) ||
+        !parseRangeBound(range.substr(separator + 1), mRangeEnd))
+    {
+        Log::err << "Error: invalid range '" << range << "'; expected START:END, " <<
+            "in sample frames or in seconds (for example '1.5s:3s')." << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Resamples sounds to sampleRate Hz; 0 keeps their rate.
+// Returns true on success, false on failure
+bool SndToWAV::setOutputSampleRate(unsigned int sampleRate)
+{
+    if(sampleRate > 0xFFFF)
+    {
+        Log::err << "Error: cannot resample to " << sampleRate << " Hz; rates are " <<
+            "at most 65535 Hz." << std::endl;
+        return false;
+    }
+
+    mOutputSampleRate = sampleRate;
+    return true;
+}
+
+// Static
+// Returns true on success, false on failure
+bool SndToWAV::parseDecibels(const std::string& text, double& decibels)
+{
+    std::istringstream stream(text);
+    stream >> decibels;
+
+    // The whole text must be a level, at most full scale.
+    return !text.empty() && !stream.fail() &&
+        stream.peek() == std::char_traits<char>::eof() && decibels <= 0;
+}
+
+// Trims leading and trailing samples below threshold dBFS (for example '-60').
+// Returns true on success, false on failure
+bool SndToWAV::setSilenceThreshold(const std::string& threshold)
+{
+    if(!parseDecibels(threshold, mPostProcessing.silenceThreshold))
+    {
+        Log::err << "Error: invalid silence threshold '" << threshold << "'; expected " <<
+            "a level in dBFS, at most 0 (for example '-60')." << std::endl;
+        return false;
+    }
+
+    mPostProcessing.trimSilence = true;
+    return true;
+}
+
+// Normalizes the peak of sounds to peakLevel dBFS (for example '-1').
+// Returns true on success, false on failure
+bool SndToWAV::setNormalizedPeak(const std::string& peakLevel)
+{
+    if(!parseDecibels(peakLevel, mPostProcessing.peakLevel))
+    {
+        Log::err << "Error: invalid peak level '" << peakLevel << "'; expected " <<
+            "a level in dBFS, at most 0 (for example '-1')." << std::endl;
+        return false;
+    }
+
+    mPostProcessing.normalize = true;
+    return true;
+}
+
+// Averages the channels of sounds to mono.
+void SndToWAV::setDownmix(bool downmix)
+{
+    mPostProcessing.downmix = downmix;
+}
+
+// Builds and saves a seek index of MACE sounds, as 'NAME.seekindex' next to
+// the outputs, when their ranges are extracted.
+void SndToWAV::setBuildSeekIndex(bool buildSeekIndex)
+{
+    mBuildSeekIndex = buildSeekIndex;
+}
+
+// Ranges of MACE sounds start decoding from the nearest checkpoint of a seek
+// index kept as 'NAME.seekindex' next to the outputs, if there is one; they are
+// otherwise decoded from the start of the sound up to the end of the range.
+// Building an index takes a pass over the whole sound, so that is only done
+// when asked for, for the ranges which follow.
+void SndToWAV::useSeekIndex(SndFile& sndFile, const std::string& name) const
+{
+    std::string indexPath = name + ".seekindex";
+    if(!mOutputDirectory.empty())
+        indexPath = mOutputDirectory + '/' + indexPath;
+
+    {
+        std::ifstream indexFile(indexPath, std::ifstream::in | std::ifstream::binary);
+        if(!indexFile.fail() && sndFile.loadSeekIndex(indexFile))
+            return;
+    }
+
+    if(!mBuildSeekIndex || !sndFile.buildSeekIndex())
+        return; // Ranges are then decoded from the start.
+
+    std::ofstream indexFile(indexPath, std::ofstream::out |
+        std::ofstream::binary | std::ofstream::trunc);
+    if(indexFile.fail() || !sndFile.saveSeekIndex(indexFile))
+    {
+        Log::warn << "Warning: could not write seek index '" << indexPath << "'." <<
+            std::endl;
+    }
+}
+
+// Static
+const char* SndToWAV::getExtension(OutputFormat format)
+{
+    switch(format)
+    {
+    case OutputFormat::AIFF:
+        return ".aiff";
+    case OutputFormat::FLAC:
+        return ".flac";
+    case OutputFormat::PCMHash:
+        return ".hash";
+    case OutputFormat::Peaks:
+        return ".peaks";
+    case OutputFormat::Stats:
+        return ".json";
+    case OutputFormat::Fingerprint:
+        return ".fingerprint";
+    default:
+        return ".wav";
+    }
+}
+
+// Describes every option changing the converted files, for the journal.
+std::string SndToWAV::getOptions() const
+{
+    std::ostringstream options;
+    options << "format=";
+    for(OutputFormat format : mOutputFormats)
+        options << getExtension(format);
+
+    options << " keep-compressed=" << mKeepCompressed <<
+        " sample-format=" << static_cast<int>(mSampleFormat) <<
+        " resample=" << mOutputSampleRate;
+
+    options << " range=";
+    if(mRangeStart.isSet)
+        options << mRangeStart.value << (mRangeStart.inSeconds ? "s" : "");
+    options << ':';
+    if(mRangeEnd.isSet)
+        options << mRangeEnd.value << (mRangeEnd.inSeconds ? "s" : "");
+
+    if(mPostProcessing.trimSilence)
+        options << " trim=" << mPostProcessing.silenceThreshold;
+    if(mPostProcessing.normalize)
+        options << " normalize=" << mPostProcessing.peakLevel;
+    if(mPostProcessing.downmix)
+        options << " downmix";
+
+    return options.str();
+}
+
+std::unique_ptr<SoundWriter> SndToWAV::createWriter(OutputFormat format)
+{
+    if(format == OutputFormat::AIFF)
+    {
+        return std::unique_ptr<SoundWriter>(new AIFFFile());
+    } else if(format == OutputFormat::FLAC)
+    {
+        // Threads are only started for the first FLAC sound.
+        if(mEncoderPool == nullptr)
+            mEncoderPool = std::make_shared<WorkerPool>(mNumEncoderThreads);
+
+        FLACFile* flacFile = new FLACFile();
+        flacFile->setWorkerPool(mEncoderPool.get());
+        return std::unique_ptr<SoundWriter>(flacFile);
+    } else if(format == OutputFormat::PCMHash)
+    {
+        return std::unique_ptr<SoundWriter>(new PCMHashWriter());
+    } else if(format == OutputFormat::Peaks)
+    {
+        return std::unique_ptr<SoundWriter>(new PeakFile());
+    } else if(format == OutputFormat::Stats)
+    {
+        return std::unique_ptr<SoundWriter>(new StatsFile());
+    } else if(format == OutputFormat::Fingerprint)
+    {
+        return std::unique_ptr<SoundWriter>(new FingerprintFile());
+    }
+
+    WAVFile* wavFile = new WAVFile();
+    wavFile->setKeepCompressed(mKeepCompressed);
+    wavFile->setSampleFormat(mSampleFormat);
+    return std::unique_ptr<SoundWriter>(wavFile);
+}
+
+// Writes the sound in every output format, to the matching stream, decoding
+// it only once.
+// Returns true on success, false on failure
+bool SndToWAV::writeSound(SndFile& sndFile, const std::vector<std::ostream*>& outputStreams)
+{
+    std::vector<std::unique_ptr<SoundWriter>> writers;
+    std::vector<SoundWriter::Output> outputs;
+
+    for(std::size_t i = 0; i < mOutputFormats.size(); ++i)
+    {
+        writers.push_back(createWriter(mOutputFormats[i]));
+        outputs.push_back(SoundWriter::Output(writers.back().get(), outputStreams[i]));
+    }
+
+    return SoundWriter::convertSnd(sndFile, outputs);
+}
+
+// Converts char* containing an 'snd ' resource to the output format.
+// Returns true on success, false on failure
+bool SndToWAV::convertResourceData(const std::string& resourceFilePath,
+    char* resourceData, std::size_t resourceSize, const std::string& name)
+{
+    std::vector<std::string> outputFileNames;
+    std::string outputNames; // All of them, for messages.
+    for(OutputFormat format : mOutputFormats)
+    {
+        outputFileNames.push_back(name + getExtension(format));
+        if(!mOutputDirectory.empty())
+            outputFileNames.back() = mOutputDirectory + '/' + outputFileNames.back();
+
+        outputNames += (outputNames.empty() ? "" : "', '") + outputFileNames.back();
+    }
+
+    std::string inputHash;
+
+    if(mJournal != nullptr)
+    {
+        inputHash = Journal::hash(resourceData, resourceSize);
+        if(mJournal->isUpToDate(resourceFilePath, name, inputHash, getOptions(),
+            outputFileNames[0]))
+        {
+            Log::info << "Skipped '" + name + "'; '" + outputNames +
+                "' is up to date." << std::endl;
+            return true;
+        }
+    }
+
     // Convert char* to stream.
     std::stringstream stream;
     stream.rdbuf()->pubsetbuf(resourceData, resourceSize);
 
     SndFile sndFile(stream, name);
-	WAVFile wavFile;
-    std::string wavFileName = name + ".wav";
-    bool success = wavFile.convertSnd(sndFile, wavFileName);
-    printResult(success, name, wavFileName);
+
+    if((mRangeStart.isSet || mRangeEnd.isSet) && sndFile.isValid())
+    {
+        if(!sndFile.setRange(getFrame(mRangeStart, sndFile, 0),
+            getFrame(mRangeEnd, sndFile, sndFile.getNumFrames())))
+        {
+            printResult(false, name, mToStandardOutput ? "standard output" : outputNames);
+            return false;
+        }
+
+        if(sndFile.canUseSeekIndex())
+            useSeekIndex(sndFile, name);
+    }
+
+    if(mOutputSampleRate != 0 && sndFile.isValid() &&
+        !sndFile.setOutputSampleRate(mOutputSampleRate))
+    {
+        printResult(false, name, mToStandardOutput ? "standard output" : outputNames);
+        return false;
+    }
+
+    if(mPostProcessing.isEnabled() && sndFile.isValid() && !sndFile.process(mPostProcessing))
+    {
+        printResult(false, name, mToStandardOutput ? "standard output" : outputNames);
+        return false;
+    }
+
+    if(mToStandardOutput)
+    {
+        WAVFile rawFile;
+        rawFile.setSampleFormat(mSampleFormat);
+
+        bool success = mRawPCM ?
+            rawFile.convertSndToRawPCM(sndFile, std::cout) :
+            writeSound(sndFile, {&std::cout});
+
+        std::cout.flush();
+        printResult(success, name, "standard output");
+        return success;
+    }
+
+    if(mArchive != nullptr)
+    {
+        // Entry headers hold the size, so sounds are converted in memory first.
+        std::vector<std::unique_ptr<std::ostringstream>> entries;
+        std::vector<std::ostream*> outputStreams;
+        for(std::size_t i = 0; i < mOutputFormats.size(); ++i)
+        {
+            entries.emplace_back(new std::ostringstream());
+            outputStreams.push_back(entries.back().get());
+        }
+
+        bool success = writeSound(sndFile, outputStreams);
+
+        for(std::size_t i = 0; success && i < entries.size(); ++i)
+        {
+            std::string entry = entries[i]->str();
+            success = mArchive->add(name, name + getExtension(mOutputFormats[i]),
+                entry.data(), entry.size());
+        }
+
+        printResult(success, name, outputNames);
+        return success;
+    }
+
+    std::vector<std::unique_ptr<std::ofstream>> outputFiles;
+    std::vector<std::ostream*> outputStreams;
+    bool success = true;
+
+    for(const std::string& fileName : outputFileNames)
+    {
+        outputFiles.emplace_back(new std::ofstream(fileName, std::ofstream::out |
+            std::ofstream::binary | std::ofstream::trunc));
+        outputStreams.push_back(outputFiles.back().get());
+
+        if(outputFiles.back()->fail())
+        {
+            Log::err << "Error: could not open '" + fileName + "' for writing!" <<
+                std::endl;
+            success = false;
+            break;
+        }
+    }
+
+    if(success)
+        success = writeSound(sndFile, outputStreams);
+
+    // Closed before the journal hashes them.
+    outputFiles.clear();
+
+    printResult(success, name, outputNames);
+
+    // The journal only records the first output.
+    if(success && mJournal != nullptr)
+        success = mJournal->commit(resourceFilePath, name, inputHash, getOptions(),
+            outputFileNames[0]);
 
     return success;
 }
@@ -78,7 +612,8 @@ bool SndToWAV::extract(const std::string& resourceFilePath, unsigned int resourc
         return false;
     }
     
-    return convertResourceData(resourceData.get(), resourceSize, std::to_string(resourceID));
+    return convertResourceData(resourceFilePath, resourceData.get(), resourceSize,
+        std::to_string(resourceID));
 }
 
 // Convert an 'snd ' resource by name.
@@ -97,7 +632,8 @@ bool SndToWAV::extract(const std::string& resourceFilePath, const std::string& r
         return false;
     }
 
-    return convertResourceData(resourceData.get(), resourceSize, resourceName);
+    return convertResourceData(resourceFilePath, resourceData.get(), resourceSize,
+        resourceName);
 }
 
 // Convert all 'snd ' resources in resource file.
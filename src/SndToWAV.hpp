@@ -19,25 +19,96 @@
 #define SND_TO_WAV_HPP
 
 #include "ResExtractor.hpp"
+#include "Journal.hpp"
+#include "TarArchive.hpp"
+#include "WAVFile.hpp"
+#include "PostProcessor.hpp"
 
 #include <string>
 #include <cstddef> // For size_t
 #include <memory>
+#include <ostream>
+#include <vector>
 
+class SndFile;
+class SoundWriter;
+class WorkerPool;
 class SndToWAV
 {
+public:
+    enum class OutputFormat
+    {
+        WAV,
+        AIFF, // AIFF-C for compressed and 8-bit sounds.
+        FLAC,
+        PCMHash, // Hash of the decoded samples.
+        Peaks, // Peak envelopes, for waveforms.
+        Stats, // Levels and loudness, as JSON.
+        Fingerprint // For finding near-duplicate sounds.
+    };
+
 private:
+    // Unset bounds are the start or the end of the sound.
+    struct RangeBound
+    {
+        bool isSet = false;
+        bool inSeconds = false; // Otherwise, in sample frames.
+        double value = 0;
+    };
+
+    static bool parseRangeBound(const std::string& text, RangeBound& bound);
+    static bool parseDecibels(const std::string& text, double& decibels);
+    static std::size_t getFrame(const RangeBound& bound, const SndFile& sndFile,
+        std::size_t defaultFrame);
+
     static void printResult(bool success, const std::string& name,
-        const std::string& wavFileName);
+        const std::string& outputFileName);
 
-    bool convertResourceData(char* resourceData, std::size_t resourceSize,
-        const std::string& name);
+    void useSeekIndex(SndFile& sndFile, const std::string& name) const;
+    static const char* getExtension(OutputFormat format);
+    std::string getOptions() const;
+    std::unique_ptr<SoundWriter> createWriter(OutputFormat format);
+    bool writeSound(SndFile& sndFile, const std::vector<std::ostream*>& outputStreams);
+    bool convertResourceData(const std::string& resourceFilePath,
+        char* resourceData, std::size_t resourceSize, const std::string& name);
 
     std::size_t mResourceFileBlockSize;
+    std::shared_ptr<Journal> mJournal; // Only set in incremental mode.
+    std::unique_ptr<TarArchive> mArchive; // Only set when archiving.
+    std::string mOutputDirectory; // Empty for the working directory.
+    RangeBound mRangeStart;
+    RangeBound mRangeEnd;
+    unsigned int mOutputSampleRate = 0; // In Hz; 0 keeps the rate of sounds.
+    PostProcessor::Options mPostProcessing;
+    bool mToStandardOutput = false;
+    bool mRawPCM = false;
+    bool mKeepCompressed = false;
+    bool mBuildSeekIndex = false;
+    WAVFile::SampleFormat mSampleFormat = WAVFile::SampleFormat::Decoded;
+    std::vector<OutputFormat> mOutputFormats = {OutputFormat::WAV}; // All from one decode.
+    std::size_t mNumEncoderThreads = 0; // One per core.
+    std::shared_ptr<WorkerPool> mEncoderPool; // Created when first needed.
 
 public:
     SndToWAV(std::size_t resourceFileBlockSize);
 
+    bool useJournal(const std::string& journalPath);
+    void useJournal(std::shared_ptr<Journal> journal);
+    void setOutputDirectory(const std::string& outputDirectory);
+    void useStandardOutput(bool rawPCM);
+    bool useArchive(const std::string& archivePath);
+    bool closeArchive();
+    bool setRange(const std::string& range);
+    void setBuildSeekIndex(bool buildSeekIndex);
+    bool setOutputSampleRate(unsigned int sampleRate);
+    bool setSilenceThreshold(const std::string& threshold);
+    bool setNormalizedPeak(const std::string& peakLevel);
+    void setDownmix(bool downmix);
+    void setKeepCompressed(bool keepCompressed);
+    bool setSampleFormat(const std::string& sampleFormatName);
+    bool setOutputFormats(const std::string& formatNames);
+    void setNumEncoderThreads(std::size_t numThreads);
+
     bool extract(const std::string& resourceFilePath, unsigned int resourceID);
     bool extract(const std::string& resourceFilePath, const std::string& resourceName);
     bool extract(const std::string& resourceFilePath);
@@ -0,0 +1,248 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "SndToWAVC.h"
+#include "SndFile.hpp"
+#include "WAVFile.hpp"
+#include "SampleSink.hpp"
+
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <exception>
+#include <limits>
+
+namespace
+{
+    const std::string MEMORY_SND_NAME = "<memory>";
+
+    void fillInfo(const SndFile& sndFile, std::size_t decodedSize, sndtowav_info* info)
+    {
+        if(info == nullptr)
+            return;
+
+        std::uint32_t fixedSampleRate = sndFile.getSoundSampleHeader().sampleRate;
+        unsigned bitsPerSample = sndFile.getDecoder().getBitsPerSample();
+        std::size_t frameSize = sndFile.getNumChannels() * bitsPerSample/8;
+
+        info->sampleRate = fixedSampleRate >> 16;
+        info->fixedSampleRate = fixedSampleRate;
+        info->numChannels = static_cast<unsigned>(sndFile.getNumChannels());
+        info->bitsPerSample = bitsPerSample;
+        info->numFrames = frameSize != 0 ? decodedSize / frameSize : 0;
+    }
+
+    // Ignores NULL and empty indexes.
+    // Returns true on success, false if the index is not for this sound.
+    bool useSeekIndex(SndFile& sndFile, const void* indexData, std::size_t indexSize)
+    {
+        if(indexData == nullptr || indexSize == 0)
+            return true;
+
+        std::istringstream indexStream(std::string(static_cast<const char*>(indexData),
+            indexSize));
+        return sndFile.loadSeekIndex(indexStream);
+    }
+
+    // Output stream writing to a fixed-size, caller-owned buffer.
+    class MemoryStreamBuffer : public std::streambuf
+    {
+    public:
+        MemoryStreamBuffer(void* buffer, std::size_t capacity)
+        {
+            char* begin = static_cast<char*>(buffer);
+            setp(begin, begin + capacity);
+        }
+
+        std::size_t getSize() const
+        {
+            return pptr() - pbase();
+        }
+    };
+}
+
+sndtowav_status sndtowav_convert_to_wav(
+    const void* sndData, size_t sndSize,
+    void* wavData, size_t wavCapacity, size_t* wavSize,
+    sndtowav_info* info)
+{
+    return sndtowav_convert_range_to_wav(sndData, sndSize,
+        0, std::numeric_limits<size_t>::max(), wavData, wavCapacity, wavSize, info);
+}
+
+sndtowav_status sndtowav_decode_to_pcm(
+    const void* sndData, size_t sndSize,
+    void* pcmData, size_t pcmCapacity, size_t* pcmSize,
+    sndtowav_info* info)
+{
+    return sndtowav_decode_range_to_pcm(sndData, sndSize,
+        0, std::numeric_limits<size_t>::max(), pcmData, pcmCapacity, pcmSize, info);
+}
+
+sndtowav_status sndtowav_convert_range_to_wav(
+    const void* sndData, size_t sndSize,
+    size_t firstFrame, size_t endFrame,
+    void* wavData, size_t wavCapacity, size_t* wavSize,
+    sndtowav_info* info)
+{
+    return sndtowav_convert_range_to_wav_indexed(sndData, sndSize, nullptr, 0,
+        firstFrame, endFrame, wavData, wavCapacity, wavSize, info);
+}
+
+sndtowav_status sndtowav_decode_range_to_pcm(
+    const void* sndData, size_t sndSize,
+    size_t firstFrame, size_t endFrame,
+    void* pcmData, size_t pcmCapacity, size_t* pcmSize,
+    sndtowav_info* info)
+{
+    return sndtowav_decode_range_to_pcm_indexed(sndData, sndSize, nullptr, 0,
+        firstFrame, endFrame, pcmData, pcmCapacity, pcmSize, info);
+}
+
+sndtowav_status sndtowav_build_seek_index(
+    const void* sndData, size_t sndSize,
+    void* indexData, size_t indexCapacity, size_t* indexSize)
+{
+    if(sndData == nullptr || indexSize == nullptr)
+        return SNDTOWAV_INVALID_ARGUMENT;
+
+    try
+    {
+        std::istringstream sndStream(std::string(static_cast<const char*>(sndData), sndSize));
+        SndFile sndFile(sndStream, MEMORY_SND_NAME);
+        if(!sndFile.isValid())
+            return SNDTOWAV_INVALID_SND;
+
+        // The size is known before decoding anything.
+        *indexSize = sndFile.getSeekIndexSize();
+        if(*indexSize == 0)
+            return SNDTOWAV_OK;
+        if(indexData == nullptr || indexCapacity < *indexSize)
+            return SNDTOWAV_BUFFER_TOO_SMALL;
+
+        MemoryStreamBuffer indexBuffer(indexData, indexCapacity);
+        std::ostream indexStream(&indexBuffer);
+        bool success = sndFile.buildSeekIndex() && sndFile.saveSeekIndex(indexStream);
+
+        *indexSize = indexBuffer.getSize();
+        return success ? SNDTOWAV_OK : SNDTOWAV_INVALID_SND;
+    } catch(const std::exception&)
+    {
+        return SNDTOWAV_INTERNAL_ERROR;
+    }
+}
+
+sndtowav_status sndtowav_convert_range_to_wav_indexed(
+    const void* sndData, size_t sndSize,
+    const void* indexData, size_t indexSize,
+    size_t firstFrame, size_t endFrame,
+    void* wavData, size_t wavCapacity, size_t* wavSize,
+    sndtowav_info* info)
+{
+    if(sndData == nullptr || wavSize == nullptr)
+        return SNDTOWAV_INVALID_ARGUMENT;
+
+    // No exceptions may cross the C boundary.
+    try
+    {
+        std::istringstream sndStream(std::string(static_cast<const char*>(sndData), sndSize));
+        SndFile sndFile(sndStream, MEMORY_SND_NAME);
+        WAVFile wavFile;
+        if(!sndFile.isValid())
+            return SNDTOWAV_INVALID_SND;
+
+        if(!sndFile.setRange(firstFrame, endFrame) ||
+            !useSeekIndex(sndFile, indexData, indexSize))
+            return SNDTOWAV_INVALID_ARGUMENT;
+
+        if(!wavFile.populateHeader(sndFile))
+            return SNDTOWAV_INVALID_SND;
+
+        // The size is known before decoding anything.
+        fillInfo(sndFile, wavFile.getHeader().subchunk2Size, info);
+        *wavSize = wavFile.getHeader().chunkSize + 8;
+        if(wavData == nullptr || wavCapacity < *wavSize)
+            return SNDTOWAV_BUFFER_TOO_SMALL;
+
+        MemoryStreamBuffer wavBuffer(wavData, wavCapacity);
+        std::ostream wavStream(&wavBuffer);
+        bool success = wavFile.convertSnd(sndFile, wavStream);
+
+        *wavSize = wavBuffer.getSize();
+        return success ? SNDTOWAV_OK : SNDTOWAV_INVALID_SND;
+    } catch(const std::exception&)
+    {
+        return SNDTOWAV_INTERNAL_ERROR;
+    }
+}
+
+sndtowav_status sndtowav_decode_range_to_pcm_indexed(
+    const void* sndData, size_t sndSize,
+    const void* indexData, size_t indexSize,
+    size_t firstFrame, size_t endFrame,
+    void* pcmData, size_t pcmCapacity, size_t* pcmSize,
+    sndtowav_info* info)
+{
+    if(sndData == nullptr || pcmSize == nullptr)
+        return SNDTOWAV_INVALID_ARGUMENT;
+
+    try
+    {
+        std::istringstream sndStream(std::string(static_cast<const char*>(sndData), sndSize));
+        SndFile sndFile(sndStream, MEMORY_SND_NAME);
+        if(!sndFile.isValid())
+            return SNDTOWAV_INVALID_SND;
+
+        if(!sndFile.setRange(firstFrame, endFrame) ||
+            !useSeekIndex(sndFile, indexData, indexSize))
+            return SNDTOWAV_INVALID_ARGUMENT;
+
+        fillInfo(sndFile, sndFile.getDecodedSize(), info);
+        *pcmSize = sndFile.getDecodedSize();
+        if(pcmData == nullptr || pcmCapacity < *pcmSize)
+            return SNDTOWAV_BUFFER_TOO_SMALL;
+
+        // Decode straight into the caller's buffer.
+        MemorySampleSink sink(pcmData, pcmCapacity);
+        bool success = sndFile.decode(&sink);
+
+        *pcmSize = sink.getSize();
+        return success ? SNDTOWAV_OK : SNDTOWAV_INVALID_SND;
+    } catch(const std::exception&)
+    {
+        return SNDTOWAV_INTERNAL_ERROR;
+    }
+}
+
+const char* sndtowav_status_string(sndtowav_status status)
+{
+    switch(status)
+    {
+    case SNDTOWAV_OK:
+        return "success";
+    case SNDTOWAV_INVALID_ARGUMENT:
+        return "invalid argument";
+    case SNDTOWAV_INVALID_SND:
+        return "invalid or unsupported 'snd ' data";
+    case SNDTOWAV_BUFFER_TOO_SMALL:
+        return "output buffer too small";
+    case SNDTOWAV_INTERNAL_ERROR:
+        return "internal error";
+    }
+
+    return "unknown status";
+}
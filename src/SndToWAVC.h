@@ -0,0 +1,124 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+// C interface to the SndToWAV library.
+// Converts raw 'snd ' resource data in memory, without touching the disk.
+//
+// Output buffers are owned by the caller. To find the required size, call
+// with a NULL (or too small) buffer: SNDTOWAV_BUFFER_TOO_SMALL is returned,
+// and *outputSize is set to the number of bytes needed.
+
+#ifndef SND_TO_WAV_C_H
+#define SND_TO_WAV_C_H
+
+#include <stddef.h> /* For size_t */
+
+#if defined(_WIN32) && defined(SNDTOWAV_SHARED)
+#   ifdef SNDTOWAV_EXPORTS
+#       define SNDTOWAV_API __declspec(dllexport)
+#   else
+#       define SNDTOWAV_API __declspec(dllimport)
+#   endif
+#else
+#   define SNDTOWAV_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum sndtowav_status
+{
+    SNDTOWAV_OK = 0,
+    SNDTOWAV_INVALID_ARGUMENT = 1,
+    SNDTOWAV_INVALID_SND = 2,       /* Could not parse or decode 'snd ' data. */
+    SNDTOWAV_BUFFER_TOO_SMALL = 3,  /* *outputSize holds the required size. */
+    SNDTOWAV_INTERNAL_ERROR = 4
+} sndtowav_status;
+
+typedef struct sndtowav_info
+{
+    unsigned sampleRate;        /* Integer part of the sample rate, in Hz. */
+    unsigned fixedSampleRate;   /* Unsigned 16.16 fixed-point sample rate, as stored. */
+    unsigned numChannels;
+    unsigned bitsPerSample;     /* 8-bit samples are unsigned, 16-bit are signed. */
+    size_t numFrames;           /* Number of decoded sample frames (of the range). */
+} sndtowav_info;
+
+/* Converts an 'snd ' resource to a complete WAV file.
+ * info may be NULL. */
+SNDTOWAV_API sndtowav_status sndtowav_convert_to_wav(
+    const void* sndData, size_t sndSize,
+    void* wavData, size_t wavCapacity, size_t* wavSize,
+    sndtowav_info* info);
+
+/* Decodes an 'snd ' resource to interleaved little-endian PCM.
+ * info may be NULL. */
+SNDTOWAV_API sndtowav_status sndtowav_decode_to_pcm(
+    const void* sndData, size_t sndSize,
+    void* pcmData, size_t pcmCapacity, size_t* pcmSize,
+    sndtowav_info* info);
+
+/* Same as above, but only converts sample frames [firstFrame, endFrame).
+ * endFrame is clamped to the end of the sound; pass (size_t)-1 for the rest
+ * of the sound. Only the packets covering the range are decoded. */
+SNDTOWAV_API sndtowav_status sndtowav_convert_range_to_wav(
+    const void* sndData, size_t sndSize,
+    size_t firstFrame, size_t endFrame,
+    void* wavData, size_t wavCapacity, size_t* wavSize,
+    sndtowav_info* info);
+
+SNDTOWAV_API sndtowav_status sndtowav_decode_range_to_pcm(
+    const void* sndData, size_t sndSize,
+    size_t firstFrame, size_t endFrame,
+    void* pcmData, size_t pcmCapacity, size_t* pcmSize,
+    sndtowav_info* info);
+
+/* MACE sounds carry decoder state from their very beginning, so the range
+ * functions above decode them from it. A seek index holds checkpoints of that
+ * state: build it once per sound (this decodes the whole sound), store it
+ * with the sound, and pass it to the functions below, which then start
+ * decoding from the nearest checkpoint. Sounds of other codecs need no index;
+ * theirs is empty (*indexSize is 0). */
+SNDTOWAV_API sndtowav_status sndtowav_build_seek_index(
+    const void* sndData, size_t sndSize,
+    void* indexData, size_t indexCapacity, size_t* indexSize);
+
+/* Same as the range functions above, with a seek index built for the same
+ * sound; NULL or empty indexes are ignored. An index built for another sound
+ * gives SNDTOWAV_INVALID_ARGUMENT. */
+SNDTOWAV_API sndtowav_status sndtowav_convert_range_to_wav_indexed(
+    const void* sndData, size_t sndSize,
+    const void* indexData, size_t indexSize,
+    size_t firstFrame, size_t endFrame,
+    void* wavData, size_t wavCapacity, size_t* wavSize,
+    sndtowav_info* info);
+
+SNDTOWAV_API sndtowav_status sndtowav_decode_range_to_pcm_indexed(
+    const void* sndData, size_t sndSize,
+    const void* indexData, size_t indexSize,
+    size_t firstFrame, size_t endFrame,
+    void* pcmData, size_t pcmCapacity, size_t* pcmSize,
+    sndtowav_info* info);
+
+SNDTOWAV_API const char* sndtowav_status_string(sndtowav_status status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SND_TO_WAV_C_H */
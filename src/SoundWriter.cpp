@@ -0,0 +1,74 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "SoundWriter.hpp"
+#include "Log.hpp"
+#include "SndFile.hpp"
+
+#include <fstream>
+
+// Returns true on success, false on failure.
+bool SoundWriter::convertSnd(SndFile& sndFile, std::ostream& outputStream)
+{
+    return convertSnd(sndFile, {Output(this, &outputStream)});
+}
+
+// Returns true on success, false on failure.
+bool SoundWriter::convertSnd(SndFile& sndFile, const std::string& fileName)
+{
+    std::ofstream outputFile(fileName, std::ofstream::out |
+            std::ofstream::binary | std::ofstream::trunc);
+
+    if(outputFile.fail())
+    {
+        Log::err << "Error: could not open '" + fileName + "' for writing!" <<
+            std::endl;
+        return false;
+    }
+
+    return convertSnd(sndFile, outputFile);
+}
+
+// Static
+// Writes the sound with every writer, decoding it at most once.
+// Returns true on success, false on failure.
+bool SoundWriter::convertSnd(SndFile& sndFile, const std::vector<Output>& outputs)
+{
+    FanOutSampleSink sink;
+    bool needsSamples = false;
+
+    for(const Output& output : outputs)
+    {
+        if(!output.first->begin(sndFile, *output.second))
+            return false;
+
+        if(output.first->getSampleSink() != nullptr)
+        {
+            sink.addSink(*output.first->getSampleSink());
+            needsSamples = true;
+        }
+    }
+
+    if(needsSamples && !sndFile.decode(&sink))
+        return false;
+
+    bool success = true;
+    for(const Output& output : outputs)
+        success &= output.first->finish() && !output.second->fail();
+
+    return success;
+}
@@ -0,0 +1,59 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SOUND_WRITER_HPP
+#define SOUND_WRITER_HPP
+
+#include "SampleSink.hpp"
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <utility> // For std::pair
+
+class SndFile;
+
+// Writes a sound to an output stream in some format. Writers only receive
+// decoded samples through their sample sink, so several of them can share a
+// single decoding pass.
+class SoundWriter
+{
+public:
+    // A writer, and the stream it writes to.
+    using Output = std::pair<SoundWriter*, std::ostream*>;
+
+    virtual ~SoundWriter() = default;
+
+    // Writes what comes before the samples, such as headers. Writers which
+    // do not need decoded samples write the whole sound here.
+    // Returns true on success, false on failure.
+    virtual bool begin(SndFile& sndFile, std::ostream& outputStream) = 0;
+
+    // Receives decoded samples between begin() and finish(), or nullptr if
+    // begin() already wrote them.
+    virtual SampleSink* getSampleSink() = 0;
+
+    // Returns true on success, false on failure.
+    virtual bool finish() = 0;
+
+    bool convertSnd(SndFile& sndFile, std::ostream& outputStream);
+    bool convertSnd(SndFile& sndFile, const std::string& fileName);
+
+    static bool convertSnd(SndFile& sndFile, const std::vector<Output>& outputs);
+};
+
+#endif // SOUND_WRITER_HPP
@@ -0,0 +1,97 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "StatsFile.hpp"
+#include "Log.hpp"
+#include "SndFile.hpp"
+
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm> // For std::max
+
+// Static
+// Rounded to 0.01 dB; null if not finite.
+void StatsFile::writeLevel(std::ostream& stream, double level)
+{
+    if(std::isfinite(level))
+        stream << std::fixed << std::setprecision(2) << level;
+    else
+        stream << "null";
+}
+
+// Returns true on success, false on failure.
+bool StatsFile::begin(SndFile& sndFile, std::ostream& outputStream)
+{
+    if(!sndFile.isValid())
+    {
+        Log::err << "Error: cannot convert invalid snd file!" << std::endl;
+        return false;
+    }
+
+    unsigned bitsPerSample = sndFile.getDecoder().getBitsPerSample();
+    if(!SampleAnalyzer::isSupported(bitsPerSample))
+    {
+        Log::err << "Error: cannot analyze " << bitsPerSample << "-bit samples." <<
+            std::endl;
+        return false;
+    }
+
+    mOutputStream = &outputStream;
+    mAnalyzer.reset(new SampleAnalyzer(sndFile.getDecodedNumChannels(), bitsPerSample,
+        sndFile.getDecodedSampleRate() / 65536.0));
+    return true;
+}
+
+SampleSink* StatsFile::getSampleSink()
+{
+    return mAnalyzer.get();
+}
+
+// Returns true on success, false on failure.
+bool StatsFile::finish()
+{
+    mAnalyzer->finish();
+
+    float peak = 0;
+    for(std::size_t channel = 0; channel < mAnalyzer->getNumChannels(); ++channel)
+        peak = std::max(peak, mAnalyzer->getPeak(channel));
+
+    std::ostringstream json;
+    json << "{\"frames\":" << mAnalyzer->getNumFrames() <<
+        ",\"sampleRate\":" << std::fixed << std::setprecision(3) << mAnalyzer->getSampleRate() <<
+        ",\"peakDBFS\":";
+    writeLevel(json, 20.0*std::log10(peak));
+    json << ",\"rmsDBFS\":";
+    writeLevel(json, 20.0*std::log10(mAnalyzer->getRMS()));
+    json << ",\"integratedLUFS\":";
+    writeLevel(json, mAnalyzer->getIntegratedLoudness());
+    json << ",\"channels\":[";
+
+    for(std::size_t channel = 0; channel < mAnalyzer->getNumChannels(); ++channel)
+    {
+        json << (channel == 0 ? "" : ",") << "{\"peakDBFS\":";
+        writeLevel(json, 20.0*std::log10(mAnalyzer->getPeak(channel)));
+        json << ",\"rmsDBFS\":";
+        writeLevel(json, 20.0*std::log10(mAnalyzer->getRMS(channel)));
+        json << "}";
+    }
+
+    json << "]}\n";
+    *mOutputStream << json.str();
+    return !mOutputStream->fail();
+}
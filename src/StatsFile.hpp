@@ -0,0 +1,47 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef STATS_FILE_HPP
+#define STATS_FILE_HPP
+
+#include "SoundWriter.hpp"
+#include "SampleAnalyzer.hpp"
+
+#include <ostream>
+#include <memory>
+
+// Writes levels of a sound as a JSON record:
+//     {"frames":22050,"sampleRate":22254.545,"peakDBFS":-0.5,"rmsDBFS":-12.1,
+//      "integratedLUFS":-14.2,"channels":[{"peakDBFS":-0.5,"rmsDBFS":-12.1}]}
+// Levels are relative to full scale; RMS levels are not offset by 3 dB, so a
+// full-scale sine wave is at -3.01 dBFS. Unknown or infinitely low levels are
+// null; loudness needs at least 400 ms of sound.
+class StatsFile : public SoundWriter
+{
+private:
+    static void writeLevel(std::ostream& stream, double level);
+
+    std::ostream* mOutputStream = nullptr;
+    std::unique_ptr<SampleAnalyzer> mAnalyzer;
+
+public:
+    bool begin(SndFile& sndFile, std::ostream& outputStream) override;
+    SampleSink* getSampleSink() override;
+    bool finish() override;
+};
+
+#endif // STATS_FILE_HPP
@@ -0,0 +1,221 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "TarArchive.hpp"
+#include "Log.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstring> // For std::memcpy
+#include <algorithm> // For std::min
+#include <ctime>
+
+// Tar headers and data are padded to 512-byte blocks.
+const std::size_t TarArchive::cBlockSize = 512U;
+
+TarArchive::TarArchive(const std::string& archivePath)
+    : mArchivePath(archivePath)
+{
+    if(mArchivePath == "-")
+    {
+        mStream = &std::cout;
+        return;
+    }
+
+    mArchiveFile.open(mArchivePath, std::ofstream::out |
+        std::ofstream::binary | std::ofstream::trunc);
+
+    if(mArchiveFile.fail())
+    {
+        Log::err << "Error: could not open archive '" << mArchivePath <<
+            "' for writing!" << std::endl;
+        return;
+    }
+
+    mStream = &mArchiveFile;
+}
+
+bool TarArchive::isOpen() const
+{
+    return mStream != nullptr;
+}
+
+// Static
+// Zero-padded, NUL-terminated octal, as tar expects.
+void TarArchive::writeOctal(char* field, std::size_t fieldSize, std::uint64_t value)
+{
+    std::ostringstream stream;
+    stream << std::oct << std::setw(fieldSize - 1) << std::setfill('0') << value;
+    std::memcpy(field, stream.str().c_str(), fieldSize);
+}
+
+// Static
+std::string TarArchive::escapeJSON(const std::string& text)
+{
+    std::ostringstream escaped;
+
+    for(char c : text)
+    {
+        if(c == '"' || c == '\\')
+        {
+            escaped << '\\' << c;
+        } else if(static_cast<unsigned char>(c) < 0x20)
+        {
+            escaped << "\\u" << std::hex << std::setw(4) << std::setfill('0') <<
+                static_cast<int>(c) << std::dec;
+        } else
+        {
+            escaped << c;
+        }
+    }
+
+    return escaped.str();
+}
+
+// Writes a ustar header; names which do not fit in it are preceded by a pax
+// extended header holding the full path.
+// Returns true on success, false on failure
+bool TarArchive::writeHeader(const std::string& fileName, std::uint64_t size, char type)
+{
+    const std::size_t cNameSize = 100U;
+
+    if(fileName.size() > cNameSize)
+    {
+        // The record length counts its own digits.
+        std::string record = " path=" + fileName + "\n";
+        std::size_t length = record.size() + 1;
+        while(std::to_string(length).size() + record.size() != length)
+            ++length;
+        record = std::to_string(length) + record;
+
+        std::string paxName = "PaxHeader/" + fileName.substr(0, cNameSize - 10);
+        if(!writeHeader(paxName, record.size(), 'x') ||
+            !writeData(record.data(), record.size()))
+            return false;
+    }
+
+    // Too big for the 11 octal digits of the size field.
+    if(size >= (std::uint64_t(1) << 33))
+    {
+        Log::err << "Error: '" << fileName << "' is too big for a tar archive!" <<
+            std::endl;
+        return false;
+    }
+
+    char header[cBlockSize] = {0};
+    std::memcpy(header, fileName.data(), std::min(fileName.size(), cNameSize));
+    writeOctal(header + 100, 8, 0644); // Mode
+    writeOctal(header + 108, 8, 0); // Owner ID
+    writeOctal(header + 116, 8, 0); // Group ID
+    writeOctal(header + 124, 12, size);
+    writeOctal(header + 136, 12, static_cast<std::uint64_t>(std::time(nullptr)));
+    header[156] = type;
+    std::memcpy(header + 257, "ustar\0" "00", 8);
+
+    // The checksum is computed with its own field filled with spaces.
+    std::memset(header + 148, ' ', 8);
+    unsigned checksum = 0;
+    for(char c : header)
+        checksum += static_cast<unsigned char>(c);
+    writeOctal(header + 148, 7, checksum);
+
+    mStream->write(header, cBlockSize);
+    mOffset += cBlockSize;
+    return !mStream->fail();
+}
+
+// Writes data, padded to a whole block.
+// Returns true on success, false on failure
+bool TarArchive::writeData(const char* data, std::size_t size)
+{
+    const char padding[cBlockSize] = {0};
+    std::size_t paddingSize = (cBlockSize - size % cBlockSize) % cBlockSize;
+
+    mStream->write(data, size);
+    mStream->write(padding, paddingSize);
+    mOffset += size + paddingSize;
+    return !mStream->fail();
+}
+
+// Returns true on success, false on failure
+bool TarArchive::addFile(const std::string& fileName, const char* data, std::size_t size)
+{
+    if(!writeHeader(fileName, size, '0'))
+        return false;
+
+    return writeData(data, size);
+}
+
+// Adds the converted file of a resource.
+// Returns true on success, false on failure
+bool TarArchive::add(const std::string& resourceName, const std::string& fileName,
+    const char* data, std::size_t size)
+{
+    if(!writeHeader(fileName, size, '0'))
+        return false;
+
+    mEntries.push_back({resourceName, fileName, mOffset, size});
+    if(!writeData(data, size))
+    {
+        Log::err << "Error: could not write '" << fileName << "' to archive '" <<
+            mArchivePath << "'!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Writes the manifest and the end-of-archive marker.
+// Returns true on success, false on failure
+bool TarArchive::close()
+{
+    if(mClosed)
+        return true;
+    mClosed = true;
+
+    std::ostringstream json;
+    json << "{\"entries\":[";
+
+    for(std::size_t i = 0; i < mEntries.size(); ++i)
+    {
+        const Entry& entry = mEntries[i];
+        json << (i == 0 ? "" : ",") <<
+            "{\"resource\":\"" << escapeJSON(entry.resourceName) << "\"," <<
+            "\"file\":\"" << escapeJSON(entry.fileName) << "\"," <<
+            "\"offset\":" << entry.offset << "," <<
+            "\"size\":" << entry.size << "}";
+    }
+
+    json << "]}\n";
+    std::string manifest = json.str();
+
+    // Two zero blocks end the archive.
+    const char end[2*cBlockSize] = {0};
+    bool success = addFile("manifest.json", manifest.data(), manifest.size());
+    mStream->write(end, sizeof(end));
+    mStream->flush();
+
+    if(!success || mStream->fail())
+    {
+        Log::err << "Error: could not finish archive '" << mArchivePath << "'!" <<
+            std::endl;
+        return false;
+    }
+
+    return true;
+}
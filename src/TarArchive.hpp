@@ -0,0 +1,72 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TAR_ARCHIVE_HPP
+#define TAR_ARCHIVE_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <ostream>
+#include <cstdint>
+#include <cstddef> // For std::size_t
+
+// Writes files as entries of an uncompressed POSIX tar archive, streamed
+// sequentially to a single file or to stdout. Closing the archive adds a
+// 'manifest.json' entry, mapping each resource to the offset and size of its
+// file's data in the archive:
+//     {"entries":[{"resource":"128","file":"128.wav","offset":512,"size":1234},...]}
+class TarArchive
+{
+private:
+    struct Entry
+    {
+        std::string resourceName;
+        std::string fileName;
+        std::uint64_t offset; // Of the data, in bytes from the start of the archive.
+        std::uint64_t size;
+    };
+
+    static const std::size_t cBlockSize;
+
+    static void writeOctal(char* field, std::size_t fieldSize, std::uint64_t value);
+
+    bool writeHeader(const std::string& fileName, std::uint64_t size, char type);
+    bool writeData(const char* data, std::size_t size);
+    bool addFile(const std::string& fileName, const char* data, std::size_t size);
+
+    std::ofstream mArchiveFile;
+    std::ostream* mStream = nullptr; // nullptr if the archive could not be opened.
+    std::string mArchivePath;
+    std::uint64_t mOffset = 0;
+    std::vector<Entry> mEntries;
+    bool mClosed = false;
+
+public:
+    // An archivePath of '-' streams the archive to stdout.
+    TarArchive(const std::string& archivePath);
+
+    bool isOpen() const;
+
+    bool add(const std::string& resourceName, const std::string& fileName,
+        const char* data, std::size_t size);
+    bool close();
+
+    static std::string escapeJSON(const std::string& text);
+};
+
+#endif // TAR_ARCHIVE_HPP
@@ -18,13 +18,22 @@
 #include "WAVFile.hpp"
 #include "Log.hpp"
 #include "SndFile.hpp"
+#include "SampleSink.hpp"
 #include "IMA4Decoder.hpp"
 #include "MACEDecoder.hpp"
 #include "XLawDecoder.hpp"
+#include "IMAADPCMEncoder.hpp"
+#include "SampleConverter.hpp"
 
 #include <iomanip>
 #include <cstddef> // For std::size_t
-#include <fstream>
+
+const std::uint16_t WAVHeader::cPCMFormat = 0x0001;
+const std::uint16_t WAVHeader::cIEEEFloatFormat = 0x0003;
+const std::uint16_t WAVHeader::cIMAADPCMFormat = 0x0011;
+const std::uint16_t WAVHeader::cALawFormat = 0x0006;
+const std::uint16_t WAVHeader::cULawFormat = 0x0007;
+const std::uint16_t WAVHeader::cIMAADPCMSamplesPerBlock = 505; // 256-byte mono blocks
 
 std::ostream& operator<<(std::ostream& lhs, const WAVHeader& rhs)
 {
@@ -46,8 +55,20 @@ std::ostream& operator<<(std::ostream& lhs, const WAVHeader& rhs)
         " -- Sample rate: " << rhs.sampleRate << std::endl <<
         " -- Byte rate: " << rhs.byteRate << std::endl <<
         " -- Block align: " << rhs.blockAlign << std::endl <<
-        " -- Bits per sample: " << rhs.bitsPerSample << std::endl <<
+        " -- Bits per sample: " << rhs.bitsPerSample << std::endl;
 
+    if(rhs.audioFormat != WAVHeader::cPCMFormat)
+    {
+        lhs <<
+            " -- Extra format size: " << rhs.extraFormatSize << std::endl <<
+            " -- Samples per block: " << rhs.samplesPerBlock << std::endl <<
+            " -- Fact ID: " << std::string(reinterpret_cast<const char*>(rhs.factID), 4) <<
+                std::endl <<
+            " -- Fact size: " << rhs.factSize << std::endl <<
+            " -- Number of samples: " << rhs.numSamples << std::endl;
+    }
+
+    lhs <<
         " -- Subchunk 2 ID: " << std::string(reinterpret_cast<const char*>(rhs.subchunk2ID), 4) <<
             std::endl <<
         " -- Subchunk 2 size: " << rhs.subchunk2Size;
@@ -61,67 +82,129 @@ WAVFile::WAVFile()
 {
 }
 
-WAVFile::WAVFile(const SndFile& sndFile, const std::string& WAVFileName)
+WAVFile::WAVFile(SndFile& sndFile, const std::string& WAVFileName)
 {
     convertSnd(sndFile, WAVFileName);
 }
 
-// Returns true on success, false on failure.
-bool WAVFile::populateHeader(const SndFile& sndFile)
+WAVFile::~WAVFile()
 {
-    // Could definitely do this cleaner.
-    const SoundSampleHeader& sndHeader = sndFile.getSoundSampleHeader();
-    const ExtendedSoundSampleHeader* extSndHeader = nullptr;
-    const CompressedSoundSampleHeader* cmpSndHeader = nullptr;
+}
 
-    if(sndHeader.encode == SndFile::cExtendedSoundHeaderEncode)
-    {
-        extSndHeader = static_cast<const ExtendedSoundSampleHeader*>(&sndHeader);
-    } else if(sndHeader.encode == SndFile::cCompressedSoundHeaderEncode)
-    {
-        cmpSndHeader = static_cast<const CompressedSoundSampleHeader*>(&sndHeader);
-    }
+void WAVFile::setKeepCompressed(bool keepCompressed)
+{
+    mKeepCompressed = keepCompressed;
+}
 
-    std::size_t numPackets = 0;
-    if(sndHeader.encode == SndFile::cStandardSoundHeaderEncode)
-    {
-        numPackets = sndHeader.lengthOrChannels;
-    } else if(sndHeader.encode == SndFile::cExtendedSoundHeaderEncode)
-    {
-        numPackets = extSndHeader->numFrames * sndHeader.lengthOrChannels;
-    } else if(sndHeader.encode == SndFile::cCompressedSoundHeaderEncode)
+void WAVFile::setSampleFormat(SampleFormat sampleFormat)
+{
+    mSampleFormat = sampleFormat;
+}
+
+SampleConverter::Format WAVFile::getConverterFormat() const
+{
+    return mSampleFormat == SampleFormat::Int24 ?
+        SampleConverter::Format::Int24 : SampleConverter::Format::Float32;
+}
+
+const WAVHeader& WAVFile::getHeader() const
+{
+    return mHeader;
+}
+
+// Returns true on success, false on failure.
+bool WAVFile::populateHeader(const SndFile& sndFile)
+{
+    if(!sndFile.isValid())
     {
-        numPackets = cmpSndHeader->numFrames * sndHeader.lengthOrChannels;
+        Log::err << "Error: cannot convert invalid snd file!" << std::endl;
+        return false;
     }
 
-    mHeader.chunkSize = 36 + sndFile.getDecoder().getDecodedSize(numPackets);
+    const Decoder& decoder = sndFile.getDecoder();
+    mHeader = WAVHeader(); // In case it was populated for another sound.
 
     // "fmt " //
     mHeader.subchunk1Size = 16;
-    mHeader.audioFormat = 1; // For PCM
+    mHeader.audioFormat = WAVHeader::cPCMFormat;
+    mHeader.numChannels = sndFile.getDecodedNumChannels();
 
-    if(sndHeader.encode == SndFile::cStandardSoundHeaderEncode)
-    {
-        // Basic sounds only support mono.
-        mHeader.numChannels = 1;
-    } else if(sndHeader.encode == SndFile::cExtendedSoundHeaderEncode ||
-        sndHeader.encode == SndFile::cCompressedSoundHeaderEncode )
+    // Snd sample rate is an unsigned 32-bit fixed-point.
+    // We only keep the integer part, unless samples are resampled to a
+    // whole rate!
+    mHeader.sampleRate = sndFile.getDecodedSampleRate() >> 16;
+
+    unsigned bitsPerSample = decoder.getBitsPerSample();
+    std::size_t decodedFrameSize = mHeader.numChannels * bitsPerSample/8;
+    std::size_t numFrames = decodedFrameSize != 0 ?
+        sndFile.getDecodedSize() / decodedFrameSize : 0;
+
+    if(mSampleFormat != SampleFormat::Decoded)
     {
-        mHeader.numChannels = sndHeader.lengthOrChannels;
-    }
+        if(!SampleConverter::isSupported(bitsPerSample))
+        {
+            Log::err << "Error: cannot convert " << bitsPerSample << "-bit samples; " <<
+                "only 8, 16, 24 and 32-bit samples can be converted." << std::endl;
+            return false;
+        }
 
-    // Snd sample rate is an unsigned 32-bit fixed-point.
-    // We only keep the integer part!
-    mHeader.sampleRate = sndHeader.sampleRate >> 16;
+        if(mSampleFormat == SampleFormat::Float32)
+            mHeader.audioFormat = WAVHeader::cIEEEFloatFormat;
 
-    unsigned bitsPerSample = sndFile.getDecoder().getBitsPerSample();
+        bitsPerSample = SampleConverter::getBitsPerSample(getConverterFormat());
+    }
 
     mHeader.byteRate = mHeader.sampleRate * mHeader.numChannels * bitsPerSample/8;
     mHeader.blockAlign = mHeader.numChannels * bitsPerSample/8;
     mHeader.bitsPerSample = bitsPerSample;
 
     // "data" //
-    mHeader.subchunk2Size = sndFile.getDecoder().getDecodedSize(numPackets);
+    mHeader.subchunk2Size = sndFile.getDecodedSize();
+    if(mSampleFormat != SampleFormat::Decoded)
+        mHeader.subchunk2Size = numFrames * mHeader.blockAlign;
+
+    if(mKeepCompressed && mSampleFormat == SampleFormat::Decoded)
+    {
+        if(dynamic_cast<const XLawDecoder*>(&decoder) != nullptr && sndFile.canWriteEncoded())
+        {
+            // One byte per sample, stored as-is.
+            mHeader.audioFormat = dynamic_cast<const ALawDecoder*>(&decoder) != nullptr ?
+                WAVHeader::cALawFormat : WAVHeader::cULawFormat;
+            mHeader.bitsPerSample = 8;
+            mHeader.blockAlign = mHeader.numChannels;
+            mHeader.byteRate = mHeader.sampleRate * mHeader.blockAlign;
+            mHeader.subchunk2Size = numFrames * mHeader.blockAlign;
+        } else if(dynamic_cast<const IMA4Decoder*>(&decoder) != nullptr)
+        {
+            // Re-encoded from the decoded samples, which loses some more; QuickTime
+            // and WAV IMA ADPCM blocks differ in size and headers.
+            mHeader.audioFormat = WAVHeader::cIMAADPCMFormat;
+            mHeader.bitsPerSample = 4;
+            mHeader.extraFormatSize = 2;
+            mHeader.samplesPerBlock = WAVHeader::cIMAADPCMSamplesPerBlock;
+            mHeader.blockAlign = IMAADPCMEncoder::getBlockAlign(mHeader.numChannels,
+                mHeader.samplesPerBlock);
+            mHeader.byteRate = static_cast<std::uint64_t>(mHeader.sampleRate) *
+                mHeader.blockAlign / mHeader.samplesPerBlock;
+            mHeader.subchunk2Size = IMAADPCMEncoder::getEncodedSize(mHeader.numChannels,
+                mHeader.samplesPerBlock, numFrames);
+        } else
+        {
+            Log::verb << "Sound has no matching compressed WAV format; " <<
+                "writing PCM." << std::endl;
+        }
+    }
+
+    // Formats other than PCM need the "fact" chunk.
+    if(mHeader.audioFormat != WAVHeader::cPCMFormat)
+    {
+        mHeader.subchunk1Size = 18 + mHeader.extraFormatSize;
+        mHeader.numSamples = numFrames;
+    }
+
+    mHeader.chunkSize = 4 + (8 + mHeader.subchunk1Size) + (8 + mHeader.subchunk2Size);
+    if(mHeader.audioFormat != WAVHeader::cPCMFormat)
+        mHeader.chunkSize += 8 + mHeader.factSize;
 
     // Debug info.
     Log::verb << mHeader << std::endl;
@@ -144,56 +227,113 @@ void WAVFile::writeHeader(std::ostream& outputStream)
     writeLittleValue(outputStream, mHeader.blockAlign);
     writeLittleValue(outputStream, mHeader.bitsPerSample);
 
+    if(mHeader.audioFormat != WAVHeader::cPCMFormat)
+    {
+        writeLittleValue(outputStream, mHeader.extraFormatSize);
+        if(mHeader.extraFormatSize == 2)
+            writeLittleValue(outputStream, mHeader.samplesPerBlock);
+
+        writeLittleArray(outputStream, mHeader.factID, 4);
+        writeLittleValue(outputStream, mHeader.factSize);
+        writeLittleValue(outputStream, mHeader.numSamples);
+    }
+
     writeLittleArray(outputStream, mHeader.subchunk2ID, 4);
     writeLittleValue(outputStream, mHeader.subchunk2Size);
 }
 
+// Copies samples which are kept compressed, or prepares the sink writing
+// sample data as it is decoded.
 // Returns true on success, false on failure.
-bool WAVFile::writeSampleData(std::ostream& outputStream, const SndFile& sndFile)
+bool WAVFile::beginSampleData(std::ostream& outputStream, SndFile& sndFile)
 {
-    std::vector<std::uint8_t> decodedSampleData =
-        sndFile.getDecoder().getLittleEndianData();
+    mOutputStream = &outputStream;
+    mEncoder.reset();
+    mConverter.reset();
+    mStreamSink.reset(new StreamSampleSink(outputStream));
+    mSampleSink = nullptr;
 
-    // We only support 8-bit or 16-bit samples.
-    unsigned bytesPerSample = mHeader.bitsPerSample/8;
-    if(bytesPerSample == 1)
+    if(mHeader.audioFormat == WAVHeader::cALawFormat ||
+        mHeader.audioFormat == WAVHeader::cULawFormat)
+    {
+        return sndFile.writeEncoded(*mStreamSink);
+    } else if(mHeader.audioFormat == WAVHeader::cIMAADPCMFormat)
     {
-        writeLittleArray(outputStream, decodedSampleData.data(), decodedSampleData.size());
+        mEncoder.reset(new IMAADPCMEncoder(*mStreamSink, mHeader.numChannels,
+            mHeader.samplesPerBlock));
+        mSampleSink = mEncoder.get();
         return true;
-    } else if(bytesPerSample == 2)
+    } else if(mSampleFormat != SampleFormat::Decoded)
+    {
+        unsigned bitsPerSample = sndFile.getDecoder().getBitsPerSample();
+        if(bitsPerSample == mHeader.bitsPerSample && mSampleFormat == SampleFormat::Int24)
+        {
+            mSampleSink = mStreamSink.get(); // Already 24-bit.
+            return true;
+        }
+
+        mConverter.reset(new SampleConverter(*mStreamSink, bitsPerSample,
+            getConverterFormat()));
+        mSampleSink = mConverter.get();
+        return true;
+    }
+
+    // We only support 8, 16, 24 or 32-bit samples.
+    // Samples are already decoded to little-endian.
+    // Note: samples above 8 bits are normally signed, but that doesn't
+    // change anything here.
+    unsigned bytesPerSample = mHeader.bitsPerSample/8;
+    if(mHeader.bitsPerSample%8 == 0 && bytesPerSample >= 1 && bytesPerSample <= 4)
     {
-        // If we have 2 bytes/sample, we have to make sure each sample is in little-endian!
-        // Note: 16-bit samples are normally signed, but that doesn't
-        // change anything here.
-        writeLittleArray(outputStream,
-            decodedSampleData.data(), decodedSampleData.size());
+        mSampleSink = mStreamSink.get();
         return true;
     }
 
     Log::err << "Error: cannot write sample data; sound sample is " <<
-        mHeader.bitsPerSample << "-bit, when only 8-bit and 16-bit samples " <<
-        "are supported." << std::endl;
+        mHeader.bitsPerSample << "-bit, when only 8, 16, 24 and 32-bit " <<
+        "samples are supported." << std::endl;
     return false;
 }
 
 // Returns true on success, false on failure.
-bool WAVFile::convertSnd(const SndFile& sndFile, const std::string& WAVFileName)
+bool WAVFile::begin(SndFile& sndFile, std::ostream& outputStream)
 {
     if(!populateHeader(sndFile))
         return false; // Error messages already dealt with.
 
-    std::ofstream outputFile(WAVFileName, std::ofstream::out |
-            std::ofstream::binary | std::ofstream::trunc);
+    writeHeader(outputStream);
+    return beginSampleData(outputStream, sndFile) && !outputStream.fail();
+}
 
-    if(outputFile.fail())
+SampleSink* WAVFile::getSampleSink()
+{
+    return mSampleSink;
+}
+
+// Returns true on success, false on failure.
+bool WAVFile::finish()
+{
+    if(mEncoder != nullptr && !mEncoder->finish())
+        return false;
+
+    return !mOutputStream->fail();
+}
+
+// Writes headerless little-endian PCM, in the format described by getHeader().
+// Returns true on success, false on failure.
+bool WAVFile::convertSndToRawPCM(SndFile& sndFile, std::ostream& outputStream)
+{
+    if(!populateHeader(sndFile))
+        return false; // Error messages already dealt with.
+
+    if(mHeader.audioFormat != WAVHeader::cPCMFormat &&
+        mHeader.audioFormat != WAVHeader::cIEEEFloatFormat)
     {
-        Log::err << "Error: could not open '" + WAVFileName + "' for writing!" <<
+        Log::err << "Error: raw output is always PCM; cannot keep samples compressed." <<
             std::endl;
         return false;
     }
 
-    writeHeader(outputFile);
-    writeSampleData(outputFile, sndFile);
-
-    return true;
+    return beginSampleData(outputStream, sndFile) && sndFile.decode(mSampleSink) &&
+        finish();
 }
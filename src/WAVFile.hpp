@@ -18,16 +18,26 @@
 #ifndef WAV_FILE_HPP
 #define WAV_FILE_HPP
 
-#include "Utils.hpp"
+#include "Endian.hpp"
+#include "SoundWriter.hpp"
+#include "SampleConverter.hpp"
 
 #include <ostream>
 #include <string>
 #include <cstdint> // Fixed-width types
 #include <vector>
+#include <memory>
 
 class WAVHeader
 {
 public:
+    static const std::uint16_t cPCMFormat;
+    static const std::uint16_t cIEEEFloatFormat;
+    static const std::uint16_t cIMAADPCMFormat;
+    static const std::uint16_t cALawFormat;
+    static const std::uint16_t cULawFormat;
+    static const std::uint16_t cIMAADPCMSamplesPerBlock;
+
     // http://soundfile.sapp.org/doc/WaveFormat/
     std::uint8_t chunkID[4] = {'R','I','F','F'};
     std::uint32_t chunkSize = 0;
@@ -42,6 +52,13 @@ public:
     std::uint16_t blockAlign = 0;
     std::uint16_t bitsPerSample = 0;
 
+    // Only for formats other than PCM, which also have a "fact" chunk.
+    std::uint16_t extraFormatSize = 0;
+    std::uint16_t samplesPerBlock = 0; // IMA ADPCM only.
+    std::uint8_t factID[4] = {'f','a','c','t'};
+    std::uint32_t factSize = 4;
+    std::uint32_t numSamples = 0; // Per channel.
+
     std::uint8_t subchunk2ID[4] = {'d','a','t','a'};
     std::uint32_t subchunk2Size = 0;
 };
@@ -49,17 +66,35 @@ public:
 std::ostream& operator<<(std::ostream& lhs, const WAVHeader& rhs);
 
 class SndFile;
-class WAVFile
+class IMAADPCMEncoder;
+class WAVFile : public SoundWriter
 {
+public:
+    // Format of PCM samples: as they are decoded, or converted.
+    enum class SampleFormat
+    {
+        Decoded,
+        Int24,
+        Float32 // IEEE float WAV.
+    };
+
 private:
     WAVHeader mHeader;
+    bool mKeepCompressed = false;
+    SampleFormat mSampleFormat = SampleFormat::Decoded;
+
+    std::ostream* mOutputStream = nullptr;
+    std::unique_ptr<StreamSampleSink> mStreamSink;
+    std::unique_ptr<IMAADPCMEncoder> mEncoder; // Only for IMA ADPCM.
+    std::unique_ptr<SampleConverter> mConverter; // Only for converted samples.
+    SampleSink* mSampleSink = nullptr; // nullptr if samples are copied as-is.
 
     // Safe endian.
     // littleStream is a little-endian output stream.
     template<class T>
     static void writeLittleValue(std::ostream& littleStream, T value)
     {
-        T little = Utils::safeLittleEndian(value);
+        T little = Endian::toLittle(value);
         littleStream.write(reinterpret_cast<const char*>(&little), sizeof(T));
     }
 
@@ -67,34 +102,47 @@ private:
     // littleStream is a little-endian output stream.
     // Only writes length of bytes (LSBs of value).
     template<class T>
-    static T writeLittleValue(std::ostream& littleStream, T value, std::size_t length)
+    static void writeLittleValue(std::ostream& littleStream, T value, std::size_t length)
     {
-        T little = Utils::safeLittleEndian(value);
-        
+        T little = Endian::toLittle(value);
+
         littleStream.write(reinterpret_cast<const char*>(&little), length);
     }
 
     // Safe endian.
     // littleStream is a little-endian output stream.
     template<class T>
-    static void writeLittleArray(std::ostream& littleStream, T* values, std::size_t length)
+    static void writeLittleArray(std::ostream& littleStream, const T* values, std::size_t length)
     {
-        for(std::size_t i = 0; i < length; ++i)
-        {
-            T little = Utils::safeLittleEndian(values[i]);
-            littleStream.write(reinterpret_cast<const char*>(&little), sizeof(T));
-        }
+        std::vector<std::uint8_t> little(length * sizeof(T));
+        Endian::storeLittle(values, length, little.data());
+        littleStream.write(reinterpret_cast<const char*>(little.data()), little.size());
     }
 
-    bool populateHeader(const SndFile& sndFile);
+    SampleConverter::Format getConverterFormat() const;
     void writeHeader(std::ostream& outputStream);
-    bool writeSampleData(std::ostream& outputStream, const SndFile& sndFile);
+    bool beginSampleData(std::ostream& outputStream, SndFile& sndFile);
 
 public:
     WAVFile();
-    WAVFile(const SndFile& sndFile, const std::string& WAVFileName);
+    WAVFile(SndFile& sndFile, const std::string& WAVFileName);
+    ~WAVFile();
+
+    // Keeps A-law and mu-law samples as-is, and stores IMA 4:1 as WAV IMA
+    // ADPCM, instead of writing PCM.
+    void setKeepCompressed(bool keepCompressed);
+
+    // Takes precedence over setKeepCompressed().
+    void setSampleFormat(SampleFormat sampleFormat);
+
+    bool populateHeader(const SndFile& sndFile);
+    const WAVHeader& getHeader() const;
+
+    bool begin(SndFile& sndFile, std::ostream& outputStream) override;
+    SampleSink* getSampleSink() override;
+    bool finish() override;
 
-    bool convertSnd(const SndFile& sndFile, const std::string& WAVFileName);
+    bool convertSndToRawPCM(SndFile& sndFile, std::ostream& outputStream);
 };
 
 #endif // WAV_FILE_HPP
@@ -0,0 +1,93 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "WorkerPool.hpp"
+
+#include <utility> // For std::move
+
+WorkerPool::WorkerPool(std::size_t numThreads)
+{
+    if(numThreads == 0)
+        numThreads = std::thread::hardware_concurrency();
+    if(numThreads == 0)
+        numThreads = 1; // Unknown hardware concurrency.
+
+    for(std::size_t i = 0; i < numThreads; ++i)
+        mThreads.emplace_back(&WorkerPool::work, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+
+    mJobAvailable.notify_all();
+    for(std::thread& thread : mThreads)
+        thread.join();
+}
+
+void WorkerPool::work()
+{
+    while(true)
+    {
+        std::function<void()> job;
+
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mJobAvailable.wait(lock, [this] { return mStopping || !mJobs.empty(); });
+
+            // Only stop once every job is done.
+            if(mJobs.empty())
+                return;
+
+            job = std::move(mJobs.front());
+            mJobs.pop();
+            ++mNumRunningJobs;
+        }
+
+        job();
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            --mNumRunningJobs;
+        }
+        mJobsDone.notify_all();
+    }
+}
+
+void WorkerPool::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobs.push(std::move(job));
+    }
+
+    mJobAvailable.notify_one();
+}
+
+void WorkerPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mJobsDone.wait(lock, [this] { return mJobs.empty() && mNumRunningJobs == 0; });
+}
+
+std::size_t WorkerPool::getNumThreads() const
+{
+    return mThreads.size();
+}
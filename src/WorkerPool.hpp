@@ -0,0 +1,57 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+#include <cstddef> // For std::size_t
+
+// Fixed set of threads running submitted jobs in submission order.
+class WorkerPool
+{
+private:
+    void work();
+
+    std::vector<std::thread> mThreads;
+    std::queue<std::function<void()>> mJobs;
+    std::mutex mMutex;
+    std::condition_variable mJobAvailable;
+    std::condition_variable mJobsDone;
+    std::size_t mNumRunningJobs = 0;
+    bool mStopping = false;
+
+public:
+    // 0 threads means one per hardware thread.
+    WorkerPool(std::size_t numThreads = 0);
+    ~WorkerPool(); // Finishes all submitted jobs.
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    void submit(std::function<void()> job);
+    void wait(); // Blocks until all submitted jobs are done.
+
+    std::size_t getNumThreads() const;
+};
+
+#endif // WORKER_POOL_HPP
@@ -24,8 +24,17 @@
 // Modified by Carl Hewett for SndToWAV.
 
 #include "XLawDecoder.hpp"
+#include "CpuFeatures.hpp"
+
 #include <iostream>
 #include <cstddef> // For size_t
+#include <algorithm> // For std::min
+
+#if defined(SNDTOWAV_X86)
+#include <immintrin.h>
+#elif defined(SNDTOWAV_NEON)
+#include <arm_neon.h>
+#endif
 
 // Conversion tables to obtain 16-bit PCM from 8-bit a-law/mu-law.
 // These tables are valid for *-law input bytes [0...127].
@@ -72,10 +81,333 @@ static const std::int16_t uLawToPCM[128] = {
    -56,    -48,    -40,    -32,    -24,    -16,     -8,     -0,
 };
 
+// Full 256-entry tables, with the mirrored half precomputed, holding
+// little-endian output bytes.
+struct XLawTable
+{
+    std::uint8_t littleEndian[256][2];
+
+    XLawTable(const std::int16_t* xLawToPCM)
+    {
+        for(int b = 0; b < 256; ++b)
+        {
+            std::int16_t sample = b < 128 ? xLawToPCM[b] : -xLawToPCM[b - 128];
+            std::uint16_t unsignedSample = static_cast<std::uint16_t>(sample);
+
+            littleEndian[b][0] = static_cast<std::uint8_t>(unsignedSample & 0xFF);
+            littleEndian[b][1] = static_cast<std::uint8_t>(unsignedSample >> 8);
+        }
+    }
+};
+
+static const XLawTable aLawTable(aLawToPCM);
+static const XLawTable uLawTable(uLawToPCM);
+
+// Expands numSamples *-law bytes to 16-bit little-endian samples.
+using ExpandFunction = void (*)(const std::uint8_t* data, std::size_t numSamples,
+    std::uint8_t* samples);
+
+static inline void expand_table(const XLawTable& table, const std::uint8_t* data,
+    std::size_t numSamples, std::uint8_t* samples)
+{
+    for(std::size_t i = 0; i < numSamples; ++i)
+    {
+        samples[i*2] = table.littleEndian[data[i]][0];
+        samples[i*2 + 1] = table.littleEndian[data[i]][1];
+    }
+}
+
+static void alaw_expand_scalar(const std::uint8_t* data, std::size_t numSamples,
+    std::uint8_t* samples)
+{
+    expand_table(aLawTable, data, numSamples, samples);
+}
+
+static void ulaw_expand_scalar(const std::uint8_t* data, std::size_t numSamples,
+    std::uint8_t* samples)
+{
+    expand_table(uLawTable, data, numSamples, samples);
+}
+
+// The vector kernels compute the same values as the tables, like ffmpeg's
+// alaw2linear() and ulaw2linear():
+//   a-law: a ^= 0x55, sample = (2 * mantissa + 1 [+ 32]) << shift(segment),
+//          negated when the sign bit is clear.
+//   mu-law: u = ~u, sample = ((mantissa << 3) + 0x84) << exponent) - 0x84,
+//           negated when the sign bit is set.
+// Variable shifts are multiplications by a power of two found with a byte
+// shuffle; products always fit in 16 bits.
+
+#if defined(SNDTOWAV_X86)
+
+// Signs are 0 or -1 per 16-bit sample.
+SNDTOWAV_TARGET("ssse3")
+static inline __m128i negate_where_ssse3(__m128i values, __m128i signs)
+{
+    return _mm_sub_epi16(_mm_xor_si128(values, signs), signs);
+}
+
+SNDTOWAV_TARGET("ssse3")
+static void alaw_expand_ssse3(const std::uint8_t* data, std::size_t numSamples,
+    std::uint8_t* samples)
+{
+    const __m128i segmentOffsets = _mm_setr_epi8(0, 32, 32, 32, 32, 32, 32, 32,
+        0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i segmentScales = _mm_setr_epi8(1, 1, 2, 4, 8, 16, 32, 64,
+        0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i zero = _mm_setzero_si128();
+
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        __m128i a = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)),
+            _mm_set1_epi8(0x55));
+        __m128i mantissa = _mm_and_si128(a, _mm_set1_epi8(0x0F));
+        __m128i segment = _mm_and_si128(_mm_srli_epi16(a, 4), _mm_set1_epi8(0x07));
+
+        __m128i base = _mm_add_epi8(_mm_add_epi8(mantissa, mantissa), _mm_set1_epi8(1));
+        base = _mm_add_epi8(base, _mm_shuffle_epi8(segmentOffsets, segment));
+        __m128i scale = _mm_shuffle_epi8(segmentScales, segment);
+        __m128i negative = _mm_cmpgt_epi8(zero, _mm_xor_si128(a, _mm_set1_epi8(-128)));
+
+        __m128i low = _mm_slli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(base, zero),
+            _mm_unpacklo_epi8(scale, zero)), 3);
+        __m128i high = _mm_slli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(base, zero),
+            _mm_unpackhi_epi8(scale, zero)), 3);
+
+        low = negate_where_ssse3(low, _mm_unpacklo_epi8(negative, negative));
+        high = negate_where_ssse3(high, _mm_unpackhi_epi8(negative, negative));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(samples + i*2), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(samples + i*2 + 16), high);
+    }
+
+    alaw_expand_scalar(data + i, numSamples - i, samples + i*2);
+}
+
+SNDTOWAV_TARGET("ssse3")
+static void ulaw_expand_ssse3(const std::uint8_t* data, std::size_t numSamples,
+    std::uint8_t* samples)
+{
+    const __m128i exponentScales = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+        0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(0x84);
+
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        __m128i u = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)),
+            _mm_set1_epi8(-1));
+        __m128i mantissa = _mm_and_si128(u, _mm_set1_epi8(0x0F));
+        __m128i exponent = _mm_and_si128(_mm_srli_epi16(u, 4), _mm_set1_epi8(0x07));
+        __m128i scale = _mm_shuffle_epi8(exponentScales, exponent);
+        __m128i negative = _mm_cmpgt_epi8(zero, u);
+
+        __m128i low = _mm_add_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(mantissa, zero), 3), bias);
+        __m128i high = _mm_add_epi16(_mm_slli_epi16(_mm_unpackhi_epi8(mantissa, zero), 3), bias);
+        low = _mm_sub_epi16(_mm_mullo_epi16(low, _mm_unpacklo_epi8(scale, zero)), bias);
+        high = _mm_sub_epi16(_mm_mullo_epi16(high, _mm_unpackhi_epi8(scale, zero)), bias);
+
+        low = negate_where_ssse3(low, _mm_unpacklo_epi8(negative, negative));
+        high = negate_where_ssse3(high, _mm_unpackhi_epi8(negative, negative));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(samples + i*2), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(samples + i*2 + 16), high);
+    }
+
+    ulaw_expand_scalar(data + i, numSamples - i, samples + i*2);
+}
+
+SNDTOWAV_TARGET("avx2")
+static inline __m256i negate_where_avx2(__m256i values, __m256i signs)
+{
+    return _mm256_sub_epi16(_mm256_xor_si256(values, signs), signs);
+}
+
+SNDTOWAV_TARGET("avx2")
+static void alaw_expand_avx2(const std::uint8_t* data, std::size_t numSamples,
+    std::uint8_t* samples)
+{
+    // Shuffles look up within each 128-bit lane, so tables are in both.
+    const __m256i segmentOffsets = _mm256_setr_epi8(0, 32, 32, 32, 32, 32, 32, 32,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 32, 32, 32, 32, 32, 32, 32, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i segmentScales = _mm256_setr_epi8(1, 1, 2, 4, 8, 16, 32, 64,
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 4, 8, 16, 32, 64, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i zero = _mm256_setzero_si256();
+
+    std::size_t i = 0;
+    for(; i + 32 <= numSamples; i += 32)
+    {
+        __m256i a = _mm256_xor_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)),
+            _mm256_set1_epi8(0x55));
+        __m256i mantissa = _mm256_and_si256(a, _mm256_set1_epi8(0x0F));
+        __m256i segment = _mm256_and_si256(_mm256_srli_epi16(a, 4), _mm256_set1_epi8(0x07));
+
+        __m256i base = _mm256_add_epi8(_mm256_add_epi8(mantissa, mantissa), _mm256_set1_epi8(1));
+        base = _mm256_add_epi8(base, _mm256_shuffle_epi8(segmentOffsets, segment));
+        __m256i scale = _mm256_shuffle_epi8(segmentScales, segment);
+        __m256i negative = _mm256_cmpgt_epi8(zero,
+            _mm256_xor_si256(a, _mm256_set1_epi8(-128)));
+
+        // Widen in order, rather than interleaving lanes.
+        __m256i low = _mm256_slli_epi16(_mm256_mullo_epi16(
+            _mm256_cvtepu8_epi16(_mm256_castsi256_si128(base)),
+            _mm256_cvtepu8_epi16(_mm256_castsi256_si128(scale))), 3);
+        __m256i high = _mm256_slli_epi16(_mm256_mullo_epi16(
+            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(base, 1)),
+            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(scale, 1))), 3);
+
+        low = negate_where_avx2(low, _mm256_cvtepi8_epi16(_mm256_castsi256_si128(negative)));
+        high = negate_where_avx2(high, _mm256_cvtepi8_epi16(_mm256_extracti128_si256(negative, 1)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(samples + i*2), low);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(samples + i*2 + 32), high);
+    }
+
+    alaw_expand_scalar(data + i, numSamples - i, samples + i*2);
+}
+
+SNDTOWAV_TARGET("avx2")
+static void ulaw_expand_avx2(const std::uint8_t* data, std::size_t numSamples,
+    std::uint8_t* samples)
+{
+    const __m256i exponentScales = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i bias = _mm256_set1_epi16(0x84);
+
+    std::size_t i = 0;
+    for(; i + 32 <= numSamples; i += 32)
+    {
+        __m256i u = _mm256_xor_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)),
+            _mm256_set1_epi8(-1));
+        __m256i mantissa = _mm256_and_si256(u, _mm256_set1_epi8(0x0F));
+        __m256i exponent = _mm256_and_si256(_mm256_srli_epi16(u, 4), _mm256_set1_epi8(0x07));
+        __m256i scale = _mm256_shuffle_epi8(exponentScales, exponent);
+        __m256i negative = _mm256_cmpgt_epi8(zero, u);
+
+        __m256i low = _mm256_add_epi16(_mm256_slli_epi16(
+            _mm256_cvtepu8_epi16(_mm256_castsi256_si128(mantissa)), 3), bias);
+        __m256i high = _mm256_add_epi16(_mm256_slli_epi16(
+            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(mantissa, 1)), 3), bias);
+        low = _mm256_sub_epi16(_mm256_mullo_epi16(low,
+            _mm256_cvtepu8_epi16(_mm256_castsi256_si128(scale))), bias);
+        high = _mm256_sub_epi16(_mm256_mullo_epi16(high,
+            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(scale, 1))), bias);
+
+        low = negate_where_avx2(low, _mm256_cvtepi8_epi16(_mm256_castsi256_si128(negative)));
+        high = negate_where_avx2(high, _mm256_cvtepi8_epi16(_mm256_extracti128_si256(negative, 1)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(samples + i*2), low);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(samples + i*2 + 32), high);
+    }
+
+    ulaw_expand_scalar(data + i, numSamples - i, samples + i*2);
+}
+
+#elif defined(SNDTOWAV_NEON)
+
+static inline int16x8_t negate_where_neon(int16x8_t values, int16x8_t signs)
+{
+    return vsubq_s16(veorq_s16(values, signs), signs);
+}
+
+static void alaw_expand_neon(const std::uint8_t* data, std::size_t numSamples,
+    std::uint8_t* samples)
+{
+    static const std::uint8_t offsets[16] = {0, 32, 32, 32, 32, 32, 32, 32};
+    static const std::uint8_t scales[16] = {1, 1, 2, 4, 8, 16, 32, 64};
+    const uint8x16_t segmentOffsets = vld1q_u8(offsets);
+    const uint8x16_t segmentScales = vld1q_u8(scales);
+
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        uint8x16_t a = veorq_u8(vld1q_u8(data + i), vdupq_n_u8(0x55));
+        uint8x16_t mantissa = vandq_u8(a, vdupq_n_u8(0x0F));
+        uint8x16_t segment = vandq_u8(vshrq_n_u8(a, 4), vdupq_n_u8(0x07));
+
+        uint8x16_t base = vaddq_u8(vaddq_u8(mantissa, mantissa), vdupq_n_u8(1));
+        base = vaddq_u8(base, vqtbl1q_u8(segmentOffsets, segment));
+        uint8x16_t scale = vqtbl1q_u8(segmentScales, segment);
+        int8x16_t negative = vreinterpretq_s8_u8(vceqq_u8(vandq_u8(a, vdupq_n_u8(0x80)),
+            vdupq_n_u8(0)));
+
+        int16x8_t low = vreinterpretq_s16_u16(vshlq_n_u16(vmulq_u16(
+            vmovl_u8(vget_low_u8(base)), vmovl_u8(vget_low_u8(scale))), 3));
+        int16x8_t high = vreinterpretq_s16_u16(vshlq_n_u16(vmulq_u16(
+            vmovl_u8(vget_high_u8(base)), vmovl_u8(vget_high_u8(scale))), 3));
+
+        low = negate_where_neon(low, vmovl_s8(vget_low_s8(negative)));
+        high = negate_where_neon(high, vmovl_s8(vget_high_s8(negative)));
+
+        vst1q_u8(samples + i*2, vreinterpretq_u8_s16(low));
+        vst1q_u8(samples + i*2 + 16, vreinterpretq_u8_s16(high));
+    }
+
+    alaw_expand_scalar(data + i, numSamples - i, samples + i*2);
+}
+
+static void ulaw_expand_neon(const std::uint8_t* data, std::size_t numSamples,
+    std::uint8_t* samples)
+{
+    static const std::uint8_t scales[16] = {1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t exponentScales = vld1q_u8(scales);
+    const uint16x8_t bias = vdupq_n_u16(0x84);
+
+    std::size_t i = 0;
+    for(; i + 16 <= numSamples; i += 16)
+    {
+        uint8x16_t u = vmvnq_u8(vld1q_u8(data + i));
+        uint8x16_t mantissa = vandq_u8(u, vdupq_n_u8(0x0F));
+        uint8x16_t exponent = vandq_u8(vshrq_n_u8(u, 4), vdupq_n_u8(0x07));
+        uint8x16_t scale = vqtbl1q_u8(exponentScales, exponent);
+        int8x16_t negative = vreinterpretq_s8_u8(vtstq_u8(u, vdupq_n_u8(0x80)));
+
+        uint16x8_t lowMagnitude = vaddq_u16(vshlq_n_u16(vmovl_u8(vget_low_u8(mantissa)), 3), bias);
+        uint16x8_t highMagnitude = vaddq_u16(vshlq_n_u16(vmovl_u8(vget_high_u8(mantissa)), 3), bias);
+        int16x8_t low = vreinterpretq_s16_u16(vsubq_u16(vmulq_u16(lowMagnitude,
+            vmovl_u8(vget_low_u8(scale))), bias));
+        int16x8_t high = vreinterpretq_s16_u16(vsubq_u16(vmulq_u16(highMagnitude,
+            vmovl_u8(vget_high_u8(scale))), bias));
+
+        low = negate_where_neon(low, vmovl_s8(vget_low_s8(negative)));
+        high = negate_where_neon(high, vmovl_s8(vget_high_s8(negative)));
+
+        vst1q_u8(samples + i*2, vreinterpretq_u8_s16(low));
+        vst1q_u8(samples + i*2 + 16, vreinterpretq_u8_s16(high));
+    }
+
+    ulaw_expand_scalar(data + i, numSamples - i, samples + i*2);
+}
+
+#endif
+
+// Picks the kernel of the current kernel set.
+static ExpandFunction select_expand_function(bool useULaw)
+{
+#if defined(SNDTOWAV_X86)
+    if(CpuFeatures::useAVX2())
+        return useULaw ? ulaw_expand_avx2 : alaw_expand_avx2;
+    if(CpuFeatures::useSSE())
+        return useULaw ? ulaw_expand_ssse3 : alaw_expand_ssse3;
+#elif defined(SNDTOWAV_NEON)
+    if(CpuFeatures::useNEON())
+        return useULaw ? ulaw_expand_neon : alaw_expand_neon;
+#endif
+
+    return useULaw ? ulaw_expand_scalar : alaw_expand_scalar;
+}
+
 /* XLawDecoder */
-XLawDecoder::XLawDecoder()
+// Samples don't depend on the channel count, so the kernel is bound right away.
+XLawDecoder::XLawDecoder(bool useULaw)
+    : mExpand(select_expand_function(useULaw))
 {
-    // Do nothing
+
 }
 
 std::size_t XLawDecoder::getEncodedSize(std::size_t numPackets) const
@@ -95,52 +427,33 @@ unsigned XLawDecoder::getBitsPerSample() const
 }
 
 bool XLawDecoder::decode(const std::vector<std::uint8_t>& data,
-    std::size_t /* numChannels */, bool useULaw)
+    std::size_t /* numChannels */)
 {
-    const std::int16_t* xLawToPCM = aLawToPCM; // Get correct table
-    std::vector<std::int16_t> decodedSamples(data.size());
+    std::vector<std::uint8_t> decodedData(cChunkSamples * 2);
 
-    if(useULaw)
-        xLawToPCM = uLawToPCM;
-
-    for(std::size_t i = 0; i < data.size(); i++)
+    for(std::size_t chunk = 0; chunk < data.size(); chunk += cChunkSamples)
     {
-        std::int8_t b = *reinterpret_cast<const std::int8_t*>(&data[i]); // SIGNED!
-        if(b < 0)
-        {
-            // Mirror table and negate output
-            decodedSamples[i] = -xLawToPCM[128 + b];
-        } else
-        {
-            decodedSamples[i] = xLawToPCM[b];
-        }
+        std::size_t numSamples = std::min(cChunkSamples, data.size() - chunk);
+
+        // Straight to little-endian bytes.
+        mExpand(&data[chunk], numSamples, decodedData.data());
+        if(!outputSamples(decodedData.data(), numSamples * 2))
+            return false;
     }
 
-    setLittleEndianData(decodedSamples);
     return true;
 }
 
 /* ALawDecoder */
 ALawDecoder::ALawDecoder()
+    : XLawDecoder(false)
 {
     // Do nothing
 }
 
-bool ALawDecoder::decode(const std::vector<std::uint8_t>& data,
-    std::size_t numChannels)
-{
-    return XLawDecoder::decode(data, numChannels, false);
-}
-
 /* ULawDecoder */
 ULawDecoder::ULawDecoder()
+    : XLawDecoder(true)
 {
     // Do nothing
 }
-
-bool ULawDecoder::decode(const std::vector<std::uint8_t>& data,
-    std::size_t numChannels)
-{
-    return XLawDecoder::decode(data, numChannels, true);
-}
-
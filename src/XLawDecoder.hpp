@@ -26,24 +26,30 @@
 
 class XLawDecoder : public Decoder
 {
+private:
+    // Expands *-law bytes to 16-bit little-endian samples.
+    using ExpandFunction = void (*)(const std::uint8_t* data, std::size_t numSamples,
+        std::uint8_t* samples);
+
+    ExpandFunction mExpand;
+
 protected:
-    XLawDecoder();
+    XLawDecoder(bool useULaw);
 
+public:
     std::size_t getEncodedSize(std::size_t numPackets) const override;
     std::size_t getDecodedSize(std::size_t numPackets) const override;
 
     unsigned getBitsPerSample() const override;
 
     bool decode(const std::vector<std::uint8_t>& data,
-        std::size_t numChannels, bool useULaw);
+        std::size_t numChannels) override;
 };
 
 class ALawDecoder : public XLawDecoder
 {
 public:
     ALawDecoder();
-    bool decode(const std::vector<std::uint8_t>& data,
-        std::size_t numChannels) override;
 };
 
 
@@ -51,8 +57,6 @@ class ULawDecoder : public XLawDecoder
 {
 public:
     ULawDecoder();
-    bool decode(const std::vector<std::uint8_t>& data,
-        std::size_t numChannels) override;
 };
 
 #endif // XLAW_DECODER_HPP
@@ -16,13 +16,26 @@
 // along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
 
 #include "SndToWAV.hpp"
+#include "ConversionDaemon.hpp"
+#include "DirectoryWatcher.hpp"
+#include "DuplicateReport.hpp"
+#include "CpuFeatures.hpp"
 #include "Log.hpp"
 
 #include <iomanip>
+#include <iostream>
 #include <cstddef> // For size_t
 #include <vector>
 #include <tuple>
 #include <algorithm>
+#include <memory>
+#include <chrono>
+
+#ifdef _WIN32
+#include <io.h> // For _setmode
+#include <fcntl.h>
+#include <cstdio>
+#endif
 
 std::string gVersion = "v1.0";
 
@@ -39,7 +52,16 @@ void printHelp()
         "Note: only supports 'snd ' files containing a single sound sample." << std::endl <<
         std::endl <<
         "Usage: SndToWAV -input INPUT_FILE [-blocksize BLOCKSIZE]" << std::endl <<
-        "   [-ID RESOURCE_ID | -name RESOURCE_NAME] [-verbose]" << std::endl <<
+        "   [-ID RESOURCE_ID | -name RESOURCE_NAME] [-journal JOURNAL_FILE]" << std::endl <<
+        "   [-range START:END [-seek-index]] [-resample RATE] [-trim THRESHOLD]" << std::endl <<
+        "   [-normalize PEAK]" << std::endl <<
+        "   [-downmix] [-stdout [-raw] | -archive ARCHIVE_FILE]" << std::endl <<
+        "   [-format FORMATS] [-keep-compressed | -sample-format SAMPLE_FORMAT]" << std::endl <<
+        "   [-kernel KERNEL_SET] [-verbose]" << std::endl <<
+        "   or: SndToWAV -daemon SOCKET_PATH [-cachesize CACHE_SIZE] [-blocksize BLOCKSIZE]" << std::endl <<
+        "   or: SndToWAV -watch DIRECTORY [-threads THREADS] [-journal JOURNAL_FILE]" << std::endl <<
+        "   [-blocksize BLOCKSIZE]" << std::endl <<
+        "   or: SndToWAV -duplicates DIRECTORY [-threshold BIT_ERROR_RATE]" << std::endl <<
         std::endl <<
         " --help, --h            display help" << std::endl <<
         std::endl <<
@@ -49,8 +71,68 @@ void printHelp()
         " -blocksize             blocksize of the resource fork, in bytes (default is 4096)" << std::endl <<
         " -ID                    ID of sound resource to extract" << std::endl <<
         " -name                  name of sound resource to extract" << std::endl <<
+        " -journal               journal file enabling incremental extraction; unchanged" << std::endl <<
+        "                        sounds are skipped, and interrupted runs resume" << std::endl <<
+        " -range                 only extract part of the sounds; bounds are in sample" << std::endl <<
+        "                        frames, or in seconds with an 's' suffix, and may be" << std::endl <<
+        "                        omitted (for example: -range 1.5s:3s, -range 22050:);" << std::endl <<
+        "                        MACE sounds decode from the start up to the range end," << std::endl <<
+        "                        or from a 'NAME.seekindex' next to the outputs, if any" << std::endl <<
+        " -seek-index            with -range, write a 'NAME.seekindex' for MACE sounds" << std::endl <<
+        "                        lacking one, so that later ranges of them are decoded" << std::endl <<
+        "                        from the nearest checkpoint; costs a pass over the" << std::endl <<
+        "                        whole sound, and cannot be used with -stdout or -archive" << std::endl <<
+        " -resample              resample sounds to RATE Hz (at most 65535) as they are" << std::endl <<
+        "                        decoded, from their exact fractional rate" << std::endl <<
+        " -trim                  trim leading and trailing silence: samples below" << std::endl <<
+        "                        THRESHOLD dBFS (for example: -trim -60)" << std::endl <<
+        " -normalize             scale sounds so that their peak is PEAK dBFS, at most 0" << std::endl <<
+        "                        (for example: -normalize -1)" << std::endl <<
+        " -downmix               average the channels of sounds to mono" << std::endl <<
+        "                        (-trim, -normalize and -downmix only apply to 8 and" << std::endl <<
+        "                        16-bit sounds)" << std::endl <<
+        " -stdout                stream the sound to standard output instead of a file;" << std::endl <<
+        "                        requires -ID or -name" << std::endl <<
+        " -raw                   with -stdout, write headerless little-endian PCM" << std::endl <<
+        " -archive               write all sounds to a single tar archive, ending with a" << std::endl <<
+        "                        'manifest.json' of their offsets; '-' streams it to" << std::endl <<
+        "                        standard output" << std::endl <<
+        " -format                output formats, separated by commas: wav, aiff, flac," << std::endl <<
+        "                        hash, peaks, stats or fingerprint (default is wav); all" << std::endl <<
+        "                        are written from a single decoding pass; aiff keeps" << std::endl <<
+        "                        samples as they are in the sound, using AIFF-C for" << std::endl <<
+        "                        compressed and 8-bit sounds; hash writes a hash of the" << std::endl <<
+        "                        decoded samples; peaks writes waveform peaks, stats" << std::endl <<
+        "                        levels and loudness, and fingerprint a fingerprint for" << std::endl <<
+        "                        -duplicates" << std::endl <<
+        " -keep-compressed       keep A-law and mu-law samples as-is, instead of writing" << std::endl <<
+        "                        PCM; IMA 4:1 is decoded and lossily re-encoded to IMA" << std::endl <<
+        "                        ADPCM WAV files, a quarter of the size of PCM" << std::endl <<
+        " -sample-format         convert the samples of WAV files (and of -raw output)" << std::endl <<
+        "                        to int24 (24-bit PCM) or float32 (32-bit float)" << std::endl <<
+        " -kernel                decoding kernels to use: scalar, sse, avx2, avx512 or" << std::endl <<
+        "                        neon (default is the best the CPU supports)" << std::endl <<
         " -verbose               enable verbose logging" << std::endl <<
         std::endl <<
+        "Daemon options:" << std::endl <<
+        " -daemon                serve conversion requests on a Unix domain socket" << std::endl <<
+        " -cachesize             size of the converted sound cache, in MiB (default is 256)" << std::endl <<
+        std::endl <<
+        "Watch options:" << std::endl <<
+        " -watch                 convert .rsrc files as they are added to or modified in" << std::endl <<
+        "                        a directory; sounds of 'NAME.rsrc' are written to 'NAME/'" << std::endl <<
+        "                        in the same directory" << std::endl <<
+        " -threads               number of conversion threads, or of FLAC encoding" << std::endl <<
+        "                        threads outside of watch mode (default is one per core)" << std::endl <<
+        " -journal               defaults to 'SndToWAV.journal' in watch mode" << std::endl <<
+        std::endl <<
+        "Duplicate options:" << std::endl <<
+        " -duplicates            report sounds which are near-duplicates of each other," << std::endl <<
+        "                        whatever their compression, as JSON clusters, from the" << std::endl <<
+        "                        .fingerprint files anywhere in DIRECTORY" << std::endl <<
+        " -threshold             highest share of fingerprint bits which may differ" << std::endl <<
+        "                        between duplicates (default is 0.2)" << std::endl <<
+        std::endl <<
         "If no ID or name is specified, will extract all sounds from the resource fork." << std::endl;
 }
 
@@ -65,6 +147,26 @@ int main(int argc, char **argv)
     std::size_t resourceFileBlockSize = 4096U;
     int ID = -1;
     std::string resourceName;
+    std::string journalFile;
+    std::string range;
+    bool buildSeekIndex = false;
+    unsigned int resampleRate = 0U;
+    std::string silenceThreshold;
+    std::string normalizedPeak;
+    bool downmix = false;
+    bool toStandardOutput = false;
+    bool rawPCM = false;
+    std::string archiveFile;
+    std::string outputFormat;
+    bool keepCompressed = false;
+    std::string sampleFormat;
+    std::string daemonSocketPath;
+    std::size_t daemonCacheSize = 256U; // In MiB.
+    std::string watchDirectory;
+    std::string duplicatesDirectory;
+    float maxBitErrorRate = 0.2f;
+    std::size_t numThreads = 0U; // One per core.
+    std::string kernelSetName;
 
     // Wow! So easy!
     argDefinitionVector argDefinitions = {
@@ -76,6 +178,26 @@ int main(int argc, char **argv)
         argDefinitionTuple("-blocksize", &resourceFileBlockSize, "std::size_t"),
         argDefinitionTuple("-ID", &ID, "int"),
         argDefinitionTuple("-name", &resourceName, "std::string"),
+        argDefinitionTuple("-journal", &journalFile, "std::string"),
+        argDefinitionTuple("-range", &range, "std::string"),
+        argDefinitionTuple("-seek-index", &buildSeekIndex, "bool"),
+        argDefinitionTuple("-resample", &resampleRate, "unsigned int"),
+        argDefinitionTuple("-trim", &silenceThreshold, "std::string"),
+        argDefinitionTuple("-normalize", &normalizedPeak, "std::string"),
+        argDefinitionTuple("-downmix", &downmix, "bool"),
+        argDefinitionTuple("-stdout", &toStandardOutput, "bool"),
+        argDefinitionTuple("-raw", &rawPCM, "bool"),
+        argDefinitionTuple("-archive", &archiveFile, "std::string"),
+        argDefinitionTuple("-format", &outputFormat, "std::string"),
+        argDefinitionTuple("-keep-compressed", &keepCompressed, "bool"),
+        argDefinitionTuple("-sample-format", &sampleFormat, "std::string"),
+        argDefinitionTuple("-daemon", &daemonSocketPath, "std::string"),
+        argDefinitionTuple("-cachesize", &daemonCacheSize, "std::size_t"),
+        argDefinitionTuple("-watch", &watchDirectory, "std::string"),
+        argDefinitionTuple("-duplicates", &duplicatesDirectory, "std::string"),
+        argDefinitionTuple("-threshold", &maxBitErrorRate, "float"),
+        argDefinitionTuple("-threads", &numThreads, "std::size_t"),
+        argDefinitionTuple("-kernel", &kernelSetName, "std::string"),
         argDefinitionTuple("-verbose", nullptr, "verbose")
     };
 
@@ -115,6 +237,9 @@ int main(int argc, char **argv)
 
                 else if(textualType == "float")
                     *static_cast<float*>(associatedVariable) = std::stof(*(foundStringIt + 1));
+
+                else if(textualType == "bool")
+                    *static_cast<bool*>(associatedVariable) = true; // Flag, no value.
                 else if(textualType == "printhelp")
                 {
                     printHelp();
@@ -133,6 +258,52 @@ int main(int argc, char **argv)
         }
     }
 
+    // Kernels are bound as decoding starts, so this must come first.
+    if(!kernelSetName.empty())
+    {
+        CpuFeatures::KernelSet kernelSet;
+        if(!CpuFeatures::parseKernelSet(kernelSetName, kernelSet) ||
+           !CpuFeatures::setKernelSet(kernelSet))
+            return 1; // Error messages already dealt with.
+    }
+
+    Log::verb << "Using " << CpuFeatures::getKernelSetName(CpuFeatures::getKernelSet()) <<
+        " kernels." << std::endl;
+
+    if(!daemonSocketPath.empty())
+    {
+        ConversionDaemon daemon(resourceFileBlockSize, daemonCacheSize * 1024U * 1024U);
+        return daemon.run(daemonSocketPath) ? 0 : 1;
+    }
+
+    if(!watchDirectory.empty())
+    {
+        // Always incremental, so only changed sounds are converted again.
+        std::shared_ptr<Journal> journal = std::make_shared<Journal>(
+            journalFile.empty() ? "SndToWAV.journal" : journalFile);
+        if(!journal->isOpen())
+            return 1; // Error messages already dealt with.
+
+        DirectoryWatcher watcher(resourceFileBlockSize, journal, numThreads,
+            std::chrono::milliseconds(500));
+        return watcher.run(watchDirectory) ? 0 : 1;
+    }
+
+    if(!duplicatesDirectory.empty())
+    {
+        if(!(maxBitErrorRate >= 0.0f && maxBitErrorRate < 0.5f))
+        {
+            Log::err << "Error: -threshold must be at least 0, and below 0.5, which " <<
+                "unrelated sounds reach." << std::endl;
+            return 1;
+        }
+
+        // The report goes to stdout.
+        Log::useStandardError();
+        DuplicateReport report(maxBitErrorRate);
+        return report.run(duplicatesDirectory, std::cout) ? 0 : 1;
+    }
+
     // Do errors:
     if(inputFile.empty())
     {
@@ -140,20 +311,147 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    if(toStandardOutput && ID < 0 && resourceName.empty())
+    {
+        Log::err << "Error: -stdout can only stream a single sound; specify it with " <<
+            "-ID or -name." << std::endl;
+        return 1;
+    }
+
+    if(toStandardOutput && !journalFile.empty())
+    {
+        Log::err << "Error: -journal cannot be used with -stdout." << std::endl;
+        return 1;
+    }
+
+    if(!archiveFile.empty() && (toStandardOutput || !journalFile.empty()))
+    {
+        Log::err << "Error: -archive cannot be used with -stdout or -journal; " <<
+            "use -archive - to stream the archive." << std::endl;
+        return 1;
+    }
+
+    if(buildSeekIndex && range.empty())
+    {
+        Log::err << "Error: -seek-index only applies with -range." << std::endl;
+        return 1;
+    }
+
+    // These modes write no files but the sound or archive.
+    if(buildSeekIndex && (toStandardOutput || !archiveFile.empty()))
+    {
+        Log::err << "Error: -seek-index cannot be used with -stdout or -archive." << std::endl;
+        return 1;
+    }
+
+    if((!range.empty() || resampleRate != 0 || !silenceThreshold.empty() ||
+        !normalizedPeak.empty() || downmix) && !journalFile.empty())
+    {
+        Log::err << "Error: -journal cannot be used with -range, -resample, -trim, " <<
+            "-normalize or -downmix." << std::endl;
+        return 1;
+    }
+
+    if(keepCompressed && rawPCM)
+    {
+        Log::err << "Error: -keep-compressed cannot be used with -raw." << std::endl;
+        return 1;
+    }
+
+    if(!outputFormat.empty() && outputFormat != "wav" && rawPCM)
+    {
+        Log::err << "Error: -format " << outputFormat << " cannot be used with -raw." <<
+            std::endl;
+        return 1;
+    }
+
+    if(keepCompressed && !outputFormat.empty() &&
+        (',' + outputFormat + ',').find(",wav,") == std::string::npos)
+    {
+        Log::err << "Error: -keep-compressed only applies to wav output." << std::endl;
+        return 1;
+    }
+
+    if(!sampleFormat.empty() && keepCompressed)
+    {
+        Log::err << "Error: -sample-format cannot be used with -keep-compressed." << std::endl;
+        return 1;
+    }
+
+    if(!sampleFormat.empty() && !outputFormat.empty() &&
+        (',' + outputFormat + ',').find(",wav,") == std::string::npos)
+    {
+        Log::err << "Error: -sample-format only applies to wav output." << std::endl;
+        return 1;
+    }
+
+    if(outputFormat.find(',') != std::string::npos &&
+        (toStandardOutput || !journalFile.empty()))
+    {
+        Log::err << "Error: -stdout and -journal can only be used with a single " <<
+            "output format." << std::endl;
+        return 1;
+    }
+
     // Do the fun part:
     SndToWAV sndToWAV(resourceFileBlockSize);
 
+    if(!range.empty() && !sndToWAV.setRange(range))
+        return 1; // Error messages already dealt with.
+
+    sndToWAV.setBuildSeekIndex(buildSeekIndex);
+
+    if(!sndToWAV.setOutputSampleRate(resampleRate))
+        return 1; // Error messages already dealt with.
+
+    if(!silenceThreshold.empty() && !sndToWAV.setSilenceThreshold(silenceThreshold))
+        return 1; // Error messages already dealt with.
+
+    if(!normalizedPeak.empty() && !sndToWAV.setNormalizedPeak(normalizedPeak))
+        return 1; // Error messages already dealt with.
+
+    sndToWAV.setDownmix(downmix);
+
+    if(!outputFormat.empty() && !sndToWAV.setOutputFormats(outputFormat))
+        return 1; // Error messages already dealt with.
+
+    sndToWAV.setKeepCompressed(keepCompressed);
+
+    if(!sampleFormat.empty() && !sndToWAV.setSampleFormat(sampleFormat))
+        return 1; // Error messages already dealt with.
+    sndToWAV.setNumEncoderThreads(numThreads);
+
+    if(!journalFile.empty() && !sndToWAV.useJournal(journalFile))
+        return 1; // Error messages already dealt with.
+
+    if(toStandardOutput || archiveFile == "-")
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY); // Do not translate newlines.
+#endif
+        if(toStandardOutput)
+            sndToWAV.useStandardOutput(rawPCM);
+    }
+
+    if(!archiveFile.empty() && !sndToWAV.useArchive(archiveFile))
+        return 1; // Error messages already dealt with.
+
+    bool success = false;
+
     if(ID > -1)
     {
         // ID was specified.
-        sndToWAV.extract(inputFile, ID);
+        success = sndToWAV.extract(inputFile, ID);
     } else if(!resourceName.empty())
     {
         // Name was specified.
-        sndToWAV.extract(inputFile, resourceName);
+        success = sndToWAV.extract(inputFile, resourceName);
     } else
     {
         // Nothing was specified, extract all!
-        sndToWAV.extract(inputFile);
+        success = sndToWAV.extract(inputFile);
     }
+
+    success &= sndToWAV.closeArchive();
+    return success ? 0 : 1;
 }
@@ -0,0 +1,88 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Test.hpp"
+#include "CpuFeatures.hpp"
+
+#include <string>
+
+static const CpuFeatures::KernelSet cKernelSets[] = {CpuFeatures::KernelSet::Scalar,
+    CpuFeatures::KernelSet::SSE, CpuFeatures::KernelSet::AVX2,
+    CpuFeatures::KernelSet::AVX512, CpuFeatures::KernelSet::NEON};
+
+static void testNames()
+{
+    for(CpuFeatures::KernelSet kernelSet : cKernelSets)
+    {
+        CpuFeatures::KernelSet parsed = CpuFeatures::KernelSet::Scalar;
+        CHECK(CpuFeatures::parseKernelSet(CpuFeatures::getKernelSetName(kernelSet), parsed));
+        CHECK(parsed == kernelSet);
+    }
+
+    CpuFeatures::KernelSet parsed = CpuFeatures::KernelSet::Scalar;
+    CHECK(!CpuFeatures::parseKernelSet("sse2", parsed));
+    CHECK(!CpuFeatures::parseKernelSet("", parsed));
+}
+
+// Until a set is forced, kernels use the best one.
+static void testBestKernelSet()
+{
+    CpuFeatures::KernelSet best = CpuFeatures::getBestKernelSet();
+    CHECK(CpuFeatures::isSupported(best));
+    CHECK(CpuFeatures::getKernelSet() == best);
+    CHECK(CpuFeatures::isSupported(CpuFeatures::KernelSet::Scalar));
+
+    // Each x86 set implies the previous ones.
+    CHECK(!CpuFeatures::isSupported(CpuFeatures::KernelSet::AVX512) ||
+        CpuFeatures::isSupported(CpuFeatures::KernelSet::AVX2));
+    CHECK(!CpuFeatures::isSupported(CpuFeatures::KernelSet::AVX2) ||
+        CpuFeatures::isSupported(CpuFeatures::KernelSet::SSE));
+}
+
+static void testForcedKernelSets()
+{
+    for(CpuFeatures::KernelSet kernelSet : cKernelSets)
+    {
+        CpuFeatures::KernelSet previous = CpuFeatures::getKernelSet();
+        if(!CpuFeatures::isSupported(kernelSet))
+        {
+            CHECK(!CpuFeatures::setKernelSet(kernelSet));
+            CHECK(CpuFeatures::getKernelSet() == previous);
+            continue;
+        }
+
+        CHECK(CpuFeatures::setKernelSet(kernelSet));
+        CHECK(CpuFeatures::getKernelSet() == kernelSet);
+
+        // AVX-512 CPUs use the AVX2 kernels.
+        bool isX86 = kernelSet == CpuFeatures::KernelSet::SSE ||
+            kernelSet == CpuFeatures::KernelSet::AVX2 ||
+            kernelSet == CpuFeatures::KernelSet::AVX512;
+        CHECK(CpuFeatures::useSSE() == isX86);
+        CHECK(CpuFeatures::useAVX2() == (isX86 && kernelSet != CpuFeatures::KernelSet::SSE));
+        CHECK(CpuFeatures::useNEON() == (kernelSet == CpuFeatures::KernelSet::NEON));
+    }
+}
+
+int main()
+{
+    testNames();
+    testBestKernelSet();
+    testForcedKernelSets();
+
+    return Test::finish();
+}
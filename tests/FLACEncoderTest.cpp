@@ -0,0 +1,415 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Test.hpp"
+#include "FLACEncoder.hpp"
+#include "SampleSink.hpp"
+#include "WorkerPool.hpp"
+
+#include <algorithm> // For std::min
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Reads big-endian bit fields, as FLAC stores them.
+    class BitReader
+    {
+    private:
+        const std::uint8_t* mData;
+        std::size_t mSize;
+        std::size_t mPosition = 0; // In bits.
+
+    public:
+        BitReader(const std::uint8_t* data, std::size_t size)
+            : mData(data),
+              mSize(size)
+        {
+
+        }
+
+        bool isValid() const
+        {
+            return mPosition <= 8*mSize;
+        }
+
+        // Bytes read so far, once aligned.
+        std::size_t getBytePosition() const
+        {
+            return mPosition/8;
+        }
+
+        std::uint32_t read(unsigned numBits)
+        {
+            std::uint32_t value = 0;
+            for(unsigned i = 0; i < numBits; ++i, ++mPosition)
+            {
+                std::uint32_t bit = mPosition < 8*mSize ?
+                    (mData[mPosition/8] >> (7 - mPosition%8)) & 1 : 0;
+                value = (value << 1) | bit;
+            }
+
+            return value;
+        }
+
+        std::int32_t readSigned(unsigned numBits)
+        {
+            std::uint32_t value = read(numBits);
+            if(numBits > 0 && numBits < 32 && (value >> (numBits - 1)) != 0)
+                value |= ~std::uint32_t(0) << numBits;
+
+            return static_cast<std::int32_t>(value);
+        }
+
+        std::int32_t readRice(unsigned parameter)
+        {
+            std::uint32_t quotient = 0;
+            while(isValid() && read(1) == 0)
+                ++quotient;
+
+            std::uint32_t folded = (quotient << parameter) | read(parameter);
+            return static_cast<std::int32_t>(folded >> 1) ^ -static_cast<std::int32_t>(folded & 1);
+        }
+
+        void alignToByte()
+        {
+            mPosition = (mPosition + 7)/8*8;
+        }
+    };
+
+    std::uint8_t crc8(const std::uint8_t* data, std::size_t size)
+    {
+        std::uint8_t crc = 0;
+        for(std::size_t i = 0; i < size; ++i)
+        {
+            crc ^= data[i];
+            for(unsigned bit = 0; bit < 8; ++bit)
+                crc = static_cast<std::uint8_t>((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+
+        return crc;
+    }
+
+    std::uint16_t crc16(const std::uint8_t* data, std::size_t size)
+    {
+        std::uint16_t crc = 0;
+        for(std::size_t i = 0; i < size; ++i)
+        {
+            crc ^= static_cast<std::uint16_t>(data[i] << 8);
+            for(unsigned bit = 0; bit < 8; ++bit)
+                crc = static_cast<std::uint16_t>((crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1);
+        }
+
+        return crc;
+    }
+
+    bool readResidual(BitReader& reader, std::size_t blockSize, unsigned order,
+        std::vector<std::int64_t>& samples)
+    {
+        unsigned method = reader.read(2);
+        unsigned partitionOrder = reader.read(4);
+        if(method > 1 || (blockSize >> partitionOrder) < order)
+            return false;
+
+        unsigned parameterBits = method == 0 ? 4 : 5;
+        unsigned escape = (1u << parameterBits) - 1;
+        std::size_t partitionSize = blockSize >> partitionOrder;
+        for(std::size_t partition = 0; partition < (std::size_t(1) << partitionOrder); ++partition)
+        {
+            unsigned parameter = reader.read(parameterBits);
+            unsigned rawBits = parameter == escape ? reader.read(5) : 0;
+
+            std::size_t count = partitionSize - (partition == 0 ? order : 0);
+            for(std::size_t i = 0; i < count; ++i)
+                samples.push_back(parameter == escape ? reader.readSigned(rawBits) :
+                    reader.readRice(parameter));
+        }
+
+        return reader.isValid();
+    }
+
+    // Decodes a subframe, the residual still to be predicted.
+    bool readSubframe(BitReader& reader, std::size_t blockSize, unsigned bitsPerSample,
+        std::vector<std::int64_t>& samples)
+    {
+        samples.clear();
+        if(reader.read(1) != 0)
+            return false;
+
+        unsigned type = reader.read(6);
+        if(reader.read(1) != 0) // Wasted bits, which the encoder never writes.
+            return false;
+
+        if(type == 0)
+        {
+            samples.assign(blockSize, reader.readSigned(bitsPerSample));
+            return true;
+        } else if(type == 1)
+        {
+            for(std::size_t i = 0; i < blockSize; ++i)
+                samples.push_back(reader.readSigned(bitsPerSample));
+            return true;
+        }
+
+        bool isLPC = type >= 32;
+        unsigned order = isLPC ? (type & 31) + 1 : type & 7;
+        if(!isLPC && (type < 8 || order > 4))
+            return false;
+
+        for(unsigned i = 0; i < order; ++i)
+            samples.push_back(reader.readSigned(bitsPerSample));
+
+        std::vector<std::int64_t> coefficients;
+        int shift = 0;
+        if(isLPC)
+        {
+            unsigned precision = reader.read(4) + 1;
+            shift = reader.readSigned(5);
+            for(unsigned i = 0; i < order; ++i)
+                coefficients.push_back(reader.readSigned(precision));
+            if(shift < 0)
+                return false;
+        } else
+        {
+            static const std::int64_t fixed[5][4] = {{0, 0, 0, 0}, {1, 0, 0, 0},
+                {2, -1, 0, 0}, {3, -3, 1, 0}, {4, -6, 4, -1}};
+            coefficients.assign(fixed[order], fixed[order] + order);
+        }
+
+        if(!readResidual(reader, blockSize, order, samples) || samples.size() != blockSize)
+            return false;
+
+        for(std::size_t i = order; i < blockSize; ++i)
+        {
+            std::int64_t prediction = 0;
+            for(unsigned j = 0; j < order; ++j)
+                prediction += coefficients[j] * samples[i - 1 - j];
+            samples[i] += prediction >> shift;
+        }
+
+        return true;
+    }
+
+    // Decodes the frames written by FLACEncoder, which only uses fixed-size
+    // blocks, and leaves the sample rate to STREAMINFO.
+    bool decodeFrames(const std::string& frames, std::size_t numChannels,
+        unsigned bitsPerSample, std::vector<std::int32_t>& samples)
+    {
+        const std::uint8_t* data = reinterpret_cast<const std::uint8_t*>(frames.data());
+        std::size_t offset = 0;
+        std::uint64_t frameNumber = 0;
+
+        while(offset < frames.size())
+        {
+            BitReader reader(data + offset, frames.size() - offset);
+            if(reader.read(14) != 0x3FFE || reader.read(2) != 0)
+                return false;
+
+            unsigned blockSizeCode = reader.read(4);
+            unsigned sampleRateCode = reader.read(4);
+            unsigned channelAssignment = reader.read(4);
+            unsigned sampleSizeCode = reader.read(3);
+            reader.read(1);
+
+            static const unsigned sampleSizes[8] = {0, 8, 0, 0, 16, 0, 24, 0};
+            if(sampleRateCode != 0 || sampleSizes[sampleSizeCode] != bitsPerSample)
+                return false;
+
+            // Frame number, in FLAC's UTF-8-like coding.
+            std::uint32_t first = reader.read(8);
+            std::uint64_t number = first;
+            unsigned numBytes = 0;
+            while(numBytes < 7 && (first & (0x80u >> numBytes)) != 0)
+                ++numBytes;
+            if(numBytes > 1)
+            {
+                number = first & ((1u << (7 - numBytes)) - 1);
+                for(unsigned i = 1; i < numBytes; ++i)
+                    number = (number << 6) | (reader.read(8) & 0x3F);
+            }
+            if(number != frameNumber++)
+                return false;
+
+            std::size_t blockSize = 0;
+            if(blockSizeCode == 12)
+                blockSize = FLACEncoder::cBlockSize;
+            else if(blockSizeCode == 6)
+                blockSize = reader.read(8) + 1;
+            else if(blockSizeCode == 7)
+                blockSize = reader.read(16) + 1;
+            else
+                return false;
+
+            std::size_t headerSize = reader.getBytePosition();
+            if(reader.read(8) != crc8(data + offset, headerSize))
+                return false;
+
+            bool isStereo = channelAssignment >= 8;
+            if(isStereo ? (channelAssignment > 10 || numChannels != 2) :
+                channelAssignment + 1 != numChannels)
+                return false;
+
+            std::vector<std::vector<std::int64_t>> channels(numChannels);
+            for(std::size_t channel = 0; channel < numChannels; ++channel)
+            {
+                // Side channels need one more bit.
+                bool isSide = (channelAssignment == 8 && channel == 1) ||
+                    (channelAssignment == 9 && channel == 0) ||
+                    (channelAssignment == 10 && channel == 1);
+                if(!readSubframe(reader, blockSize, bitsPerSample + (isSide ? 1 : 0),
+                    channels[channel]))
+                    return false;
+            }
+
+            reader.alignToByte();
+            std::size_t frameSize = reader.getBytePosition();
+            if(reader.read(16) != crc16(data + offset, frameSize) || !reader.isValid())
+                return false;
+
+            for(std::size_t i = 0; i < blockSize; ++i)
+            {
+                if(channelAssignment == 8) // Left, side.
+                {
+                    channels[1][i] = channels[0][i] - channels[1][i];
+                } else if(channelAssignment == 9) // Side, right.
+                {
+                    channels[0][i] += channels[1][i];
+                } else if(channelAssignment == 10) // Mid, side.
+                {
+                    std::int64_t mid = channels[0][i]*2 | (channels[1][i] & 1);
+                    std::int64_t side = channels[1][i];
+                    channels[0][i] = (mid + side) >> 1;
+                    channels[1][i] = (mid - side) >> 1;
+                }
+
+                for(std::size_t channel = 0; channel < numChannels; ++channel)
+                    samples.push_back(static_cast<std::int32_t>(channels[channel][i]));
+            }
+
+            offset += frameSize + 2;
+        }
+
+        return true;
+    }
+
+    // Tone, noise, silence and full-scale steps, so that every subframe type
+    // and stereo coding is used; channels are correlated.
+    std::vector<std::int32_t> makeSamples(std::size_t numFrames, std::size_t numChannels,
+        unsigned bitsPerSample)
+    {
+        const double maxSample = static_cast<double>((1 << (bitsPerSample - 1)) - 1);
+        std::vector<std::uint8_t> noise = Test::makeRandomBytes(numFrames*numChannels, 7);
+        std::vector<std::int32_t> samples;
+
+        for(std::size_t i = 0; i < numFrames; ++i)
+        {
+            std::size_t section = (i / (2*FLACEncoder::cBlockSize)) % 4;
+            for(std::size_t channel = 0; channel < numChannels; ++channel)
+            {
+                double value = 0;
+                if(section == 0)
+                {
+                    value = 0.5*std::sin(0.01*i*(channel + 1)) + 0.3*std::sin(0.037*i) +
+                        0.01*(noise[i*numChannels] - 128)/128.0;
+                } else if(section == 1)
+                {
+                    value = (noise[i*numChannels + channel] - 128)/128.0;
+                } else if(section == 3)
+                {
+                    value = (i/50 + channel) % 2 == 0 ? 1.0 : -1.0;
+                }
+
+                samples.push_back(static_cast<std::int32_t>(std::lround(value * maxSample)));
+            }
+        }
+
+        return samples;
+    }
+
+    // Little-endian; 8-bit samples are unsigned.
+    std::vector<std::uint8_t> toBytes(const std::vector<std::int32_t>& samples,
+        unsigned bitsPerSample)
+    {
+        std::vector<std::uint8_t> bytes;
+        for(std::int32_t sample : samples)
+        {
+            std::uint32_t bits = static_cast<std::uint32_t>(bitsPerSample == 8 ?
+                sample + 128 : sample);
+            for(unsigned byte = 0; byte < bitsPerSample/8; ++byte)
+                bytes.push_back(static_cast<std::uint8_t>(bits >> (8*byte)));
+        }
+
+        return bytes;
+    }
+}
+
+// Frames decode to the samples written, however they are split across
+// writes, and encoding in parallel gives the same frames.
+static void testRoundTrip(std::size_t numChannels, unsigned bitsPerSample,
+    std::size_t numFrames, WorkerPool* pool)
+{
+    std::vector<std::int32_t> samples = makeSamples(numFrames, numChannels, bitsPerSample);
+    std::vector<std::uint8_t> bytes = toBytes(samples, bitsPerSample);
+
+    std::ostringstream serialStream;
+    StreamSampleSink serialSink(serialStream);
+    FLACEncoder serialEncoder(serialSink, numChannels, bitsPerSample, nullptr);
+    CHECK(serialEncoder.write(bytes.data(), bytes.size()));
+    CHECK(serialEncoder.finish());
+
+    std::ostringstream stream;
+    StreamSampleSink sink(stream);
+    FLACEncoder encoder(sink, numChannels, bitsPerSample, pool);
+    for(std::size_t offset = 0; offset < bytes.size(); offset += 1001)
+    {
+        std::size_t size = std::min<std::size_t>(1001, bytes.size() - offset);
+        CHECK(encoder.write(bytes.data() + offset, size));
+    }
+    CHECK(encoder.finish());
+
+    CHECK(stream.str() == serialStream.str());
+
+    std::vector<std::int32_t> decoded;
+    CHECK(decodeFrames(stream.str(), numChannels, bitsPerSample, decoded));
+    CHECK(decoded == samples);
+
+    // Uncompressible noise still fits in the verbatim size.
+    CHECK(encoder.getMaxFrameSize() <=
+        FLACEncoder::cBlockSize*numChannels*(bitsPerSample + 1)/8 + 32);
+}
+
+int main()
+{
+    WorkerPool pool(4);
+
+    // Whole blocks, a short last block, and one under 256 samples.
+    for(std::size_t numFrames : {std::size_t(8*FLACEncoder::cBlockSize), std::size_t(40000),
+        std::size_t(100)})
+    {
+        for(std::size_t numChannels : {1, 2, 3})
+        {
+            for(unsigned bitsPerSample : {8, 16, 24})
+                testRoundTrip(numChannels, bitsPerSample, numFrames, &pool);
+        }
+    }
+
+    return Test::finish();
+}
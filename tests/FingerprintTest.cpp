@@ -0,0 +1,298 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Test.hpp"
+#include "Fingerprinter.hpp"
+#include "FingerprintMatcher.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const double cPi = 3.14159265358979323846;
+    const double cMaxBitErrorRate = 0.2; // The default of -threshold.
+
+    using Signal = std::vector<double>; // Mono, at Fingerprinter::cSampleRate.
+
+    double getTime(std::size_t i)
+    {
+        return static_cast<double>(i) / Fingerprinter::cSampleRate;
+    }
+
+    // Harmonics of a vibrato, with a syllable-like envelope.
+    Signal makeVoice(double seconds)
+    {
+        Signal signal(static_cast<std::size_t>(seconds * Fingerprinter::cSampleRate));
+        double phase = 0;
+        for(std::size_t i = 0; i < signal.size(); ++i)
+        {
+            double t = getTime(i);
+            phase += 2*cPi*(140 + 30*std::sin(2*cPi*3*t)) / Fingerprinter::cSampleRate;
+
+            double value = 0;
+            for(int harmonic = 1; harmonic < 15; ++harmonic)
+                value += std::sin(harmonic*phase) / harmonic
+                    * (1 + std::sin(2*cPi*(0.7 + 0.13*harmonic)*t));
+            signal[i] = 0.25*value*(0.6 + 0.4*std::sin(2*cPi*4*t));
+        }
+
+        return signal;
+    }
+
+    // A sweep from startFrequency, changing by slope Hz per second, with a
+    // 3 Hz envelope; slope 0 gives a tone.
+    Signal makeSweep(double seconds, double startFrequency, double slope)
+    {
+        Signal signal(static_cast<std::size_t>(seconds * Fingerprinter::cSampleRate));
+        for(std::size_t i = 0; i < signal.size(); ++i)
+        {
+            double t = getTime(i);
+            signal[i] = 0.5*std::sin(2*cPi*(startFrequency*t + 0.5*slope*t*t)) *
+                (0.6 + 0.4*std::sin(2*cPi*3*t));
+        }
+
+        return signal;
+    }
+
+    Signal makeNoise(double seconds, std::uint32_t seed)
+    {
+        std::vector<std::uint8_t> bytes = Test::makeRandomBytes(
+            static_cast<std::size_t>(seconds * Fingerprinter::cSampleRate), seed);
+
+        Signal signal;
+        for(std::uint8_t byte : bytes)
+            signal.push_back((byte - 127.5) / 256.0);
+        return signal;
+    }
+
+    Signal addNoise(const Signal& signal, double level)
+    {
+        double duration = static_cast<double>(signal.size()) / Fingerprinter::cSampleRate;
+        Signal noise = makeNoise(duration, 99);
+        Signal noisy = signal;
+        for(std::size_t i = 0; i < noisy.size() && i < noise.size(); ++i)
+            noisy[i] += level * noise[i];
+        return noisy;
+    }
+
+    Signal scale(const Signal& signal, double gain)
+    {
+        Signal scaled = signal;
+        for(double& value : scaled)
+            value *= gain;
+        return scaled;
+    }
+
+    Signal pad(const Signal& signal, std::size_t numLeading, std::size_t numTrailing)
+    {
+        Signal padded(numLeading, 0.0);
+        padded.insert(padded.end(), signal.begin(), signal.end());
+        padded.resize(padded.size() + numTrailing, 0.0);
+        return padded;
+    }
+
+    // Little-endian 16-bit or unsigned 8-bit PCM; other channels get the
+    // same samples, at lower levels.
+    std::vector<std::uint8_t> toBytes(const Signal& signal, std::size_t numChannels,
+        unsigned bitsPerSample)
+    {
+        std::vector<std::uint8_t> bytes;
+        for(double value : signal)
+        {
+            for(std::size_t channel = 0; channel < numChannels; ++channel)
+            {
+                double sample = std::max(-1.0, std::min(1.0, value * (1.0 - 0.2*channel)));
+                if(bitsPerSample == 8)
+                {
+                    bytes.push_back(static_cast<std::uint8_t>(std::lround(128 + 127*sample)));
+                } else
+                {
+                    std::uint16_t bits = static_cast<std::uint16_t>(
+                        static_cast<std::int16_t>(std::lround(32767*sample)));
+                    bytes.push_back(static_cast<std::uint8_t>(bits & 0xFF));
+                    bytes.push_back(static_cast<std::uint8_t>(bits >> 8));
+                }
+            }
+        }
+
+        return bytes;
+    }
+
+    // Returns its index in the matcher.
+    std::size_t addFingerprint(FingerprintMatcher& matcher, const Signal& signal,
+        std::size_t numChannels = 1, unsigned bitsPerSample = 16)
+    {
+        std::vector<std::uint8_t> bytes = toBytes(signal, numChannels, bitsPerSample);
+        Fingerprinter fingerprinter(numChannels, bitsPerSample);
+
+        // In odd sizes, so that frames are split across writes.
+        for(std::size_t offset = 0; offset < bytes.size(); offset += 999)
+        {
+            fingerprinter.write(bytes.data() + offset,
+                std::min<std::size_t>(999, bytes.size() - offset));
+        }
+        fingerprinter.finish();
+
+        matcher.add(fingerprinter.getSubFingerprints(), fingerprinter.getMasks());
+        return matcher.getNumFingerprints() - 1;
+    }
+}
+
+// Bits valid in both count if they differ, and bits valid in only one count
+// half.
+static void testBitErrorRates()
+{
+    const std::size_t size = 40;
+    std::vector<std::uint32_t> ones(size, 0xFFFFFFFFU);
+    std::vector<std::uint32_t> zeros(size, 0);
+    std::vector<std::uint32_t> lowHalf(size, 0x0000FFFFU);
+    std::vector<std::uint32_t> highHalf(size, 0xFFFF0000U);
+
+    FingerprintMatcher matcher;
+    matcher.add(ones, ones);
+    matcher.add(zeros, ones); // Differs on every bit.
+    matcher.add(lowHalf, lowHalf);
+    matcher.add(zeros, highHalf); // Valid where the previous one is not.
+    matcher.add(zeros, zeros); // No valid bits.
+    matcher.add(ones, std::vector<std::uint32_t>(size, 0x00FFFFFFU));
+
+    CHECK(matcher.compare(0, 0) == 0.0);
+    CHECK(matcher.compare(0, 1) == 1.0);
+    CHECK(matcher.compare(2, 3) == 0.5);
+    CHECK(matcher.compare(0, 4) == 0.5);
+    CHECK(matcher.compare(4, 4) == 1.0); // Nothing to compare.
+    CHECK(matcher.compare(0, 5) == 0.125); // 8 bits valid in only one, of 32.
+
+    // Too short, and too different in size.
+    FingerprintMatcher shortMatcher;
+    shortMatcher.add(std::vector<std::uint32_t>(4, 0), std::vector<std::uint32_t>(4, 1));
+    shortMatcher.add(std::vector<std::uint32_t>(4, 0), std::vector<std::uint32_t>(4, 1));
+    shortMatcher.add(zeros, ones);
+    CHECK(shortMatcher.compare(0, 1) == 1.0);
+    CHECK(shortMatcher.compare(0, 2) == 1.0);
+}
+
+// The vector kernels must count exactly the bits of the scalar ones, at
+// every alignment; sizes are odd, so that kernels' tails are covered.
+static void testKernelSets()
+{
+    std::vector<std::vector<std::uint32_t>> subFingerprints;
+    std::vector<std::vector<std::uint32_t>> masks;
+    std::uint32_t seed = 1;
+    for(std::size_t size : {8, 9, 15, 16, 17, 33, 100, 101, 103, 120})
+    {
+        for(std::vector<std::vector<std::uint32_t>>* values : {&subFingerprints, &masks})
+        {
+            std::vector<std::uint8_t> bytes = Test::makeRandomBytes(4*size, seed++);
+            values->push_back(std::vector<std::uint32_t>(size));
+            for(std::size_t i = 0; i < 4*size; ++i)
+                values->back()[i/4] |= static_cast<std::uint32_t>(bytes[i]) << (8*(i%4));
+        }
+
+        // Silent and partly valid sub-fingerprints.
+        masks.back()[size/2] = 0;
+        masks.back()[size/3] &= 0x0000FFFFU;
+        subFingerprints.back()[size/3] &= masks.back()[size/3];
+    }
+
+    std::vector<double> expected;
+    for(CpuFeatures::KernelSet kernelSet : Test::getKernelSets())
+    {
+        CHECK(CpuFeatures::setKernelSet(kernelSet));
+
+        // Kernels are bound when matchers are made.
+        FingerprintMatcher matcher;
+        for(std::size_t i = 0; i < subFingerprints.size(); ++i)
+            matcher.add(subFingerprints[i], masks[i]);
+
+        std::vector<double> bitErrorRates;
+        for(std::size_t first = 0; first < matcher.getNumFingerprints(); ++first)
+        {
+            for(std::size_t second = 0; second < matcher.getNumFingerprints(); ++second)
+                bitErrorRates.push_back(matcher.compare(first, second));
+        }
+
+        if(kernelSet == CpuFeatures::KernelSet::Scalar)
+            expected = bitErrorRates;
+        else
+            CHECK(bitErrorRates == expected);
+    }
+}
+
+// Copies of a sound match it, whatever their level, sample size, number of
+// channels, padding, or added noise; different sounds, tonal ones included,
+// do not.
+static void testPairs()
+{
+    std::vector<Signal> sounds = {makeVoice(1.2), makeSweep(1.0, 440, 0),
+        makeSweep(1.0, 1000, 0), makeSweep(1.0, 300, 600), makeSweep(1.0, 1500, -600),
+        makeNoise(1.0, 5)};
+
+    FingerprintMatcher matcher;
+    std::vector<std::vector<std::size_t>> copies; // Of each sound, itself first.
+    for(const Signal& sound : sounds)
+    {
+        copies.push_back({addFingerprint(matcher, sound),
+            addFingerprint(matcher, sound, 1, 8),
+            addFingerprint(matcher, sound, 2, 16),
+            addFingerprint(matcher, scale(sound, 0.3)),
+            addFingerprint(matcher, pad(sound, 700, 300)),
+            addFingerprint(matcher, addNoise(sound, 0.03))});
+    }
+
+    for(std::size_t sound = 0; sound < sounds.size(); ++sound)
+    {
+        for(std::size_t copy = 1; copy < copies[sound].size(); ++copy)
+        {
+            double bitErrorRate = matcher.compare(copies[sound][0], copies[sound][copy]);
+            if(!CHECK(bitErrorRate <= cMaxBitErrorRate))
+                std::cerr << "Sound " << sound << ", copy " << copy << ": " << bitErrorRate
+                    << std::endl;
+        }
+
+        for(std::size_t other = sound + 1; other < sounds.size(); ++other)
+        {
+            double bitErrorRate = matcher.compare(copies[sound][0], copies[other][0]);
+            if(!CHECK(bitErrorRate >= 0.3))
+                std::cerr << "Sounds " << sound << " and " << other << ": " << bitErrorRate
+                    << std::endl;
+        }
+    }
+
+    // One cluster per sound, holding its copies.
+    std::vector<FingerprintMatcher::Cluster> clusters = matcher.findClusters(cMaxBitErrorRate);
+    if(CHECK(clusters.size() == sounds.size()))
+    {
+        for(std::size_t sound = 0; sound < sounds.size(); ++sound)
+            CHECK(clusters[sound].fingerprints == copies[sound]);
+    }
+}
+
+int main()
+{
+    testBitErrorRates();
+    testKernelSets();
+    testPairs();
+
+    return Test::finish();
+}
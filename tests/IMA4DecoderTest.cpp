@@ -0,0 +1,103 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Test.hpp"
+#include "IMA4Decoder.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Random packets, with step indices in the table, as encoders write them.
+static std::vector<std::uint8_t> makePackets(std::size_t numPackets, std::uint32_t seed)
+{
+    std::vector<std::uint8_t> packets = Test::makeRandomBytes(numPackets*IMA4_PACKET_LENGTH,
+        seed);
+    for(std::size_t packet = 0; packet < numPackets; ++packet)
+    {
+        std::uint8_t& stepIndex = packets[packet*IMA4_PACKET_LENGTH + 1];
+        stepIndex = static_cast<std::uint8_t>((stepIndex & 0x80) | (stepIndex % 89));
+    }
+
+    return packets;
+}
+
+// Apple QuickTime IMA ADPCM, as in FFmpeg's adpcm_ima_qt_expand_nibble().
+static std::vector<std::uint8_t> decodeReference(const std::vector<std::uint8_t>& packets,
+    std::size_t numChannels)
+{
+    std::vector<std::uint8_t> samples(packets.size() / IMA4_PACKET_LENGTH *
+        IMA4_SAMPLES_PER_PACKET * 2);
+
+    for(std::size_t packet = 0; packet < packets.size() / IMA4_PACKET_LENGTH; ++packet)
+    {
+        const std::uint8_t* in = &packets[packet*IMA4_PACKET_LENGTH];
+        int predictor = static_cast<std::int16_t>((in[0] << 8 | in[1]) & 0xFF80);
+        int stepIndex = in[1] & 0x7F;
+
+        std::size_t first = (packet / numChannels)*IMA4_SAMPLES_PER_PACKET*numChannels +
+            packet % numChannels;
+        for(std::size_t i = 0; i < IMA4_SAMPLES_PER_PACKET; ++i)
+        {
+            unsigned nibble = (in[2 + i/2] >> (4*(i % 2))) & 0x0F;
+            int diff = (2*static_cast<int>(nibble & 7) + 1)*gIMAStepTable[stepIndex] >> 3;
+            predictor += (nibble & 8) ? -diff : diff;
+            predictor = std::min(std::max(predictor, -32768), 32767);
+            stepIndex = std::min(std::max(stepIndex + gIMAIndexTable[nibble], 0), 88);
+
+            std::size_t sample = first + i*numChannels;
+            samples[2*sample] = static_cast<std::uint8_t>(predictor & 0xFF);
+            samples[2*sample + 1] = static_cast<std::uint8_t>((predictor >> 8) & 0xFF);
+        }
+    }
+
+    return samples;
+}
+
+// Kernels decode packets four or eight at a time, so every count up to a few
+// blocks is checked, and one spanning several chunks.
+static void testChannels(std::size_t numChannels)
+{
+    std::vector<std::size_t> numFrames = {3001};
+    for(std::size_t count = 0; count <= 20; ++count)
+        numFrames.push_back(count);
+
+    for(std::size_t frames : numFrames)
+    {
+        std::vector<std::uint8_t> packets = makePackets(frames*numChannels,
+            static_cast<std::uint32_t>(frames + 1));
+
+        // Kernels are bound when decoders are specialized, so each input gets
+        // its own.
+        IMA4Decoder decoder;
+        CHECK(decoder.decode(packets, numChannels));
+        CHECK(decoder.getLittleEndianData() == decodeReference(packets, numChannels));
+    }
+}
+
+int main()
+{
+    for(CpuFeatures::KernelSet kernelSet : Test::getKernelSets())
+    {
+        CHECK(CpuFeatures::setKernelSet(kernelSet));
+        testChannels(1);
+        testChannels(2);
+    }
+
+    return Test::finish();
+}
@@ -0,0 +1,216 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Test.hpp"
+#include "IMAADPCMEncoder.hpp"
+#include "IMA4Decoder.hpp" // For the IMA ADPCM tables
+#include "SampleSink.hpp"
+
+#include <algorithm> // For std::min and std::max
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <cstdlib> // For std::abs
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const double cPi = 3.14159265358979323846;
+
+    // A sine mix, with some noise, per channel.
+    std::vector<std::int16_t> makeSamples(std::size_t numFrames, std::size_t numChannels)
+    {
+        std::vector<std::uint8_t> noise = Test::makeRandomBytes(numFrames*numChannels, 7);
+        std::vector<std::int16_t> samples(numFrames*numChannels);
+        for(std::size_t i = 0; i < samples.size(); ++i)
+        {
+            double t = static_cast<double>(i / numChannels) / 22050;
+            double frequency = 220.0*static_cast<double>(1 + i % numChannels);
+            double value = 9000*std::sin(2*cPi*frequency*t) +
+                4000*std::sin(2*cPi*3.1*frequency*t) + 4*(noise[i] - 128);
+            samples[i] = static_cast<std::int16_t>(std::lround(value));
+        }
+
+        return samples;
+    }
+
+    // Writes samples little-endian, in odd sizes, so that samples are split
+    // across writes.
+    std::string encode(const std::vector<std::int16_t>& samples, std::size_t numChannels,
+        std::size_t samplesPerBlock)
+    {
+        std::vector<std::uint8_t> bytes;
+        for(std::int16_t sample : samples)
+        {
+            std::uint16_t unsignedSample = static_cast<std::uint16_t>(sample);
+            bytes.push_back(static_cast<std::uint8_t>(unsignedSample & 0xFF));
+            bytes.push_back(static_cast<std::uint8_t>(unsignedSample >> 8));
+        }
+
+        std::ostringstream stream;
+        StreamSampleSink sink(stream);
+        IMAADPCMEncoder encoder(sink, numChannels, samplesPerBlock);
+        for(std::size_t offset = 0; offset < bytes.size(); offset += 777)
+        {
+            CHECK(encoder.write(bytes.data() + offset,
+                std::min<std::size_t>(777, bytes.size() - offset)));
+        }
+
+        CHECK(encoder.finish());
+        return stream.str();
+    }
+
+    // WAV IMA ADPCM, as in FFmpeg's adpcm_ima_expand_nibble().
+    std::vector<std::int16_t> decode(const std::string& blocks, std::size_t numChannels,
+        std::size_t samplesPerBlock)
+    {
+        std::size_t blockAlign = IMAADPCMEncoder::getBlockAlign(numChannels, samplesPerBlock);
+        std::vector<std::int16_t> samples;
+
+        for(std::size_t offset = 0; offset + blockAlign <= blocks.size(); offset += blockAlign)
+        {
+            const std::uint8_t* block = reinterpret_cast<const std::uint8_t*>(&blocks[offset]);
+            std::size_t first = samples.size();
+            samples.resize(first + samplesPerBlock*numChannels);
+
+            for(std::size_t channel = 0; channel < numChannels; ++channel)
+            {
+                const std::uint8_t* header = block + 4*channel;
+                int predictor = static_cast<std::int16_t>(header[0] | header[1] << 8);
+                int stepIndex = std::min<int>(header[2], 88);
+                samples[first + channel] = static_cast<std::int16_t>(predictor);
+
+                for(std::size_t i = 1; i < samplesPerBlock; ++i)
+                {
+                    std::size_t group = (i - 1) / 8;
+                    std::size_t position = (i - 1) % 8;
+                    std::uint8_t byte = block[4*numChannels +
+                        (group*numChannels + channel)*4 + position/2];
+                    unsigned nibble = (byte >> (4*(position % 2))) & 0x0F;
+
+                    int step = gIMAStepTable[stepIndex];
+                    int diff = step >> 3;
+                    if(nibble & 4) diff += step;
+                    if(nibble & 2) diff += step >> 1;
+                    if(nibble & 1) diff += step >> 2;
+                    predictor += (nibble & 8) ? -diff : diff;
+                    predictor = std::min(std::max(predictor, -32768), 32767);
+                    stepIndex = std::min(std::max(stepIndex + gIMAIndexTable[nibble], 0), 88);
+
+                    samples[first + i*numChannels + channel] = static_cast<std::int16_t>(predictor);
+                }
+            }
+        }
+
+        return samples;
+    }
+}
+
+static void testBlockAlign()
+{
+    CHECK(IMAADPCMEncoder::getBlockAlign(1, 505) == 256);
+    CHECK(IMAADPCMEncoder::getBlockAlign(2, 505) == 512);
+    CHECK(IMAADPCMEncoder::getBlockAlign(2, 9) == 16);
+
+    CHECK(IMAADPCMEncoder::getEncodedSize(1, 505, 0) == 0);
+    CHECK(IMAADPCMEncoder::getEncodedSize(1, 505, 1) == 256);
+    CHECK(IMAADPCMEncoder::getEncodedSize(1, 505, 505) == 256);
+    CHECK(IMAADPCMEncoder::getEncodedSize(2, 505, 506) == 1024);
+}
+
+// Blocks must have the announced size, start on their exact sample, and
+// decode close to the samples; padding repeats the last frame.
+static void testRoundTrip(std::size_t numChannels, std::size_t samplesPerBlock)
+{
+    for(std::size_t numFrames : {std::size_t(0), std::size_t(1), samplesPerBlock - 1,
+        samplesPerBlock, samplesPerBlock + 1, 3*samplesPerBlock + 7, std::size_t(20000)})
+    {
+        std::vector<std::int16_t> samples = makeSamples(numFrames, numChannels);
+        std::string blocks = encode(samples, numChannels, samplesPerBlock);
+        if(!CHECK(blocks.size() == IMAADPCMEncoder::getEncodedSize(numChannels,
+            samplesPerBlock, numFrames)))
+            continue;
+
+        std::vector<std::int16_t> decoded = decode(blocks, numChannels, samplesPerBlock);
+        std::size_t numBlocks = (numFrames + samplesPerBlock - 1) / samplesPerBlock;
+        if(!CHECK(decoded.size() == numBlocks*samplesPerBlock*numChannels))
+            continue;
+
+        double squaredError = 0;
+        double squaredSignal = 0;
+        bool startsMatch = true;
+        for(std::size_t i = 0; i < samples.size(); ++i)
+        {
+            double error = static_cast<double>(decoded[i]) - samples[i];
+            squaredError += error*error;
+            squaredSignal += static_cast<double>(samples[i])*samples[i];
+
+            if((i / numChannels) % samplesPerBlock == 0)
+                startsMatch = startsMatch && decoded[i] == samples[i];
+        }
+
+        CHECK(startsMatch);
+        // The step size takes some samples to adapt, so this is only checked
+        // over a long sound: at least 30 dB of SNR.
+        if(numFrames == 20000)
+            CHECK(squaredError < squaredSignal / 1000);
+    }
+
+    // Silence stays exactly silent.
+    std::vector<std::int16_t> silence(3*samplesPerBlock*numChannels);
+    CHECK(decode(encode(silence, numChannels, samplesPerBlock), numChannels,
+        samplesPerBlock) == silence);
+}
+
+// Full-scale square waves make the predictor clamp.
+static void testClamping()
+{
+    std::vector<std::int16_t> samples(4*505);
+    for(std::size_t i = 0; i < samples.size(); ++i)
+        samples[i] = (i / 50) % 2 ? 32767 : -32768;
+
+    std::vector<std::int16_t> decoded = decode(encode(samples, 1, 505), 1, 505);
+    if(!CHECK(decoded.size() == samples.size()))
+        return;
+
+    // The step size shrinks along flat halves, and grows back at each edge,
+    // which is reached within a dozen samples; the predictor then stays near
+    // the rail, clamped on one side.
+    int maxError = 0;
+    for(std::size_t i = 0; i < samples.size(); ++i)
+    {
+        if(i % 50 >= 12)
+            maxError = std::max(maxError, std::abs(decoded[i] - samples[i]));
+    }
+
+    CHECK(maxError <= 4096);
+}
+
+int main()
+{
+    testBlockAlign();
+    for(std::size_t numChannels = 1; numChannels <= 2; ++numChannels)
+    {
+        testRoundTrip(numChannels, 505);
+        testRoundTrip(numChannels, 9);
+    }
+    testClamping();
+
+    return Test::finish();
+}
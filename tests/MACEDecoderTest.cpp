@@ -0,0 +1,136 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Test.hpp"
+#include "MACEDecoder.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Hashes of the samples which the original MACE 3:1 decoder, ported from
+// FFmpeg, decodes from 3000 packets of Test::makeRandomBytes() with seeds
+// 1, 2 and 3.
+static const std::uint64_t cMACE3Hashes[] = {0xb994689cd13b9c53ULL, 0x3788e95e5e05de6fULL,
+    0x89faab8b4f01de7fULL};
+
+// Same for MACE 6:1, from a straight port of FFmpeg's decoder, with one byte
+// per packet instead of two.
+static const std::uint64_t cMACE6Hashes[] = {0x0f781e91c384e76fULL, 0x3e70374d6701d7e3ULL,
+    0x9e21dad4ee99ff77ULL};
+
+static const std::size_t cNumPackets = 3000;
+
+static bool decode(MACEDecoder& decoder, const std::vector<std::uint8_t>& data,
+    std::size_t numChannels, std::vector<std::uint8_t>& samples)
+{
+    decoder.setSink(nullptr); // Drops samples of the previous sound.
+    decoder.specialize(numChannels);
+    if(!decoder.decode(data, numChannels))
+        return false;
+
+    samples = decoder.getLittleEndianData();
+    return true;
+}
+
+static void testMACE3()
+{
+    for(std::uint32_t seed = 1; seed <= 3; ++seed)
+    {
+        MACE3Decoder decoder;
+        std::vector<std::uint8_t> samples;
+        CHECK(decode(decoder, Test::makeRandomBytes(2*cNumPackets, seed), 1, samples));
+        CHECK(samples.size() == 6*2*cNumPackets);
+        CHECK(Test::hashBytes(samples) == cMACE3Hashes[seed - 1]);
+    }
+}
+
+static void testMACE6()
+{
+    for(std::uint32_t seed = 1; seed <= 3; ++seed)
+    {
+        MACE6Decoder decoder;
+        std::vector<std::uint8_t> samples;
+        CHECK(decode(decoder, Test::makeRandomBytes(cNumPackets, seed), 1, samples));
+        CHECK(samples.size() == 6*2*cNumPackets);
+        CHECK(Test::hashBytes(samples) == cMACE6Hashes[seed - 1]);
+    }
+}
+
+// Channel c of a sound with several channels must decode as the sound of
+// its packets alone. Kernels are specialized for 1 and 2 channels, and 3
+// channels use the generic kernel; the same decoder is specialized again for
+// each count.
+static void testChannels(MACEDecoder& decoder, std::size_t bytesPerPacket,
+    const std::uint64_t* hashes)
+{
+    for(std::size_t numChannels : {2, 3, 1, 2})
+    {
+        std::vector<std::vector<std::uint8_t>> channels;
+        for(std::size_t channel = 0; channel < numChannels; ++channel)
+        {
+            channels.push_back(Test::makeRandomBytes(bytesPerPacket*cNumPackets,
+                static_cast<std::uint32_t>(channel + 1)));
+        }
+
+        // Packet frames hold a packet of each channel, in order.
+        std::vector<std::uint8_t> data;
+        for(std::size_t packet = 0; packet < cNumPackets; ++packet)
+        {
+            for(const std::vector<std::uint8_t>& channel : channels)
+            {
+                data.insert(data.end(), channel.begin() + packet*bytesPerPacket,
+                    channel.begin() + (packet + 1)*bytesPerPacket);
+            }
+        }
+
+        // Samples of every channel, each 2 bytes, interleaved.
+        std::vector<std::uint8_t> samples;
+        CHECK(decode(decoder, data, numChannels, samples));
+        if(!CHECK(samples.size() == numChannels*6*2*cNumPackets))
+            continue;
+
+        for(std::size_t channel = 0; channel < numChannels; ++channel)
+        {
+            std::vector<std::uint8_t> channelSamples;
+            for(std::size_t i = channel*2; i < samples.size(); i += numChannels*2)
+            {
+                channelSamples.insert(channelSamples.end(), samples.begin() + i,
+                    samples.begin() + i + 2);
+            }
+
+            CHECK(Test::hashBytes(channelSamples) == hashes[channel]);
+        }
+    }
+}
+
+int main()
+{
+    for(CpuFeatures::KernelSet kernelSet : Test::getKernelSets())
+    {
+        CHECK(CpuFeatures::setKernelSet(kernelSet));
+        testMACE3();
+        testMACE6();
+
+        MACE3Decoder mace3Decoder;
+        testChannels(mace3Decoder, 2, cMACE3Hashes);
+        MACE6Decoder mace6Decoder;
+        testChannels(mace6Decoder, 1, cMACE6Hashes);
+    }
+
+    return Test::finish();
+}
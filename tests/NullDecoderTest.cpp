@@ -0,0 +1,77 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Test.hpp"
+#include "NullDecoder.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Checks every size up to a few vectors, so that kernels' tails are covered,
+// and a sound of several chunks. 24-bit samples straddle vectors.
+static void testDecoder(unsigned bitsPerSample)
+{
+    const std::size_t bytesPerSample = bitsPerSample/8;
+
+    std::vector<std::size_t> sizes; // In samples.
+    for(std::size_t size = 0; size <= 70; ++size)
+        sizes.push_back(size);
+    sizes.push_back(100003);
+
+    for(std::size_t size : sizes)
+    {
+        std::vector<std::uint8_t> data = Test::makeRandomBytes(size * bytesPerSample,
+            static_cast<std::uint32_t>(size + bitsPerSample));
+
+        // Kernels are bound when decoders are made.
+        NullDecoder decoder(bitsPerSample);
+        CHECK(decoder.decode(data, 1));
+
+        const std::vector<std::uint8_t>& samples = decoder.getLittleEndianData();
+        if(!CHECK(samples.size() == data.size()))
+            continue;
+
+        bool matches = true;
+        for(std::size_t i = 0; i < size; ++i)
+        {
+            for(std::size_t byte = 0; byte < bytesPerSample; ++byte)
+            {
+                matches = matches && samples[i*bytesPerSample + byte] ==
+                    data[i*bytesPerSample + bytesPerSample - 1 - byte];
+            }
+        }
+
+        CHECK(matches);
+    }
+}
+
+int main()
+{
+    for(CpuFeatures::KernelSet kernelSet : Test::getKernelSets())
+    {
+        CHECK(CpuFeatures::setKernelSet(kernelSet));
+        for(unsigned bitsPerSample : {8, 16, 24, 32})
+            testDecoder(bitsPerSample);
+    }
+
+    // Whole samples only.
+    NullDecoder decoder(24);
+    CHECK(!decoder.decode(Test::makeRandomBytes(7, 1), 1));
+
+    return Test::finish();
+}
@@ -0,0 +1,194 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Test.hpp"
+#include "PostProcessor.hpp"
+
+#include <algorithm> // For std::max
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib> // For std::abs
+#include <vector>
+
+namespace
+{
+    struct Sound
+    {
+        std::vector<std::uint8_t> samples;
+        std::size_t numChannels;
+        unsigned bitsPerSample;
+        std::size_t numLeadingFrames; // Silent.
+        std::size_t numSoundFrames; // Starting and ending with a loud sample.
+    };
+
+    // Noise between silence, which for 16-bit samples is quiet noise.
+    Sound makeSound(std::size_t numChannels, unsigned bitsPerSample, std::size_t numSoundFrames,
+        std::uint32_t seed)
+    {
+        const std::size_t bytesPerSample = bitsPerSample/8;
+        Sound sound = {{}, numChannels, bitsPerSample, 301, numSoundFrames};
+        std::size_t numFrames = sound.numLeadingFrames + numSoundFrames + 157;
+        std::vector<std::uint8_t> noise = Test::makeRandomBytes(
+            numFrames*numChannels*bytesPerSample, seed);
+
+        for(std::size_t frame = 0; frame < numFrames; ++frame)
+        {
+            bool isSound = frame >= sound.numLeadingFrames &&
+                frame < sound.numLeadingFrames + numSoundFrames;
+            bool isEdge = frame == sound.numLeadingFrames ||
+                frame + 1 == sound.numLeadingFrames + numSoundFrames;
+
+            for(std::size_t channel = 0; channel < numChannels; ++channel)
+            {
+                const std::uint8_t* random = &noise[(frame*numChannels + channel)*bytesPerSample];
+                if(bitsPerSample == 8)
+                {
+                    std::uint8_t sample = isSound ? random[0] : 128;
+                    if(isEdge && channel == 0)
+                        sample = 0; // Full scale, below the centre.
+                    sound.samples.push_back(sample);
+                } else
+                {
+                    // Within 16 of 0 when silent, under -60 dBFS.
+                    std::uint8_t low = isSound ? random[0] : random[0] % 33;
+                    std::uint8_t high = isSound ? random[1] : 0;
+                    if(!isSound && low > 16)
+                    {
+                        low = static_cast<std::uint8_t>(low - 33);
+                        high = 0xFF;
+                    }
+                    if(isEdge && channel == 0)
+                    {
+                        low = 0xFF; // 32767.
+                        high = 0x7F;
+                    }
+
+                    sound.samples.push_back(low);
+                    sound.samples.push_back(high);
+                }
+            }
+        }
+
+        return sound;
+    }
+
+    unsigned getPeak(const std::vector<std::uint8_t>& samples, unsigned bitsPerSample)
+    {
+        unsigned peak = 0;
+        for(std::size_t i = 0; i < samples.size(); i += bitsPerSample/8)
+        {
+            int sample = bitsPerSample == 8 ? samples[i] - 128 :
+                static_cast<std::int16_t>(samples[i] | (samples[i + 1] << 8));
+            peak = std::max(peak, static_cast<unsigned>(std::abs(sample)));
+        }
+
+        return peak;
+    }
+}
+
+// The vector kernels must give exactly the samples of the scalar ones.
+static void testKernelSets(const Sound& sound, const PostProcessor::Options& options)
+{
+    std::vector<std::uint8_t> expected;
+    std::size_t expectedChannels = 0;
+
+    for(CpuFeatures::KernelSet kernelSet : Test::getKernelSets())
+    {
+        CHECK(CpuFeatures::setKernelSet(kernelSet));
+
+        // Kernels are bound when post-processors are made.
+        PostProcessor postProcessor(options, sound.bitsPerSample);
+        std::vector<std::uint8_t> samples = sound.samples;
+        std::size_t numChannels = sound.numChannels;
+        postProcessor.process(samples, numChannels);
+
+        if(kernelSet == CpuFeatures::KernelSet::Scalar)
+        {
+            expected = samples;
+            expectedChannels = numChannels;
+        } else
+        {
+            CHECK(samples == expected);
+            CHECK(numChannels == expectedChannels);
+        }
+    }
+}
+
+static void testSound(const Sound& sound)
+{
+    const std::size_t bytesPerSample = sound.bitsPerSample/8;
+
+    PostProcessor::Options trim;
+    trim.trimSilence = true;
+
+    PostProcessor::Options downmix;
+    downmix.downmix = true;
+
+    PostProcessor::Options normalize;
+    normalize.normalize = true;
+    normalize.peakLevel = -6.0;
+
+    PostProcessor::Options all = trim;
+    all.downmix = true;
+    all.normalize = true;
+
+    for(const PostProcessor::Options& options : {trim, downmix, normalize, all})
+        testKernelSets(sound, options);
+
+    // Trimming keeps the sound between its first and last loud samples.
+    std::vector<std::uint8_t> samples = sound.samples;
+    std::size_t numChannels = sound.numChannels;
+    PostProcessor(trim, sound.bitsPerSample).process(samples, numChannels);
+
+    const std::size_t frameSize = sound.numChannels*bytesPerSample;
+    CHECK(samples == std::vector<std::uint8_t>(
+        sound.samples.begin() + sound.numLeadingFrames*frameSize,
+        sound.samples.begin() + (sound.numLeadingFrames + sound.numSoundFrames)*frameSize));
+
+    // Downmixing leaves one channel.
+    samples = sound.samples;
+    numChannels = sound.numChannels;
+    PostProcessor(downmix, sound.bitsPerSample).process(samples, numChannels);
+    CHECK(numChannels == 1);
+    CHECK(samples.size() == sound.samples.size() / sound.numChannels);
+
+    // Normalizing to -6 dBFS scales the peak to half of full scale.
+    samples = sound.samples;
+    numChannels = sound.numChannels;
+    PostProcessor(normalize, sound.bitsPerSample).process(samples, numChannels);
+    const double halfScale = (sound.bitsPerSample == 8 ? 127 : 32767) * 0.501187;
+    double peak = static_cast<double>(getPeak(samples, sound.bitsPerSample));
+    CHECK(peak >= halfScale - 1.0 && peak <= halfScale + 1.0);
+}
+
+int main()
+{
+    // Odd sizes, so that kernels' tails are covered.
+    for(unsigned bitsPerSample : {8, 16})
+    {
+        for(std::size_t numChannels : {1, 2, 3})
+        {
+            for(std::size_t numSoundFrames : {2, 37, 10007})
+            {
+                testSound(makeSound(numChannels, bitsPerSample, numSoundFrames,
+                    static_cast<std::uint32_t>(numSoundFrames + numChannels)));
+            }
+        }
+    }
+
+    return Test::finish();
+}
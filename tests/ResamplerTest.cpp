@@ -0,0 +1,187 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Test.hpp"
+#include "Resampler.hpp"
+#include "SampleSink.hpp"
+
+#include <algorithm> // For std::min
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <cstdlib> // For std::abs
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const double cPi = 3.14159265358979323846;
+    const std::uint32_t cInputRate = 0x56EE8BA3; // 22254.5454 Hz, the usual Mac rate.
+
+    // 16-bit little-endian stereo: a sine on the left channel, and noise at
+    // a lower level on the right one.
+    std::vector<std::uint8_t> makeSamples(std::size_t numFrames, double frequency)
+    {
+        std::vector<std::uint8_t> noise = Test::makeRandomBytes(numFrames, 3);
+        std::vector<std::uint8_t> bytes;
+        for(std::size_t frame = 0; frame < numFrames; ++frame)
+        {
+            double t = frame / (cInputRate / 65536.0);
+            std::int16_t samples[2] = {
+                static_cast<std::int16_t>(std::lround(16000*std::sin(2*cPi*frequency*t))),
+                static_cast<std::int16_t>(64*(noise[frame] - 128))};
+
+            for(std::int16_t sample : samples)
+            {
+                bytes.push_back(static_cast<std::uint8_t>(sample & 0xFF));
+                bytes.push_back(static_cast<std::uint8_t>(static_cast<std::uint16_t>(sample) >> 8));
+            }
+        }
+
+        return bytes;
+    }
+
+    std::string resample(const std::vector<std::uint8_t>& bytes, std::uint32_t outputRate,
+        std::size_t writeSize)
+    {
+        std::ostringstream stream;
+        StreamSampleSink sink(stream);
+        Resampler resampler(sink, 2, 16, cInputRate, outputRate);
+
+        for(std::size_t offset = 0; offset < bytes.size(); offset += writeSize)
+        {
+            CHECK(resampler.write(bytes.data() + offset,
+                std::min(writeSize, bytes.size() - offset)));
+        }
+
+        CHECK(resampler.finish());
+        return stream.str();
+    }
+
+    std::int16_t getSample(const std::string& bytes, std::size_t frame, std::size_t channel)
+    {
+        std::size_t i = 4*frame + 2*channel;
+        return static_cast<std::int16_t>(static_cast<std::uint8_t>(bytes[i]) |
+            static_cast<std::uint8_t>(bytes[i + 1]) << 8);
+    }
+}
+
+// Every input frame count gives as many output frames as announced, however
+// the input is split; splits land inside frames and samples.
+static void testFrameCounts()
+{
+    for(std::uint32_t outputRate : {44100U << 16, 48000U << 16, 11025U << 16, 8000U << 16})
+    {
+        for(std::size_t numFrames : {std::size_t(0), std::size_t(1), std::size_t(37),
+            std::size_t(1000), std::size_t(2*22254 + 17)})
+        {
+            std::vector<std::uint8_t> bytes = makeSamples(numFrames, 1000);
+            std::string output = resample(bytes, outputRate, bytes.size() + 1);
+            CHECK(output.size() ==
+                4*Resampler::getNumOutputFrames(numFrames, cInputRate, outputRate));
+
+            for(std::size_t writeSize : {std::size_t(1), std::size_t(3), std::size_t(4093)})
+                CHECK(resample(bytes, outputRate, writeSize) == output);
+        }
+    }
+}
+
+// Kernel sets only sum taps in another order, so samples may round
+// differently, by 1 at most.
+static void testKernelSets()
+{
+    std::vector<std::uint8_t> bytes = makeSamples(3*22254 + 5, 1000);
+    for(std::uint32_t outputRate : {44100U << 16, 11025U << 16})
+    {
+        std::string expected;
+        for(CpuFeatures::KernelSet kernelSet : Test::getKernelSets())
+        {
+            // Kernels are bound when resamplers are made.
+            CHECK(CpuFeatures::setKernelSet(kernelSet));
+            std::string output = resample(bytes, outputRate, 4096);
+
+            if(kernelSet == CpuFeatures::KernelSet::Scalar)
+            {
+                expected = output;
+                continue;
+            }
+
+            if(!CHECK(output.size() == expected.size()))
+                continue;
+
+            int maxDifference = 0;
+            for(std::size_t frame = 0; frame < output.size()/4; ++frame)
+            {
+                for(std::size_t channel = 0; channel < 2; ++channel)
+                {
+                    maxDifference = std::max(maxDifference, std::abs(
+                        getSample(output, frame, channel) - getSample(expected, frame, channel)));
+                }
+            }
+
+            CHECK(maxDifference <= 1);
+        }
+    }
+}
+
+// A 1 kHz sine comes out as a 1 kHz sine of the same amplitude, once the
+// filters are past the edges of the sound: what is left once the best
+// fitting 1 kHz sine is subtracted is noise, 70 dB below it.
+static void testSine()
+{
+    for(std::uint32_t outputRate : {44100U << 16, 8000U << 16})
+    {
+        std::string output = resample(makeSamples(2*22254, 1000), outputRate, 4096);
+        double rate = outputRate / 65536.0;
+        std::size_t first = static_cast<std::size_t>(rate / 10);
+        std::size_t end = output.size()/4 - first;
+
+        double sineSum = 0, cosineSum = 0;
+        for(std::size_t frame = first; frame < end; ++frame)
+        {
+            double phase = 2*cPi*1000*frame/rate;
+            sineSum += getSample(output, frame, 0)*std::sin(phase);
+            cosineSum += getSample(output, frame, 0)*std::cos(phase);
+        }
+
+        double a = 2*sineSum/(end - first);
+        double b = 2*cosineSum/(end - first);
+        CHECK(std::abs(std::sqrt(a*a + b*b) - 16000) < 16000*0.002);
+
+        double residualSum = 0;
+        for(std::size_t frame = first; frame < end; ++frame)
+        {
+            double phase = 2*cPi*1000*frame/rate;
+            double residual = getSample(output, frame, 0) - a*std::sin(phase) -
+                b*std::cos(phase);
+            residualSum += residual*residual;
+        }
+
+        double residualRMS = std::sqrt(residualSum/(end - first));
+        CHECK(residualRMS < 16000/std::sqrt(2.0)*std::pow(10.0, -70.0/20));
+    }
+}
+
+int main()
+{
+    testFrameCounts();
+    testKernelSets();
+    testSine();
+
+    return Test::finish();
+}
@@ -0,0 +1,293 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Test.hpp"
+#include "SampleAnalyzer.hpp"
+
+#include <algorithm> // For std::min and std::max
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    const double cPi = 3.14159265358979323846;
+    const double cSampleRate = 48000;
+
+    // Interleaved samples, as signed integers of bitsPerSample bits.
+    struct Sound
+    {
+        std::vector<std::int32_t> samples;
+        std::size_t numChannels;
+        unsigned bitsPerSample;
+    };
+
+    // A sine of the same level on every channel.
+    Sound makeSine(std::size_t numFrames, std::size_t numChannels, unsigned bitsPerSample,
+        double frequency, double decibels)
+    {
+        Sound sound = {std::vector<std::int32_t>(numFrames*numChannels), numChannels,
+            bitsPerSample};
+        double fullScale = std::ldexp(1.0, static_cast<int>(bitsPerSample) - 1);
+        double amplitude = std::pow(10.0, decibels/20)*fullScale;
+
+        for(std::size_t i = 0; i < sound.samples.size(); ++i)
+        {
+            double t = static_cast<double>(i / numChannels) / cSampleRate;
+            sound.samples[i] = static_cast<std::int32_t>(std::lround(
+                amplitude*std::sin(2*cPi*frequency*t)));
+        }
+
+        return sound;
+    }
+
+    Sound makeNoise(std::size_t numFrames, std::size_t numChannels, unsigned bitsPerSample,
+        std::uint32_t seed)
+    {
+        Sound sound = {std::vector<std::int32_t>(numFrames*numChannels), numChannels,
+            bitsPerSample};
+        std::vector<std::uint8_t> noise = Test::makeRandomBytes(4*sound.samples.size(), seed);
+
+        for(std::size_t i = 0; i < sound.samples.size(); ++i)
+        {
+            std::uint32_t bits = static_cast<std::uint32_t>(noise[4*i]) |
+                static_cast<std::uint32_t>(noise[4*i + 1]) << 8 |
+                static_cast<std::uint32_t>(noise[4*i + 2]) << 16 |
+                static_cast<std::uint32_t>(noise[4*i + 3]) << 24;
+            sound.samples[i] = static_cast<std::int32_t>(bits) >> (32 - bitsPerSample);
+        }
+
+        return sound;
+    }
+
+    // Little-endian, and unsigned for 8-bit samples.
+    std::vector<std::uint8_t> toBytes(const Sound& sound)
+    {
+        std::vector<std::uint8_t> bytes;
+        for(std::int32_t sample : sound.samples)
+        {
+            if(sound.bitsPerSample == 8)
+                sample += 128;
+
+            for(unsigned byte = 0; byte < sound.bitsPerSample/8; ++byte)
+                bytes.push_back(static_cast<std::uint8_t>(static_cast<std::uint32_t>(sample) >>
+                    (8*byte)));
+        }
+
+        return bytes;
+    }
+
+    float toFullScale(std::int32_t sample, unsigned bitsPerSample)
+    {
+        return static_cast<float>(sample) /
+            static_cast<float>(std::uint32_t(1) << (bitsPerSample - 1));
+    }
+
+    // Writes in pieces of writeSize bytes, which may split samples.
+    std::unique_ptr<SampleAnalyzer> analyze(const Sound& sound, std::size_t writeSize)
+    {
+        std::unique_ptr<SampleAnalyzer> analyzer(new SampleAnalyzer(sound.numChannels,
+            sound.bitsPerSample, cSampleRate));
+        std::vector<std::uint8_t> bytes = toBytes(sound);
+
+        for(std::size_t offset = 0; offset < bytes.size(); offset += writeSize)
+        {
+            CHECK(analyzer->write(bytes.data() + offset,
+                std::min(writeSize, bytes.size() - offset)));
+        }
+
+        analyzer->finish();
+        return analyzer;
+    }
+
+    bool isClose(double value, double expected, double tolerance)
+    {
+        return std::abs(value - expected) <= tolerance;
+    }
+}
+
+// A stereo 997 Hz sine at -20 dBFS is -20 LUFS, as in EBU Tech 3341; quieter
+// parts more than 10 LU below are gated out, and loudness is unknown for
+// silence and sounds shorter than a 400 ms block.
+static void testLoudness()
+{
+    Sound sine = makeSine(5*48000, 2, 16, 997, -20);
+    std::unique_ptr<SampleAnalyzer> analyzer = analyze(sine, 4096);
+    CHECK(isClose(analyzer->getIntegratedLoudness(), -20, 0.05));
+
+    Sound quiet = makeSine(5*48000, 2, 16, 997, -50);
+    sine.samples.insert(sine.samples.end(), quiet.samples.begin(), quiet.samples.end());
+    analyzer = analyze(sine, 4096);
+    CHECK(isClose(analyzer->getIntegratedLoudness(), -20, 0.2)); // Blocks over both count.
+
+    Sound mono = makeSine(5*48000, 1, 24, 997, -20);
+    analyzer = analyze(mono, 4096);
+    CHECK(isClose(analyzer->getIntegratedLoudness(), -23.01, 0.05)); // One channel less.
+
+    Sound silence = {std::vector<std::int32_t>(2*48000*2), 2, 16};
+    CHECK(std::isnan(analyze(silence, 4096)->getIntegratedLoudness()));
+
+    Sound brief = makeSine(48000*39/100, 2, 16, 997, -20);
+    CHECK(std::isnan(analyze(brief, 4096)->getIntegratedLoudness()));
+}
+
+// Peak and RMS levels of a sine are its amplitude, and the amplitude over
+// the square root of 2.
+static void testLevels()
+{
+    for(unsigned bitsPerSample : {8U, 16U, 24U, 32U})
+    {
+        Sound sine = makeSine(48000 + 77, 2, bitsPerSample, 1000, -6);
+        std::unique_ptr<SampleAnalyzer> analyzer = analyze(sine, 4096);
+        double amplitude = std::pow(10.0, -6.0/20);
+        // Within a quantization step, or float precision; a second of sine
+        // is not a whole number of periods, which barely changes its RMS.
+        double step = std::max(std::ldexp(1.0, 1 - static_cast<int>(bitsPerSample)), 1e-6);
+
+        CHECK(analyzer->getNumFrames() == 48000 + 77);
+        for(std::size_t channel = 0; channel < 2; ++channel)
+        {
+            CHECK(isClose(analyzer->getPeak(channel), amplitude, step));
+            CHECK(isClose(analyzer->getRMS(channel), amplitude/std::sqrt(2.0), step + 1e-4));
+        }
+        CHECK(isClose(analyzer->getRMS(), amplitude/std::sqrt(2.0), step + 1e-4));
+    }
+
+    // 8-bit samples are unsigned, centred on 128.
+    Sound centre = {std::vector<std::int32_t>(1000), 1, 8};
+    centre.samples.back() = 127;
+    std::unique_ptr<SampleAnalyzer> analyzer = analyze(centre, 4096);
+    CHECK(analyzer->getPeak(0) == 127.0f/128);
+    CHECK(isClose(analyzer->getRMS(0), 127.0/128/std::sqrt(1000.0), 1e-6));
+}
+
+// Each peak of each level holds the minimum and maximum of its frames, with a
+// shorter last peak, and each level has half as many peaks as the previous one.
+static void testPeakLevels()
+{
+    for(std::size_t numFrames : {std::size_t(1), std::size_t(255), std::size_t(256),
+        std::size_t(257), std::size_t(100000)})
+    {
+        Sound noise = makeNoise(numFrames, 3, 16, static_cast<std::uint32_t>(numFrames));
+        std::unique_ptr<SampleAnalyzer> analyzer = analyze(noise, 1001);
+        const std::vector<SampleAnalyzer::PeakLevel>& levels = analyzer->getPeakLevels();
+
+        std::size_t numPeaks = (numFrames + SampleAnalyzer::cFramesPerPeak - 1) /
+            SampleAnalyzer::cFramesPerPeak;
+        std::size_t expectedNumLevels = 1;
+        for(std::size_t peaks = numPeaks; peaks > 1 &&
+            expectedNumLevels < SampleAnalyzer::cMaxNumPeakLevels; peaks = (peaks + 1)/2)
+            ++expectedNumLevels;
+        CHECK(levels.size() == expectedNumLevels);
+
+        std::size_t framesPerPeak = SampleAnalyzer::cFramesPerPeak;
+        for(const SampleAnalyzer::PeakLevel& level : levels)
+        {
+            CHECK(level.framesPerPeak == framesPerPeak);
+            std::size_t expectedNumPeaks = (numFrames + framesPerPeak - 1) / framesPerPeak;
+            if(!CHECK(level.minimums.size() == 3*expectedNumPeaks &&
+                level.maximums.size() == 3*expectedNumPeaks))
+                break;
+
+            bool matches = true;
+            for(std::size_t peak = 0; peak < expectedNumPeaks; ++peak)
+            {
+                for(std::size_t channel = 0; channel < 3; ++channel)
+                {
+                    float minimum = 1, maximum = -1;
+                    for(std::size_t frame = peak*framesPerPeak;
+                        frame < std::min(numFrames, (peak + 1)*framesPerPeak); ++frame)
+                    {
+                        float sample = toFullScale(noise.samples[3*frame + channel], 16);
+                        minimum = std::min(minimum, sample);
+                        maximum = std::max(maximum, sample);
+                    }
+
+                    matches = matches && level.minimums[3*peak + channel] == minimum &&
+                        level.maximums[3*peak + channel] == maximum;
+                }
+            }
+
+            CHECK(matches);
+            framesPerPeak *= 2;
+        }
+    }
+}
+
+// Kernel sets and write sizes only change how squares are summed, so RMS
+// levels may differ in their last bits; everything else is identical.
+static void testKernelSets()
+{
+    for(std::size_t numFrames : {std::size_t(3), std::size_t(250), std::size_t(48000*2 + 13)})
+    {
+        Sound noise = makeNoise(numFrames, 2, 24, 11);
+        std::unique_ptr<SampleAnalyzer> expected;
+
+        for(CpuFeatures::KernelSet kernelSet : Test::getKernelSets())
+        {
+            CHECK(CpuFeatures::setKernelSet(kernelSet));
+
+            for(std::size_t writeSize : {std::size_t(5), std::size_t(4096)})
+            {
+                // Kernels are bound when analyzers are made.
+                std::unique_ptr<SampleAnalyzer> analyzer = analyze(noise, writeSize);
+                if(expected == nullptr)
+                {
+                    expected = std::move(analyzer);
+                    continue;
+                }
+
+                const std::vector<SampleAnalyzer::PeakLevel>& levels = analyzer->getPeakLevels();
+                const std::vector<SampleAnalyzer::PeakLevel>& expectedLevels =
+                    expected->getPeakLevels();
+                bool levelsMatch = levels.size() == expectedLevels.size();
+                for(std::size_t i = 0; levelsMatch && i < levels.size(); ++i)
+                {
+                    levelsMatch = levels[i].framesPerPeak == expectedLevels[i].framesPerPeak &&
+                        levels[i].minimums == expectedLevels[i].minimums &&
+                        levels[i].maximums == expectedLevels[i].maximums;
+                }
+
+                CHECK(levelsMatch);
+                CHECK(analyzer->getNumFrames() == expected->getNumFrames());
+                for(std::size_t channel = 0; channel < 2; ++channel)
+                {
+                    CHECK(analyzer->getPeak(channel) == expected->getPeak(channel));
+                    CHECK(isClose(analyzer->getRMS(channel), expected->getRMS(channel),
+                        1e-6*expected->getRMS(channel)));
+                }
+
+                double loudness = analyzer->getIntegratedLoudness();
+                double expectedLoudness = expected->getIntegratedLoudness();
+                CHECK(loudness == expectedLoudness ||
+                    (std::isnan(loudness) && std::isnan(expectedLoudness)));
+            }
+        }
+    }
+}
+
+int main()
+{
+    testLoudness();
+    testLevels();
+    testPeakLevels();
+    testKernelSets();
+
+    return Test::finish();
+}
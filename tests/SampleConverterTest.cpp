@@ -0,0 +1,239 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Test.hpp"
+#include "SampleConverter.hpp"
+#include "SampleSink.hpp"
+
+#include <algorithm> // For std::min and std::max
+#include <cstdint>
+#include <cstddef>
+#include <cstring> // For std::memcpy
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Writes in pieces of writeSize bytes, which may split samples.
+    std::string convert(const std::vector<std::uint8_t>& bytes, unsigned bitsPerSample,
+        SampleConverter::Format format, std::size_t writeSize)
+    {
+        std::ostringstream stream;
+        StreamSampleSink sink(stream);
+        SampleConverter converter(sink, bitsPerSample, format);
+
+        for(std::size_t offset = 0; offset < bytes.size(); offset += writeSize)
+        {
+            CHECK(converter.write(bytes.data() + offset,
+                std::min(writeSize, bytes.size() - offset)));
+        }
+
+        return stream.str();
+    }
+
+    std::int32_t loadSample(const std::uint8_t* bytes, unsigned bitsPerSample)
+    {
+        if(bitsPerSample == 8)
+            return static_cast<std::int32_t>(bytes[0]) - 128; // Unsigned.
+
+        std::uint32_t bits = 0;
+        for(unsigned byte = 0; byte < bitsPerSample/8; ++byte)
+            bits |= static_cast<std::uint32_t>(bytes[byte]) << (8*byte);
+
+        return static_cast<std::int32_t>(bits << (32 - bitsPerSample)) >> (32 - bitsPerSample);
+    }
+
+    // Floats are exact for 8 to 24-bit samples; 32-bit ones round to 24 bits
+    // of mantissa. Int24 samples of 32-bit ones round to nearest, clipping.
+    std::string convertReference(const std::vector<std::uint8_t>& bytes, unsigned bitsPerSample,
+        SampleConverter::Format format)
+    {
+        std::string output;
+        for(std::size_t i = 0; i + bitsPerSample/8 <= bytes.size(); i += bitsPerSample/8)
+        {
+            std::int32_t sample = loadSample(&bytes[i], bitsPerSample);
+            std::uint32_t bits;
+
+            if(format == SampleConverter::Format::Float32)
+            {
+                float value = static_cast<float>(sample) /
+                    static_cast<float>(std::uint32_t(1) << (bitsPerSample - 1));
+                std::memcpy(&bits, &value, sizeof(bits));
+            } else if(bitsPerSample == 32)
+            {
+                std::int64_t rounded = (static_cast<std::int64_t>(sample) + 128) >> 8;
+                bits = static_cast<std::uint32_t>(std::min<std::int64_t>(rounded, 0x7FFFFF));
+            } else
+            {
+                bits = static_cast<std::uint32_t>(sample) << (24 - bitsPerSample);
+            }
+
+            for(unsigned byte = 0; byte < SampleConverter::getBitsPerSample(format)/8; ++byte)
+                output += static_cast<char>(bits >> (8*byte));
+        }
+
+        return output;
+    }
+
+    std::vector<std::uint8_t> toBytes(const std::vector<std::uint32_t>& samples,
+        unsigned bitsPerSample)
+    {
+        std::vector<std::uint8_t> bytes;
+        for(std::uint32_t sample : samples)
+        {
+            for(unsigned byte = 0; byte < bitsPerSample/8; ++byte)
+                bytes.push_back(static_cast<std::uint8_t>(sample >> (8*byte)));
+        }
+
+        return bytes;
+    }
+}
+
+// Vector kernels convert 8 or 16 samples at a time, so every count up to a
+// few vectors is checked; each kernel set must match the scalar kernels.
+static void testKernelSets()
+{
+    for(unsigned bitsPerSample : {8U, 16U, 24U, 32U})
+    {
+        for(SampleConverter::Format format : {SampleConverter::Format::Int24,
+            SampleConverter::Format::Float32})
+        {
+            std::vector<std::size_t> sizes = {1001};
+            for(std::size_t numSamples = 0; numSamples <= 40; ++numSamples)
+                sizes.push_back(numSamples);
+
+            for(std::size_t numSamples : sizes)
+            {
+                std::vector<std::uint8_t> bytes = Test::makeRandomBytes(
+                    numSamples*bitsPerSample/8, static_cast<std::uint32_t>(numSamples + 1));
+                std::string expected = convertReference(bytes, bitsPerSample, format);
+                std::string scalar;
+
+                for(CpuFeatures::KernelSet kernelSet : Test::getKernelSets())
+                {
+                    // Kernels are bound when converters are made.
+                    CHECK(CpuFeatures::setKernelSet(kernelSet));
+                    std::string output = convert(bytes, bitsPerSample, format, 4096);
+                    if(kernelSet == CpuFeatures::KernelSet::Scalar)
+                        scalar = output;
+
+                    CHECK(output == expected);
+                    CHECK(output == scalar);
+                }
+            }
+        }
+    }
+}
+
+// Samples split across writes convert as if written at once.
+static void testSplitWrites()
+{
+    for(unsigned bitsPerSample : {8U, 16U, 24U, 32U})
+    {
+        std::vector<std::uint8_t> bytes = Test::makeRandomBytes(300*bitsPerSample/8, 5);
+        for(SampleConverter::Format format : {SampleConverter::Format::Int24,
+            SampleConverter::Format::Float32})
+        {
+            std::string expected = convert(bytes, bitsPerSample, format, bytes.size());
+            for(std::size_t writeSize : {std::size_t(1), std::size_t(3), std::size_t(7),
+                std::size_t(37)})
+                CHECK(convert(bytes, bitsPerSample, format, writeSize) == expected);
+        }
+    }
+}
+
+static float toFloat(const std::string& output, std::size_t i)
+{
+    std::uint32_t bits = 0;
+    for(unsigned byte = 0; byte < 4; ++byte)
+    {
+        bits |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(output[4*i + byte])) <<
+            (8*byte);
+    }
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static std::int32_t toInt24(const std::string& output, std::size_t i)
+{
+    std::uint32_t bits = 0;
+    for(unsigned byte = 0; byte < 3; ++byte)
+    {
+        bits |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(output[3*i + byte])) <<
+            (8*byte);
+    }
+
+    return static_cast<std::int32_t>(bits << 8) >> 8;
+}
+
+// 8-bit samples are unsigned, centred on 128, in the vector kernels' blocks
+// and in their tails.
+static void testCentring()
+{
+    std::vector<std::uint32_t> samples(35);
+    for(std::size_t i = 0; i < samples.size(); ++i)
+        samples[i] = i % 3 == 0 ? 128 : (i % 3 == 1 ? 0 : 255);
+
+    for(CpuFeatures::KernelSet kernelSet : Test::getKernelSets())
+    {
+        CHECK(CpuFeatures::setKernelSet(kernelSet));
+        std::string floats = convert(toBytes(samples, 8), 8, SampleConverter::Format::Float32,
+            4096);
+        std::string ints = convert(toBytes(samples, 8), 8, SampleConverter::Format::Int24, 4096);
+
+        bool matches = true;
+        for(std::size_t i = 0; i < samples.size(); ++i)
+        {
+            float expected = i % 3 == 0 ? 0.0f : (i % 3 == 1 ? -1.0f : 127.0f/128);
+            std::int32_t expectedInt = i % 3 == 0 ? 0 : (i % 3 == 1 ? -0x800000 : 0x7F0000);
+            matches = matches && toFloat(floats, i) == expected &&
+                toInt24(ints, i) == expectedInt;
+        }
+
+        CHECK(matches);
+    }
+}
+
+// 32-bit samples round to the nearest 24-bit one, halves upwards, and those
+// which would round past full scale clip.
+static void testRounding()
+{
+    std::vector<std::uint32_t> samples = {0x7FFFFF80, 0x7FFFFF7F, 0x7FFFFFFF, 0x80000000,
+        0x0000007F, 0x00000080, 0xFFFFFF80, 0xFFFFFF7F, 0x12345680};
+    std::vector<std::int32_t> expected = {0x7FFFFF, 0x7FFFFF, 0x7FFFFF, -0x800000,
+        0, 1, 0, -1, 0x123457};
+
+    std::string output = convert(toBytes(samples, 32), 32, SampleConverter::Format::Int24, 4096);
+    if(!CHECK(output.size() == 3*samples.size()))
+        return;
+
+    for(std::size_t i = 0; i < samples.size(); ++i)
+        CHECK(toInt24(output, i) == expected[i]);
+}
+
+int main()
+{
+    testKernelSets();
+    testSplitWrites();
+    testCentring();
+    testRounding();
+
+    return Test::finish();
+}
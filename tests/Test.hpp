@@ -0,0 +1,106 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TEST_HPP
+#define TEST_HPP
+
+#include "CpuFeatures.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+// Checks for the tests, which are plain executables run by CTest: a failed
+// check is reported, and makes finish() return 1, for main() to return.
+#define CHECK(condition) Test::check((condition), #condition, __FILE__, __LINE__)
+
+namespace Test
+{
+    inline unsigned& getNumFailures()
+    {
+        static unsigned numFailures = 0;
+        return numFailures;
+    }
+
+    inline bool check(bool condition, const char* expression, const char* file, int line)
+    {
+        if(!condition)
+        {
+            std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+            ++getNumFailures();
+        }
+
+        return condition;
+    }
+
+    inline int finish()
+    {
+        if(getNumFailures() == 0)
+            return 0;
+
+        std::cerr << getNumFailures() << " check(s) failed." << std::endl;
+        return 1;
+    }
+
+    // Kernel sets the CPU supports, scalar first, to run the same checks
+    // with each of them; see CpuFeatures::setKernelSet().
+    inline std::vector<CpuFeatures::KernelSet> getKernelSets()
+    {
+        std::vector<CpuFeatures::KernelSet> kernelSets;
+        for(CpuFeatures::KernelSet kernelSet : {CpuFeatures::KernelSet::Scalar,
+            CpuFeatures::KernelSet::SSE, CpuFeatures::KernelSet::AVX2,
+            CpuFeatures::KernelSet::AVX512, CpuFeatures::KernelSet::NEON})
+        {
+            if(CpuFeatures::isSupported(kernelSet))
+                kernelSets.push_back(kernelSet);
+        }
+
+        return kernelSets;
+    }
+
+    // Same bytes on every platform (xorshift32), so hashes of what they
+    // decode to can be pinned.
+    inline std::vector<std::uint8_t> makeRandomBytes(std::size_t size, std::uint32_t seed)
+    {
+        std::vector<std::uint8_t> bytes(size);
+        for(std::uint8_t& byte : bytes)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            byte = static_cast<std::uint8_t>(seed >> 24);
+        }
+
+        return bytes;
+    }
+
+    // FNV-1a.
+    inline std::uint64_t hashBytes(const std::vector<std::uint8_t>& bytes)
+    {
+        std::uint64_t hash = 0xcbf29ce484222325ULL;
+        for(std::uint8_t byte : bytes)
+        {
+            hash ^= byte;
+            hash *= 0x100000001b3ULL;
+        }
+
+        return hash;
+    }
+}
+
+#endif // TEST_HPP
@@ -0,0 +1,91 @@
+// Copyright 2020 Carl Hewett
+//
+// This file is part of SndToWAV.
+//
+// SndToWAV is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// SndToWAV is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SndToWAV. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Test.hpp"
+#include "XLawDecoder.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// G.711 expansions, as in FFmpeg's pcm_tablegen.h.
+static int alaw_to_linear(std::uint8_t value)
+{
+    value ^= 0x55;
+    int magnitude = value & 0x0F;
+    int segment = (value & 0x70) >> 4;
+    if(segment > 0)
+        magnitude = (2*magnitude + 1 + 32) << (segment + 2);
+    else
+        magnitude = (2*magnitude + 1) << 3;
+
+    return (value & 0x80) ? magnitude : -magnitude;
+}
+
+static int ulaw_to_linear(std::uint8_t value)
+{
+    value = static_cast<std::uint8_t>(~value);
+    int magnitude = (((value & 0x0F) << 3) + 0x84) << ((value & 0x70) >> 4);
+    return (value & 0x80) ? (0x84 - magnitude) : (magnitude - 0x84);
+}
+
+// Checks every size up to a few vectors, so that kernels' tails are covered.
+// Kernels are bound when decoders are made, so each input gets its own.
+template<typename DecoderType>
+static void testDecoder(int (*toLinear)(std::uint8_t))
+{
+    std::vector<std::uint8_t> allBytes(256);
+    for(std::size_t i = 0; i < allBytes.size(); ++i)
+        allBytes[i] = static_cast<std::uint8_t>(i);
+
+    std::vector<std::vector<std::uint8_t>> inputs = {allBytes,
+        Test::makeRandomBytes(100000, 1)};
+    for(std::size_t size = 0; size <= 70; ++size)
+        inputs.push_back(Test::makeRandomBytes(size, static_cast<std::uint32_t>(size + 2)));
+
+    for(const std::vector<std::uint8_t>& input : inputs)
+    {
+        DecoderType decoder;
+        CHECK(decoder.decode(input, 1));
+
+        const std::vector<std::uint8_t>& samples = decoder.getLittleEndianData();
+        if(!CHECK(samples.size() == 2*input.size()))
+            continue;
+
+        bool matches = true;
+        for(std::size_t i = 0; i < input.size(); ++i)
+        {
+            std::uint16_t expected = static_cast<std::uint16_t>(toLinear(input[i]));
+            matches = matches && samples[2*i] == (expected & 0xFF) &&
+                samples[2*i + 1] == (expected >> 8);
+        }
+
+        CHECK(matches);
+    }
+}
+
+int main()
+{
+    for(CpuFeatures::KernelSet kernelSet : Test::getKernelSets())
+    {
+        CHECK(CpuFeatures::setKernelSet(kernelSet));
+        testDecoder<ALawDecoder>(alaw_to_linear);
+        testDecoder<ULawDecoder>(ulaw_to_linear);
+    }
+
+    return Test::finish();
+}